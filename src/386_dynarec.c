@@ -15,6 +15,7 @@
 #include "fdc.h"
 #include "nmi.h"
 #include "pic.h"
+#include "profiler.h"
 #include "timer.h"
 
 #include "386_common.h"
@@ -311,6 +312,8 @@ static inline void exec_recompiler(void)
         codeblock_t *block = &codeblock[codeblock_hash[hash]];
         int valid_block = 0;
 
+        PROFILER_GUEST_BLOCK_ENTER(phys_addr, cs, cs + cpu_state.pc);
+
         if (!cpu_state.abrt)
         {
                 page_t *page = &pages[phys_addr >> 12];
@@ -402,6 +405,9 @@ static inline void exec_recompiler(void)
                 inrecomp=0;
 
                 cpu_recomp_blocks++;
+#ifdef PROFILER
+                block->profiler_execs++;
+#endif
         }
         else if (valid_block && !cpu_state.abrt)
         {
@@ -412,11 +418,16 @@ static inline void exec_recompiler(void)
                 x86_was_reset = 0;
 
                 cpu_new_blocks++;
+#ifdef PROFILER
+                block->profiler_execs++;
+#endif
 
 #if defined(__APPLE__) && defined(__aarch64__)
                 pthread_jit_write_protect_np(0);
 #endif
+                PROFILER_ENTER(PROFILER_CODEGEN);
                 codegen_block_start_recompile(block);
+                PROFILER_EXIT();
                 codegen_in_recompile = 1;
 
 //                if (output) pclog("Recompile block at %04x:%04x  %04x %04x %04x %04x  %04x %04x  ESP=%04x %04x  %02x%02x:%02x%02x %02x%02x:%02x%02x %02x%02x:%02x%02x\n", CS, pc, AX, BX, CX, DX, SI, DI, ESP, BP, ram[0x116330+0x6df4+0xa+3], ram[0x116330+0x6df4+0xa+2], ram[0x116330+0x6df4+0xa+1], ram[0x116330+0x6df4+0xa+0], ram[0x11d136+3],ram[0x11d136+2],ram[0x11d136+1],ram[0x11d136+0], ram[(0x119abe)+0x3],ram[(0x119abe)+0x2],ram[(0x119abe)+0x1],ram[(0x119abe)+0x0]);
@@ -440,7 +451,9 @@ static inline void exec_recompiler(void)
 
                                 cpu_state.pc++;
 
+                                PROFILER_ENTER(PROFILER_CODEGEN);
                                 codegen_generate_call(opcode, x86_opcodes[(opcode | cpu_state.op32) & 0x3ff], fetchdat, cpu_state.pc, cpu_state.pc-1);
+                                PROFILER_EXIT();
 
                                 x86_opcodes[(opcode | cpu_state.op32) & 0x3ff](fetchdat);
 
@@ -481,7 +494,11 @@ static inline void exec_recompiler(void)
                 cpu_end_block_after_ins = 0;
 
                 if ((!cpu_state.abrt || (cpu_state.abrt & ABRT_EXPECTED)) && !x86_was_reset)
+                {
+                        PROFILER_ENTER(PROFILER_CODEGEN);
                         codegen_block_end_recompile(block);
+                        PROFILER_EXIT();
+                }
 
                 if (x86_was_reset)
                         codegen_reset();
@@ -500,7 +517,9 @@ static inline void exec_recompiler(void)
                 cpu_block_end = 0;
                 x86_was_reset = 0;
 
+                PROFILER_ENTER(PROFILER_CODEGEN);
                 codegen_block_init(phys_addr);
+                PROFILER_EXIT();
 
 //                if (output) pclog("Recompile block at %04x:%04x  %04x %04x %04x %04x  %04x %04x  ESP=%04x %04x  %02x%02x:%02x%02x %02x%02x:%02x%02x %02x%02x:%02x%02x\n", CS, pc, AX, BX, CX, DX, SI, DI, ESP, BP, ram[0x116330+0x6df4+0xa+3], ram[0x116330+0x6df4+0xa+2], ram[0x116330+0x6df4+0xa+1], ram[0x116330+0x6df4+0xa+0], ram[0x11d136+3],ram[0x11d136+2],ram[0x11d136+1],ram[0x11d136+0], ram[(0x119abe)+0x3],ram[(0x119abe)+0x2],ram[(0x119abe)+0x1],ram[(0x119abe)+0x0]);
                 while (!cpu_block_end)
@@ -564,7 +583,11 @@ static inline void exec_recompiler(void)
 
 //                if (!cpu_state.abrt && !x86_was_reset)
                 if ((!cpu_state.abrt || (cpu_state.abrt & ABRT_EXPECTED)) && !x86_was_reset)
+                {
+                        PROFILER_ENTER(PROFILER_CODEGEN);
                         codegen_block_end();
+                        PROFILER_EXIT();
+                }
 
                 if (x86_was_reset)
                         codegen_reset();
@@ -572,6 +595,7 @@ static inline void exec_recompiler(void)
         else
                 cpu_state.oldpc = cpu_state.pc;
 
+        PROFILER_GUEST_BLOCK_EXIT();
 }
 
 
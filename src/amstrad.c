@@ -10,10 +10,29 @@
 
 #include "amstrad.h"
 
+enum
+{
+        AMSTRAD_NOLATCH,
+        AMSTRAD_SW9,
+        AMSTRAD_SW10
+};
+
 static uint8_t amstrad_dead;
-int amstrad_latch = 0;
+static int amstrad_latch = 0;
 static uint8_t amstrad_language;
 
+/*The PC1640 reports DIP switch 9 or 10 depending on the address of the last
+  port read*/
+static void amstrad_inb_watch(uint16_t port)
+{
+        if (port & 0x80)
+                amstrad_latch = AMSTRAD_NOLATCH;
+        else if (port & 0x4000)
+                amstrad_latch = AMSTRAD_SW10;
+        else
+                amstrad_latch = AMSTRAD_SW9;
+}
+
 uint8_t amstrad_read(uint16_t port, void *priv)
 {
         uint8_t temp;
@@ -171,6 +190,8 @@ void amstrad_init()
         io_sethandler(0xdead, 0x0001, amstrad_read,       NULL, NULL, amstrad_write,       NULL, NULL,  NULL);
         if ((romset == ROM_PC200 || romset == ROM_PPC512) && gfxcard != GFX_BUILTIN)        
                 io_sethandler(0x03de, 0x0001, amstrad_read,       NULL, NULL, amstrad_write,       NULL, NULL,  NULL);
+        if (romset == ROM_PC1640)
+                io_set_inb_watch(amstrad_inb_watch);
 
 	
 }
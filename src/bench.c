@@ -0,0 +1,1051 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ibm.h"
+#include "bench.h"
+#include "codegen.h"
+#include "codegen_allocator.h"
+#include "cpu.h"
+#include "dosbox/nukedopl.h"
+#include "io.h"
+#include "mem.h"
+#include "model.h"
+#include "profiler.h"
+#include "sound.h"
+#include "sound_emu8k.h"
+#include "thread.h"
+#include "video.h"
+#include "vid_voodoo_regs.h"
+#include "x86.h"
+
+/*Benchmark messages go to the console, not the log*/
+#undef printf
+
+/*Payloads are loaded at BENCH_LOAD_ADDR and entered in real mode with
+  CS:IP = BENCH_LOAD_ADDR >> 4:0000. They all start with the same prologue,
+  which switches to flat 32-bit protected mode with interrupts disabled, and
+  then loop forever, incrementing the dword at BENCH_COUNTER_ADDR once per
+  iteration. Scratch memory is at 0x20000, the stack below 0x9000.
+
+  The payloads were assembled with GNU as, from the sources in the comments.
+  Common prologue :
+
+          .code16
+  start:
+          cli
+          lgdtl   %cs:gdtr - start
+          movl    %cr0, %eax
+          orb     $1, %al
+          movl    %eax, %cr0
+          ljmpl   $0x08, $pm
+          .code32
+  pm:
+          movw    $0x10, %ax
+          movw    %ax, %ds
+          movw    %ax, %es
+          movw    %ax, %ss
+          movw    %ax, %fs
+          movw    %ax, %gs
+          movl    $0x9000, %esp
+          jmp     body
+          .p2align 3
+  gdt:
+          .quad   0
+          .quad   0x00cf9a000000ffff
+          .quad   0x00cf92000000ffff
+  gdtr:
+          .word   23
+          .long   gdt*/
+
+#define BENCH_LOAD_ADDR    0x10000
+#define BENCH_COUNTER_ADDR 0x600
+
+/*Integer ALU, multiply, shift, branch and memory traffic :
+  body:
+          movl    $1, %eax
+          xorl    %ebx, %ebx
+  1:      movl    $1000, %ecx
+  2:      imull   $1103515245, %eax, %eax
+          addl    $12345, %eax
+          movl    %eax, %edx
+          shrl    $20, %edx
+          andl    $0x3fc, %edx
+          addl    %eax, 0x20000(%edx)
+          xorl    0x20000(%edx), %ebx
+          roll    $5, %ebx
+          testl   $0x100, %eax
+          jz      3f
+          subl    %ebx, %esi
+  3:      decl    %ecx
+          jnz     2b
+          incl    0x600
+          jmp     1b*/
+static const uint8_t bench_int_code[] =
+{
+        0xfa, 0x2e, 0x66, 0x0f, 0x01, 0x16, 0x48, 0x00, 0x0f, 0x20, 0xc0, 0x0c, 0x01, 0x0f, 0x22, 0xc0,
+        0x66, 0xea, 0x18, 0x00, 0x01, 0x00, 0x08, 0x00, 0x66, 0xb8, 0x10, 0x00, 0x8e, 0xd8, 0x8e, 0xc0,
+        0x8e, 0xd0, 0x8e, 0xe0, 0x8e, 0xe8, 0xbc, 0x00, 0x90, 0x00, 0x00, 0xeb, 0x21, 0x8d, 0x76, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00, 0x00, 0x9a, 0xcf, 0x00,
+        0xff, 0xff, 0x00, 0x00, 0x00, 0x92, 0xcf, 0x00, 0x17, 0x00, 0x30, 0x00, 0x01, 0x00, 0xb8, 0x01,
+        0x00, 0x00, 0x00, 0x31, 0xdb, 0xb9, 0xe8, 0x03, 0x00, 0x00, 0x69, 0xc0, 0x6d, 0x4e, 0xc6, 0x41,
+        0x05, 0x39, 0x30, 0x00, 0x00, 0x89, 0xc2, 0xc1, 0xea, 0x14, 0x81, 0xe2, 0xfc, 0x03, 0x00, 0x00,
+        0x01, 0x82, 0x00, 0x00, 0x02, 0x00, 0x33, 0x9a, 0x00, 0x00, 0x02, 0x00, 0xc1, 0xc3, 0x05, 0xa9,
+        0x00, 0x01, 0x00, 0x00, 0x74, 0x02, 0x29, 0xde, 0x49, 0x75, 0xcf, 0xff, 0x05, 0x00, 0x06, 0x00,
+        0x00, 0xeb, 0xc2,
+};
+
+/*x87 arithmetic, square root and memory operands :
+  body:
+          fninit
+  1:      movl    $1000, %ecx
+          fld1
+          fldpi
+  2:      fld     %st(0)
+          fmul    %st(1), %st
+          fadd    %st(2), %st
+          fsqrt
+          fstpl   0x20000
+          faddl   0x20000
+          fmul    %st(1), %st
+          fdivl   0x20000
+          fstps   0x20008
+          decl    %ecx
+          jnz     2b
+          fstp    %st(0)
+          fstp    %st(0)
+          incl    0x600
+          jmp     1b*/
+static const uint8_t bench_fpu_code[] =
+{
+        0xfa, 0x2e, 0x66, 0x0f, 0x01, 0x16, 0x48, 0x00, 0x0f, 0x20, 0xc0, 0x0c, 0x01, 0x0f, 0x22, 0xc0,
+        0x66, 0xea, 0x18, 0x00, 0x01, 0x00, 0x08, 0x00, 0x66, 0xb8, 0x10, 0x00, 0x8e, 0xd8, 0x8e, 0xc0,
+        0x8e, 0xd0, 0x8e, 0xe0, 0x8e, 0xe8, 0xbc, 0x00, 0x90, 0x00, 0x00, 0xeb, 0x21, 0x8d, 0x76, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00, 0x00, 0x9a, 0xcf, 0x00,
+        0xff, 0xff, 0x00, 0x00, 0x00, 0x92, 0xcf, 0x00, 0x17, 0x00, 0x30, 0x00, 0x01, 0x00, 0xdb, 0xe3,
+        0xb9, 0xe8, 0x03, 0x00, 0x00, 0xd9, 0xe8, 0xd9, 0xeb, 0xd9, 0xc0, 0xd8, 0xc9, 0xd8, 0xc2, 0xd9,
+        0xfa, 0xdd, 0x1d, 0x00, 0x00, 0x02, 0x00, 0xdc, 0x05, 0x00, 0x00, 0x02, 0x00, 0xd8, 0xc9, 0xdc,
+        0x35, 0x00, 0x00, 0x02, 0x00, 0xd9, 0x1d, 0x08, 0x00, 0x02, 0x00, 0x49, 0x75, 0xdb, 0xdd, 0xd8,
+        0xdd, 0xd8, 0xff, 0x05, 0x00, 0x06, 0x00, 0x00, 0xeb, 0xc6,
+};
+
+/*Program mode 13h directly, then fill the screen with rep stosl :
+  body:
+          movw    $0x3c2, %dx
+          movb    $0x63, %al
+          outb    %al, %dx
+          movl    $seq, %esi
+          movw    $0x3c4, %dx
+          movl    $5, %ecx
+          xorb    %bl, %bl
+  1:      movb    %bl, %al
+          outb    %al, %dx
+          incw    %dx
+          lodsb
+          outb    %al, %dx
+          decw    %dx
+          incb    %bl
+          loop    1b
+          movw    $0x3d4, %dx
+          movw    $0x0e11, %ax
+          outw    %ax, %dx
+          movl    $crtc, %esi
+          movl    $25, %ecx
+          xorb    %bl, %bl
+  1:      movb    %bl, %al
+          outb    %al, %dx
+          incw    %dx
+          lodsb
+          outb    %al, %dx
+          decw    %dx
+          incb    %bl
+          loop    1b
+          movl    $gc, %esi
+          movw    $0x3ce, %dx
+          movl    $9, %ecx
+          xorb    %bl, %bl
+  1:      movb    %bl, %al
+          outb    %al, %dx
+          incw    %dx
+          lodsb
+          outb    %al, %dx
+          decw    %dx
+          incb    %bl
+          loop    1b
+          movw    $0x3da, %dx
+          inb     %dx, %al
+          movl    $attr, %esi
+          movw    $0x3c0, %dx
+          movl    $21, %ecx
+          xorb    %bl, %bl
+  1:      movb    %bl, %al
+          outb    %al, %dx
+          lodsb
+          outb    %al, %dx
+          incb    %bl
+          loop    1b
+          movb    $0x20, %al
+          outb    %al, %dx
+          xorl    %eax, %eax
+  1:      movl    $0xa0000, %edi
+          movl    $16000, %ecx
+          rep stosl
+          addl    $0x01010101, %eax
+          incl    0x600
+          jmp     1b
+  seq:    .byte   0x03, 0x01, 0x0f, 0x00, 0x0e
+  crtc:   .byte   0x5f, 0x4f, 0x50, 0x82, 0x54, 0x80, 0xbf, 0x1f, 0x00, 0x41, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+          .byte   0x9c, 0x0e, 0x8f, 0x28, 0x40, 0x96, 0xb9, 0xa3, 0xff
+  gc:     .byte   0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x05, 0x0f, 0xff
+  attr:   .byte   0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+          .byte   0x41, 0x00, 0x0f, 0x00, 0x00*/
+static const uint8_t bench_vga_code[] =
+{
+        0xfa, 0x2e, 0x66, 0x0f, 0x01, 0x16, 0x48, 0x00, 0x0f, 0x20, 0xc0, 0x0c, 0x01, 0x0f, 0x22, 0xc0,
+        0x66, 0xea, 0x18, 0x00, 0x01, 0x00, 0x08, 0x00, 0x66, 0xb8, 0x10, 0x00, 0x8e, 0xd8, 0x8e, 0xc0,
+        0x8e, 0xd0, 0x8e, 0xe0, 0x8e, 0xe8, 0xbc, 0x00, 0x90, 0x00, 0x00, 0xeb, 0x21, 0x8d, 0x76, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00, 0x00, 0x9a, 0xcf, 0x00,
+        0xff, 0xff, 0x00, 0x00, 0x00, 0x92, 0xcf, 0x00, 0x17, 0x00, 0x30, 0x00, 0x01, 0x00, 0x66, 0xba,
+        0xc2, 0x03, 0xb0, 0x63, 0xee, 0xbe, 0xee, 0x00, 0x01, 0x00, 0x66, 0xba, 0xc4, 0x03, 0xb9, 0x05,
+        0x00, 0x00, 0x00, 0x30, 0xdb, 0x88, 0xd8, 0xee, 0x66, 0x42, 0xac, 0xee, 0x66, 0x4a, 0xfe, 0xc3,
+        0xe2, 0xf3, 0x66, 0xba, 0xd4, 0x03, 0x66, 0xb8, 0x11, 0x0e, 0x66, 0xef, 0xbe, 0xf3, 0x00, 0x01,
+        0x00, 0xb9, 0x19, 0x00, 0x00, 0x00, 0x30, 0xdb, 0x88, 0xd8, 0xee, 0x66, 0x42, 0xac, 0xee, 0x66,
+        0x4a, 0xfe, 0xc3, 0xe2, 0xf3, 0xbe, 0x0c, 0x01, 0x01, 0x00, 0x66, 0xba, 0xce, 0x03, 0xb9, 0x09,
+        0x00, 0x00, 0x00, 0x30, 0xdb, 0x88, 0xd8, 0xee, 0x66, 0x42, 0xac, 0xee, 0x66, 0x4a, 0xfe, 0xc3,
+        0xe2, 0xf3, 0x66, 0xba, 0xda, 0x03, 0xec, 0xbe, 0x15, 0x01, 0x01, 0x00, 0x66, 0xba, 0xc0, 0x03,
+        0xb9, 0x15, 0x00, 0x00, 0x00, 0x30, 0xdb, 0x88, 0xd8, 0xee, 0xac, 0xee, 0xfe, 0xc3, 0xe2, 0xf7,
+        0xb0, 0x20, 0xee, 0x31, 0xc0, 0xbf, 0x00, 0x00, 0x0a, 0x00, 0xb9, 0x80, 0x3e, 0x00, 0x00, 0xf3,
+        0xab, 0x05, 0x01, 0x01, 0x01, 0x01, 0xff, 0x05, 0x00, 0x06, 0x00, 0x00, 0xeb, 0xe7, 0x03, 0x01,
+        0x0f, 0x00, 0x0e, 0x5f, 0x4f, 0x50, 0x82, 0x54, 0x80, 0xbf, 0x1f, 0x00, 0x41, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x9c, 0x0e, 0x8f, 0x28, 0x40, 0x96, 0xb9, 0xa3, 0xff, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x40, 0x05, 0x0f, 0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a,
+        0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x41, 0x00, 0x0f, 0x00, 0x00,
+};
+
+/*Sequential PIO reads of 256 sectors at a time from the primary master,
+  polling the status register. Wraps to LBA 0 at 32 MB or on error :
+  body:
+          movw    $0x3f6, %dx
+          movb    $0x02, %al
+          outb    %al, %dx
+          xorl    %ebx, %ebx
+  1:      call    wait_bsy
+          movw    $0x1f2, %dx
+          xorb    %al, %al
+          outb    %al, %dx
+          incw    %dx
+          movb    %bl, %al
+          outb    %al, %dx
+          incw    %dx
+          movb    %bh, %al
+          outb    %al, %dx
+          incw    %dx
+          movl    %ebx, %eax
+          shrl    $16, %eax
+          outb    %al, %dx
+          incw    %dx
+          andb    $0x0f, %ah
+          movb    %ah, %al
+          orb     $0xe0, %al
+          outb    %al, %dx
+          incw    %dx
+          movb    $0x20, %al
+          outb    %al, %dx
+          movl    $256, %esi
+  2:      call    wait_bsy
+          testb   $0x01, %al
+          jnz     4f
+          testb   $0x08, %al
+          jz      2b
+          movl    $0x20000, %edi
+          movl    $256, %ecx
+          movw    $0x1f0, %dx
+          rep insw
+          decl    %esi
+          jnz     2b
+          addl    $256, %ebx
+          andl    $0xffff, %ebx
+          incl    0x600
+          jmp     1b
+  4:      xorl    %ebx, %ebx
+          jmp     1b
+  wait_bsy:
+          movw    $0x1f7, %dx
+  3:      inb     %dx, %al
+          testb   $0x80, %al
+          jnz     3b
+          ret*/
+static const uint8_t bench_ide_code[] =
+{
+        0xfa, 0x2e, 0x66, 0x0f, 0x01, 0x16, 0x48, 0x00, 0x0f, 0x20, 0xc0, 0x0c, 0x01, 0x0f, 0x22, 0xc0,
+        0x66, 0xea, 0x18, 0x00, 0x01, 0x00, 0x08, 0x00, 0x66, 0xb8, 0x10, 0x00, 0x8e, 0xd8, 0x8e, 0xc0,
+        0x8e, 0xd0, 0x8e, 0xe0, 0x8e, 0xe8, 0xbc, 0x00, 0x90, 0x00, 0x00, 0xeb, 0x21, 0x8d, 0x76, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00, 0x00, 0x9a, 0xcf, 0x00,
+        0xff, 0xff, 0x00, 0x00, 0x00, 0x92, 0xcf, 0x00, 0x17, 0x00, 0x30, 0x00, 0x01, 0x00, 0x66, 0xba,
+        0xf6, 0x03, 0xb0, 0x02, 0xee, 0x31, 0xdb, 0xe8, 0x66, 0x00, 0x00, 0x00, 0x66, 0xba, 0xf2, 0x01,
+        0x30, 0xc0, 0xee, 0x66, 0x42, 0x88, 0xd8, 0xee, 0x66, 0x42, 0x88, 0xf8, 0xee, 0x66, 0x42, 0x89,
+        0xd8, 0xc1, 0xe8, 0x10, 0xee, 0x66, 0x42, 0x80, 0xe4, 0x0f, 0x88, 0xe0, 0x0c, 0xe0, 0xee, 0x66,
+        0x42, 0xb0, 0x20, 0xee, 0xbe, 0x00, 0x01, 0x00, 0x00, 0xe8, 0x34, 0x00, 0x00, 0x00, 0xa8, 0x01,
+        0x75, 0x2c, 0xa8, 0x08, 0x74, 0xf3, 0xbf, 0x00, 0x00, 0x02, 0x00, 0xb9, 0x00, 0x01, 0x00, 0x00,
+        0x66, 0xba, 0xf0, 0x01, 0x66, 0xf3, 0x6d, 0x4e, 0x75, 0xdf, 0x81, 0xc3, 0x00, 0x01, 0x00, 0x00,
+        0x81, 0xe3, 0xff, 0xff, 0x00, 0x00, 0xff, 0x05, 0x00, 0x06, 0x00, 0x00, 0xeb, 0x99, 0x31, 0xdb,
+        0xeb, 0x95, 0x66, 0xba, 0xf7, 0x01, 0xec, 0xa8, 0x80, 0x75, 0xfb, 0xc3,
+};
+
+/*Halt, for workloads driven from the host :
+  body:
+  1:      hlt
+          jmp     1b*/
+static const uint8_t bench_idle_code[] =
+{
+        0xfa, 0x2e, 0x66, 0x0f, 0x01, 0x16, 0x48, 0x00, 0x0f, 0x20, 0xc0, 0x0c, 0x01, 0x0f, 0x22, 0xc0,
+        0x66, 0xea, 0x18, 0x00, 0x01, 0x00, 0x08, 0x00, 0x66, 0xb8, 0x10, 0x00, 0x8e, 0xd8, 0x8e, 0xc0,
+        0x8e, 0xd0, 0x8e, 0xe0, 0x8e, 0xe8, 0xbc, 0x00, 0x90, 0x00, 0x00, 0xeb, 0x21, 0x8d, 0x76, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0x00, 0x00, 0x00, 0x9a, 0xcf, 0x00,
+        0xff, 0xff, 0x00, 0x00, 0x00, 0x92, 0xcf, 0x00, 0x17, 0x00, 0x30, 0x00, 0x01, 0x00, 0xf4, 0xeb,
+        0xfd,
+};
+/*Host driven Voodoo workload. The guest halts while a fixed stream of
+  Gouraud shaded triangles is written to the card's registers, so that they go
+  through voodoo_queue_command() and the render threads like any other
+  command stream*/
+#define BENCH_VOODOO_BASE 0xe0000000
+#define BENCH_VOODOO_TRIS_PER_FRAME 500
+
+static int bench_voodoo_dev;
+static uint32_t bench_voodoo_seed;
+
+/*Iteration count for host driven workloads*/
+static uint32_t bench_host_iterations;
+
+static void bench_pci_write(int dev, int reg, uint32_t val)
+{
+        outl(0xcf8, 0x80000000 | (dev << 11) | reg);
+        outl(0xcfc, val);
+}
+
+static uint32_t bench_pci_read(int dev, int reg)
+{
+        outl(0xcf8, 0x80000000 | (dev << 11) | reg);
+        return inl(0xcfc);
+}
+
+static void bench_voodoo_writef(int reg, float val)
+{
+        union
+        {
+                float f;
+                uint32_t i;
+        } temp;
+
+        temp.f = val;
+        mem_writel_phys(BENCH_VOODOO_BASE + reg, temp.i);
+}
+
+static float bench_voodoo_rand(float range)
+{
+        bench_voodoo_seed = bench_voodoo_seed * 1103515245 + 12345;
+        return (float)((bench_voodoo_seed >> 16) & 0x7fff) * range / 32768.0f;
+}
+
+static int bench_voodoo_init()
+{
+        for (bench_voodoo_dev = 0; bench_voodoo_dev < 32; bench_voodoo_dev++)
+        {
+                uint32_t id = bench_pci_read(bench_voodoo_dev, 0x00);
+
+                if (id == 0x0001121a || id == 0x0002121a)
+                        break;
+        }
+        if (bench_voodoo_dev == 32)
+        {
+                printf("Benchmark needs a Voodoo Graphics or Voodoo 2\n");
+                return -1;
+        }
+
+        bench_pci_write(bench_voodoo_dev, 0x10, BENCH_VOODOO_BASE);
+        bench_pci_write(bench_voodoo_dev, 0x04, 0x02); /*Memory enable*/
+        bench_pci_write(bench_voodoo_dev, 0x40, 0x01); /*initEnable - allow fbiInit writes*/
+
+        mem_writel_phys(BENCH_VOODOO_BASE + SST_fbiInit1, 10 << 4); /*640 pixel rows*/
+        mem_writel_phys(BENCH_VOODOO_BASE + SST_fbiInit2, 0);
+        mem_writel_phys(BENCH_VOODOO_BASE + SST_clipLeftRight, 640);
+        mem_writel_phys(BENCH_VOODOO_BASE + SST_clipLowYHighY, 480);
+        mem_writel_phys(BENCH_VOODOO_BASE + SST_fbzColorPath, 0); /*Iterated RGB*/
+        mem_writel_phys(BENCH_VOODOO_BASE + SST_fbzMode, FBZ_RGB_WMASK | FBZ_DRAW_FRONT | 1);
+
+        bench_voodoo_seed = 1;
+        return 0;
+}
+
+static void bench_voodoo_frame()
+{
+        int c;
+
+        for (c = 0; c < BENCH_VOODOO_TRIS_PER_FRAME; c++)
+        {
+                float x[3], y[3];
+                float cx = bench_voodoo_rand(576.0f), cy = bench_voodoo_rand(416.0f);
+                float area;
+                int i, j;
+
+                for (i = 0; i < 3; i++)
+                {
+                        x[i] = cx + bench_voodoo_rand(64.0f);
+                        y[i] = cy + bench_voodoo_rand(64.0f);
+                }
+                /*The hardware expects vertices sorted by Y*/
+                for (i = 0; i < 2; i++)
+                {
+                        for (j = 0; j < 2 - i; j++)
+                        {
+                                if (y[j] > y[j+1])
+                                {
+                                        float temp = x[j]; x[j] = x[j+1]; x[j+1] = temp;
+                                        temp = y[j]; y[j] = y[j+1]; y[j+1] = temp;
+                                }
+                        }
+                }
+                area = (x[0] - x[1]) * (y[1] - y[2]) - (x[1] - x[2]) * (y[0] - y[1]);
+
+                bench_voodoo_writef(SST_fvertexAx, x[0]);
+                bench_voodoo_writef(SST_fvertexAy, y[0]);
+                bench_voodoo_writef(SST_fvertexBx, x[1]);
+                bench_voodoo_writef(SST_fvertexBy, y[1]);
+                bench_voodoo_writef(SST_fvertexCx, x[2]);
+                bench_voodoo_writef(SST_fvertexCy, y[2]);
+                bench_voodoo_writef(SST_fstartR, bench_voodoo_rand(255.0f));
+                bench_voodoo_writef(SST_fstartG, bench_voodoo_rand(255.0f));
+                bench_voodoo_writef(SST_fstartB, bench_voodoo_rand(255.0f));
+                bench_voodoo_writef(SST_fdRdX, 1.0f);
+                bench_voodoo_writef(SST_fdGdX, -1.0f);
+                bench_voodoo_writef(SST_fdBdX, 0.5f);
+                bench_voodoo_writef(SST_fdRdY, -0.5f);
+                bench_voodoo_writef(SST_fdGdY, 1.0f);
+                bench_voodoo_writef(SST_fdBdY, -1.0f);
+                mem_writel_phys(BENCH_VOODOO_BASE + SST_ftriangleCMD, (area < 0.0f) ? 0x80000000 : 0);
+
+                bench_host_iterations++;
+        }
+}
+
+static int bench_voodoo_finish(FILE *f)
+{
+        /*Wait for the render threads to catch up, so that the host time
+          covers every triangle*/
+        while (mem_readl_phys(BENCH_VOODOO_BASE + SST_status) & (1 << 9))
+                thread_sleep(1);
+        return 0;
+}
+
+/*Host driven EMU8000 workload. Two chips get the same register writes and
+  render the same samples, one with the SSE2 voice and reverb code and one
+  with the scalar code, and the outputs are compared. The two are expected to
+  be identical; BENCH_EMU8K_TOLERANCE allows for the scalar build evaluating
+  the float interpolation and reverb with x87 precision or contracting them
+  into fused multiply-adds. Needs the AWE32 ROM, which provides the samples*/
+#define BENCH_EMU8K_ADDR 0x620
+#define BENCH_EMU8K_SAMPLES_PER_FRAME 4096
+#define BENCH_EMU8K_CHUNK 512
+#define BENCH_EMU8K_TOLERANCE 2
+
+static emu8k_t *bench_emu8k[2];
+static uint32_t bench_emu8k_seed;
+static uint64_t bench_emu8k_time[2];
+static int bench_emu8k_max_diff;
+static uint32_t bench_emu8k_frame_nr;
+
+static uint32_t bench_emu8k_rand(uint32_t range)
+{
+        bench_emu8k_seed = bench_emu8k_seed * 1103515245 + 12345;
+        return (bench_emu8k_seed >> 8) % range;
+}
+
+/*Write one register of both chips. port is the offset from the base, as in
+  the EMU8000 docs : 0x000 for Data0, 0x400 for Data1/Data2 and 0x800 for
+  Data3*/
+static void bench_emu8k_write(int port, int reg, int voice, uint16_t val)
+{
+        int c;
+
+        for (c = 0; c < 2; c++)
+        {
+                emu8k_outw(BENCH_EMU8K_ADDR + 0x802, (reg << 5) | voice, bench_emu8k[c]);
+                emu8k_outw(BENCH_EMU8K_ADDR + port, val, bench_emu8k[c]);
+        }
+}
+
+static void bench_emu8k_write32(int port, int reg, int voice, uint32_t val)
+{
+        bench_emu8k_write(port, reg, voice, val & 0xffff);
+        bench_emu8k_write(port + 2, reg, voice, val >> 16);
+}
+
+static void bench_emu8k_note_on(int voice)
+{
+        uint32_t start = 0x1000 + voice * 0x3000 + bench_emu8k_rand(0x100);
+        uint32_t loop_end = start + 0x800 + bench_emu8k_rand(0x1000);
+
+        bench_emu8k_write(0x400, 5, voice, 0x0080); /*DCYSUSV - envelope engine off*/
+        bench_emu8k_write32(0x000, 3, voice, 0x0000ffff); /*VTFT*/
+        bench_emu8k_write32(0x000, 2, voice, 0x0000ffff); /*CVCF*/
+        bench_emu8k_write(0x400, 4, voice, 0x8000); /*ENVVOL*/
+        bench_emu8k_write(0x400, 6, voice, 0x8000); /*ENVVAL*/
+        bench_emu8k_write(0x400, 7, voice, (bench_emu8k_rand(0x80) << 8) | bench_emu8k_rand(0x80)); /*DCYSUS*/
+        bench_emu8k_write(0x402, 4, voice, 0x7f00 | (0x20 + bench_emu8k_rand(0x60))); /*ATKHLDV*/
+        bench_emu8k_write(0x402, 5, voice, 0x8000); /*LFO1VAL*/
+        bench_emu8k_write(0x402, 6, voice, 0x7f00 | (0x20 + bench_emu8k_rand(0x60))); /*ATKHLD*/
+        bench_emu8k_write(0x402, 7, voice, 0x8000); /*LFO2VAL*/
+        bench_emu8k_write32(0x000, 1, voice, 0x40000000 | (bench_emu8k_rand(0x100) << 8)); /*PTRX - reverb send*/
+        bench_emu8k_write32(0x000, 0, voice, 0x40000000); /*CPF*/
+        bench_emu8k_write(0x800, 0, voice, 0xc000 + bench_emu8k_rand(0x3000)); /*IP*/
+        bench_emu8k_write(0x800, 1, voice, (bench_emu8k_rand(0x100) << 8) | bench_emu8k_rand(0x40)); /*IFATN - cutoff, attenuation*/
+        bench_emu8k_write(0x800, 2, voice, bench_emu8k_rand(0x10000)); /*PEFE*/
+        bench_emu8k_write(0x800, 3, voice, bench_emu8k_rand(0x10000)); /*FMMOD*/
+        bench_emu8k_write(0x800, 4, voice, bench_emu8k_rand(0x10000)); /*TREMFRQ*/
+        bench_emu8k_write(0x800, 5, voice, bench_emu8k_rand(0x10000)); /*FM2FRQ2*/
+        bench_emu8k_write32(0x000, 6, voice, (bench_emu8k_rand(0x100) << 24) | (start + 0x100)); /*PSST - pan, loop start*/
+        bench_emu8k_write32(0x000, 7, voice, (bench_emu8k_rand(0x100) << 24) | loop_end); /*CSL - chorus send, loop end*/
+        bench_emu8k_write32(0x400, 0, voice, (bench_emu8k_rand(0x10) << 28) | start); /*CCCA - filter Q, start*/
+        bench_emu8k_write(0x400, 5, voice, (bench_emu8k_rand(0x80) << 8) | bench_emu8k_rand(0x80)); /*DCYSUSV - sustain, decay, engine on*/
+}
+
+static int bench_emu8k_init()
+{
+        FILE *f = romfopen("awe32.raw", "rb");
+        int c;
+
+        if (!f)
+        {
+                printf("Benchmark needs the AWE32 ROM (awe32.raw)\n");
+                return -1;
+        }
+        fclose(f);
+
+        for (c = 0; c < 2; c++)
+        {
+                bench_emu8k[c] = malloc(sizeof(emu8k_t));
+                memset(bench_emu8k[c], 0, sizeof(emu8k_t));
+                emu8k_init(bench_emu8k[c], BENCH_EMU8K_ADDR, 0);
+                /*Keep register writes from rendering, see bench_emu8k_frame()*/
+                bench_emu8k[c]->pos = MAXSOUNDBUFLEN;
+        }
+        bench_emu8k[1]->scalar_render = 1;
+
+        /*Effects set up. Writing INIT1 voice 0 ends the initialisation
+          sequence, so that the following writes take effect*/
+        bench_emu8k_write(0x400, 2, 0, 0x0000);
+        bench_emu8k_write(0x400, 2, 3, 0x00c0); /*Reverb output level*/
+        bench_emu8k_write(0x400, 2, 5, 0x0080); /*Allpass feedback*/
+        bench_emu8k_write(0x400, 2, 7, 0x8474); /*Separate left and right tails*/
+        for (c = 0; c < 3; c++)
+        {
+                bench_emu8k_write(0x400, 2, 0x0f + c * 8, 0x00a0); /*Reflection gain*/
+                bench_emu8k_write(0x400, 2, 0x09 + c * 8, 0x0008); /*Reflection feedback*/
+                bench_emu8k_write(0x402, 2, 0x07 + c * 8, 0x00a0);
+                bench_emu8k_write(0x402, 2, 0x01 + c * 8, 0x0008);
+        }
+        bench_emu8k_write(0x402, 2, 0x1d, 0x0060); /*Reflection damping*/
+        bench_emu8k_write(0x402, 2, 0x14, 0x0300); /*Tail length*/
+        bench_emu8k_write(0x402, 2, 0x16, 0x0500);
+        bench_emu8k_write(0x400, 3, 1, 0x0080); /*Reflection input level*/
+        bench_emu8k_write(0x400, 3, 9, 0x0040); /*Chorus feedback*/
+        bench_emu8k_write(0x400, 3, 12, 0x0200); /*Chorus delay*/
+        bench_emu8k_write(0x402, 3, 3, 0x0040); /*Chorus depth*/
+        bench_emu8k_write(0x402, 3, 0x1f, 0x0080); /*Tail level*/
+        bench_emu8k_write(0x400, 1, 10, 0x00bc); /*HWCF5 - chorus LFO speed*/
+        bench_emu8k_write(0x402, 1, 10, 0x0000);
+        bench_emu8k_write(0x400, 1, 31, 0x0004); /*HWCF3 - audio enable*/
+
+        bench_emu8k_seed = 1;
+        for (c = 0; c < 32; c++)
+                bench_emu8k_note_on(c);
+
+        bench_emu8k_time[0] = bench_emu8k_time[1] = 0;
+        bench_emu8k_max_diff = 0;
+        bench_emu8k_frame_nr = 0;
+        return 0;
+}
+
+static void bench_emu8k_frame()
+{
+        int pos, c;
+
+        /*Release one note and start another each frame, so that the
+          envelopes go through all their phases*/
+        bench_emu8k_write(0x400, 5, bench_emu8k_frame_nr & 31, 0x8000 | bench_emu8k_rand(0x80)); /*DCYSUSV - release*/
+        bench_emu8k_note_on((bench_emu8k_frame_nr + 16) & 31);
+        bench_emu8k_frame_nr++;
+
+        for (c = 0; c < 2; c++)
+        {
+                uint64_t start_time = timer_read();
+
+                /*Render in chunks, as the sound thread does*/
+                bench_emu8k[c]->pos = 0;
+                for (pos = BENCH_EMU8K_CHUNK; pos <= BENCH_EMU8K_SAMPLES_PER_FRAME; pos += BENCH_EMU8K_CHUNK)
+                        emu8k_render(bench_emu8k[c], pos);
+                bench_emu8k_time[c] += timer_read() - start_time;
+                /*Park the position at the end of the buffer again, so that the
+                  register writes in the next frame don't render anything*/
+                bench_emu8k[c]->pos = MAXSOUNDBUFLEN;
+        }
+
+        for (pos = 0; pos < BENCH_EMU8K_SAMPLES_PER_FRAME * 2; pos++)
+        {
+                int diff = abs(bench_emu8k[0]->buffer[pos] - bench_emu8k[1]->buffer[pos]);
+
+                if (diff > bench_emu8k_max_diff)
+                        bench_emu8k_max_diff = diff;
+        }
+
+        bench_host_iterations += BENCH_EMU8K_SAMPLES_PER_FRAME;
+}
+
+static int bench_emu8k_finish(FILE *f)
+{
+        double simd_time = (double)bench_emu8k_time[0] / timer_freq;
+        double scalar_time = (double)bench_emu8k_time[1] / timer_freq;
+
+        fprintf(f, ",\n  \"emu8k_samples_per_s\": %.0f", simd_time ? bench_host_iterations / simd_time : 0.0);
+        fprintf(f, ",\n  \"emu8k_scalar_samples_per_s\": %.0f", scalar_time ? bench_host_iterations / scalar_time : 0.0);
+        fprintf(f, ",\n  \"emu8k_max_diff\": %i", bench_emu8k_max_diff);
+        fprintf(f, ",\n  \"emu8k_tolerance\": %i", BENCH_EMU8K_TOLERANCE);
+
+        if (bench_emu8k_max_diff > BENCH_EMU8K_TOLERANCE)
+        {
+                printf("EMU8000 SSE2 and scalar output differ by %i, tolerance is %i\n", bench_emu8k_max_diff, BENCH_EMU8K_TOLERANCE);
+                return -1;
+        }
+        return 0;
+}
+
+/*Host driven NukedOPL3 workload. Two chips get the same random register
+  stream, covering OPL2 and OPL3 mode, all waveforms, 4-op channels and
+  rhythm mode. One renders with the SSE2 core and one with the scalar core,
+  and their output must be identical. The chips run at their native rate, so
+  every output sample is one generated sample*/
+#define BENCH_OPL3_RATE 49716
+#define BENCH_OPL3_SAMPLES_PER_FRAME 4096
+#define BENCH_OPL3_CHUNK 256
+
+static opl3_chip *bench_opl3[2];
+static uint32_t bench_opl3_seed;
+static uint64_t bench_opl3_time[2];
+static int bench_opl3_mismatches;
+static int16_t bench_opl3_buffer[2][BENCH_OPL3_CHUNK * 2];
+
+static uint32_t bench_opl3_rand(uint32_t range)
+{
+        bench_opl3_seed = bench_opl3_seed * 1103515245 + 12345;
+        return (bench_opl3_seed >> 8) % range;
+}
+
+static void bench_opl3_write(uint16_t reg, uint8_t val)
+{
+        OPL3_WriteReg(bench_opl3[0], reg, val);
+        OPL3_WriteReg(bench_opl3[1], reg, val);
+}
+
+/*One random register write. Operator and channel registers are picked more
+  often than the chip wide ones, and OPL3 mode is only rarely turned off*/
+static void bench_opl3_random_write()
+{
+        static const uint8_t op_regs[5] = {0x20, 0x40, 0x60, 0x80, 0xe0};
+        uint16_t bank = bench_opl3_rand(2) ? 0x100 : 0;
+        uint32_t kind = bench_opl3_rand(32);
+
+        if (kind < 16)
+                bench_opl3_write(bank | op_regs[kind % 5] | bench_opl3_rand(0x16), bench_opl3_rand(0x100));
+        else if (kind < 20)
+                bench_opl3_write(bank | 0xa0 | bench_opl3_rand(9), bench_opl3_rand(0x100));
+        else if (kind < 26)
+                bench_opl3_write(bank | 0xb0 | bench_opl3_rand(9), bench_opl3_rand(0x40)); /*Key on/off, block, f_num high*/
+        else if (kind < 29)
+                bench_opl3_write(bank | 0xc0 | bench_opl3_rand(9), bench_opl3_rand(0x100));
+        else if (kind < 30)
+                bench_opl3_write(0xbd, bench_opl3_rand(0x100)); /*Rhythm, tremolo and vibrato depth*/
+        else if (kind < 31)
+                bench_opl3_write(0x104, bench_opl3_rand(0x40)); /*4-op channels*/
+        else
+                bench_opl3_write(0x105, bench_opl3_rand(8) ? 1 : 0); /*OPL3 mode*/
+}
+
+static int bench_opl3_init()
+{
+        int c;
+
+        for (c = 0; c < 2; c++)
+        {
+                bench_opl3[c] = malloc(sizeof(opl3_chip));
+                OPL3_Reset(bench_opl3[c], BENCH_OPL3_RATE);
+        }
+        bench_opl3[1]->scalar = 1;
+
+        bench_opl3_seed = 1;
+        bench_opl3_write(0x105, 1);
+        for (c = 0; c < 0x200; c++)
+                bench_opl3_random_write();
+
+        bench_opl3_time[0] = bench_opl3_time[1] = 0;
+        bench_opl3_mismatches = 0;
+        return 0;
+}
+
+static void bench_opl3_frame()
+{
+        int pos, c, d;
+
+        for (pos = 0; pos < BENCH_OPL3_SAMPLES_PER_FRAME; pos += BENCH_OPL3_CHUNK)
+        {
+                /*Register writes come in short bursts between blocks of
+                  output, as they do from a music driver*/
+                for (c = bench_opl3_rand(8); c >= 0; c--)
+                        bench_opl3_random_write();
+
+                for (c = 0; c < 2; c++)
+                {
+                        uint64_t start_time = timer_read();
+
+                        OPL3_GenerateStream(bench_opl3[c], bench_opl3_buffer[c], BENCH_OPL3_CHUNK);
+                        bench_opl3_time[c] += timer_read() - start_time;
+                }
+
+                for (d = 0; d < BENCH_OPL3_CHUNK * 2; d++)
+                {
+                        if (bench_opl3_buffer[0][d] != bench_opl3_buffer[1][d])
+                                bench_opl3_mismatches++;
+                }
+        }
+
+        bench_host_iterations += BENCH_OPL3_SAMPLES_PER_FRAME;
+}
+
+static int bench_opl3_finish(FILE *f)
+{
+        double simd_time = (double)bench_opl3_time[0] / timer_freq;
+        double scalar_time = (double)bench_opl3_time[1] / timer_freq;
+
+        fprintf(f, ",\n  \"opl3_samples_per_s\": %.0f", simd_time ? bench_host_iterations / simd_time : 0.0);
+        fprintf(f, ",\n  \"opl3_scalar_samples_per_s\": %.0f", scalar_time ? bench_host_iterations / scalar_time : 0.0);
+        fprintf(f, ",\n  \"opl3_mismatched_samples\": %i", bench_opl3_mismatches);
+
+        if (bench_opl3_mismatches)
+        {
+                printf("NukedOPL3 SSE2 and scalar output differ in %i samples\n", bench_opl3_mismatches);
+                return -1;
+        }
+        return 0;
+}
+
+/*Host driven memory mapping workload. Paging maps a window of virtual pages
+  onto random physical pages in conventional memory and in the C0000-EFFFF
+  upper memory area, and read and write lookups are made through it. Between
+  these the shadow RAM state of part of the upper memory area changes, or a
+  mapping that maps its writes straight to host memory moves or is disabled.
+  After every change the incrementally updated slots and lookups are checked
+  against a full recalculation*/
+#define BENCH_MEM_PD_ADDR 0x90000
+#define BENCH_MEM_PT_ADDR 0x91000
+#define BENCH_MEM_VIRT    0x40000000
+#define BENCH_MEM_PAGES   64
+#define BENCH_MEM_CHANGES_PER_FRAME 32
+
+static mem_mapping_t bench_mem_mapping;
+static uint8_t bench_mem_buffer[0x10000];
+static uint32_t bench_mem_seed;
+static uint64_t bench_mem_time;
+static int bench_mem_errors;
+
+static uint32_t bench_mem_rand(uint32_t range)
+{
+        bench_mem_seed = bench_mem_seed * 1103515245 + 12345;
+        return (bench_mem_seed >> 8) % range;
+}
+
+static uint8_t bench_mem_read(uint32_t addr, void *p)
+{
+        return bench_mem_buffer[addr & 0xffff];
+}
+
+static void bench_mem_write(uint32_t addr, uint8_t val, void *p)
+{
+        bench_mem_buffer[addr & 0xffff] = val;
+        addwritelookup_mem(mem_logical_addr, &bench_mem_buffer[addr & 0xf000], addr);
+}
+
+/*Physical pages 20000-8ffff and c0000-effff, clear of the payload, its stack
+  and the page tables*/
+static uint32_t bench_mem_random_page()
+{
+        uint32_t page = bench_mem_rand(0x70 + 0x30);
+
+        if (page < 0x70)
+                return 0x20000 + (page << 12);
+        return 0xc0000 + ((page - 0x70) << 12);
+}
+
+static void bench_mem_change()
+{
+        static const int states[4] =
+        {
+                MEM_READ_INTERNAL | MEM_WRITE_INTERNAL,
+                MEM_READ_EXTERNAL | MEM_WRITE_EXTERNAL,
+                MEM_READ_INTERNAL | MEM_WRITE_EXTERNAL,
+                MEM_READ_EXTERNAL | MEM_WRITE_INTERNAL
+        };
+        uint32_t kind = bench_mem_rand(8);
+
+        if (kind < 4)
+        {
+                uint32_t nr_slots = 1 + bench_mem_rand(2);
+
+                mem_set_mem_state(0xc0000 + bench_mem_rand(13 - nr_slots) * 0x4000, nr_slots * 0x4000, states[bench_mem_rand(4)]);
+        }
+        else if (kind < 7)
+        {
+                uint32_t base = 0xc0000 + bench_mem_rand(0x30) * 0x1000;
+                uint32_t size = (1 + bench_mem_rand(0x10)) * 0x1000;
+
+                if (base + size > 0xf0000)
+                        size = 0xf0000 - base;
+                mem_mapping_set_addr(&bench_mem_mapping, base, size);
+        }
+        else
+                mem_mapping_disable(&bench_mem_mapping);
+}
+
+static int bench_mem_init()
+{
+        mem_mapping_add(&bench_mem_mapping, 0xc0000, 0x4000, bench_mem_read, NULL, NULL, bench_mem_write, NULL, NULL, NULL, MEM_MAPPING_EXTERNAL, NULL);
+
+        bench_mem_seed = 1;
+        bench_mem_time = 0;
+        bench_mem_errors = 0;
+        return 0;
+}
+
+static void bench_mem_frame()
+{
+        uint32_t old_cr0 = cr0, old_cr3 = cr3;
+        int c, d;
+
+        /*Page tables change only here, followed by a TLB flush*/
+        memset(&ram[BENCH_MEM_PD_ADDR], 0, 0x1000);
+        *(uint32_t *)&ram[BENCH_MEM_PD_ADDR + (BENCH_MEM_VIRT >> 20)] = BENCH_MEM_PT_ADDR | 7;
+        for (c = 0; c < BENCH_MEM_PAGES; c++)
+                *(uint32_t *)&ram[BENCH_MEM_PT_ADDR + c * 4] = bench_mem_random_page() | 7;
+        cr3 = BENCH_MEM_PD_ADDR;
+        cr0 |= 0x80000000;
+        flushmmucache();
+
+        for (c = 0; c < BENCH_MEM_CHANGES_PER_FRAME; c++)
+        {
+                uint64_t start_time;
+
+                for (d = 0; d < 8; d++)
+                {
+                        uint32_t addr = BENCH_MEM_VIRT + bench_mem_rand(BENCH_MEM_PAGES) * 0x1000 + bench_mem_rand(0x1000);
+
+                        switch (bench_mem_rand(3))
+                        {
+                                case 0:
+                                get_phys(addr);
+                                break;
+                                case 1:
+                                readmembl(addr);
+                                break;
+                                case 2:
+                                writemembl(addr, bench_mem_rand(0x100));
+                                break;
+                        }
+                }
+
+                start_time = timer_read();
+                bench_mem_change();
+                bench_mem_time += timer_read() - start_time;
+
+                bench_mem_errors += mem_check_lookups();
+        }
+
+        cr0 = old_cr0;
+        cr3 = old_cr3;
+        flushmmucache();
+
+        bench_host_iterations += BENCH_MEM_CHANGES_PER_FRAME;
+}
+
+static int bench_mem_finish(FILE *f)
+{
+        double change_time = (double)bench_mem_time / timer_freq;
+
+        fprintf(f, ",\n  \"mem_changes_per_s\": %.0f", change_time ? bench_host_iterations / change_time : 0.0);
+        fprintf(f, ",\n  \"mem_check_errors\": %i", bench_mem_errors);
+
+        if (bench_mem_errors)
+        {
+                printf("Incremental memory mapping state differs from a full recalculation %i times\n", bench_mem_errors);
+                return -1;
+        }
+        return 0;
+}
+
+typedef struct bench_t
+{
+        char *name;
+        char *description;
+        char *unit; /*What one iteration is*/
+        const uint8_t *code;
+        int code_size;
+        int needs_fpu;
+        /*Optional hooks for workloads that need host side set up or input.
+          finish() can add fields to the report, and returns non-zero if the
+          benchmark's own checks failed*/
+        int (*init)();
+        void (*frame)();
+        int (*finish)(FILE *f);
+} bench_t;
+
+static const bench_t benchmarks[] =
+{
+        {"int",    "Integer loop",                  "1000 loop iterations", bench_int_code,  sizeof(bench_int_code),  0, NULL, NULL, NULL},
+        {"fpu",    "x87 loop",                      "1000 loop iterations", bench_fpu_code,  sizeof(bench_fpu_code),  1, NULL, NULL, NULL},
+        {"vga",    "VGA mode 13h fill",             "screen fills",         bench_vga_code,  sizeof(bench_vga_code),  0, NULL, NULL, NULL},
+        {"voodoo", "Voodoo triangle stream",        "triangles",            bench_idle_code, sizeof(bench_idle_code), 0, bench_voodoo_init, bench_voodoo_frame, bench_voodoo_finish},
+        {"ide",    "IDE sequential read",           "256 sector reads",     bench_ide_code,  sizeof(bench_ide_code),  0, NULL, NULL, NULL},
+        {"emu8k",  "EMU8000 voices and effects",    "output samples",       bench_idle_code, sizeof(bench_idle_code), 0, bench_emu8k_init, bench_emu8k_frame, bench_emu8k_finish},
+        {"opl3",   "NukedOPL3 register stream",     "output samples",       bench_idle_code, sizeof(bench_idle_code), 0, bench_opl3_init, bench_opl3_frame, bench_opl3_finish},
+        {"mem",    "Memory mapping changes",        "mapping changes",      bench_idle_code, sizeof(bench_idle_code), 0, bench_mem_init, bench_mem_frame, bench_mem_finish},
+        {NULL}
+};
+
+char bench_name[64];
+char bench_output[512];
+
+static const bench_t *bench;
+
+void bench_list()
+{
+        int c;
+
+        for (c = 0; benchmarks[c].name; c++)
+                printf("  %-8s - %s\n", benchmarks[c].name, benchmarks[c].description);
+}
+
+int bench_start()
+{
+        int c;
+
+        for (c = 0; benchmarks[c].name; c++)
+        {
+                if (!strcmp(benchmarks[c].name, bench_name))
+                        break;
+        }
+        if (!benchmarks[c].name)
+        {
+                printf("Unknown benchmark %s. Available benchmarks :\n", bench_name);
+                bench_list();
+                return -1;
+        }
+        bench = &benchmarks[c];
+
+        if (!is386)
+        {
+                printf("Benchmarks need a 386 or later CPU\n");
+                return -1;
+        }
+        if (bench->needs_fpu && fpu_type == FPU_NONE)
+        {
+                printf("Benchmark %s needs an FPU\n", bench->name);
+                return -1;
+        }
+        bench_host_iterations = 0;
+        if (bench->init && bench->init())
+                return -1;
+
+        /*The BIOS never runs, the CPU starts straight in the payload. Enable
+          the caches as the BIOS would, otherwise the recompiler stays off*/
+        cr0 &= ~((1 << 30) | (1 << 29));
+        memcpy(&ram[BENCH_LOAD_ADDR], bench->code, bench->code_size);
+        *(uint32_t *)&ram[BENCH_COUNTER_ADDR] = 0;
+        loadcs(BENCH_LOAD_ADDR >> 4);
+        cpu_state.pc = 0;
+        cpu_state.flags = 2;
+
+#ifdef PROFILER
+        profiler_reset();
+#endif
+        pclog("bench : running %s\n", bench->name);
+        return 0;
+}
+
+void bench_frame()
+{
+        if (bench->frame)
+                bench->frame();
+}
+
+static void bench_write_string(FILE *f, char *name, const char *s)
+{
+        fprintf(f, "  \"%s\": \"", name);
+        for (; *s; s++)
+        {
+                if (*s == '"' || *s == '\\')
+                        fputc('\\', f);
+                fputc(*s, f);
+        }
+        fprintf(f, "\",\n");
+}
+
+int bench_report(int nr_frames, uint64_t run_time, double total_ins, uint64_t recomp_blocks)
+{
+        double host_time;
+        uint32_t iterations;
+        FILE *f = stdout;
+        int ret = 0;
+
+        host_time = (double)run_time / timer_freq;
+        if (bench->frame)
+                iterations = bench_host_iterations;
+        else
+                iterations = *(uint32_t *)&ram[BENCH_COUNTER_ADDR];
+
+        if (bench_output[0])
+        {
+                f = fopen(bench_output, "wt");
+                if (!f)
+                {
+                        printf("Can't open %s\n", bench_output);
+                        return -1;
+                }
+        }
+
+        fprintf(f, "{\n");
+        bench_write_string(f, "benchmark", bench->name);
+        bench_write_string(f, "pcem_version", PCEM_VERSION_STRING);
+        bench_write_string(f, "model", model_get_internal_name());
+        bench_write_string(f, "cpu", models[model].cpu[cpu_manufacturer].cpus[cpu].name);
+        fprintf(f, "  \"dynarec\": %i,\n", cpu_use_dynarec);
+        fprintf(f, "  \"emulated_ms\": %i,\n", nr_frames * 10);
+        fprintf(f, "  \"host_s\": %.6f,\n", host_time);
+        fprintf(f, "  \"speed_percent\": %.2f,\n", nr_frames / host_time);
+        fprintf(f, "  \"mips\": %.3f,\n", total_ins / (host_time * 1000000.0));
+        fprintf(f, "  \"iterations\": %u,\n", iterations);
+        bench_write_string(f, "iteration_unit", bench->unit);
+        fprintf(f, "  \"iterations_per_host_s\": %.3f,\n", iterations / host_time);
+        fprintf(f, "  \"recompiled_blocks\": %llu,\n", (unsigned long long)recomp_blocks);
+        fprintf(f, "  \"codegen_allocator_blocks\": %i,\n", codegen_allocator_usage);
+        fprintf(f, "  \"codegen_allocator_bytes\": %i,\n", codegen_allocator_usage * MEM_BLOCK_SIZE);
+        fprintf(f, "  \"video_frames\": %i", video_frames);
+        if (bench->finish)
+                ret = bench->finish(f);
+#ifdef PROFILER
+        fprintf(f, ",\n  \"subsystem_host_s\": {\n");
+        profiler_write_json(f);
+        fprintf(f, "  }");
+#endif
+        fprintf(f, "\n}\n");
+
+        if (f != stdout)
+                fclose(f);
+        return ret;
+}
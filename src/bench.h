@@ -0,0 +1,20 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+/*Built-in benchmarks. Each benchmark replaces the BIOS with a small payload
+  (and optionally a host side command stream), runs for a fixed amount of
+  emulated time in headless mode, then reports host time and throughput as
+  JSON. The same benchmark on the same configuration always executes the same
+  guest work, so results are comparable between builds and hosts*/
+extern char bench_name[64];
+extern char bench_output[512];
+
+void bench_list();
+/*Called after a hard reset. Returns 0 on success*/
+int bench_start();
+/*Called before every frame*/
+void bench_frame();
+/*Write the JSON report to bench_output, or stdout if it is empty*/
+int bench_report(int nr_frames, uint64_t run_time, double total_ins, uint64_t recomp_blocks);
+
+#endif
@@ -57,6 +57,12 @@ typedef struct codeblock_t
         /*First mem_block_t used by this block. Any subsequent mem_block_ts
           will be in the list starting at head_mem_block->next.*/
         struct mem_block_t *head_mem_block;
+#ifdef PROFILER
+        /*Executions not yet added to the guest profiler, and the CS selector
+          the block was created with*/
+        uint64_t profiler_execs;
+        uint16_t profiler_cs;
+#endif
 } codeblock_t;
 
 extern codeblock_t *codeblock;
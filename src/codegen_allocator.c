@@ -119,6 +119,11 @@ uint8_t *codeblock_allocator_get_ptr(mem_block_t *block)
         return &mem_block_alloc[block->offset];
 }
 
+mem_block_t *codegen_allocator_get_next(mem_block_t *block)
+{
+        return block->next ? &mem_blocks[block->next - 1] : NULL;
+}
+
 void codegen_allocator_clean_blocks(struct mem_block_t *block)
 {
 #if defined __ARM_EABI__ || defined __aarch64__
@@ -56,6 +56,9 @@ uint32_t instr_counts[256*256];
 static uint16_t block_free_list;
 static void delete_block(codeblock_t *block);
 static void delete_dirty_block(codeblock_t *block);
+#ifdef PROFILER
+static void profiler_flush_block(codeblock_t *block);
+#endif
 
 /*Temporary list of code blocks that have recently been evicted. This allows for
   some historical state to be kept when a block is the target of self-modifying
@@ -279,6 +282,9 @@ void codegen_reset()
                 
                 if (block->pc != BLOCK_PC_INVALID)
                 {
+#ifdef PROFILER
+                        profiler_flush_block(block);
+#endif
                         block->phys = 0;
                         block->phys_2 = 0;
                         delete_block(block);
@@ -444,6 +450,9 @@ static void delete_block(codeblock_t *block)
 #ifndef RELEASE_BUILD
         if (block->pc == BLOCK_PC_INVALID)
                 fatal("Deleting deleted block\n");
+#endif
+#ifdef PROFILER
+        profiler_flush_block(block);
 #endif
         block->pc = BLOCK_PC_INVALID;
 
@@ -466,6 +475,9 @@ static void delete_dirty_block(codeblock_t *block)
 #ifndef RELEASE_BUILD
         if (block->pc == BLOCK_PC_INVALID)
                 fatal("Deleting deleted block\n");
+#endif
+#ifdef PROFILER
+        profiler_flush_block(block);
 #endif
         block->pc = BLOCK_PC_INVALID;
 
@@ -473,6 +485,31 @@ static void delete_dirty_block(codeblock_t *block)
         block_free_list_add(block);
 }
 
+#ifdef PROFILER
+static void profiler_flush_block(codeblock_t *block)
+{
+        if (block->profiler_execs)
+        {
+                profiler_guest_add_execs(block->phys, block->_cs, block->pc, block->profiler_cs, block->profiler_execs);
+                block->profiler_execs = 0;
+        }
+}
+
+void codegen_profiler_flush()
+{
+        int c;
+
+        if (!codeblock)
+                return;
+
+        for (c = 1; c < BLOCK_SIZE; c++)
+        {
+                if (codeblock[c].pc != BLOCK_PC_INVALID)
+                        profiler_flush_block(&codeblock[c]);
+        }
+}
+#endif
+
 void codegen_delete_block(codeblock_t *block)
 {
         if (block->pc != BLOCK_PC_INVALID)
@@ -588,6 +625,11 @@ void codegen_block_init(uint32_t phys_addr)
         block->flags = CODEBLOCK_STATIC_TOP;
 //        pclog("  block_init: %p flags = %x\n", block, block->flags);
         block->status = cpu_cur_status;
+#ifdef PROFILER
+        /*The block is being run for the first time*/
+        block->profiler_execs = 1;
+        block->profiler_cs = CS;
+#endif
         
         recomp_page = block->phys & ~0xfff;
 //        pclog("codegen_block_init: %08x\n", block->pc);
@@ -855,6 +897,16 @@ void codegen_block_end_recompile(codeblock_t *block)
 
         codegen_accumulate_flush(ir_data);
         codegen_ir_compile(ir_data, block);
+
+#ifdef PROFILER
+        if (profiler_perf_map)
+        {
+                struct mem_block_t *mem_block;
+
+                for (mem_block = block->head_mem_block; mem_block; mem_block = codegen_allocator_get_next(mem_block))
+                        profiler_perf_map_add(codeblock_allocator_get_ptr(mem_block), MEM_BLOCK_SIZE, block->phys, block->profiler_cs, block->pc - block->_cs);
+        }
+#endif
 }
 
 void codegen_flush()
@@ -7,38 +7,44 @@ static mem_mapping_t compaq_ram_mapping;
 
 uint8_t compaq_read_ram(uint32_t addr, void *priv)
 {
+        uint32_t bus_addr = addr;
         addr = (addr & 0x7ffff) + 0x80000;
-        addreadlookup(mem_logical_addr, addr);
+        addreadlookup(mem_logical_addr, addr, bus_addr);
         return ram[addr];
 }
 uint16_t compaq_read_ramw(uint32_t addr, void *priv)
 {
+        uint32_t bus_addr = addr;
         addr = (addr & 0x7ffff) + 0x80000;
-        addreadlookup(mem_logical_addr, addr);
+        addreadlookup(mem_logical_addr, addr, bus_addr);
         return *(uint16_t *)&ram[addr];
 }
 uint32_t compaq_read_raml(uint32_t addr, void *priv)
 {
+        uint32_t bus_addr = addr;
         addr = (addr & 0x7ffff) + 0x80000;
-        addreadlookup(mem_logical_addr, addr);
+        addreadlookup(mem_logical_addr, addr, bus_addr);
         return *(uint32_t *)&ram[addr];
 }
 void compaq_write_ram(uint32_t addr, uint8_t val, void *priv)
 {
+        uint32_t bus_addr = addr;
         addr = (addr & 0x7ffff) + 0x80000;
-        addwritelookup(mem_logical_addr, addr);
+        addwritelookup(mem_logical_addr, addr, bus_addr);
         mem_write_ramb_page(addr, val, &pages[addr >> 12]);
 }
 void compaq_write_ramw(uint32_t addr, uint16_t val, void *priv)
 {
+        uint32_t bus_addr = addr;
         addr = (addr & 0x7ffff) + 0x80000;
-        addwritelookup(mem_logical_addr, addr);
+        addwritelookup(mem_logical_addr, addr, bus_addr);
         mem_write_ramw_page(addr, val, &pages[addr >> 12]);
 }
 void compaq_write_raml(uint32_t addr, uint32_t val, void *priv)
 {
+        uint32_t bus_addr = addr;
         addr = (addr & 0x7ffff) + 0x80000;
-        addwritelookup(mem_logical_addr, addr);
+        addwritelookup(mem_logical_addr, addr, bus_addr);
         mem_write_raml_page(addr, val, &pages[addr >> 12]);
 }
 
@@ -5,6 +5,7 @@
 #include "x86_ops.h"
 #include "mem.h"
 #include "pci.h"
+#include "savestate.h"
 #include "codegen.h"
 #include "x87_timings.h"
 
@@ -2204,3 +2205,69 @@ void cpu_set_nonturbo_divider(int divider)
                 cpu_set_turbo(0);
         }
 }
+
+void cpu_save_state(savestate_t *s)
+{
+        uint8_t ccr[7] = {ccr0, ccr1, ccr2, ccr3, ccr4, ccr5, ccr6};
+
+        savestate_begin_section(s, "cpu");
+        savestate_write(s, &cpu_state, sizeof(cpu_state));
+        savestate_write(s, &gdt, sizeof(x86seg));
+        savestate_write(s, &ldt, sizeof(x86seg));
+        savestate_write(s, &idt, sizeof(x86seg));
+        savestate_write(s, &tr, sizeof(x86seg));
+        savestate_write(s, &cr2, sizeof(cr2));
+        savestate_write(s, &cr3, sizeof(cr3));
+        savestate_write(s, &cr4, sizeof(cr4));
+        savestate_write(s, dr, sizeof(dr));
+        savestate_write(s, &sysenter_cs, sizeof(sysenter_cs));
+        savestate_write(s, &sysenter_eip, sizeof(sysenter_eip));
+        savestate_write(s, &sysenter_esp, sizeof(sysenter_esp));
+        savestate_write(s, &use32, sizeof(use32));
+        savestate_write(s, &stack32, sizeof(stack32));
+        savestate_write(s, &nmi_enable, sizeof(nmi_enable));
+        savestate_write(s, &cpu_cur_status, sizeof(cpu_cur_status));
+        savestate_write(s, &msr, sizeof(msr));
+        savestate_write(s, ccr, sizeof(ccr));
+        savestate_write(s, &cyrix_addr, sizeof(cyrix_addr));
+        savestate_end_section(s);
+}
+
+void cpu_load_state(savestate_t *s)
+{
+        uint8_t ccr[7];
+
+        if (savestate_open_section(s, "cpu"))
+                return;
+        savestate_read(s, &cpu_state, sizeof(cpu_state));
+        savestate_read(s, &gdt, sizeof(x86seg));
+        savestate_read(s, &ldt, sizeof(x86seg));
+        savestate_read(s, &idt, sizeof(x86seg));
+        savestate_read(s, &tr, sizeof(x86seg));
+        savestate_read(s, &cr2, sizeof(cr2));
+        savestate_read(s, &cr3, sizeof(cr3));
+        savestate_read(s, &cr4, sizeof(cr4));
+        savestate_read(s, dr, sizeof(dr));
+        savestate_read(s, &sysenter_cs, sizeof(sysenter_cs));
+        savestate_read(s, &sysenter_eip, sizeof(sysenter_eip));
+        savestate_read(s, &sysenter_esp, sizeof(sysenter_esp));
+        savestate_read(s, &use32, sizeof(use32));
+        savestate_read(s, &stack32, sizeof(stack32));
+        savestate_read(s, &nmi_enable, sizeof(nmi_enable));
+        savestate_read(s, &cpu_cur_status, sizeof(cpu_cur_status));
+        savestate_read(s, &msr, sizeof(msr));
+        savestate_read(s, ccr, sizeof(ccr));
+        savestate_read(s, &cyrix_addr, sizeof(cyrix_addr));
+
+        ccr0 = ccr[0];
+        ccr1 = ccr[1];
+        ccr2 = ccr[2];
+        ccr3 = ccr[3];
+        ccr4 = ccr[4];
+        ccr5 = ccr[5];
+        ccr6 = ccr[6];
+
+        /*Snapshots are taken between instructions, so the effective segment
+          is only a stale pointer into the old process*/
+        cpu_state.ea_seg = &cpu_state.seg_ds;
+}
@@ -212,4 +212,8 @@ const char *fpu_get_internal_name(int model, int manu, int cpu, int type);
 const char *fpu_get_name_from_index(int model, int manu, int cpu, int c);
 int fpu_get_type_from_index(int model, int manu, int cpu, int c);
 
+struct savestate_t;
+void cpu_save_state(struct savestate_t *s);
+void cpu_load_state(struct savestate_t *s);
+
 #endif
@@ -3,6 +3,7 @@
 #include "cpu.h"
 #include "device.h"
 #include "model.h"
+#include "savestate.h"
 #include "sound.h"
 
 static void *device_priv[256];
@@ -117,6 +118,51 @@ void device_add_status_info(char *s, int max_len)
         }
 }
 
+void device_save_all(savestate_t *s)
+{
+        int c;
+        
+        for (c = 0; c < 256; c++)
+        {
+                if (devices[c] != NULL)
+                {
+                        if (devices[c]->save != NULL)
+                        {
+                                char name[64];
+
+                                snprintf(name, sizeof(name), "device%i %s", c, devices[c]->name);
+                                savestate_begin_section(s, name);
+                                devices[c]->save(s, device_priv[c]);
+                                savestate_end_section(s);
+                        }
+                        else
+                                pclog("device_save_all : %s does not support snapshots\n", devices[c]->name);
+                }
+        }
+}
+
+void device_load_all(savestate_t *s)
+{
+        int c;
+        
+        for (c = 0; c < 256; c++)
+        {
+                if (devices[c] != NULL)
+                {
+                        if (devices[c]->load != NULL)
+                        {
+                                char name[64];
+
+                                snprintf(name, sizeof(name), "device%i %s", c, devices[c]->name);
+                                if (!savestate_open_section(s, name))
+                                        devices[c]->load(s, device_priv[c]);
+                        }
+                        else
+                                pclog("device_load_all : %s does not support snapshots, state not restored\n", devices[c]->name);
+                }
+        }
+}
+
 int device_get_config_int(char *s)
 {
         device_config_t *config = current_device->config;
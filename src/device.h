@@ -7,6 +7,8 @@
 #define CONFIG_SELECTION 3
 #define CONFIG_MIDI 4
 
+struct savestate_t;
+
 typedef struct device_config_selection_t
 {
         char description[256];
@@ -34,6 +36,10 @@ typedef struct device_t
         void (*force_redraw)(void *p);
         void (*add_status_info)(char *s, int max_len, void *p);
         device_config_t *config;
+        /*Optional. Store and restore the device state in a snapshot. load is
+          called on a device freshly initialised with the same configuration*/
+        void (*save)(struct savestate_t *s, void *p);
+        void (*load)(struct savestate_t *s, void *p);
 } device_t;
 
 void device_init();
@@ -43,6 +49,8 @@ int device_available(device_t *d);
 void device_speed_changed();
 void device_force_redraw();
 void device_add_status_info(char *s, int max_len);
+void device_save_all(struct savestate_t *s);
+void device_load_all(struct savestate_t *s);
 
 extern char *current_device_name;
 
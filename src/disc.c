@@ -6,6 +6,7 @@
 #include "disc_img.h"
 #include "fdc.h"
 #include "fdd.h"
+#include "savestate.h"
 #include "timer.h"
 
 int disc_drivesel = 0;
@@ -207,6 +208,7 @@ void disc_reset()
         curdrive = 0;
         disc_period = 32;
 	timer_add(&disc_poll_timer, disc_poll, NULL, 0);
+        img_reset();
 
         for (drive = 0; drive < 2; drive++)
         {
@@ -228,6 +230,30 @@ void disc_init()
         disc_reset();
 }
 
+void disc_save_state(savestate_t *s)
+{
+        savestate_write(s, &disc_drivesel, sizeof(disc_drivesel));
+        savestate_write(s, &curdrive, sizeof(curdrive));
+        savestate_write(s, disc_changed, sizeof(disc_changed));
+        savestate_write(s, &motorspin, sizeof(motorspin));
+        savestate_write(s, &motoron, sizeof(motoron));
+        savestate_write(s, &disc_notfound, sizeof(disc_notfound));
+        savestate_write(s, &disc_period, sizeof(disc_period));
+        savestate_write_timer(s, &disc_poll_timer);
+}
+
+void disc_load_state(savestate_t *s)
+{
+        savestate_read(s, &disc_drivesel, sizeof(disc_drivesel));
+        savestate_read(s, &curdrive, sizeof(curdrive));
+        savestate_read(s, disc_changed, sizeof(disc_changed));
+        savestate_read(s, &motorspin, sizeof(motorspin));
+        savestate_read(s, &motoron, sizeof(motoron));
+        savestate_read(s, &disc_notfound, sizeof(disc_notfound));
+        savestate_read(s, &disc_period, sizeof(disc_period));
+        savestate_read_timer(s, &disc_poll_timer);
+}
+
 int oldtrack[2] = {0, 0};
 void disc_seek(int drive, int track)
 {
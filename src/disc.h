@@ -18,6 +18,9 @@ void disc_load(int drive, char *fn);
 void disc_new(int drive, char *fn);
 void disc_close(int drive);
 void disc_init();
+struct savestate_t;
+void disc_save_state(struct savestate_t *s);
+void disc_load_state(struct savestate_t *s);
 void disc_reset();
 void disc_poll();
 void disc_seek(int drive, int track);
@@ -1,11 +1,19 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include "ibm.h"
 #include "disc.h"
 #include "disc_fdi.h"
 #include "fdc.h"
 #include "fdi2raw.h"
 
+/*Decoded track, kept so that fdi2raw only has to decode each track once*/
+typedef struct fdi_track_t
+{
+        uint8_t *data;
+        int len, index;
+} fdi_track_t;
+
 static struct
 {
         FILE *f;
@@ -17,6 +25,8 @@ static struct
         int trackindex[2][4];
         
         int lasttrack;
+        
+        fdi_track_t *track_cache;
 } fdi[2];
 
 static uint8_t fdi_timing[256*1024];
@@ -85,6 +95,8 @@ void fdi_load(int drive, char *fn)
 //        if (!fdih[drive]) printf("Failed to load!\n");
         fdi[drive].lasttrack = fdi2raw_get_last_track(fdi[drive].h);
         fdi[drive].sides = fdi2raw_get_last_head(fdi[drive].h) + 1;
+        fdi[drive].track_cache = malloc((fdi[drive].lasttrack + 1) * 2 * 4 * sizeof(fdi_track_t));
+        memset(fdi[drive].track_cache, 0, (fdi[drive].lasttrack + 1) * 2 * 4 * sizeof(fdi_track_t));
 //        printf("Last track %i\n",fdilasttrack[drive]);
         drives[drive].seek        = fdi_seek;
         drives[drive].readsector  = fdi_readsector;
@@ -99,6 +111,18 @@ void fdi_load(int drive, char *fn)
 
 void fdi_close(int drive)
 {
+        if (fdi[drive].track_cache)
+        {
+                int c;
+                
+                for (c = 0; c < (fdi[drive].lasttrack + 1) * 2 * 4; c++)
+                {
+                        if (fdi[drive].track_cache[c].data)
+                                free(fdi[drive].track_cache[c].data);
+                }
+                free(fdi[drive].track_cache);
+                fdi[drive].track_cache = NULL;
+        }
         if (fdi[drive].h)
                 fdi2raw_header_free(fdi[drive].h);
         if (fdi[drive].f)
@@ -106,6 +130,41 @@ void fdi_close(int drive)
         fdi[drive].f = NULL;
 }
 
+static int fdi_load_track(int drive, int track, int side, int density)
+{
+        fdi_track_t *cached = &fdi[drive].track_cache[((track * 2) + side) * 4 + density];
+        int multirev = 0;
+        int c;
+        
+        if (cached->data)
+        {
+                memcpy(fdi[drive].track_data[side][density], cached->data, ((cached->len + 15) / 16) * 2);
+                fdi[drive].tracklen[side][density] = cached->len;
+                fdi[drive].trackindex[side][density] = cached->index;
+                return 1;
+        }
+
+        c = fdi2raw_loadtrack(fdi[drive].h, (uint16_t *)fdi[drive].track_data[side][density],
+                      (uint16_t *)fdi_timing,
+                      (track * fdi[drive].sides) + side,
+                      &fdi[drive].tracklen[side][density],
+                      &fdi[drive].trackindex[side][density], &multirev, density);
+
+        /*Tracks with weak bits decode differently on each revolution, so must
+          not be cached*/
+        if (c > 0 && !multirev)
+        {
+                int size = ((fdi[drive].tracklen[side][density] + 15) / 16) * 2;
+                
+                cached->data = malloc(size);
+                memcpy(cached->data, fdi[drive].track_data[side][density], size);
+                cached->len = fdi[drive].tracklen[side][density];
+                cached->index = fdi[drive].trackindex[side][density];
+        }
+        
+        return c;
+}
+
 void fdi_seek(int drive, int track)
 {
         int density;
@@ -120,21 +179,13 @@ void fdi_seek(int drive, int track)
                 
         for (density = 0; density < 4; density++)
         {
-                int c = fdi2raw_loadtrack(fdi[drive].h, (uint16_t *)fdi[drive].track_data[0][density],
-                              (uint16_t *)fdi_timing,
-                              track * fdi[drive].sides,
-                              &fdi[drive].tracklen[0][density],
-                              &fdi[drive].trackindex[0][density], NULL, density);
+                int c = fdi_load_track(drive, track, 0, density);
                 if (!c)
                         memset(fdi[drive].track_data[0][density], 0, fdi[drive].tracklen[0][density]);
 
                 if (fdi[drive].sides == 2)
                 {
-                        c = fdi2raw_loadtrack(fdi[drive].h, (uint16_t *)fdi[drive].track_data[1][density],
-                                      (uint16_t *)fdi_timing,
-                                      (track * fdi[drive].sides) + 1,
-                                      &fdi[drive].tracklen[1][density],
-                                      &fdi[drive].trackindex[1][density], NULL, density);
+                        c = fdi_load_track(drive, track, 1, density);
                         if (!c)
                                 memset(fdi[drive].track_data[1][density], 0, fdi[drive].tracklen[1][density]);
                 }
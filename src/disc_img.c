@@ -1,13 +1,24 @@
+#include <stdlib.h>
 #include "ibm.h"
 #include "fdd.h"
 #include "disc.h"
 #include "disc_img.h"
 #include "disc_sector.h"
+#include "timer.h"
+
+/*The whole image is held in memory, so seeking only has to rebuild the sector
+  list. Sector writes mark the track dirty; dirty tracks are written back to the
+  image file after a short delay, or when the disc is closed*/
+#define IMG_MAX_TRACKS 86
+#define IMG_FLUSH_DELAY (500 * 1000 * TIMER_USEC)
 
 static struct
 {
         FILE *f;
-        uint8_t track_data[2][20*1024];
+        uint8_t *disc_data;
+        uint8_t *track_data[2];
+        int track_size;
+        uint8_t dirty[IMG_MAX_TRACKS];
         int sectors, tracks, sides;
         int sector_size;
         int rate;
@@ -22,6 +33,8 @@ static uint8_t xdf_map[5][24][3];
 
 int bpb_disable;
 
+static pc_timer_t img_flush_timer;
+
 void img_writeback(int drive, int track);
 
 static int img_sector_size_code(int drive)
@@ -54,6 +67,36 @@ void img_init()
 //        adl[0] = adl[1] = 0;
 }
 
+static void img_flush(int drive)
+{
+        int track;
+        
+        if (!img[drive].f || !img[drive].disc_data)
+                return;
+                
+        for (track = 0; track < IMG_MAX_TRACKS; track++)
+        {
+                if (img[drive].dirty[track])
+                {
+                        fseek(img[drive].f, track * img[drive].track_size, SEEK_SET);
+                        fwrite(&img[drive].disc_data[track * img[drive].track_size], img[drive].track_size, 1, img[drive].f);
+                        img[drive].dirty[track] = 0;
+                }
+        }
+        fflush(img[drive].f);
+}
+
+static void img_flush_callback(void *p)
+{
+        img_flush(0);
+        img_flush(1);
+}
+
+void img_reset()
+{
+        timer_add(&img_flush_timer, img_flush_callback, NULL, 0);
+}
+
 static void add_to_map(uint8_t *arr, uint8_t p1, uint8_t p2, uint8_t p3)
 {
 	arr[0] = p1;
@@ -285,6 +328,15 @@ void img_load(int drive, char *fn)
 	        fwriteprot[drive] = writeprot[drive];
 	}
 
+        /*Read the whole image now. Tracks beyond the end of the file read as
+          blank, as they did when the image was read a track at a time*/
+        img[drive].track_size = img[drive].sectors * img[drive].sector_size * img[drive].sides;
+        img[drive].disc_data = malloc(img[drive].track_size * IMG_MAX_TRACKS);
+        memset(img[drive].disc_data, 0, img[drive].track_size * IMG_MAX_TRACKS);
+        memset(img[drive].dirty, 0, sizeof(img[drive].dirty));
+        fseek(img[drive].f, 0, SEEK_SET);
+        fread(img[drive].disc_data, 1, MIN(size, img[drive].track_size * IMG_MAX_TRACKS), img[drive].f);
+
         drives[drive].seek        = img_seek;
         drives[drive].readsector  = disc_sector_readsector;
         drives[drive].writesector = disc_sector_writesector;
@@ -308,9 +360,13 @@ int img_hole(int drive)
 
 void img_close(int drive)
 {
+        img_flush(drive);
         if (img[drive].f)
                 fclose(img[drive].f);
         img[drive].f = NULL;
+        if (img[drive].disc_data)
+                free(img[drive].disc_data);
+        img[drive].disc_data = NULL;
 }
 
 void img_seek(int drive, int track)
@@ -326,21 +382,14 @@ void img_seek(int drive, int track)
 //        pclog("  %i %i\n", drive_type[drive], img[drive].tracks);
         if (img[drive].tracks <= 41 && fdd_doublestep_40(drive))
                 track /= 2;
+        if (track >= IMG_MAX_TRACKS)
+                track = IMG_MAX_TRACKS - 1;
 
 	pclog("Disk seeked to track %i\n", track);
         disc_track[drive] = track;
 
-        if (img[drive].sides == 2)
-        {
-                fseek(img[drive].f, track * img[drive].sectors * img[drive].sector_size * 2, SEEK_SET);
-                fread(img[drive].track_data[0], img[drive].sectors * img[drive].sector_size, 1, img[drive].f);
-                fread(img[drive].track_data[1], img[drive].sectors * img[drive].sector_size, 1, img[drive].f);
-        }
-        else
-        {
-                fseek(img[drive].f, track * img[drive].sectors * img[drive].sector_size, SEEK_SET);
-                fread(img[drive].track_data[0], img[drive].sectors * img[drive].sector_size, 1, img[drive].f);
-        }
+        img[drive].track_data[0] = &img[drive].disc_data[track * img[drive].track_size];
+        img[drive].track_data[1] = img[drive].track_data[0] + img[drive].sectors * img[drive].sector_size;
         
         disc_sector_reset(drive, 0);
         disc_sector_reset(drive, 1);
@@ -439,16 +488,10 @@ void img_writeback(int drive, int track)
         if (img[drive].xdf_type)
                 return; /*Should never happen*/
 
-        if (img[drive].sides == 2)
-        {
-                fseek(img[drive].f, track * img[drive].sectors * img[drive].sector_size * 2, SEEK_SET);
-                fwrite(img[drive].track_data[0], img[drive].sectors * img[drive].sector_size, 1, img[drive].f);
-                fwrite(img[drive].track_data[1], img[drive].sectors * img[drive].sector_size, 1, img[drive].f);
-        }
-        else
-        {
-                fseek(img[drive].f, track * img[drive].sectors * img[drive].sector_size, SEEK_SET);
-                fwrite(img[drive].track_data[0], img[drive].sectors * img[drive].sector_size, 1, img[drive].f);
-        }
+        /*Sector data has already been written to the in-memory image, at the
+          currently seeked track. Just note the track and let the flush timer
+          coalesce the file writes*/
+        img[drive].dirty[disc_track[drive]] = 1;
+        if (!timer_is_enabled(&img_flush_timer))
+                timer_set_delay_u64(&img_flush_timer, IMG_FLUSH_DELAY);
 }
-
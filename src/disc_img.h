@@ -1,4 +1,5 @@
 void img_init();
+void img_reset();
 void img_load(int drive, char *fn);
 void img_close(int drive);
 void img_seek(int drive, int track);
@@ -3,6 +3,7 @@
 #include "disc_sector.h"
 #include "fdc.h"
 #include "fdd.h"
+#include "savestate.h"
 
 /*Handling for 'sector based' image formats (like .IMG) as opposed to 'stream based' formats (eg .FDI)*/
 
@@ -49,6 +50,40 @@ static int index_count;
 
 static int disc_sector_status;
 
+/*The sector lists are rebuilt by the image loaders when the drives seek, so
+  only the state of the operation in progress is stored*/
+void disc_sector_save_state(savestate_t *s)
+{
+        savestate_write(s, &disc_sector_state, sizeof(disc_sector_state));
+        savestate_write(s, &disc_sector_track, sizeof(disc_sector_track));
+        savestate_write(s, &disc_sector_side, sizeof(disc_sector_side));
+        savestate_write(s, &disc_sector_drive, sizeof(disc_sector_drive));
+        savestate_write(s, &disc_sector_sector, sizeof(disc_sector_sector));
+        savestate_write(s, &disc_sector_n, sizeof(disc_sector_n));
+        savestate_write(s, &disc_intersector_delay, sizeof(disc_intersector_delay));
+        savestate_write(s, &disc_sector_fill, sizeof(disc_sector_fill));
+        savestate_write(s, &cur_sector, sizeof(cur_sector));
+        savestate_write(s, &cur_byte, sizeof(cur_byte));
+        savestate_write(s, &index_count, sizeof(index_count));
+        savestate_write(s, &disc_sector_status, sizeof(disc_sector_status));
+}
+
+void disc_sector_load_state(savestate_t *s)
+{
+        savestate_read(s, &disc_sector_state, sizeof(disc_sector_state));
+        savestate_read(s, &disc_sector_track, sizeof(disc_sector_track));
+        savestate_read(s, &disc_sector_side, sizeof(disc_sector_side));
+        savestate_read(s, &disc_sector_drive, sizeof(disc_sector_drive));
+        savestate_read(s, &disc_sector_sector, sizeof(disc_sector_sector));
+        savestate_read(s, &disc_sector_n, sizeof(disc_sector_n));
+        savestate_read(s, &disc_intersector_delay, sizeof(disc_intersector_delay));
+        savestate_read(s, &disc_sector_fill, sizeof(disc_sector_fill));
+        savestate_read(s, &cur_sector, sizeof(cur_sector));
+        savestate_read(s, &cur_byte, sizeof(cur_byte));
+        savestate_read(s, &index_count, sizeof(index_count));
+        savestate_read(s, &disc_sector_status, sizeof(disc_sector_status));
+}
+
 void disc_sector_reset(int drive, int side)
 {
         disc_sector_count[drive][side] = 0;
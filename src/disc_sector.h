@@ -7,5 +7,8 @@ void disc_sector_format(int drive, int sector, int side, int density, uint8_t fi
 void disc_sector_stop();
 void disc_sector_poll();
 void disc_sector_stop();
+struct savestate_t;
+void disc_sector_save_state(struct savestate_t *s);
+void disc_sector_load_state(struct savestate_t *s);
 
 extern void (*disc_sector_writeback[2])(int drive, int track);
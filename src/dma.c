@@ -5,6 +5,7 @@
 #include "io.h"
 #include "mem.h"
 #include "ps2_mca.h"
+#include "savestate.h"
 #include "video.h"
 #include "x86.h"
 
@@ -35,6 +36,45 @@ static struct
 
 static void dma_ps2_run(int channel);
 
+/*Devices that transfer data lazily, in batches, register a sync callback for
+  their channel. It is called before any guest access to the DMA registers, so
+  the device can first bring the channel's address and count up to date.*/
+static struct
+{
+        void (*callback)(void *p);
+        void *p;
+} dma_sync[8];
+
+static void dma_sync_all()
+{
+        int c;
+        
+        for (c = 0; c < 8; c++)
+        {
+                if (dma_sync[c].callback)
+                        dma_sync[c].callback(dma_sync[c].p);
+        }
+}
+
+void dma_set_sync_callback(int channel, void (*callback)(void *p), void *p)
+{
+        if (channel < 0 || channel > 7)
+                return;
+        dma_sync[channel].callback = callback;
+        dma_sync[channel].p = p;
+}
+
+void dma_remove_sync_callback(int channel, void *p)
+{
+        if (channel < 0 || channel > 7)
+                return;
+        if (dma_sync[channel].p == p)
+        {
+                dma_sync[channel].callback = NULL;
+                dma_sync[channel].p = NULL;
+        }
+}
+
 void dma_reset()
 {
         int c;
@@ -59,6 +99,8 @@ uint8_t dma_read(uint16_t addr, void *priv)
 {
         int channel = (addr >> 1) & 3;
         uint8_t temp;
+
+        dma_sync_all();
 //        printf("Read DMA %04X %04X:%04X %i %02X\n",addr,CS,pc, pic_intpending, pic.pend);
         switch (addr & 0xf)
         {
@@ -91,6 +133,8 @@ uint8_t dma_read(uint16_t addr, void *priv)
 void dma_write(uint16_t addr, uint8_t val, void *priv)
 {
         int channel = (addr >> 1) & 3;
+
+        dma_sync_all();
 //        printf("Write DMA %04X %02X %04X:%04X\n",addr,val,CS,pc);
         dmaregs[addr & 0xf] = val;
         switch (addr & 0xf)
@@ -158,6 +202,8 @@ void dma_write(uint16_t addr, uint8_t val, void *priv)
 static uint8_t dma_ps2_read(uint16_t addr, void *priv)
 {
         dma_t *dma_c = &dma[dma_ps2.xfr_channel];
+
+        dma_sync_all();
         uint8_t temp = 0xff;
         
         switch (addr)
@@ -229,6 +275,7 @@ static void dma_ps2_write(uint16_t addr, uint8_t val, void *priv)
         dma_t *dma_c = &dma[dma_ps2.xfr_channel];
         uint8_t mode;
         
+        dma_sync_all();
 //        pclog("Write PS2 DMA %04X %02X %04X:%04X\n",addr,val,CS,cpu_state.pc);
         
         switch (addr)
@@ -320,6 +367,8 @@ uint8_t dma16_read(uint16_t addr, void *priv)
 {
         int channel = ((addr >> 2) & 3) + 4;
         uint8_t temp;
+
+        dma_sync_all();
 //        printf("Read DMA %04X %04X:%04X\n",addr,cs>>4,pc);
         addr >>= 1;
         switch (addr & 0xf)
@@ -355,6 +404,8 @@ uint8_t dma16_read(uint16_t addr, void *priv)
 void dma16_write(uint16_t addr, uint8_t val, void *priv)
 {
         int channel = ((addr >> 2) & 3) + 4;
+
+        dma_sync_all();
 //        printf("Write dma16 %04X %02X %04X:%04X\n",addr,val,CS,pc);
         addr >>= 1;
         dma16regs[addr & 0xf] = val;
@@ -431,6 +482,7 @@ void dma16_write(uint16_t addr, uint8_t val, void *priv)
 
 void dma_page_write(uint16_t addr, uint8_t val, void *priv)
 {
+        dma_sync_all();
         dmapages[addr & 0xf] = val;
         switch (addr & 0xf)
         {
@@ -596,6 +648,88 @@ int dma_channel_read(int channel)
         return temp;
 }
 
+/*Read up to count transfers from a channel in one go. Address, count and
+  terminal count are handled as for the same number of dma_channel_read()
+  calls, but runs of incrementing transfers are fetched from memory as a block.
+  Stops early if the channel stops providing data. Returns the number of
+  transfers read.*/
+int dma_channel_read_block(int channel, uint16_t *data, int count)
+{
+        dma_t *dma_c = &dma[channel];
+        uint8_t buf[512];
+        int c = 0;
+
+        while (c < count)
+        {
+                uint32_t wrap_mask = dma_c->size ? 0x1ffff : 0xffff;
+                int span, bytes, i;
+
+                if ((dma_c->mode & 0x20) || (dma_c->size && (dma_c->ac & 1)))
+                {
+                        /*Decrementing or misaligned, take the slow path*/
+                        int val = dma_channel_read(channel);
+
+                        if (val == DMA_NODATA)
+                                break;
+                        data[c++] = val & 0xffff;
+                        continue;
+                }
+
+                if (((channel < 4) ? dma_command : dma16_command) & 0x04)
+                        break;
+        	if (dma_m & (1 << channel))
+                        break;
+                if ((dma_c->mode & 0xC) != 8)
+                        break;
+
+                span = MIN(count - c, dma_c->cc + 1);
+                span = MIN(span, sizeof(buf) >> dma_c->size);
+                if (!dma_ps2.is_ps2)
+                        span = MIN(span, (int)(((wrap_mask + 1) - (dma_c->ac & wrap_mask)) >> dma_c->size));
+                bytes = span << dma_c->size;
+
+                mem_dma_read(dma_c->ac, buf, bytes);
+                if (dma_c->size)
+                {
+                        for (i = 0; i < span; i++)
+                                data[c + i] = buf[i*2] | (buf[i*2 + 1] << 8);
+                }
+                else
+                {
+                        for (i = 0; i < span; i++)
+                                data[c + i] = buf[i];
+                }
+                if (!AT)
+                {
+                        for (i = 0; i < span; i++)
+                                refreshread();
+                }
+
+                if (dma_ps2.is_ps2)
+                        dma_c->ac += bytes;
+                else
+                        dma_c->ac = (dma_c->ac & ~wrap_mask) | ((dma_c->ac + bytes) & wrap_mask);
+                c += span;
+
+                dma_stat_rq |= (1 << channel);
+
+                dma_c->cc -= span;
+                if (dma_c->cc < 0)
+                {
+                        if (dma_c->mode & 0x10) /*Auto-init*/
+                        {
+                                dma_c->cc = dma_c->cb;
+                                dma_c->ac = dma_c->ab;
+                        }
+                        else
+                                dma_m |= (1 << channel);
+                        dma_stat |= (1 << channel);
+                }
+        }
+
+        return c;
+}
+
 int dma_channel_write(int channel, uint16_t val)
 {
         dma_t *dma_c = &dma[channel];
@@ -776,3 +910,42 @@ static void dma_ps2_run(int channel)
                 break;
         }
 }
+
+void dma_save_state(savestate_t *s)
+{
+        /*Bring lazily run transfers up to date first*/
+        dma_sync_all();
+
+        savestate_begin_section(s, "dma");
+        savestate_write(s, dma, sizeof(dma));
+        savestate_write(s, dmaregs, sizeof(dmaregs));
+        savestate_write(s, dma16regs, sizeof(dma16regs));
+        savestate_write(s, dmapages, sizeof(dmapages));
+        savestate_write(s, &dma_wp, sizeof(dma_wp));
+        savestate_write(s, &dma16_wp, sizeof(dma16_wp));
+        savestate_write(s, &dma_m, sizeof(dma_m));
+        savestate_write(s, &dma_stat, sizeof(dma_stat));
+        savestate_write(s, &dma_stat_rq, sizeof(dma_stat_rq));
+        savestate_write(s, &dma_command, sizeof(dma_command));
+        savestate_write(s, &dma16_command, sizeof(dma16_command));
+        savestate_write(s, &dma_ps2, sizeof(dma_ps2));
+        savestate_end_section(s);
+}
+
+void dma_load_state(savestate_t *s)
+{
+        if (savestate_open_section(s, "dma"))
+                return;
+        savestate_read(s, dma, sizeof(dma));
+        savestate_read(s, dmaregs, sizeof(dmaregs));
+        savestate_read(s, dma16regs, sizeof(dma16regs));
+        savestate_read(s, dmapages, sizeof(dmapages));
+        savestate_read(s, &dma_wp, sizeof(dma_wp));
+        savestate_read(s, &dma16_wp, sizeof(dma16_wp));
+        savestate_read(s, &dma_m, sizeof(dma_m));
+        savestate_read(s, &dma_stat, sizeof(dma_stat));
+        savestate_read(s, &dma_stat_rq, sizeof(dma_stat_rq));
+        savestate_read(s, &dma_command, sizeof(dma_command));
+        savestate_read(s, &dma16_command, sizeof(dma16_command));
+        savestate_read(s, &dma_ps2, sizeof(dma_ps2));
+}
@@ -15,3 +15,11 @@ void writedma2(uint8_t temp);
 
 int dma_channel_read(int channel);
 int dma_channel_write(int channel, uint16_t val);
+int dma_channel_read_block(int channel, uint16_t *data, int count);
+
+void dma_set_sync_callback(int channel, void (*callback)(void *p), void *p);
+void dma_remove_sync_callback(int channel, void *p);
+
+struct savestate_t;
+void dma_save_state(struct savestate_t *s);
+void dma_load_state(struct savestate_t *s);
@@ -33,6 +33,11 @@
 //#include "SDL.h"
 //#include "SDL_thread.h"
 
+extern "C"
+{
+#include "../thread.h"
+}
+
 #include <stdint.h>
 typedef signed int Bits;
 typedef unsigned int Bitu;
@@ -108,7 +113,52 @@ private:
 		virtual ~TrackFile() { };
 	};
 	
-	class BinaryFile : public TrackFile {
+	class BlockSource {
+	public:
+		// returns number of valid bytes in block, or <= 0 on error
+		virtual int readBlock(Bit8u *dest, int block) = 0;
+		virtual ~BlockSource() { };
+	};
+
+	// LRU cache of fixed size blocks. Once a sequential stream is detected
+	// the following blocks are loaded ahead of the reader on a worker thread.
+	class ReadAheadCache {
+	public:
+		ReadAheadCache(BlockSource *source, int block_size, int nr_blocks, int prefetch_depth);
+		~ReadAheadCache();
+		bool read(Bit8u *buffer, int seek, int count);
+	private:
+		ReadAheadCache();
+		struct Block {
+			int nr;
+			int length;
+			int state;
+			unsigned int last_used;
+			Bit8u *data;
+		};
+		Block *findBlock(int nr);
+		Block *loadBlock(int nr);
+		void schedulePrefetch(int nr);
+		static void prefetchThread(void *param);
+
+		BlockSource *source;
+		int block_size;
+		int nr_blocks;
+		int prefetch_depth;
+		Block *blocks;
+		unsigned int use_counter;
+		int next_seek;
+		int sequential;
+		int prefetch_next, prefetch_end;
+		bool quit;
+		mutex_t *mutex;		// protects block state and prefetch window
+		mutex_t *io_mutex;	// serialises calls to source->readBlock()
+		thread_t *thread;
+		event_t *wake_event;
+		event_t *exit_event;
+	};
+
+	class BinaryFile : public TrackFile, private BlockSource {
 	public:
 		BinaryFile(const char *filename, bool &error);
 		~BinaryFile();
@@ -116,9 +166,61 @@ private:
 		int getLength();
 	private:
 		BinaryFile();
+		int readBlock(Bit8u *dest, int block);
 		std::ifstream *file;
+		int length;
+		ReadAheadCache *cache;
+		Bit8u *map;
+		int next_seek;
 	};
 	
+#ifdef USE_CHD
+	// CHD v5 image. One instance is shared by the ChdTrackFiles of all
+	// tracks; decompressed hunks are cached and read ahead on a worker thread.
+	class ChdFile : private BlockSource {
+	public:
+		ChdFile(const char *filename, bool &error);
+		~ChdFile();
+		bool readFrame(Bit8u *buffer, int frame, int offset, int count);
+		bool getMetadata(Bit32u tag, int index, std::string &data);
+		int refcount;
+	private:
+		ChdFile();
+		int readBlock(Bit8u *dest, int hunk);
+		bool readHunk(Bit8u *dest, int hunk, int depth);
+		bool readAt(Bit8u *dest, uint64_t offset, int count);
+		bool decodeMap();
+		bool decompress(Bit32u codec, const Bit8u *src, int srclen, Bit8u *dest);
+		std::ifstream *file;
+		Bit32u compressors[4];
+		uint64_t logicalbytes;
+		uint64_t mapoffset;
+		uint64_t metaoffset;
+		Bit32u hunkbytes;
+		Bit32u unitbytes;
+		Bit32u hunkcount;
+		Bit8u *map;
+		Bit8u *compressed;
+		Bit8u *scratch;
+		ReadAheadCache *cache;
+	};
+
+	class ChdTrackFile : public TrackFile {
+	public:
+		ChdTrackFile(ChdFile *chd, int first_frame, int frames, int sectorSize, bool audio);
+		~ChdTrackFile();
+		bool read(Bit8u *buffer, int seek, int count);
+		int getLength();
+	private:
+		ChdTrackFile();
+		ChdFile *chd;
+		int first_frame;
+		int frames;
+		int sectorSize;
+		bool audio;
+	};
+#endif
+
 	struct Track {
 		int number;
 		int track_number;
@@ -155,6 +257,9 @@ static	void	CDAudioCallBack(Bitu len);
 
 	void 	ClearTracks();
 	bool	LoadIsoFile(char *filename);
+#ifdef USE_CHD
+	bool	LoadChdFile(char *filename);
+#endif
 	bool	CanReadPVD(TrackFile *file, int sectorSize, bool mode2);
 	// cue sheet processing
 	bool	LoadCueSheet(char *cuefile);
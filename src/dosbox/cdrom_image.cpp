@@ -32,6 +32,9 @@
 
 #if !defined(WIN32)
 #include <libgen.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #else
 #include <string.h>
 #endif
@@ -44,29 +47,297 @@ using namespace std;
 
 #define safe_strncpy(a,b,n) do { strncpy((a),(b),(n)-1); (a)[(n)-1] = 0; } while (0)
 
+#define BLOCK_STATE_EMPTY   0
+#define BLOCK_STATE_LOADING 1
+#define BLOCK_STATE_VALID   2
+
+CDROM_Interface_Image::ReadAheadCache::ReadAheadCache(BlockSource *source, int block_size, int nr_blocks, int prefetch_depth)
+	: source(source), block_size(block_size), nr_blocks(nr_blocks), prefetch_depth(prefetch_depth)
+{
+	blocks = new Block[nr_blocks];
+	for (int i = 0; i < nr_blocks; i++) {
+		blocks[i].nr = -1;
+		blocks[i].length = 0;
+		blocks[i].state = BLOCK_STATE_EMPTY;
+		blocks[i].last_used = 0;
+		blocks[i].data = new Bit8u[block_size];
+	}
+	use_counter = 0;
+	next_seek = -1;
+	sequential = 0;
+	prefetch_next = prefetch_end = 0;
+	quit = false;
+	mutex = thread_create_mutex();
+	io_mutex = thread_create_mutex();
+	thread = NULL;
+	wake_event = thread_create_event();
+	exit_event = thread_create_event();
+}
+
+CDROM_Interface_Image::ReadAheadCache::~ReadAheadCache()
+{
+	if (thread) {
+		thread_lock_mutex(mutex);
+		quit = true;
+		thread_unlock_mutex(mutex);
+		thread_set_event(wake_event);
+		thread_wait_event(exit_event, -1);
+		thread_kill(thread);
+	}
+	thread_destroy_event(exit_event);
+	thread_destroy_event(wake_event);
+	thread_destroy_mutex(io_mutex);
+	thread_destroy_mutex(mutex);
+	for (int i = 0; i < nr_blocks; i++)
+		delete[] blocks[i].data;
+	delete[] blocks;
+}
+
+/* Must be called with mutex held */
+CDROM_Interface_Image::ReadAheadCache::Block *CDROM_Interface_Image::ReadAheadCache::findBlock(int nr)
+{
+	for (int i = 0; i < nr_blocks; i++) {
+		if (blocks[i].nr == nr && blocks[i].state != BLOCK_STATE_EMPTY)
+			return &blocks[i];
+	}
+	return NULL;
+}
+
+/* Must be called with io_mutex held, and mutex not held. Returns the block
+   with mutex held, or NULL (with mutex held) if the source read failed */
+CDROM_Interface_Image::ReadAheadCache::Block *CDROM_Interface_Image::ReadAheadCache::loadBlock(int nr)
+{
+	Block *block;
+
+	thread_lock_mutex(mutex);
+	block = findBlock(nr);
+	if (block)
+		return block;
+
+	block = &blocks[0];
+	for (int i = 1; i < nr_blocks; i++) {
+		if (blocks[i].state == BLOCK_STATE_EMPTY) {
+			block = &blocks[i];
+			break;
+		}
+		if (blocks[i].last_used < block->last_used)
+			block = &blocks[i];
+	}
+	block->nr = nr;
+	block->state = BLOCK_STATE_LOADING;
+	thread_unlock_mutex(mutex);
+
+	int length = source->readBlock(block->data, nr);
+
+	thread_lock_mutex(mutex);
+	if (length <= 0) {
+		block->state = BLOCK_STATE_EMPTY;
+		block->nr = -1;
+		return NULL;
+	}
+	block->length = length;
+	block->state = BLOCK_STATE_VALID;
+	block->last_used = ++use_counter;
+	return block;
+}
+
+/* Must be called with mutex held */
+void CDROM_Interface_Image::ReadAheadCache::schedulePrefetch(int nr)
+{
+	if (prefetch_next <= nr || prefetch_next > nr + prefetch_depth)
+		prefetch_next = nr + 1;
+	prefetch_end = nr + prefetch_depth;
+
+	if (!thread)
+		thread = thread_create(prefetchThread, this);
+	thread_set_event(wake_event);
+}
+
+void CDROM_Interface_Image::ReadAheadCache::prefetchThread(void *param)
+{
+	ReadAheadCache *cache = (ReadAheadCache *)param;
+
+	while (1) {
+		thread_wait_event(cache->wake_event, -1);
+		thread_reset_event(cache->wake_event);
+
+		while (1) {
+			int nr = -1;
+
+			thread_lock_mutex(cache->mutex);
+			if (cache->quit) {
+				thread_unlock_mutex(cache->mutex);
+				thread_set_event(cache->exit_event);
+				return;
+			}
+			while (cache->prefetch_next <= cache->prefetch_end) {
+				int next = cache->prefetch_next++;
+				if (!cache->findBlock(next)) {
+					nr = next;
+					break;
+				}
+			}
+			thread_unlock_mutex(cache->mutex);
+
+			if (nr == -1)
+				break;
+
+			thread_lock_mutex(cache->io_mutex);
+			Block *block = cache->loadBlock(nr);
+			thread_unlock_mutex(cache->mutex);
+			thread_unlock_mutex(cache->io_mutex);
+			if (!block) {
+				/*Most likely end of file, stop prefetching this stream*/
+				thread_lock_mutex(cache->mutex);
+				cache->prefetch_end = cache->prefetch_next - 1;
+				thread_unlock_mutex(cache->mutex);
+			}
+		}
+	}
+}
+
+bool CDROM_Interface_Image::ReadAheadCache::read(Bit8u *buffer, int seek, int count)
+{
+	thread_lock_mutex(mutex);
+	/*Treat small forward skips as sequential, readers of cooked sectors
+	  from raw images step over the sector headers*/
+	if (seek >= next_seek && seek - next_seek < block_size) {
+		if (sequential < 2)
+			sequential++;
+	} else
+		sequential = 0;
+	next_seek = seek + count;
+	if (sequential >= 2)
+		schedulePrefetch((seek + count - 1) / block_size);
+	thread_unlock_mutex(mutex);
+
+	while (count) {
+		int nr = seek / block_size;
+		int offset = seek % block_size;
+		int len = count;
+		if (len > block_size - offset)
+			len = block_size - offset;
+
+		thread_lock_mutex(mutex);
+		Block *block = findBlock(nr);
+		if (!block || block->state != BLOCK_STATE_VALID) {
+			/*Either a miss, or the prefetch thread is currently loading
+			  this block - in which case it holds io_mutex and we will
+			  find the block valid once we acquire it*/
+			thread_unlock_mutex(mutex);
+			thread_lock_mutex(io_mutex);
+			block = loadBlock(nr);
+			thread_unlock_mutex(io_mutex);
+		}
+		if (!block || offset + len > block->length) {
+			thread_unlock_mutex(mutex);
+			return false;
+		}
+		memcpy(buffer, &block->data[offset], len);
+		block->last_used = ++use_counter;
+		thread_unlock_mutex(mutex);
+
+		buffer += len;
+		seek += len;
+		count -= len;
+	}
+	return true;
+}
+
+#define BINARY_BLOCK_SIZE     (64 * 1024)
+#define BINARY_CACHE_BLOCKS   32
+#define BINARY_PREFETCH_DEPTH 8
+
 CDROM_Interface_Image::BinaryFile::BinaryFile(const char *filename, bool &error)
 {
+	file = NULL;
+	cache = NULL;
+	map = NULL;
+	next_seek = -1;
+	length = -1;
+
+#if !defined(WIN32)
+	/*Map the whole image where address space allows, and leave caching and
+	  read-ahead to the host OS*/
+	if (sizeof(void *) >= 8) {
+		int fd = open(filename, O_RDONLY);
+		if (fd != -1) {
+			struct stat st;
+			if (!fstat(fd, &st) && st.st_size > 0 && st.st_size <= INT_MAX) {
+				void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+				if (p != MAP_FAILED) {
+					map = (Bit8u *)p;
+					length = (int)st.st_size;
+				}
+			}
+			close(fd);
+		}
+		if (map) {
+			error = false;
+			return;
+		}
+	}
+#endif
+
 	file = new ifstream(filename, ios::in | ios::binary);
 	error = (file == NULL) || (file->fail());
+	if (error)
+		return;
+	file->seekg(0, ios::end);
+	length = (int)file->tellg();
+	if (file->fail())
+		length = -1;
+	cache = new ReadAheadCache(this, BINARY_BLOCK_SIZE, BINARY_CACHE_BLOCKS, BINARY_PREFETCH_DEPTH);
 }
 
 CDROM_Interface_Image::BinaryFile::~BinaryFile()
 {
+#if !defined(WIN32)
+	if (map)
+		munmap(map, length);
+#endif
+	delete cache;
 	delete file;
 }
 
 bool CDROM_Interface_Image::BinaryFile::read(Bit8u *buffer, int seek, int count)
 {
-	file->seekg(seek, ios::beg);
-	file->read((char*)buffer, count);
-	return !(file->fail());
+	if (seek < 0 || count < 0)
+		return false;
+
+#if !defined(WIN32)
+	if (map) {
+		if (count > length - seek)
+			return false;
+		if (seek >= next_seek && seek - next_seek < BINARY_BLOCK_SIZE) {
+			/*Sequential access, ask the host to start reading ahead*/
+			int ahead = (seek + count) & ~(BINARY_BLOCK_SIZE - 1);
+			int ahead_len = BINARY_BLOCK_SIZE * BINARY_PREFETCH_DEPTH;
+			if (ahead_len > length - ahead)
+				ahead_len = length - ahead;
+			if (ahead_len > 0)
+				posix_madvise(map + ahead, ahead_len, POSIX_MADV_WILLNEED);
+		}
+		next_seek = seek + count;
+		memcpy(buffer, map + seek, count);
+		return true;
+	}
+#endif
+
+	return cache->read(buffer, seek, count);
+}
+
+/* Called by the read-ahead cache, serialised on its io_mutex */
+int CDROM_Interface_Image::BinaryFile::readBlock(Bit8u *dest, int block)
+{
+	file->clear();
+	file->seekg((streamoff)block * BINARY_BLOCK_SIZE, ios::beg);
+	file->read((char*)dest, BINARY_BLOCK_SIZE);
+	return (int)file->gcount();
 }
 
 int CDROM_Interface_Image::BinaryFile::getLength()
 {
-	file->seekg(0, ios::end);
-	int length = (int)file->tellg();
-	if (file->fail()) return -1;
 	return length;
 }
 
@@ -85,6 +356,9 @@ void CDROM_Interface_Image::InitNewMedia()
 
 bool CDROM_Interface_Image::SetDevice(char* path, int forceCD)
 {
+#ifdef USE_CHD
+	if (LoadChdFile(path)) return true;
+#endif
 	if (LoadCueSheet(path)) return true;
 	if (LoadIsoFile(path)) return true;
 	
@@ -0,0 +1,804 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* CHD v5 (MAME compressed hunks of data) CD-ROM image support.
+   Supported codecs are zlib, lzma, and their CD variants cdzl and cdlz.
+   FLAC compressed hunks (cdfl, normally used by chdman for audio tracks),
+   huff and zstd are not supported - reading such a hunk fails. Parent
+   (differencing) CHDs are not supported. */
+
+#ifdef USE_CHD
+
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include <lzma.h>
+#include "cdrom.h"
+
+using namespace std;
+
+#define CHD_V5_HEADER_SIZE 124
+
+#define CHD_MAKE_TAG(a, b, c, d) (((Bit32u)(a) << 24) | ((Bit32u)(b) << 16) | ((Bit32u)(c) << 8) | (Bit32u)(d))
+
+#define CHD_CODEC_ZLIB     CHD_MAKE_TAG('z','l','i','b')
+#define CHD_CODEC_LZMA     CHD_MAKE_TAG('l','z','m','a')
+#define CHD_CODEC_CD_ZLIB  CHD_MAKE_TAG('c','d','z','l')
+#define CHD_CODEC_CD_LZMA  CHD_MAKE_TAG('c','d','l','z')
+
+#define CDROM_TRACK_METADATA_TAG  CHD_MAKE_TAG('C','H','T','R')
+#define CDROM_TRACK_METADATA2_TAG CHD_MAKE_TAG('C','H','T','2')
+
+/*Hunk map compression types*/
+enum
+{
+	COMPRESSION_TYPE_0 = 0,
+	COMPRESSION_TYPE_1,
+	COMPRESSION_TYPE_2,
+	COMPRESSION_TYPE_3,
+	COMPRESSION_NONE,
+	COMPRESSION_SELF,
+	COMPRESSION_PARENT,
+	COMPRESSION_RLE_SMALL,
+	COMPRESSION_RLE_LARGE,
+	COMPRESSION_SELF_0,
+	COMPRESSION_SELF_1,
+	COMPRESSION_PARENT_SELF,
+	COMPRESSION_PARENT_0,
+	COMPRESSION_PARENT_1
+};
+
+#define CD_FRAME_SIZE       (RAW_SECTOR_SIZE + 96)
+#define CD_SUBCODE_SIZE     96
+#define CD_TRACK_PADDING    4
+
+#define CHD_HUNK_CACHE_SIZE 32
+#define CHD_PREFETCH_DEPTH  8
+
+static inline Bit32u get_be16(const Bit8u *p)
+{
+	return (p[0] << 8) | p[1];
+}
+static inline Bit32u get_be24(const Bit8u *p)
+{
+	return (p[0] << 16) | (p[1] << 8) | p[2];
+}
+static inline Bit32u get_be32(const Bit8u *p)
+{
+	return ((Bit32u)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+static inline uint64_t get_be48(const Bit8u *p)
+{
+	return ((uint64_t)get_be16(p) << 32) | get_be32(p + 2);
+}
+static inline uint64_t get_be64(const Bit8u *p)
+{
+	return ((uint64_t)get_be32(p) << 32) | get_be32(p + 4);
+}
+static inline void put_be16(Bit8u *p, Bit32u v)
+{
+	p[0] = v >> 8;
+	p[1] = v;
+}
+static inline void put_be24(Bit8u *p, Bit32u v)
+{
+	p[0] = v >> 16;
+	p[1] = v >> 8;
+	p[2] = v;
+}
+static inline void put_be48(Bit8u *p, uint64_t v)
+{
+	put_be16(p, (Bit32u)(v >> 32));
+	p[2] = v >> 24;
+	p[3] = v >> 16;
+	p[4] = v >> 8;
+	p[5] = v;
+}
+
+/*CRC-16/CCITT, as used for the map and hunk checksums*/
+static Bit16u crc16_table[256];
+
+static void crc16_init()
+{
+	for (int i = 0; i < 256; i++) {
+		Bit16u crc = i << 8;
+		for (int j = 0; j < 8; j++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+		crc16_table[i] = crc;
+	}
+}
+
+static Bit16u crc16(const Bit8u *data, int len)
+{
+	Bit16u crc = 0xffff;
+	while (len--)
+		crc = (crc << 8) ^ crc16_table[(crc >> 8) ^ *data++];
+	return crc;
+}
+
+/*MSB-first bit reader used by the compressed hunk map*/
+struct chd_bitstream_t {
+	Bit32u buffer;
+	int bits;
+	const Bit8u *data;
+	Bit32u offset, length;
+};
+
+static Bit32u bitstream_peek(chd_bitstream_t *bs, int numbits)
+{
+	if (!numbits)
+		return 0;
+	if (numbits > bs->bits) {
+		while (bs->bits <= 24) {
+			if (bs->offset < bs->length)
+				bs->buffer |= bs->data[bs->offset] << (24 - bs->bits);
+			bs->offset++;
+			bs->bits += 8;
+		}
+	}
+	return bs->buffer >> (32 - numbits);
+}
+
+static Bit32u bitstream_read(chd_bitstream_t *bs, int numbits)
+{
+	Bit32u result = bitstream_peek(bs, numbits);
+	bs->buffer <<= numbits;
+	bs->bits -= numbits;
+	return result;
+}
+
+/*Canonical Huffman decoder for the map compression types - 16 codes, 8 bits max*/
+#define MAP_HUFF_CODES   16
+#define MAP_HUFF_MAXBITS 8
+
+struct chd_huffman_t {
+	Bit8u numbits[MAP_HUFF_CODES];
+	Bit32u code[MAP_HUFF_CODES];
+	Bit16u lookup[1 << MAP_HUFF_MAXBITS];
+};
+
+static bool huffman_import_tree_rle(chd_huffman_t *huff, chd_bitstream_t *bs)
+{
+	Bit32u bithisto[33] = {0};
+	Bit32u curstart = 0;
+	int node = 0;
+
+	while (node < MAP_HUFF_CODES) {
+		int nodebits = bitstream_read(bs, 4);
+		if (nodebits != 1)
+			huff->numbits[node++] = nodebits;
+		else {
+			nodebits = bitstream_read(bs, 4);
+			if (nodebits == 1)
+				huff->numbits[node++] = nodebits;
+			else {
+				int repcount = bitstream_read(bs, 4) + 3;
+				if (node + repcount > MAP_HUFF_CODES)
+					return false;
+				while (repcount--)
+					huff->numbits[node++] = nodebits;
+			}
+		}
+	}
+
+	for (int c = 0; c < MAP_HUFF_CODES; c++) {
+		if (huff->numbits[c] > MAP_HUFF_MAXBITS)
+			return false;
+		bithisto[huff->numbits[c]]++;
+	}
+	for (int len = 32; len > 0; len--) {
+		Bit32u nextstart = (curstart + bithisto[len]) >> 1;
+		if (len != 1 && nextstart * 2 != (curstart + bithisto[len]))
+			return false;
+		bithisto[len] = curstart;
+		curstart = nextstart;
+	}
+
+	memset(huff->lookup, 0, sizeof(huff->lookup));
+	for (int c = 0; c < MAP_HUFF_CODES; c++) {
+		if (huff->numbits[c]) {
+			int shift = MAP_HUFF_MAXBITS - huff->numbits[c];
+
+			huff->code[c] = bithisto[huff->numbits[c]]++;
+			for (Bit32u i = huff->code[c] << shift; i < (huff->code[c] + 1) << shift; i++)
+				huff->lookup[i] = (c << 5) | huff->numbits[c];
+		}
+	}
+	return bs->offset <= bs->length;
+}
+
+static int huffman_decode_one(chd_huffman_t *huff, chd_bitstream_t *bs)
+{
+	Bit16u lookup = huff->lookup[bitstream_peek(bs, MAP_HUFF_MAXBITS)];
+	bitstream_read(bs, lookup & 0x1f);
+	return lookup >> 5;
+}
+
+/*CD-ROM ECC regeneration, used for sectors the CD codecs stored without sync
+  header and ECC*/
+static Bit8u ecc_f_lut[256], ecc_b_lut[256];
+
+static const Bit8u cd_sync_header[12] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+
+static void ecc_init()
+{
+	for (int i = 0; i < 256; i++) {
+		int j = (i << 1) ^ ((i & 0x80) ? 0x11d : 0);
+		ecc_f_lut[i] = j;
+		ecc_b_lut[i ^ j] = i;
+	}
+}
+
+static void ecc_computeblock(const Bit8u *src, int major_count, int minor_count, int major_mult, int minor_inc, Bit8u *dest)
+{
+	int size = major_count * minor_count;
+
+	for (int major = 0; major < major_count; major++) {
+		int index = (major >> 1) * major_mult + (major & 1);
+		Bit8u ecc_a = 0, ecc_b = 0;
+
+		for (int minor = 0; minor < minor_count; minor++) {
+			Bit8u temp = src[index];
+			index += minor_inc;
+			if (index >= size)
+				index -= size;
+			ecc_a ^= temp;
+			ecc_b ^= temp;
+			ecc_a = ecc_f_lut[ecc_a];
+		}
+		ecc_a = ecc_b_lut[ecc_f_lut[ecc_a] ^ ecc_b];
+		dest[major] = ecc_a;
+		dest[major + major_count] = ecc_a ^ ecc_b;
+	}
+}
+
+static void ecc_generate(Bit8u *sector)
+{
+	Bit8u address[4];
+	bool mode2 = (sector[15] == 2);
+
+	/*Mode 2 ECC is computed with a zero header*/
+	if (mode2) {
+		memcpy(address, &sector[12], 4);
+		memset(&sector[12], 0, 4);
+	}
+	ecc_computeblock(&sector[12], 86, 24, 2, 86, &sector[0x81c]);
+	ecc_computeblock(&sector[12], 52, 43, 86, 88, &sector[0x8c8]);
+	if (mode2)
+		memcpy(&sector[12], address, 4);
+}
+
+static bool chd_inflate(const Bit8u *src, int srclen, Bit8u *dest, int destlen)
+{
+	z_stream z;
+
+	memset(&z, 0, sizeof(z));
+	if (inflateInit2(&z, -MAX_WBITS) != Z_OK)
+		return false;
+	z.next_in = (Bytef *)src;
+	z.avail_in = srclen;
+	z.next_out = dest;
+	z.avail_out = destlen;
+	inflate(&z, Z_SYNC_FLUSH);
+	bool success = (z.total_out == (uLong)destlen);
+	inflateEnd(&z);
+	return success;
+}
+
+static bool chd_unlzma(const Bit8u *src, int srclen, Bit8u *dest, int destlen, Bit32u hunkbytes)
+{
+	lzma_options_lzma opt;
+	lzma_filter filters[2];
+	lzma_stream strm = LZMA_STREAM_INIT;
+
+	/*chdman encodes with level 9 properties normalised for a hunk sized
+	  input; mirror that to get the same dictionary size*/
+	lzma_lzma_preset(&opt, 9);
+	opt.dict_size = 1 << 26;
+	for (int i = 11; i <= 30; i++) {
+		if (hunkbytes <= (2u << i)) {
+			opt.dict_size = 2u << i;
+			break;
+		}
+		if (hunkbytes <= (3u << i)) {
+			opt.dict_size = 3u << i;
+			break;
+		}
+	}
+	filters[0].id = LZMA_FILTER_LZMA1;
+	filters[0].options = &opt;
+	filters[1].id = LZMA_VLI_UNKNOWN;
+	filters[1].options = NULL;
+
+	if (lzma_raw_decoder(&strm, filters) != LZMA_OK)
+		return false;
+	strm.next_in = src;
+	strm.avail_in = srclen;
+	strm.next_out = dest;
+	strm.avail_out = destlen;
+	/*chdman streams have no end marker, so a whole hunk normally comes
+	  back as LZMA_OK with the output full*/
+	lzma_ret ret = lzma_code(&strm, LZMA_RUN);
+	bool success = (ret == LZMA_OK || ret == LZMA_STREAM_END) && strm.total_out == (uint64_t)destlen;
+	lzma_end(&strm);
+	return success;
+}
+
+CDROM_Interface_Image::ChdFile::ChdFile(const char *filename, bool &error)
+{
+	Bit8u header[CHD_V5_HEADER_SIZE];
+
+	refcount = 0;
+	map = NULL;
+	compressed = NULL;
+	scratch = NULL;
+	cache = NULL;
+	error = true;
+
+	file = new ifstream(filename, ios::in | ios::binary);
+	if (file->fail())
+		return;
+	file->read((char *)header, sizeof(header));
+	if (file->fail() || memcmp(header, "MComprHD", 8))
+		return;
+	if (get_be32(&header[12]) != 5 || get_be32(&header[8]) < CHD_V5_HEADER_SIZE)
+		return;
+
+	for (int c = 0; c < 4; c++)
+		compressors[c] = get_be32(&header[16 + c*4]);
+	logicalbytes = get_be64(&header[32]);
+	mapoffset = get_be64(&header[40]);
+	metaoffset = get_be64(&header[48]);
+	hunkbytes = get_be32(&header[56]);
+	unitbytes = get_be32(&header[60]);
+
+	/*Parent CHDs are not supported*/
+	for (int c = 0; c < 20; c++) {
+		if (header[104 + c])
+			return;
+	}
+	if (!hunkbytes || !unitbytes || hunkbytes % CD_FRAME_SIZE || hunkbytes > 1024*1024)
+		return;
+	if (logicalbytes > INT_MAX)
+		return;
+	hunkcount = (Bit32u)((logicalbytes + hunkbytes - 1) / hunkbytes);
+
+	crc16_init();
+	ecc_init();
+
+	compressed = new Bit8u[hunkbytes];
+	scratch = new Bit8u[hunkbytes];
+	if (compressors[0]) {
+		map = new Bit8u[hunkcount * 12];
+		if (!decodeMap())
+			return;
+	} else {
+		map = new Bit8u[hunkcount * 4];
+		if (!readAt(map, mapoffset, hunkcount * 4))
+			return;
+	}
+
+	cache = new ReadAheadCache(this, hunkbytes, CHD_HUNK_CACHE_SIZE, CHD_PREFETCH_DEPTH);
+	error = false;
+}
+
+CDROM_Interface_Image::ChdFile::~ChdFile()
+{
+	delete cache;
+	delete[] scratch;
+	delete[] compressed;
+	delete[] map;
+	delete file;
+}
+
+bool CDROM_Interface_Image::ChdFile::readAt(Bit8u *dest, uint64_t offset, int count)
+{
+	file->clear();
+	file->seekg((streamoff)offset, ios::beg);
+	file->read((char *)dest, count);
+	return !file->fail();
+}
+
+/*Expand the v5 compressed map into 12 byte entries of
+  type, 24-bit length, 48-bit offset and 16-bit CRC*/
+bool CDROM_Interface_Image::ChdFile::decodeMap()
+{
+	Bit8u rawbuf[16];
+	chd_bitstream_t bs;
+	chd_huffman_t huff;
+	uint64_t last_self = 0, last_parent = 0;
+	int repcount = 0;
+	Bit8u lastcomp = 0;
+
+	if (!readAt(rawbuf, mapoffset, sizeof(rawbuf)))
+		return false;
+	Bit32u mapbytes = get_be32(&rawbuf[0]);
+	uint64_t curoffset = get_be48(&rawbuf[4]);
+	Bit16u mapcrc = get_be16(&rawbuf[10]);
+	int lengthbits = rawbuf[12];
+	int selfbits = rawbuf[13];
+	int parentbits = rawbuf[14];
+
+	vector<Bit8u> data(mapbytes);
+	if (mapbytes && !readAt(&data[0], mapoffset + 16, mapbytes))
+		return false;
+	memset(&bs, 0, sizeof(bs));
+	bs.data = mapbytes ? &data[0] : NULL;
+	bs.length = mapbytes;
+
+	if (!huffman_import_tree_rle(&huff, &bs))
+		return false;
+
+	for (Bit32u hunk = 0; hunk < hunkcount; hunk++) {
+		Bit8u *entry = &map[hunk * 12];
+
+		if (repcount > 0) {
+			entry[0] = lastcomp;
+			repcount--;
+		} else {
+			int val = huffman_decode_one(&huff, &bs);
+			if (val == COMPRESSION_RLE_SMALL) {
+				entry[0] = lastcomp;
+				repcount = 2 + huffman_decode_one(&huff, &bs);
+			} else if (val == COMPRESSION_RLE_LARGE) {
+				entry[0] = lastcomp;
+				repcount = 2 + 16 + (huffman_decode_one(&huff, &bs) << 4);
+				repcount += huffman_decode_one(&huff, &bs);
+			} else
+				entry[0] = lastcomp = val;
+		}
+	}
+
+	for (Bit32u hunk = 0; hunk < hunkcount; hunk++) {
+		Bit8u *entry = &map[hunk * 12];
+		uint64_t offset = curoffset;
+		Bit32u length = 0;
+		Bit16u crc = 0;
+
+		switch (entry[0]) {
+			case COMPRESSION_TYPE_0: case COMPRESSION_TYPE_1:
+			case COMPRESSION_TYPE_2: case COMPRESSION_TYPE_3:
+			length = bitstream_read(&bs, lengthbits);
+			curoffset += length;
+			crc = bitstream_read(&bs, 16);
+			break;
+
+			case COMPRESSION_NONE:
+			length = hunkbytes;
+			curoffset += length;
+			crc = bitstream_read(&bs, 16);
+			break;
+
+			case COMPRESSION_SELF:
+			last_self = offset = bitstream_read(&bs, selfbits);
+			break;
+
+			case COMPRESSION_PARENT:
+			last_parent = offset = bitstream_read(&bs, parentbits);
+			break;
+
+			case COMPRESSION_SELF_1:
+			last_self++;
+			/*Fallthrough*/
+			case COMPRESSION_SELF_0:
+			entry[0] = COMPRESSION_SELF;
+			offset = last_self;
+			break;
+
+			case COMPRESSION_PARENT_SELF:
+			entry[0] = COMPRESSION_PARENT;
+			last_parent = offset = ((uint64_t)hunk * hunkbytes) / unitbytes;
+			break;
+
+			case COMPRESSION_PARENT_1:
+			last_parent += hunkbytes / unitbytes;
+			/*Fallthrough*/
+			case COMPRESSION_PARENT_0:
+			entry[0] = COMPRESSION_PARENT;
+			offset = last_parent;
+			break;
+
+			default:
+			return false;
+		}
+		put_be24(&entry[1], length);
+		put_be48(&entry[4], offset);
+		put_be16(&entry[10], crc);
+	}
+
+	return crc16(map, hunkcount * 12) == mapcrc;
+}
+
+bool CDROM_Interface_Image::ChdFile::decompress(Bit32u codec, const Bit8u *src, int srclen, Bit8u *dest)
+{
+	switch (codec) {
+		case CHD_CODEC_ZLIB:
+		return chd_inflate(src, srclen, dest, hunkbytes);
+
+		case CHD_CODEC_LZMA:
+		return chd_unlzma(src, srclen, dest, hunkbytes, hunkbytes);
+
+		case CHD_CODEC_CD_ZLIB:
+		case CHD_CODEC_CD_LZMA:
+		{
+			/*Sector data and subcode are compressed separately, behind a
+			  header of one bit per frame flagging stripped sync/ECC and
+			  the compressed length of the sector data*/
+			int frames = hunkbytes / CD_FRAME_SIZE;
+			int complen_bytes = (hunkbytes < 65536) ? 2 : 3;
+			int ecc_bytes = (frames + 7) / 8;
+			int header_bytes = ecc_bytes + complen_bytes;
+			int complen_base;
+
+			if (srclen < header_bytes)
+				return false;
+			complen_base = (src[ecc_bytes] << 8) | src[ecc_bytes + 1];
+			if (complen_bytes > 2)
+				complen_base = (complen_base << 8) | src[ecc_bytes + 2];
+			if (header_bytes + complen_base > srclen)
+				return false;
+
+			if (codec == CHD_CODEC_CD_ZLIB) {
+				if (!chd_inflate(&src[header_bytes], complen_base, scratch, frames * RAW_SECTOR_SIZE))
+					return false;
+			} else {
+				if (!chd_unlzma(&src[header_bytes], complen_base, scratch, frames * RAW_SECTOR_SIZE, frames * RAW_SECTOR_SIZE))
+					return false;
+			}
+			if (!chd_inflate(&src[header_bytes + complen_base], srclen - header_bytes - complen_base,
+					 &scratch[frames * RAW_SECTOR_SIZE], frames * CD_SUBCODE_SIZE))
+				return false;
+
+			for (int c = 0; c < frames; c++) {
+				Bit8u *sector = &dest[c * CD_FRAME_SIZE];
+
+				memcpy(sector, &scratch[c * RAW_SECTOR_SIZE], RAW_SECTOR_SIZE);
+				memcpy(&sector[RAW_SECTOR_SIZE], &scratch[frames * RAW_SECTOR_SIZE + c * CD_SUBCODE_SIZE], CD_SUBCODE_SIZE);
+				if (src[c / 8] & (1 << (c % 8))) {
+					memcpy(sector, cd_sync_header, sizeof(cd_sync_header));
+					ecc_generate(sector);
+				}
+			}
+			return true;
+		}
+	}
+
+	/*FLAC, Huffman and zstd codecs are not supported*/
+	return false;
+}
+
+bool CDROM_Interface_Image::ChdFile::readHunk(Bit8u *dest, int hunk, int depth)
+{
+	if (hunk < 0 || (Bit32u)hunk >= hunkcount || depth > 16)
+		return false;
+
+	if (!compressors[0]) {
+		uint64_t offset = (uint64_t)get_be32(&map[hunk * 4]) * hunkbytes;
+
+		if (!offset) {
+			memset(dest, 0, hunkbytes);
+			return true;
+		}
+		return readAt(dest, offset, hunkbytes);
+	}
+
+	Bit8u *entry = &map[hunk * 12];
+	int length = get_be24(&entry[1]);
+	uint64_t offset = get_be48(&entry[4]);
+	Bit16u crc = get_be16(&entry[10]);
+
+	switch (entry[0]) {
+		case COMPRESSION_TYPE_0: case COMPRESSION_TYPE_1:
+		case COMPRESSION_TYPE_2: case COMPRESSION_TYPE_3:
+		if (length > (int)hunkbytes || !readAt(compressed, offset, length))
+			return false;
+		if (!decompress(compressors[entry[0]], compressed, length, dest))
+			return false;
+		return crc16(dest, hunkbytes) == crc;
+
+		case COMPRESSION_NONE:
+		if (!readAt(dest, offset, hunkbytes))
+			return false;
+		return crc16(dest, hunkbytes) == crc;
+
+		case COMPRESSION_SELF:
+		return readHunk(dest, (int)offset, depth + 1);
+	}
+	return false;
+}
+
+/* Called by the read-ahead cache, serialised on its io_mutex */
+int CDROM_Interface_Image::ChdFile::readBlock(Bit8u *dest, int hunk)
+{
+	if (!readHunk(dest, hunk, 0))
+		return 0;
+	return hunkbytes;
+}
+
+bool CDROM_Interface_Image::ChdFile::readFrame(Bit8u *buffer, int frame, int offset, int count)
+{
+	return cache->read(buffer, frame * CD_FRAME_SIZE + offset, count);
+}
+
+bool CDROM_Interface_Image::ChdFile::getMetadata(Bit32u tag, int index, string &data)
+{
+	uint64_t offset = metaoffset;
+	int count = 0;
+
+	/*Metadata is a chain of 16 byte headers - tag, flags, 24-bit length,
+	  offset of next entry - each followed by the data*/
+	while (offset) {
+		Bit8u header[16];
+
+		if (!readAt(header, offset, sizeof(header)))
+			return false;
+		if (get_be32(&header[0]) == tag && count++ == index) {
+			int length = get_be24(&header[5]);
+			vector<char> buf(length + 1);
+
+			if (length && !readAt((Bit8u *)&buf[0], offset + 16, length))
+				return false;
+			buf[length] = 0;
+			data = &buf[0];
+			return true;
+		}
+		offset = get_be64(&header[8]);
+	}
+	return false;
+}
+
+CDROM_Interface_Image::ChdTrackFile::ChdTrackFile(ChdFile *chd, int first_frame, int frames, int sectorSize, bool audio)
+	: chd(chd), first_frame(first_frame), frames(frames), sectorSize(sectorSize), audio(audio)
+{
+	chd->refcount++;
+}
+
+CDROM_Interface_Image::ChdTrackFile::~ChdTrackFile()
+{
+	if (!--chd->refcount)
+		delete chd;
+}
+
+bool CDROM_Interface_Image::ChdTrackFile::read(Bit8u *buffer, int seek, int count)
+{
+	if (seek < 0)
+		return false;
+
+	while (count > 0) {
+		int frame = seek / sectorSize;
+		int offset = seek % sectorSize;
+		int len = count;
+
+		if (frame >= frames)
+			return false;
+		if (len > sectorSize - offset)
+			len = sectorSize - offset;
+
+		if (audio) {
+			/*CHD stores audio samples big endian*/
+			Bit8u tmp[RAW_SECTOR_SIZE];
+
+			if (!chd->readFrame(tmp, first_frame + frame, 0, RAW_SECTOR_SIZE))
+				return false;
+			for (int c = 0; c < RAW_SECTOR_SIZE; c += 2) {
+				Bit8u t = tmp[c];
+				tmp[c] = tmp[c + 1];
+				tmp[c + 1] = t;
+			}
+			memcpy(buffer, &tmp[offset], len);
+		} else if (!chd->readFrame(buffer, first_frame + frame, offset, len))
+			return false;
+
+		buffer += len;
+		seek += len;
+		count -= len;
+	}
+	return true;
+}
+
+int CDROM_Interface_Image::ChdTrackFile::getLength()
+{
+	return frames * sectorSize;
+}
+
+bool CDROM_Interface_Image::LoadChdFile(char *filename)
+{
+	bool error;
+	ChdFile *chd = new ChdFile(filename, error);
+	int lba = 0, chd_frame = 0;
+
+	tracks.clear();
+	if (error) {
+		delete chd;
+		return false;
+	}
+
+	for (int i = 0; ; i++) {
+		Track track = {0, 0, 0, 0, 0, 0, 0, false, NULL};
+		string meta;
+		int number, frames, pregap = 0, postgap = 0;
+		char type[32], subtype[32], pgtype[32] = "", pgsub[32];
+
+		if (chd->getMetadata(CDROM_TRACK_METADATA2_TAG, i, meta)) {
+			if (sscanf(meta.c_str(), "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d PREGAP:%d PGTYPE:%31s PGSUB:%31s POSTGAP:%d",
+				   &number, type, subtype, &frames, &pregap, pgtype, pgsub, &postgap) != 8)
+				break;
+		} else if (chd->getMetadata(CDROM_TRACK_METADATA_TAG, i, meta)) {
+			if (sscanf(meta.c_str(), "TRACK:%d TYPE:%31s SUBTYPE:%31s FRAMES:%d",
+				   &number, type, subtype, &frames) != 4)
+				break;
+		} else
+			break;
+
+		string t(type);
+		track.attr = DATA_TRACK;
+		track.mode2 = false;
+		if (t == "AUDIO") {
+			track.sectorSize = RAW_SECTOR_SIZE;
+			track.attr = AUDIO_TRACK;
+		} else if (t == "MODE1" || t == "MODE1/2048" || t == "MODE2_FORM1" || t == "MODE2/2048")
+			track.sectorSize = COOKED_SECTOR_SIZE;
+		else if (t == "MODE1_RAW" || t == "MODE1/2352")
+			track.sectorSize = RAW_SECTOR_SIZE;
+		else if (t == "MODE2" || t == "MODE2/2336" || t == "MODE2_FORM_MIX") {
+			track.sectorSize = 2336;
+			track.mode2 = true;
+		} else if (t == "MODE2_RAW" || t == "MODE2/2352" || t == "CDI/2352") {
+			track.sectorSize = RAW_SECTOR_SIZE;
+			track.mode2 = true;
+		} else
+			break;
+
+		if (number != i + 1 || frames <= 0)
+			break;
+		track.number = number;
+		track.track_number = number;
+		track.file = new ChdTrackFile(chd, chd_frame, frames, track.sectorSize, track.attr == AUDIO_TRACK);
+		/*Pregap is only present in the image when its type starts with V*/
+		track.start = lba + pregap;
+		if (pgtype[0] == 'V') {
+			track.skip = pregap * track.sectorSize;
+			track.length = frames - pregap;
+		} else
+			track.length = frames;
+		tracks.push_back(track);
+
+		lba = track.start + track.length + postgap;
+		chd_frame += (frames + CD_TRACK_PADDING - 1) & ~(CD_TRACK_PADDING - 1);
+	}
+
+	if (tracks.empty()) {
+		delete chd;
+		return false;
+	}
+
+	// leadout track
+	Track track = {0, 0, 0, 0, 0, 0, 0, false, NULL};
+	track.number = (int)tracks.size() + 1;
+	track.track_number = 0xAA;
+	track.attr = 0;
+	track.start = lba;
+	tracks.push_back(track);
+
+	return true;
+}
+
+#endif
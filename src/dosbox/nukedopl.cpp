@@ -14,6 +14,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "nukedopl.h"
 
 #define RSM_FRAC    10
@@ -464,31 +467,6 @@ static void OPL3_EnvelopeGenRelease(opl3_slot *slot)
     slot->eg_rout += slot->eg_inc;
 }
 
-static void OPL3_EnvelopeCalc(opl3_slot *slot)
-{
-    Bit8u rate_h, rate_l;
-    Bit8u inc = 0;
-    rate_h = slot->eg_rate >> 2;
-    rate_l = slot->eg_rate & 3;
-    if (eg_incsh[rate_h] > 0)
-    {
-        if ((slot->chip->timer & ((1 << eg_incsh[rate_h]) - 1)) == 0)
-        {
-            inc = eg_incstep[eg_incdesc[rate_h]][rate_l]
-                            [((slot->chip->timer)>> eg_incsh[rate_h]) & 0x07];
-        }
-    }
-    else
-    {
-        inc = eg_incstep[eg_incdesc[rate_h]][rate_l]
-                        [slot->chip->timer & 0x07] << (-eg_incsh[rate_h]);
-    }
-    slot->eg_inc = inc;
-    slot->eg_out = slot->eg_rout + (slot->reg_tl << 2)
-                 + (slot->eg_ksl >> kslshift[slot->reg_ksl]) + *slot->trem;
-    envelope_gen[slot->eg_gen](slot);
-}
-
 static void OPL3_EnvelopeKeyOn(opl3_slot *slot, Bit8u type)
 {
     if (!slot->key)
@@ -519,44 +497,6 @@ static void OPL3_EnvelopeKeyOff(opl3_slot *slot, Bit8u type)
     }
 }
 
-//
-// Phase Generator
-//
-
-static void OPL3_PhaseGenerate(opl3_slot *slot)
-{
-    Bit16u f_num;
-    Bit32u basefreq;
-
-    f_num = slot->channel->f_num;
-    if (slot->reg_vib)
-    {
-        Bit8s range;
-        Bit8u vibpos;
-
-        range = (f_num >> 7) & 7;
-        vibpos = slot->chip->vibpos;
-
-        if (!(vibpos & 3))
-        {
-            range = 0;
-        }
-        else if (vibpos & 1)
-        {
-            range >>= 1;
-        }
-        range >>= slot->chip->vibshift;
-
-        if (vibpos & 4)
-        {
-            range = -range;
-        }
-        f_num += range;
-    }
-    basefreq = (f_num << slot->channel->block) >> 1;
-    slot->pg_phase += (basefreq * mt[slot->reg_mult]) >> 1;
-}
-
 //
 // Noise Generator
 //
@@ -640,17 +580,77 @@ static void OPL3_SlotGenerateZM(opl3_slot *slot)
     OPL3_SlotGeneratePhase(slot, (Bit16u)(slot->pg_phase >> 9));
 }
 
-static void OPL3_SlotCalcFB(opl3_slot *slot)
+//
+// Operator update
+//
+// Feedback, phase and envelope of an operator only depend on its own state
+// and on chip-wide values that are constant for the duration of a sample, so
+// they are run for all 36 operators up front in flat loops. Only waveform
+// generation, which follows the modulation chains, is left in channel order.
+//
+
+static Bit8u OPL3_EnvelopeCalcInc(Bit8u eg_rate, Bit16u timer)
 {
-    if (slot->channel->fb != 0x00)
+    Bit8u rate_h = eg_rate >> 2;
+    Bit8u rate_l = eg_rate & 3;
+    Bit8s shift = eg_incsh[rate_h];
+    const Bit8u *step = eg_incstep[eg_incdesc[rate_h]][rate_l];
+
+    if (shift > 0)
     {
-        slot->fbmod = (slot->prout + slot->out) >> (0x09 - slot->channel->fb);
+        return (timer & ((1 << shift) - 1)) ? 0
+             : step[(timer >> shift) & 0x07];
     }
-    else
+    return step[timer & 0x07] << (-shift);
+}
+
+static void OPL3_SlotsUpdate(opl3_chip *chip)
+{
+    Bit8u ii;
+    Bit8u vibpos = chip->vibpos;
+    Bit8u vibshift = (vibpos & 1) + chip->vibshift;
+    Bit16u vibmask = (vibpos & 3) ? 0xffff : 0;
+    Bit16u vibneg = (vibpos & 4) ? 0xffff : 0;
+    Bit16u timer = chip->timer;
+
+    for (ii = 0; ii < 36; ii++)
     {
-        slot->fbmod = 0;
+        opl3_slot *slot = &chip->slot[ii];
+        Bit16s fbmod = (slot->prout + slot->out) >> (0x09 - slot->channel->fb);
+
+        slot->fbmod = slot->channel->fb ? fbmod : 0;
+        slot->prout = slot->out;
+    }
+
+    for (ii = 0; ii < 36; ii++)
+    {
+        opl3_slot *slot = &chip->slot[ii];
+        Bit16u f_num = slot->channel->f_num;
+        Bit16u range = (((f_num >> 7) & 7) >> vibshift) & vibmask;
+        Bit32u basefreq;
+
+        range = (range ^ vibneg) - vibneg;
+        f_num += range & -(Bit16u)slot->reg_vib;
+        basefreq = (f_num << slot->channel->block) >> 1;
+        slot->pg_phase += (basefreq * mt[slot->reg_mult]) >> 1;
+    }
+
+    for (ii = 0; ii < 36; ii++)
+    {
+        opl3_slot *slot = &chip->slot[ii];
+
+        slot->eg_inc = OPL3_EnvelopeCalcInc(slot->eg_rate, timer);
+        slot->eg_out = slot->eg_rout + (slot->reg_tl << 2)
+                     + (slot->eg_ksl >> kslshift[slot->reg_ksl]) + *slot->trem;
+        if (slot->eg_gen != envelope_gen_num_off)
+        {
+            envelope_gen[slot->eg_gen](slot);
+        }
+        else
+        {
+            slot->eg_rout = 0x1ff;
+        }
     }
-    slot->prout = slot->out;
 }
 
 //
@@ -1018,7 +1018,14 @@ static Bit16s OPL3_ClipSample(Bit32s sample)
     return (Bit16s)sample;
 }
 
-static void OPL3_GenerateRhythm1(opl3_chip *chip)
+//hh tc phase bit
+static Bit16u OPL3_RhythmPhaseBit(Bit16u phase14, Bit16u phase17)
+{
+    return ((phase14 & 0x08) | (((phase14 >> 5) ^ phase14) & 0x04)
+         | (((phase17 >> 2) ^ phase17) & 0x08)) ? 0x01 : 0x00;
+}
+
+static void OPL3_GenerateRhythm1(opl3_chip *chip, Bit32u pg_phase17)
 {
     opl3_channel *channel6;
     opl3_channel *channel7;
@@ -1033,11 +1040,9 @@ static void OPL3_GenerateRhythm1(opl3_chip *chip)
     channel8 = &chip->channel[8];
     OPL3_SlotGenerate(channel6->slots[0]);
     phase14 = (channel7->slots[0]->pg_phase >> 9) & 0x3ff;
-    phase17 = (channel8->slots[1]->pg_phase >> 9) & 0x3ff;
+    phase17 = (pg_phase17 >> 9) & 0x3ff;
     phase = 0x00;
-    //hh tc phase bit
-    phasebit = ((phase14 & 0x08) | (((phase14 >> 5) ^ phase14) & 0x04)
-             | (((phase17 >> 2) ^ phase17) & 0x08)) ? 0x01 : 0x00;
+    phasebit = OPL3_RhythmPhaseBit(phase14, phase17);
     //hh
     phase = (phasebit << 9)
           | (0x34 << ((phasebit ^ (chip->noise & 0x01)) << 1));
@@ -1063,9 +1068,7 @@ static void OPL3_GenerateRhythm2(opl3_chip *chip)
     phase14 = (channel7->slots[0]->pg_phase >> 9) & 0x3ff;
     phase17 = (channel8->slots[1]->pg_phase >> 9) & 0x3ff;
     phase = 0x00;
-    //hh tc phase bit
-    phasebit = ((phase14 & 0x08) | (((phase14 >> 5) ^ phase14) & 0x04)
-             | (((phase17 >> 2) ^ phase17) & 0x08)) ? 0x01 : 0x00;
+    phasebit = OPL3_RhythmPhaseBit(phase14, phase17);
     //sd
     phase = (0x100 << ((phase14 >> 8) & 0x01)) ^ ((chip->noise & 0x01) << 8);
     OPL3_SlotGeneratePhase(channel7->slots[1], phase);
@@ -1074,32 +1077,554 @@ static void OPL3_GenerateRhythm2(opl3_chip *chip)
     OPL3_SlotGeneratePhase(channel8->slots[1], phase);
 }
 
+//
+// End of sample: noise, tremolo, vibrato and the envelope timer
+//
+
+static void OPL3_ChipAdvance(opl3_chip *chip)
+{
+    OPL3_NoiseGenerate(chip);
+
+    if ((chip->timer & 0x3f) == 0x3f)
+    {
+        chip->tremolopos = (chip->tremolopos + 1) % 210;
+    }
+    if (chip->tremolopos < 105)
+    {
+        chip->tremolo = chip->tremolopos >> chip->tremoloshift;
+    }
+    else
+    {
+        chip->tremolo = (210 - chip->tremolopos) >> chip->tremoloshift;
+    }
+
+    if ((chip->timer & 0x3ff) == 0x3ff)
+    {
+        chip->vibpos = (chip->vibpos + 1) & 7;
+    }
+
+    chip->timer++;
+}
+
+//
+// Operator lanes
+//
+// The SSE2 core keeps the operator state in chip->lanes while it is running.
+// OPL3_LanesLoad() copies it there from the slots before the first sample, and
+// OPL3_LanesStore() copies it back before a register write, which needs the
+// slots. Register writes come in bursts between samples, so this happens once
+// per burst rather than once per write.
+//
+
+static const Bit8u slot_lane[36] = {
+    0, 1, 2, 8, 9, 10, 16, 17, 18, 24, 25, 26, 32, 33, 34, 40, 41, 42,
+    3, 4, 5, 11, 12, 13, 19, 20, 21, 27, 28, 29, 35, 36, 37, 43, 44, 45
+};
+
+static void OPL3_LanesStore(opl3_chip *chip)
+{
+    struct opl3_slot_lanes *lanes = &chip->lanes;
+    Bit8u ii;
+
+    for (ii = 0; ii < 36; ii++)
+    {
+        opl3_slot *slot = &chip->slot[ii];
+        Bit8u lane = slot_lane[ii];
+
+        slot->out = lanes->val[opl3_val_out + lane];
+        slot->fbmod = lanes->val[opl3_val_fbmod + lane];
+        slot->prout = lanes->val[opl3_val_prout + lane];
+        slot->eg_rout = lanes->eg_rout[lane];
+        slot->eg_out = lanes->eg_out[lane];
+        slot->eg_inc = (Bit8u)lanes->eg_inc[lane];
+        slot->eg_gen = (Bit8u)lanes->eg_gen[lane];
+        slot->eg_rate = lanes->eg_rate[lane];
+        slot->pg_phase = lanes->pg_phase[lane];
+    }
+
+    chip->lanes_valid = 0;
+}
+
+#ifdef __SSE2__
+
+static const Bit8s lane_slot[OPL3_LANES] = {
+    0, 1, 2, 18, 19, 20, -1, -1, 3, 4, 5, 21, 22, 23, -1, -1,
+    6, 7, 8, 24, 25, 26, -1, -1, 9, 10, 11, 27, 28, 29, -1, -1,
+    12, 13, 14, 30, 31, 32, -1, -1, 15, 16, 17, 33, 34, 35, -1, -1
+};
+
+// Index in lanes->val of an out, fbmod or zeromod pointer. Outputs of slots
+// from prout_from on are read from prout, the value they had at the start of
+// the sample.
+static Bit16u OPL3_LanesIndex(opl3_chip *chip, Bit16s *ptr, Bit8u prout_from)
+{
+    Bit8u slotnum;
+
+    if (ptr == &chip->zeromod)
+    {
+        return opl3_val_zero;
+    }
+    slotnum = (Bit8u)(((char *)ptr - (char *)chip->slot) / sizeof(opl3_slot));
+    if (ptr == &chip->slot[slotnum].fbmod)
+    {
+        return opl3_val_fbmod + slot_lane[slotnum];
+    }
+    if (slotnum >= prout_from)
+    {
+        return opl3_val_prout + slot_lane[slotnum];
+    }
+    return opl3_val_out + slot_lane[slotnum];
+}
+
+static void OPL3_LanesLoad(opl3_chip *chip)
+{
+    struct opl3_slot_lanes *lanes = &chip->lanes;
+    Bit8u lane;
+    Bit8u ii;
+    Bit8u jj;
+
+    for (lane = 0; lane < OPL3_LANES; lane++)
+    {
+        opl3_slot *slot;
+        opl3_channel *channel;
+
+        if (lane_slot[lane] < 0)
+        {
+            lanes->val[opl3_val_out + lane] = 0;
+            lanes->val[opl3_val_fbmod + lane] = 0;
+            lanes->val[opl3_val_prout + lane] = 0;
+            lanes->eg_rout[lane] = 0x1ff;
+            lanes->eg_out[lane] = 0x1ff;
+            lanes->eg_inc[lane] = 0;
+            lanes->eg_gen[lane] = envelope_gen_num_off;
+            lanes->eg_base[lane] = 0;
+            lanes->eg_sl[lane] = 0;
+            lanes->eg_type[lane] = 0;
+            lanes->trem[lane] = 0;
+            lanes->fbmul[lane] = 0;
+            lanes->wf[lane] = 0;
+            lanes->mod[lane] = opl3_val_zero;
+            lanes->eg_rate[lane] = 0;
+            lanes->pg_phase[lane] = 0;
+            lanes->f_num[lane] = 0;
+            lanes->vib[lane] = 0;
+            lanes->freqmul[lane] = 0;
+            lanes->oddmul[lane] = 0;
+            continue;
+        }
+        slot = &chip->slot[lane_slot[lane]];
+        channel = slot->channel;
+        lanes->val[opl3_val_out + lane] = slot->out;
+        lanes->val[opl3_val_fbmod + lane] = slot->fbmod;
+        lanes->val[opl3_val_prout + lane] = slot->prout;
+        lanes->eg_rout[lane] = slot->eg_rout;
+        lanes->eg_out[lane] = slot->eg_out;
+        lanes->eg_inc[lane] = slot->eg_inc;
+        lanes->eg_gen[lane] = slot->eg_gen;
+        lanes->eg_base[lane] = (slot->reg_tl << 2)
+                             + (slot->eg_ksl >> kslshift[slot->reg_ksl]);
+        lanes->eg_sl[lane] = slot->reg_sl << 4;
+        lanes->eg_type[lane] = slot->reg_type ? ~0 : 0;
+        lanes->trem[lane] = (slot->trem == &chip->tremolo) ? ~0 : 0;
+        // x >> (9 - fb) is the high half of x * (1 << (7 + fb))
+        lanes->fbmul[lane] = channel->fb ? 1 << (7 + channel->fb) : 0;
+        lanes->wf[lane] = slot->reg_wf << 10;
+        lanes->mod[lane] = OPL3_LanesIndex(chip, slot->mod, 36);
+        lanes->eg_rate[lane] = slot->eg_rate;
+        lanes->pg_phase[lane] = slot->pg_phase;
+        lanes->f_num[lane] = channel->f_num;
+        lanes->vib[lane] = slot->reg_vib ? ~0 : 0;
+        lanes->freqmul[lane] = mt[slot->reg_mult] << channel->block;
+        lanes->oddmul[lane] = channel->block ? 0 : mt[slot->reg_mult];
+    }
+    lanes->val[opl3_val_zero] = 0;
+
+    // The hi-hat, snare drum and top cymbal get their phase from the rhythm
+    // code and the tom-tom is not modulated
+    if (chip->rhy & 0x20)
+    {
+        lanes->mod[slot_lane[13]] = opl3_val_zero;
+        lanes->mod[slot_lane[14]] = opl3_val_zero;
+        lanes->mod[slot_lane[16]] = opl3_val_zero;
+        lanes->mod[slot_lane[17]] = opl3_val_zero;
+    }
+
+    // The left mix is taken after slot 14 and the right one after slot 32
+    for (ii = 0; ii < 18; ii++)
+    {
+        for (jj = 0; jj < 4; jj++)
+        {
+            lanes->mix[0][ii][jj] = OPL3_LanesIndex(chip, chip->channel[ii].out[jj], 15);
+            lanes->mix[1][ii][jj] = OPL3_LanesIndex(chip, chip->channel[ii].out[jj], 33);
+        }
+        lanes->cha[ii] = chip->channel[ii].cha;
+        lanes->chb[ii] = chip->channel[ii].chb;
+    }
+
+    chip->lanes_valid = 1;
+}
+
+//
+// Waveform tables for the SSE2 core. opl3_wftab has the logsin value of each
+// waveform and phase, with bit 15 set if the output is negated, and
+// opl3_exptab has OPL3_EnvelopeCalcExp() of every level.
+//
+
+static Bit16u opl3_wftab[8 * 1024];
+static Bit16s opl3_exptab[0x2000];
+
+static void OPL3_LanesInitTables(void)
+{
+    Bit16u wf;
+    Bit16u phase;
+    Bit16u level;
+
+    for (wf = 0; wf < 8; wf++)
+    {
+        for (phase = 0; phase < 0x400; phase++)
+        {
+            Bit16u out = 0;
+            Bit16u neg = 0;
+            Bit16u sinout;
+            Bit16u sin2out;
+
+            if (phase & 0x100)
+            {
+                sinout = logsinrom[(phase & 0xff) ^ 0xff];
+            }
+            else
+            {
+                sinout = logsinrom[phase & 0xff];
+            }
+            if (phase & 0x80)
+            {
+                sin2out = logsinrom[((phase ^ 0xff) << 1) & 0xff];
+            }
+            else
+            {
+                sin2out = logsinrom[(phase << 1) & 0xff];
+            }
+
+            switch (wf)
+            {
+            case 0:
+                out = sinout;
+                neg = phase & 0x200;
+                break;
+            case 1:
+                out = (phase & 0x200) ? 0x1000 : sinout;
+                break;
+            case 2:
+                out = sinout;
+                break;
+            case 3:
+                out = (phase & 0x100) ? 0x1000 : logsinrom[phase & 0xff];
+                break;
+            case 4:
+                out = (phase & 0x200) ? 0x1000 : sin2out;
+                neg = (phase & 0x300) == 0x100;
+                break;
+            case 5:
+                out = (phase & 0x200) ? 0x1000 : sin2out;
+                break;
+            case 6:
+                out = 0;
+                neg = phase & 0x200;
+                break;
+            case 7:
+                if (phase & 0x200)
+                {
+                    out = ((phase & 0x1ff) ^ 0x1ff) << 3;
+                    neg = 1;
+                }
+                else
+                {
+                    out = phase << 3;
+                }
+                break;
+            }
+            opl3_wftab[(wf << 10) | phase] = out | (neg ? 0x8000 : 0);
+        }
+    }
+
+    for (level = 0; level < 0x2000; level++)
+    {
+        opl3_exptab[level] = OPL3_EnvelopeCalcExp(level);
+    }
+}
+
+// An envelope that has reached the end of its current stage
+static void OPL3_LanesEnvelopeNext(opl3_chip *chip, Bit8u lane)
+{
+    struct opl3_slot_lanes *lanes = &chip->lanes;
+    opl3_slot *slot = &chip->slot[lane_slot[lane]];
+
+    switch (lanes->eg_gen[lane])
+    {
+    case envelope_gen_num_attack:
+        slot->eg_gen = envelope_gen_num_decay;
+        break;
+    case envelope_gen_num_decay:
+        slot->eg_gen = envelope_gen_num_sustain;
+        break;
+    case envelope_gen_num_sustain:
+    case envelope_gen_num_release:
+        slot->eg_gen = envelope_gen_num_off;
+        lanes->eg_rout[lane] = 0x1ff;
+        break;
+    }
+    // The slot's rate registers are current, so its rate can be worked out
+    // there
+    OPL3_EnvelopeUpdateRate(slot);
+    lanes->eg_gen[lane] = slot->eg_gen;
+    lanes->eg_rate[lane] = slot->eg_rate;
+}
+
+// Sum of the channel outputs for one side, as in OPL3_Generate()
+static Bit32s OPL3_LanesMix(struct opl3_slot_lanes *lanes, Bit8u side, const Bit16u *chmask)
+{
+    Bit32s mix = 0;
+    Bit8u ii;
+
+    for (ii = 0; ii < 18; ii++)
+    {
+        const Bit16u *idx = lanes->mix[side][ii];
+        Bit16s accm = lanes->val[idx[0]];
+
+        accm += lanes->val[idx[1]];
+        accm += lanes->val[idx[2]];
+        accm += lanes->val[idx[3]];
+        mix += (Bit16s)(accm & chmask[ii]);
+    }
+    return mix;
+}
+
+// SSE2 version of OPL3_Generate(). Feedback, phase and envelope run on all
+// lanes at once, then the waveforms are generated one step at a time. SSE2
+// has no gathers, so the modulator and table reads are done per lane.
+static void OPL3_GenerateLanes(opl3_chip *chip, Bit16s *buf)
+{
+    struct opl3_slot_lanes *lanes = &chip->lanes;
+    Bit8u vibpos = chip->vibpos;
+    Bit16u timer = chip->timer;
+    Bit16u noise = chip->noise & 0x01;
+    Bit16u phase14;
+    Bit16u phase17;
+    Bit16u phasebit;
+    Bit8u lane;
+    Bit8u step;
+    __m128i vibshift = _mm_cvtsi32_si128((vibpos & 1) + chip->vibshift);
+    __m128i vibmask = _mm_set1_epi32((vibpos & 3) ? ~0 : 0);
+    __m128i vibneg = _mm_set1_epi32((vibpos & 4) ? ~0 : 0);
+    __m128i tremolo = _mm_set1_epi16(chip->tremolo);
+
+    if (!chip->lanes_valid)
+    {
+        OPL3_LanesLoad(chip);
+    }
+
+    buf[1] = OPL3_ClipSample(chip->mixbuff[1]);
+
+    // The hi-hat uses operator 17 as it was before this sample's phase update
+    phase17 = (lanes->pg_phase[slot_lane[17]] >> 9) & 0x3ff;
+
+    // Feedback
+    for (lane = 0; lane < OPL3_LANES; lane += 8)
+    {
+        __m128i out = _mm_loadu_si128((__m128i *)&lanes->val[opl3_val_out + lane]);
+        __m128i prout = _mm_loadu_si128((__m128i *)&lanes->val[opl3_val_prout + lane]);
+        __m128i fbmul = _mm_loadu_si128((__m128i *)&lanes->fbmul[lane]);
+
+        _mm_storeu_si128((__m128i *)&lanes->val[opl3_val_fbmod + lane],
+                         _mm_mulhi_epi16(_mm_add_epi16(prout, out), fbmul));
+        _mm_storeu_si128((__m128i *)&lanes->val[opl3_val_prout + lane], out);
+    }
+
+    // Phase. ((f_num << block) >> 1) * mt >> 1 is worked out as
+    // (f_num * freqmul - (f_num & 1) * oddmul) >> 2, where the multiply fits
+    // in 16 bits
+    for (lane = 0; lane < OPL3_LANES; lane += 4)
+    {
+        __m128i f_num = _mm_loadu_si128((__m128i *)&lanes->f_num[lane]);
+        __m128i range = _mm_and_si128(_mm_srli_epi32(f_num, 7), _mm_set1_epi32(7));
+        __m128i odd;
+        __m128i inc;
+
+        range = _mm_and_si128(_mm_srl_epi32(range, vibshift), vibmask);
+        range = _mm_sub_epi32(_mm_xor_si128(range, vibneg), vibneg);
+        f_num = _mm_add_epi32(f_num, _mm_and_si128(range, _mm_loadu_si128((__m128i *)&lanes->vib[lane])));
+        odd = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(f_num, _mm_set1_epi32(1)));
+        inc = _mm_madd_epi16(f_num, _mm_loadu_si128((__m128i *)&lanes->freqmul[lane]));
+        inc = _mm_sub_epi32(inc, _mm_and_si128(odd, _mm_loadu_si128((__m128i *)&lanes->oddmul[lane])));
+        _mm_storeu_si128((__m128i *)&lanes->pg_phase[lane],
+                         _mm_add_epi32(_mm_loadu_si128((__m128i *)&lanes->pg_phase[lane]),
+                                       _mm_srli_epi32(inc, 2)));
+    }
+
+    // Envelope
+    for (lane = 0; lane < OPL3_LANES; lane++)
+    {
+        lanes->eg_inc[lane] = OPL3_EnvelopeCalcInc(lanes->eg_rate[lane], timer);
+    }
+    for (lane = 0; lane < OPL3_LANES; lane += 8)
+    {
+        __m128i rout = _mm_loadu_si128((__m128i *)&lanes->eg_rout[lane]);
+        __m128i inc = _mm_loadu_si128((__m128i *)&lanes->eg_inc[lane]);
+        __m128i gen = _mm_loadu_si128((__m128i *)&lanes->eg_gen[lane]);
+        __m128i sl = _mm_loadu_si128((__m128i *)&lanes->eg_sl[lane]);
+        __m128i type = _mm_loadu_si128((__m128i *)&lanes->eg_type[lane]);
+        __m128i trem = _mm_and_si128(tremolo, _mm_loadu_si128((__m128i *)&lanes->trem[lane]));
+        __m128i is_attack = _mm_cmpeq_epi16(gen, _mm_set1_epi16(envelope_gen_num_attack));
+        __m128i is_decay = _mm_cmpeq_epi16(gen, _mm_set1_epi16(envelope_gen_num_decay));
+        __m128i is_sustain = _mm_cmpeq_epi16(gen, _mm_set1_epi16(envelope_gen_num_sustain));
+        __m128i is_release = _mm_cmpeq_epi16(gen, _mm_set1_epi16(envelope_gen_num_release));
+        __m128i is_off = _mm_cmpeq_epi16(gen, _mm_set1_epi16(envelope_gen_num_off));
+        __m128i attack;
+        __m128i rise;
+        __m128i next;
+        __m128i end;
+        int done;
+
+        _mm_storeu_si128((__m128i *)&lanes->eg_out[lane],
+                         _mm_add_epi16(_mm_add_epi16(rout, _mm_loadu_si128((__m128i *)&lanes->eg_base[lane])), trem));
+
+        // A held sustain behaves as release
+        is_release = _mm_or_si128(is_release, _mm_andnot_si128(type, is_sustain));
+        attack = _mm_mullo_epi16(_mm_xor_si128(rout, _mm_set1_epi16(-1)), inc);
+        attack = _mm_max_epi16(_mm_add_epi16(rout, _mm_srai_epi16(attack, 3)), _mm_setzero_si128());
+        rise = _mm_add_epi16(rout, inc);
+
+        end = _mm_or_si128(_mm_or_si128(
+                  _mm_and_si128(is_attack, _mm_cmpeq_epi16(rout, _mm_setzero_si128())),
+                  _mm_andnot_si128(_mm_cmpgt_epi16(sl, rout), is_decay)),
+                  _mm_andnot_si128(_mm_cmpgt_epi16(_mm_set1_epi16(0x1ff), rout), is_release));
+
+        next = _mm_or_si128(_mm_and_si128(is_attack, attack),
+                            _mm_and_si128(_mm_or_si128(is_decay, is_release), rise));
+        next = _mm_or_si128(next, _mm_and_si128(is_off, _mm_set1_epi16(0x1ff)));
+        next = _mm_or_si128(next, _mm_andnot_si128(_mm_or_si128(_mm_or_si128(is_attack, is_decay),
+                                                                 _mm_or_si128(is_release, is_off)), rout));
+        // Envelopes at the end of a stage keep their level and move on to
+        // the next one
+        next = _mm_or_si128(_mm_and_si128(end, rout), _mm_andnot_si128(end, next));
+        _mm_storeu_si128((__m128i *)&lanes->eg_rout[lane], next);
+
+        done = _mm_movemask_epi8(end);
+        if (done)
+        {
+            Bit8u ii;
+
+            for (ii = 0; ii < 8; ii++)
+            {
+                if (done & (1 << (ii * 2)))
+                {
+                    OPL3_LanesEnvelopeNext(chip, lane + ii);
+                }
+            }
+        }
+    }
+
+    // Waveforms
+    for (step = 0; step < OPL3_LANES / 8; step++)
+    {
+        const Bit16u *mod = &lanes->mod[step * 8];
+        const Bit32u *pg_phase = &lanes->pg_phase[step * 8];
+        __m128i phase = _mm_packs_epi32(
+            _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((__m128i *)pg_phase), 9), _mm_set1_epi32(0x3ff)),
+            _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((__m128i *)(pg_phase + 4)), 9), _mm_set1_epi32(0x3ff)));
+        __m128i wf;
+        __m128i level;
+        __m128i out;
+
+        phase = _mm_add_epi16(phase, _mm_setr_epi16(lanes->val[mod[0]], lanes->val[mod[1]],
+                                                    lanes->val[mod[2]], lanes->val[mod[3]],
+                                                    lanes->val[mod[4]], lanes->val[mod[5]],
+                                                    lanes->val[mod[6]], lanes->val[mod[7]]));
+        if (chip->rhy & 0x20)
+        {
+            // Slots 13 and 14 are lanes 1 and 2 of step 4, slots 16 and 17
+            // lanes 1 and 2 of step 5
+            if (step == 4)
+            {
+                //hh
+                phase14 = (lanes->pg_phase[slot_lane[13]] >> 9) & 0x3ff;
+                phasebit = OPL3_RhythmPhaseBit(phase14, phase17);
+                phase = _mm_insert_epi16(phase, (phasebit << 9)
+                                       | (0x34 << ((phasebit ^ noise) << 1)), 1);
+            }
+            else if (step == 5)
+            {
+                phase14 = (lanes->pg_phase[slot_lane[13]] >> 9) & 0x3ff;
+                phasebit = OPL3_RhythmPhaseBit(phase14, (lanes->pg_phase[slot_lane[17]] >> 9) & 0x3ff);
+                //sd
+                phase = _mm_insert_epi16(phase, (0x100 << ((phase14 >> 8) & 0x01)) ^ (noise << 8), 1);
+                //tc
+                phase = _mm_insert_epi16(phase, 0x100 | (phasebit << 9), 2);
+            }
+        }
+        phase = _mm_or_si128(_mm_and_si128(phase, _mm_set1_epi16(0x3ff)),
+                             _mm_loadu_si128((__m128i *)&lanes->wf[step * 8]));
+
+        wf = _mm_setr_epi16(opl3_wftab[_mm_extract_epi16(phase, 0)], opl3_wftab[_mm_extract_epi16(phase, 1)],
+                            opl3_wftab[_mm_extract_epi16(phase, 2)], opl3_wftab[_mm_extract_epi16(phase, 3)],
+                            opl3_wftab[_mm_extract_epi16(phase, 4)], opl3_wftab[_mm_extract_epi16(phase, 5)],
+                            opl3_wftab[_mm_extract_epi16(phase, 6)], opl3_wftab[_mm_extract_epi16(phase, 7)]);
+        level = _mm_add_epi16(_mm_and_si128(wf, _mm_set1_epi16(0x1fff)),
+                              _mm_slli_epi16(_mm_loadu_si128((__m128i *)&lanes->eg_out[step * 8]), 3));
+        level = _mm_min_epi16(level, _mm_set1_epi16(0x1fff));
+
+        out = _mm_setr_epi16(opl3_exptab[_mm_extract_epi16(level, 0)], opl3_exptab[_mm_extract_epi16(level, 1)],
+                             opl3_exptab[_mm_extract_epi16(level, 2)], opl3_exptab[_mm_extract_epi16(level, 3)],
+                             opl3_exptab[_mm_extract_epi16(level, 4)], opl3_exptab[_mm_extract_epi16(level, 5)],
+                             opl3_exptab[_mm_extract_epi16(level, 6)], opl3_exptab[_mm_extract_epi16(level, 7)]);
+        out = _mm_xor_si128(out, _mm_srai_epi16(wf, 15));
+        _mm_storeu_si128((__m128i *)&lanes->val[opl3_val_out + step * 8], out);
+    }
+
+    chip->mixbuff[0] = OPL3_LanesMix(lanes, 0, lanes->cha);
+    buf[0] = OPL3_ClipSample(chip->mixbuff[0]);
+    chip->mixbuff[1] = OPL3_LanesMix(lanes, 1, lanes->chb);
+
+    OPL3_ChipAdvance(chip);
+}
+
+#endif
+
 void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 {
     Bit8u ii;
     Bit8u jj;
     Bit16s accm;
+    Bit32u pg_phase17;
+
+#ifdef __SSE2__
+    if (!chip->scalar)
+    {
+        OPL3_GenerateLanes(chip, buf);
+        return;
+    }
+#endif
+    if (chip->lanes_valid)
+    {
+        OPL3_LanesStore(chip);
+    }
+
+    // The hi-hat/cymbal phase uses operator 17 as it was before this
+    // sample's phase update
+    pg_phase17 = chip->slot[17].pg_phase;
 
     buf[1] = OPL3_ClipSample(chip->mixbuff[1]);
 
+    OPL3_SlotsUpdate(chip);
+
     for (ii = 0; ii < 12; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
         OPL3_SlotGenerate(&chip->slot[ii]);
     }
 
-    for (ii = 12; ii < 15; ii++)
-    {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-    }
-
     if (chip->rhy & 0x20)
     {
-        OPL3_GenerateRhythm1(chip);
+        OPL3_GenerateRhythm1(chip, pg_phase17);
     }
     else
     {
@@ -1119,13 +1644,6 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
         chip->mixbuff[0] += (Bit16s)(accm & chip->channel[ii].cha);
     }
 
-    for (ii = 15; ii < 18; ii++)
-    {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
-    }
-
     if (chip->rhy & 0x20)
     {
         OPL3_GenerateRhythm2(chip);
@@ -1141,9 +1659,6 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 18; ii < 33; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
         OPL3_SlotGenerate(&chip->slot[ii]);
     }
 
@@ -1160,33 +1675,10 @@ void OPL3_Generate(opl3_chip *chip, Bit16s *buf)
 
     for (ii = 33; ii < 36; ii++)
     {
-        OPL3_SlotCalcFB(&chip->slot[ii]);
-        OPL3_PhaseGenerate(&chip->slot[ii]);
-        OPL3_EnvelopeCalc(&chip->slot[ii]);
         OPL3_SlotGenerate(&chip->slot[ii]);
     }
 
-    OPL3_NoiseGenerate(chip);
-
-    if ((chip->timer & 0x3f) == 0x3f)
-    {
-        chip->tremolopos = (chip->tremolopos + 1) % 210;
-    }
-    if (chip->tremolopos < 105)
-    {
-        chip->tremolo = chip->tremolopos >> chip->tremoloshift;
-    }
-    else
-    {
-        chip->tremolo = (210 - chip->tremolopos) >> chip->tremoloshift;
-    }
-
-    if ((chip->timer & 0x3ff) == 0x3ff)
-    {
-        chip->vibpos = (chip->vibpos + 1) & 7;
-    }
-
-    chip->timer++;
+    OPL3_ChipAdvance(chip);
 }
 
 void OPL3_GenerateResampled(opl3_chip *chip, Bit16s *buf)
@@ -1210,6 +1702,15 @@ void OPL3_Reset(opl3_chip *chip, Bit32u samplerate)
     Bit8u slotnum;
     Bit8u channum;
 
+#ifdef __SSE2__
+    static Bit8u tables_init = 0;
+
+    if (!tables_init)
+    {
+        OPL3_LanesInitTables();
+        tables_init = 1;
+    }
+#endif
     memset(chip, 0, sizeof(opl3_chip));
     for (slotnum = 0; slotnum < 36; slotnum++)
     {
@@ -1264,6 +1765,10 @@ void OPL3_WriteReg(opl3_chip *chip, Bit16u reg, Bit8u v)
 {
     Bit8u high = (reg >> 8) & 0x01;
     Bit8u regm = reg & 0xff;
+    if (chip->lanes_valid)
+    {
+        OPL3_LanesStore(chip);
+    }
     switch (regm & 0xf0)
     {
     case 0x00:
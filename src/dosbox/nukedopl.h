@@ -23,9 +23,9 @@ typedef uint16_t Bit16u;
 typedef int32_t  Bit32s;
 typedef uint32_t Bit32u;
 
-struct opl3_chip;
-struct opl3_slot;
-struct opl3_channel;
+typedef struct opl3_chip opl3_chip;
+typedef struct opl3_slot opl3_slot;
+typedef struct opl3_channel opl3_channel;
 
 struct opl3_slot {
     opl3_channel *channel;
@@ -72,6 +72,47 @@ struct opl3_channel {
     Bit16u cha, chb;
 };
 
+// Operator state in structure of arrays form, for the SSE2 core. Lanes are
+// grouped in steps of 8 : lanes 0-2 of step n hold slots 3n to 3n+2, lanes 3-5
+// slots 18+3n to 18+3n+2 and lanes 6-7 are unused. A slot is only modulated by
+// slots of earlier steps, so each step can be generated at once.
+
+#define OPL3_LANES 48
+
+enum {
+    opl3_val_out = 0,
+    opl3_val_fbmod = OPL3_LANES,
+    opl3_val_prout = OPL3_LANES * 2,
+    opl3_val_zero = OPL3_LANES * 3
+};
+
+struct opl3_slot_lanes {
+    // out, fbmod and prout of each lane, then zero, indexed by mod and mix
+    Bit16s val[OPL3_LANES * 3 + 8];
+    Bit16s eg_rout[OPL3_LANES];
+    Bit16s eg_out[OPL3_LANES];
+    Bit16s eg_inc[OPL3_LANES];
+    Bit16s eg_gen[OPL3_LANES];
+    Bit16s eg_base[OPL3_LANES];
+    Bit16s eg_sl[OPL3_LANES];
+    Bit16s eg_type[OPL3_LANES];
+    Bit16s trem[OPL3_LANES];
+    Bit16s fbmul[OPL3_LANES];
+    Bit16u wf[OPL3_LANES];
+    Bit16u mod[OPL3_LANES];
+    Bit8u eg_rate[OPL3_LANES];
+    Bit32u pg_phase[OPL3_LANES];
+    Bit32s f_num[OPL3_LANES];
+    Bit32s vib[OPL3_LANES];
+    // (1 << block) * mt[reg_mult], and mt[reg_mult] if block is 0
+    Bit32s freqmul[OPL3_LANES];
+    Bit32s oddmul[OPL3_LANES];
+    // Channel outputs for the left and right mixes
+    Bit16u mix[2][18][4];
+    Bit16u cha[18];
+    Bit16u chb[18];
+};
+
 struct opl3_chip {
     opl3_channel channel[18];
     opl3_slot slot[36];
@@ -92,12 +133,24 @@ struct opl3_chip {
     Bit32s samplecnt;
     Bit16s oldsamples[2];
     Bit16s samples[2];
+
+    // Use the scalar core instead of the SSE2 one. Both give the same output.
+    Bit8u scalar;
+    // Set while the operator state lives in lanes rather than in slot
+    Bit8u lanes_valid;
+    struct opl3_slot_lanes lanes;
 };
 
+#ifdef __cplusplus
+extern "C" {
+#endif
 //void OPL3_Generate(opl3_chip *chip, Bit16s *buf);
 //void OPL3_GenerateResampled(opl3_chip *chip, Bit16s *buf);
 void OPL3_Reset(opl3_chip *chip, Bit32u samplerate);
 Bit32u OPL3_WriteAddr(opl3_chip *chip, Bit32u port, Bit8u val);
 void OPL3_WriteReg(opl3_chip *chip, Bit16u reg, Bit8u v);
 void OPL3_GenerateStream(opl3_chip *chip, Bit16s *sndptr, Bit32u numsamples);
+#ifdef __cplusplus
+}
+#endif
 #endif
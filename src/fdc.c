@@ -9,6 +9,7 @@
 #include "fdd.h"
 #include "io.h"
 #include "pic.h"
+#include "savestate.h"
 #include "timer.h"
 #include "x86.h"
 
@@ -1370,6 +1371,52 @@ void fdc_init()
 	fdc.fifo = fdc.tfifo = 0;
 }
 
+/*The drive and image state is stored along with the controller, as an
+  operation in progress spans all three. Only sector based images (.IMG etc)
+  can be restored mid-operation*/
+void fdc_save_state(savestate_t *s)
+{
+        savestate_begin_section(s, "fdc");
+        savestate_write(s, &fdc, sizeof(FDC));
+        savestate_write_timer(s, &fdc.timer);
+        savestate_write_timer(s, &fdc.watchdog_timer);
+        savestate_write(s, &fdc_reset_stat, sizeof(fdc_reset_stat));
+        savestate_write(s, &lastbyte, sizeof(lastbyte));
+        savestate_write(s, &disc_3f7, sizeof(disc_3f7));
+        savestate_write(s, discrate, sizeof(discrate));
+        savestate_write(s, &discint, sizeof(discint));
+        savestate_write(s, &bit_rate, sizeof(bit_rate));
+        savestate_write(s, &paramstogo, sizeof(paramstogo));
+        disc_save_state(s);
+        fdd_save_state(s);
+        disc_sector_save_state(s);
+        savestate_end_section(s);
+}
+
+void fdc_load_state(savestate_t *s)
+{
+        FDC temp;
+
+        if (savestate_open_section(s, "fdc"))
+                return;
+        savestate_read(s, &temp, sizeof(FDC));
+        temp.timer = fdc.timer;
+        temp.watchdog_timer = fdc.watchdog_timer;
+        fdc = temp;
+        savestate_read_timer(s, &fdc.timer);
+        savestate_read_timer(s, &fdc.watchdog_timer);
+        savestate_read(s, &fdc_reset_stat, sizeof(fdc_reset_stat));
+        savestate_read(s, &lastbyte, sizeof(lastbyte));
+        savestate_read(s, &disc_3f7, sizeof(disc_3f7));
+        savestate_read(s, discrate, sizeof(discrate));
+        savestate_read(s, &discint, sizeof(discint));
+        savestate_read(s, &bit_rate, sizeof(bit_rate));
+        savestate_read(s, &paramstogo, sizeof(paramstogo));
+        disc_load_state(s);
+        fdd_load_state(s);
+        disc_sector_load_state(s);
+}
+
 void fdc_add()
 {
         io_sethandler(0x03f0, 0x0006, fdc_read, NULL, NULL, fdc_write, NULL, NULL, NULL);
@@ -1,4 +1,7 @@
 void fdc_init();
+struct savestate_t;
+void fdc_save_state(struct savestate_t *s);
+void fdc_load_state(struct savestate_t *s);
 void fdc_add();
 void fdc_add_pcjr();
 void fdc_add_tandy();
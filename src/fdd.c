@@ -2,6 +2,7 @@
 #include "disc.h"
 #include "fdc.h"
 #include "fdd.h"
+#include "savestate.h"
 
 static struct
 {
@@ -99,6 +100,21 @@ uint64_t fdd_seek(int drive, int track_diff)
         return 1000 * TIMER_USEC;
 }
 
+void fdd_save_state(savestate_t *s)
+{
+        savestate_write(s, fdd, sizeof(fdd));
+}
+
+void fdd_load_state(savestate_t *s)
+{
+        int c;
+
+        savestate_read(s, fdd, sizeof(fdd));
+        /*Reload the track data for the restored head positions*/
+        for (c = 0; c < 2; c++)
+                disc_seek(c, fdd[c].track);
+}
+
 void fdd_disc_changed(int drive)
 {
         drive ^= fdd_swap;
@@ -8,6 +8,9 @@ int fdd_doublestep_40(int drive);
 int fdd_is_525(int drive);
 int fdd_is_ed(int drive);
 void fdd_disc_changed(int drive);
+struct savestate_t;
+void fdd_save_state(struct savestate_t *s);
+void fdd_load_state(struct savestate_t *s);
 
 void fdd_set_type(int drive, int type);
 int fdd_get_type(int drive);
@@ -0,0 +1,179 @@
+#include "ibm.h"
+#include "filters.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const biquad_coef_t low_iir_coef =
+{
+        {0.00049713569693400649, 0.00099427139386801299, 0.00049713569693400649},
+        {1.00000000000000000000, -1.93522955470669530000, 0.93726236021404663000}
+};
+const biquad_coef_t low_cut_iir_coef =
+{
+        {0.96839970114733542000, -1.93679940229467080000, 0.96839970114733542000},
+        {1.00000000000000000000, -1.93522955471202770000, 0.93726236021916731000}
+};
+const biquad_coef_t high_iir_coef =
+{
+        {0.72248704753064896000, -1.44497409506129790000, 0.72248704753064896000},
+        {1.00000000000000000000, -1.36640781670578510000, 0.52352474706139873000}
+};
+const biquad_coef_t high_cut_iir_coef =
+{
+        {0.03927726802250377400, 0.07855453604500754700, 0.03927726802250377400},
+        {1.00000000000000000000, -1.36640781666419950000, 0.52352474703279628000}
+};
+const biquad_coef_t sb_iir_coef =
+{
+        {0.03356837051492005100, 0.06713674102984010200, 0.03356837051492005100},
+        {1.00000000000000000000, -1.41898265221812010000, 0.55326988968868285000}
+};
+const biquad_coef_t adgold_highpass_iir_coef =
+{
+        {0.98657437157334349000, -1.97314874314668700000, 0.98657437157334349000},
+        {1.00000000000000000000, -1.97223372919758360000, 0.97261396931534050000}
+};
+const biquad_coef_t adgold_lowpass_iir_coef =
+{
+        {0.00009159473951071446, 0.00018318947902142891, 0.00009159473951071446},
+        {1.00000000000000000000, -1.97223372919526560000, 0.97261396931306277000}
+};
+const biquad_coef_t adgold_pseudo_stereo_iir_coef =
+{
+        {0.00001409030866231767, 0.00002818061732463533, 0.00001409030866231767},
+        {1.00000000000000000000, -1.98733021473466760000, 0.98738361004063568000}
+};
+const biquad_coef_t dss_iir_coef =
+{
+        {0.03356837051492005100, 0.06713674102984010200, 0.03356837051492005100},
+        {1.00000000000000000000, -1.41898265221812010000, 0.55326988968868285000}
+};
+const biquad_coef_t dac_iir_coef =
+{
+        {0.99901119820285345000, -0.99901119820285345000, 0.0},
+        {1.00000000000000000000, -0.99869185905052738000, 0.0}
+};
+
+/*Terms are accumulated in the same order as the original per-sample filters,
+  so the SIMD and scalar paths produce identical output*/
+static inline float biquad_sample(biquad_t *f, const biquad_coef_t *coef, int i, float x0)
+{
+        float y0;
+
+        y0 = coef->a[0] * x0;
+        y0 += coef->a[1] * f->x1[i] - coef->b[1] * f->y1[i];
+        y0 += coef->a[2] * f->x2[i] - coef->b[2] * f->y2[i];
+
+        f->x2[i] = f->x1[i];
+        f->x1[i] = x0;
+        f->y2[i] = f->y1[i];
+        f->y1[i] = y0;
+
+        return y0;
+}
+
+#ifdef __SSE2__
+/*Stereo frames live in the low two lanes*/
+static inline __m128 filter_load2(const float *p)
+{
+        return _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)p);
+}
+static inline void filter_store2(float *p, __m128 v)
+{
+        _mm_storel_pi((__m64 *)p, v);
+}
+#endif
+
+void biquad_process_stereo(biquad_t *f, const biquad_coef_t *coef, float *buf, int len)
+{
+#ifdef __SSE2__
+        __m128 a0 = _mm_set1_ps(coef->a[0]), a1 = _mm_set1_ps(coef->a[1]), a2 = _mm_set1_ps(coef->a[2]);
+        __m128 b1 = _mm_set1_ps(coef->b[1]), b2 = _mm_set1_ps(coef->b[2]);
+        __m128 x1 = filter_load2(f->x1), x2 = filter_load2(f->x2);
+        __m128 y1 = filter_load2(f->y1), y2 = filter_load2(f->y2);
+        int c;
+
+        for (c = 0; c < len; c++)
+        {
+                __m128 x0 = filter_load2(&buf[c * 2]);
+                __m128 y0;
+
+                y0 = _mm_mul_ps(a0, x0);
+                y0 = _mm_add_ps(y0, _mm_sub_ps(_mm_mul_ps(a1, x1), _mm_mul_ps(b1, y1)));
+                y0 = _mm_add_ps(y0, _mm_sub_ps(_mm_mul_ps(a2, x2), _mm_mul_ps(b2, y2)));
+                filter_store2(&buf[c * 2], y0);
+
+                x2 = x1;
+                x1 = x0;
+                y2 = y1;
+                y1 = y0;
+        }
+
+        filter_store2(f->x1, x1);
+        filter_store2(f->x2, x2);
+        filter_store2(f->y1, y1);
+        filter_store2(f->y2, y2);
+#else
+        int c;
+
+        for (c = 0; c < len; c++)
+        {
+                buf[c * 2]     = biquad_sample(f, coef, 0, buf[c * 2]);
+                buf[c * 2 + 1] = biquad_sample(f, coef, 1, buf[c * 2 + 1]);
+        }
+#endif
+}
+
+void biquad_process_mono(biquad_t *f, const biquad_coef_t *coef, float *buf, int len)
+{
+        int c;
+
+        for (c = 0; c < len; c++)
+                buf[c] = biquad_sample(f, coef, 0, buf[c]);
+}
+
+void low_fir_sb16_process(fir_sb16_t *f, float *buf, int len)
+{
+        int c, n;
+
+        for (c = 0; c < len; c++)
+        {
+                int pos = f->pos;
+#ifdef __SSE2__
+                __m128 out = _mm_setzero_ps();
+
+                f->x[pos][0] = buf[c * 2];
+                f->x[pos][1] = buf[c * 2 + 1];
+
+                for (n = 0; n < ((SB16_NCoef+1)-pos) && n < SB16_NCoef; n++)
+                        out = _mm_add_ps(out, _mm_mul_ps(_mm_set1_ps(low_fir_sb16_coef[n]), filter_load2(f->x[n+pos])));
+                for (; n < SB16_NCoef; n++)
+                        out = _mm_add_ps(out, _mm_mul_ps(_mm_set1_ps(low_fir_sb16_coef[n]), filter_load2(f->x[(n+pos) - (SB16_NCoef+1)])));
+
+                filter_store2(&buf[c * 2], out);
+#else
+                float out_l = 0.0, out_r = 0.0;
+
+                f->x[pos][0] = buf[c * 2];
+                f->x[pos][1] = buf[c * 2 + 1];
+
+                for (n = 0; n < ((SB16_NCoef+1)-pos) && n < SB16_NCoef; n++)
+                {
+                        out_l += low_fir_sb16_coef[n] * f->x[n+pos][0];
+                        out_r += low_fir_sb16_coef[n] * f->x[n+pos][1];
+                }
+                for (; n < SB16_NCoef; n++)
+                {
+                        out_l += low_fir_sb16_coef[n] * f->x[(n+pos) - (SB16_NCoef+1)][0];
+                        out_r += low_fir_sb16_coef[n] * f->x[(n+pos) - (SB16_NCoef+1)][1];
+                }
+
+                buf[c * 2]     = out_l;
+                buf[c * 2 + 1] = out_r;
+#endif
+                f->pos++;
+                if (f->pos > SB16_NCoef)
+                        f->pos = 0;
+        }
+}
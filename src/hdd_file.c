@@ -2,9 +2,11 @@
 #define _LARGEFILE64_SOURCE
 #define _GNU_SOURCE
 #include <errno.h>
+#include <stdlib.h>
 
 #include "ibm.h"
 #include "hdd_file.h"
+#include "profiler.h"
 #include "minivhd/minivhd.h"
 #include "minivhd/minivhd_util.h"
 
@@ -14,13 +16,65 @@
 #define fopen64 fopen
 #define off64_t off_t
 #endif
+#if defined(__APPLE__) || defined(_WIN32)
+#define tmpfile64 tmpfile
+#endif
+
+int hdd_overlay = 0;
+
+static void hdd_overlay_open(hdd_file_t *hdd)
+{
+        hdd->overlay = tmpfile64();
+        if (!hdd->overlay)
+        {
+                pclog("Cannot create hard disk overlay: %s", strerror(errno));
+                hdd->read_only = 1;
+                return;
+        }
+        hdd->overlay_map = malloc((hdd->sectors + 7) / 8);
+        memset(hdd->overlay_map, 0, (hdd->sectors + 7) / 8);
+}
+
+static inline int hdd_overlay_present(hdd_file_t *hdd, int sector)
+{
+        return (hdd->overlay_map[sector >> 3] >> (sector & 7)) & 1;
+}
+
+/*Read runs of sectors from the overlay or the image, whichever holds them*/
+static void hdd_overlay_read(hdd_file_t *hdd, int offset, int nr_sectors, uint8_t *buffer)
+{
+        while (nr_sectors)
+        {
+                int in_overlay = hdd_overlay_present(hdd, offset);
+                int run = 1;
+
+                while (run < nr_sectors && hdd_overlay_present(hdd, offset + run) == in_overlay)
+                        run++;
+
+                fseeko64(in_overlay ? hdd->overlay : (FILE*)hdd->f, (off64_t)offset * 512, SEEK_SET);
+                fread(buffer, run*512, 1, in_overlay ? hdd->overlay : (FILE*)hdd->f);
+
+                offset += run;
+                nr_sectors -= run;
+                buffer += run*512;
+        }
+}
+
+/*The overlay is a sparse file with sectors at the same offset as the image*/
+static void hdd_overlay_mark(hdd_file_t *hdd, int offset, int nr_sectors)
+{
+        int c;
+
+        for (c = offset; c < offset + nr_sectors; c++)
+                hdd->overlay_map[c >> 3] |= 1 << (c & 7);
+}
 
 void hdd_load_ext(hdd_file_t *hdd, const char *fn, int spt, int hpc, int tracks, int read_only)
 {
 	if (hdd->f == NULL)
         {
 		/* Try to open existing hard disk image */
-		if (read_only)
+		if (read_only || hdd_overlay)
                         hdd->f = (void*)fopen64(fn, "rb");
 		else
                         hdd->f = (void*)fopen64(fn, "rb+");
@@ -32,7 +86,9 @@ void hdd_load_ext(hdd_file_t *hdd, const char *fn, int spt, int hpc, int tracks,
                         {
                                 int err;
                                 fclose((FILE*)hdd->f);
-                                MVHDMeta *vhdm = mvhd_open(fn, (bool)read_only, &err);
+                                if (hdd_overlay && !read_only)
+                                        pclog("VHD file '%s' opened read only, overlays are not supported for VHD", fn);
+                                MVHDMeta *vhdm = mvhd_open(fn, (bool)(read_only || hdd_overlay), &err);
                                 if (vhdm == NULL)
                                 {
                                         hdd->f = NULL;
@@ -100,6 +156,10 @@ void hdd_load_ext(hdd_file_t *hdd, const char *fn, int spt, int hpc, int tracks,
         }
         hdd->sectors = hdd->spt * hdd->hpc * hdd->tracks;
         hdd->read_only = read_only;
+        if (hdd->img_type == HDD_IMG_VHD && hdd_overlay)
+                hdd->read_only = 1;
+        else if (hdd->img_type == HDD_IMG_RAW && hdd_overlay && !read_only && !hdd->overlay)
+                hdd_overlay_open(hdd);
 }
 
 void hdd_load(hdd_file_t *hdd, int d, const char *fn)
@@ -116,11 +176,18 @@ void hdd_close(hdd_file_t *hdd)
                 else if (hdd->img_type == HDD_IMG_RAW)
                         fclose((FILE*)hdd->f);
         }
+        if (hdd->overlay)
+        {
+                fclose(hdd->overlay);
+                free(hdd->overlay_map);
+                hdd->overlay = NULL;
+                hdd->overlay_map = NULL;
+        }
         hdd->img_type = HDD_IMG_RAW;
         hdd->f = NULL;
 }
 
-int hdd_read_sectors(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
+static int hdd_image_read(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
 {
         if (hdd->img_type == HDD_IMG_VHD)
         {
@@ -135,6 +202,12 @@ int hdd_read_sectors(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
                         transfer_sectors = hdd->sectors - offset;
                 addr = (uint64_t)offset * 512;
 
+                if (hdd->overlay)
+                {
+                        hdd_overlay_read(hdd, offset, transfer_sectors, buffer);
+                        return (nr_sectors != transfer_sectors);
+                }
+
                 fseeko64((FILE*)hdd->f, addr, SEEK_SET);
                 fread(buffer, transfer_sectors*512, 1, (FILE*)hdd->f);
 
@@ -146,7 +219,7 @@ int hdd_read_sectors(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
         return 1;
 }
 
-int hdd_write_sectors(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
+static int hdd_image_write(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
 {
         if (hdd->img_type == HDD_IMG_VHD)
         {
@@ -164,8 +237,17 @@ int hdd_write_sectors(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
                         transfer_sectors = hdd->sectors - offset;
                 addr = (uint64_t)offset * 512;
 
-                fseeko64((FILE*)hdd->f, addr, SEEK_SET);
-                fwrite(buffer, transfer_sectors*512, 1, (FILE*)hdd->f);
+                if (hdd->overlay)
+                {
+                        fseeko64(hdd->overlay, addr, SEEK_SET);
+                        fwrite(buffer, transfer_sectors*512, 1, hdd->overlay);
+                        hdd_overlay_mark(hdd, offset, transfer_sectors);
+                }
+                else
+                {
+                        fseeko64((FILE*)hdd->f, addr, SEEK_SET);
+                        fwrite(buffer, transfer_sectors*512, 1, (FILE*)hdd->f);
+                }
 
                 if (nr_sectors != transfer_sectors)
                         return 1;
@@ -175,7 +257,7 @@ int hdd_write_sectors(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
         return 1;
 }
 
-int hdd_format_sectors(hdd_file_t *hdd, int offset, int nr_sectors)
+static int hdd_image_format(hdd_file_t *hdd, int offset, int nr_sectors)
 {
         if (hdd->img_type == HDD_IMG_VHD)
         {
@@ -196,9 +278,19 @@ int hdd_format_sectors(hdd_file_t *hdd, int offset, int nr_sectors)
                 if ((hdd->sectors - offset) < transfer_sectors)
                         transfer_sectors = hdd->sectors - offset;
                 addr = (uint64_t)offset * 512;
-                fseeko64((FILE*)hdd->f, addr, SEEK_SET);
-                for (c = 0; c < transfer_sectors; c++)
-                        fwrite(zero_buffer, 512, 1, (FILE*)hdd->f);
+                if (hdd->overlay)
+                {
+                        fseeko64(hdd->overlay, addr, SEEK_SET);
+                        for (c = 0; c < transfer_sectors; c++)
+                                fwrite(zero_buffer, 512, 1, hdd->overlay);
+                        hdd_overlay_mark(hdd, offset, transfer_sectors);
+                }
+                else
+                {
+                        fseeko64((FILE*)hdd->f, addr, SEEK_SET);
+                        for (c = 0; c < transfer_sectors; c++)
+                                fwrite(zero_buffer, 512, 1, (FILE*)hdd->f);
+                }
 
                 if (nr_sectors != transfer_sectors)
                         return 1;
@@ -207,3 +299,37 @@ int hdd_format_sectors(hdd_file_t *hdd, int offset, int nr_sectors)
         /* Keep the compiler happy */
         return 1;
 }
+
+/*Image access is timed as disc I/O by the profiler*/
+int hdd_read_sectors(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
+{
+        int ret;
+
+        PROFILER_ENTER(PROFILER_DISC);
+        ret = hdd_image_read(hdd, offset, nr_sectors, buffer);
+        PROFILER_EXIT();
+
+        return ret;
+}
+
+int hdd_write_sectors(hdd_file_t *hdd, int offset, int nr_sectors, void *buffer)
+{
+        int ret;
+
+        PROFILER_ENTER(PROFILER_DISC);
+        ret = hdd_image_write(hdd, offset, nr_sectors, buffer);
+        PROFILER_EXIT();
+
+        return ret;
+}
+
+int hdd_format_sectors(hdd_file_t *hdd, int offset, int nr_sectors)
+{
+        int ret;
+
+        PROFILER_ENTER(PROFILER_DISC);
+        ret = hdd_image_format(hdd, offset, nr_sectors);
+        PROFILER_EXIT();
+
+        return ret;
+}
@@ -13,8 +13,18 @@ typedef struct hdd_file_t
         int sectors;
         int read_only;
         hdd_img_type img_type;
+        /*Overlay for raw images. Writes go to a private temporary file and
+          the image itself is opened read only*/
+        FILE *overlay;
+        uint8_t *overlay_map; /*One bit per sector, set if the sector is in the overlay*/
 } hdd_file_t;
 
+/*If set, hard disc images opened from now on are never written to. Raw
+  images get an overlay that is discarded when the image is closed, VHD images
+  are opened read only. Used to run several copies of a machine from the same
+  snapshot and disc images*/
+extern int hdd_overlay;
+
 void hdd_load(hdd_file_t *hdd, int d, const char *fn);
 void hdd_load_ext(hdd_file_t *hdd, const char *fn, int spt, int hpc, int tracks, int read_only);
 void hdd_close(hdd_file_t *hdd);
@@ -50,13 +50,15 @@ uint32_t readmemll(uint32_t addr);
 void writememll(uint32_t addr, uint32_t val);
 uint64_t readmemql(uint32_t addr);
 void writememql(uint32_t addr, uint64_t val);
+int readmem_block(uint32_t addr, uint8_t *data, int size);
+int writemem_block(uint32_t addr, uint8_t *data, int size);
 
 uint8_t *getpccache(uint32_t a);
 
 uint32_t mmutranslatereal(uint32_t addr, int rw);
 
-void addreadlookup(uint32_t virt, uint32_t phys);
-void addwritelookup(uint32_t virt, uint32_t phys);
+void addreadlookup(uint32_t virt, uint32_t phys, uint32_t bus_addr);
+void addwritelookup(uint32_t virt, uint32_t phys, uint32_t bus_addr);
 
 
 /*IO*/
@@ -66,6 +68,8 @@ uint16_t inw(uint16_t port);
 void outw(uint16_t port, uint16_t val);
 uint32_t inl(uint16_t port);
 void outl(uint16_t port, uint32_t val);
+int inw_block(uint16_t port, uint16_t *data, int count);
+int outw_block(uint16_t port, uint16_t *data, int count);
 
 FILE *romfopen(char *fn, char *mode);
 extern int mem_size;
@@ -431,6 +435,11 @@ void onesec();
 void resetpc_cad();
 
 extern int start_in_fullscreen;
+
+/*Batch mode, see pc_headless_run()*/
+extern int headless;
+extern int headless_run_for; /*Emulated time to run for in ms, 0 to run until killed*/
+extern int headless_max_speed;
 extern int window_w, window_h, window_x, window_y, window_remember;
 
 void startblit();
@@ -4,6 +4,7 @@
 #define _LARGEFILE64_SOURCE
 #define _GNU_SOURCE
 #include <errno.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -14,6 +15,7 @@
 #include "hdd.h"
 #include "io.h"
 #include "pic.h"
+#include "savestate.h"
 #include "timer.h"
 #include "hdd_file.h"
 #include "scsi.h"
@@ -311,6 +313,16 @@ void resetide(void)
 
 
 int idetimes=0;
+static void ide_write_sector_done(IDE *ide, int ide_board)
+{
+        ide->pos=0;
+        ide->atastat = BUSY_STAT;
+        if (ide->command == WIN_WRITE_MULTIPLE)
+                callbackide(ide_board);
+        else
+                timer_set_delay_u64(&ide_timer[ide_board], 6 * IDE_TIME);
+}
+
 void writeidew(int ide_board, uint16_t val)
 {
         IDE *ide = &ide_drives[cur_ide[ide_board]];
@@ -325,17 +337,30 @@ void writeidew(int ide_board, uint16_t val)
                 ide->pos += 2;
 
                 if (ide->pos>=512)
-                {
-                        ide->pos=0;
-                        ide->atastat = BUSY_STAT;
-                        if (ide->command == WIN_WRITE_MULTIPLE)
-                                callbackide(ide_board);
-                        else
-                      	        timer_set_delay_u64(&ide_timer[ide_board], 6 * IDE_TIME);
-                }
+                        ide_write_sector_done(ide, ide_board);
         }
 }
 
+/*Block version of writeidew(), used by REP OUTSW. Transfers at most up to the
+  end of the current sector, so the sector completion path is identical to
+  the word-at-a-time case. Returns the number of words accepted*/
+static int ide_write_data_block(int ide_board, uint16_t *data, int count)
+{
+        IDE *ide = &ide_drives[cur_ide[ide_board]];
+        
+        if (ide->command == WIN_PACKETCMD || ide->pos >= 512)
+                return 0;
+
+        count = MIN(count, (512 - ide->pos) >> 1);
+        memcpy(&ide->buffer[ide->pos >> 1], data, count * 2);
+        ide->pos += count * 2;
+
+        if (ide->pos >= 512)
+                ide_write_sector_done(ide, ide_board);
+        
+        return count;
+}
+
 void writeidel(int ide_board, uint32_t val)
 {
 //        pclog("WriteIDEl %08X\n", val);
@@ -738,6 +763,30 @@ uint8_t readide(int ide_board, uint16_t addr)
 //        fatal("Bad IDE read %04X\n", addr);
 }
 
+static void ide_read_sector_done(IDE *ide, int ide_board)
+{
+//        pclog("Over! packlen %i %i\n",ide->packlen,ide->pos);
+        ide->pos = 0;
+        ide->atastat = READY_STAT | DSC_STAT;
+        if (ide->command == WIN_READ || ide->command == WIN_READ_NORETRY || ide->command == WIN_READ_MULTIPLE)
+        {
+                ide->secount = (ide->secount - 1) & 0xff;
+                if (ide->secount)
+                {
+                        ide_next_sector(ide);
+                        ide->atastat = BUSY_STAT | READY_STAT | DSC_STAT;
+                        if (ide->command == WIN_READ_MULTIPLE)
+                                callbackide(ide_board);
+                        else
+                                timer_set_delay_u64(&ide_timer[ide_board], 6 * IDE_TIME);
+//                        pclog("set idecallback\n");
+//                        callbackide(ide_board);
+                }
+//                else
+//                   pclog("readidew done %02X\n", ide->atastat);
+        }
+}
+
 uint16_t readidew(int ide_board)
 {
         IDE *ide = &ide_drives[cur_ide[ide_board]];
@@ -760,33 +809,32 @@ uint16_t readidew(int ide_board)
                 temp = ide->buffer[ide->pos >> 1];
                 ide->pos += 2;
                 if (ide->pos >= 512 && ide->command)
-                {
-//                        pclog("Over! packlen %i %i\n",ide->packlen,ide->pos);
-                        ide->pos = 0;
-                        ide->atastat = READY_STAT | DSC_STAT;
-                        if (ide->command == WIN_READ || ide->command == WIN_READ_NORETRY || ide->command == WIN_READ_MULTIPLE)
-                        {
-                                ide->secount = (ide->secount - 1) & 0xff;
-                                if (ide->secount)
-                                {
-                                        ide_next_sector(ide);
-                                        ide->atastat = BUSY_STAT | READY_STAT | DSC_STAT;
-                                        if (ide->command == WIN_READ_MULTIPLE)
-                                                callbackide(ide_board);
-                                        else
-                                                timer_set_delay_u64(&ide_timer[ide_board], 6 * IDE_TIME);
-//                                        pclog("set idecallback\n");
-//                                        callbackide(ide_board);
-                                }
-//                                else
-//                                   pclog("readidew done %02X\n", ide->atastat);
-                        }
-                }
+                        ide_read_sector_done(ide, ide_board);
         }
 //        pclog("Read IDEw %04X\n",temp);
         return temp;
 }
 
+/*Block version of readidew(), used by REP INSW. As with ide_write_data_block(),
+  never crosses the end of the current sector. Returns the number of words
+  transferred; 0 means the caller should fall back to readidew()*/
+static int ide_read_data_block(int ide_board, uint16_t *data, int count)
+{
+        IDE *ide = &ide_drives[cur_ide[ide_board]];
+        
+        if (ide->command == WIN_PACKETCMD || !ide->command || ide->pos >= 512)
+                return 0;
+
+        count = MIN(count, (512 - ide->pos) >> 1);
+        memcpy(data, &ide->buffer[ide->pos >> 1], count * 2);
+        ide->pos += count * 2;
+
+        if (ide->pos >= 512)
+                ide_read_sector_done(ide, ide_board);
+        
+        return count;
+}
+
 uint32_t readidel(int ide_board)
 {
         uint16_t temp;
@@ -1240,28 +1288,49 @@ uint32_t ide_read_sec_l(uint16_t addr, void *priv)
         return readidel(1);
 }
 
+static int ide_read_pri_block(uint16_t addr, uint16_t *data, int count, void *priv)
+{
+        return ide_read_data_block(0, data, count);
+}
+static int ide_write_pri_block(uint16_t addr, uint16_t *data, int count, void *priv)
+{
+        return ide_write_data_block(0, data, count);
+}
+static int ide_read_sec_block(uint16_t addr, uint16_t *data, int count, void *priv)
+{
+        return ide_read_data_block(1, data, count);
+}
+static int ide_write_sec_block(uint16_t addr, uint16_t *data, int count, void *priv)
+{
+        return ide_write_data_block(1, data, count);
+}
+
 void ide_pri_enable()
 {
         io_sethandler(0x01f0, 0x0008, ide_read_pri, ide_read_pri_w, ide_read_pri_l, ide_write_pri, ide_write_pri_w, ide_write_pri_l, NULL);
         io_sethandler(0x03f6, 0x0001, ide_read_pri, NULL,           NULL,           ide_write_pri, NULL,            NULL           , NULL);
+        io_set_block_handler(0x01f0, ide_read_pri_block, ide_write_pri_block, NULL);
 }
 
 void ide_pri_disable()
 {
         io_removehandler(0x01f0, 0x0008, ide_read_pri, ide_read_pri_w, ide_read_pri_l, ide_write_pri, ide_write_pri_w, ide_write_pri_l, NULL);
         io_removehandler(0x03f6, 0x0001, ide_read_pri, NULL,           NULL,           ide_write_pri, NULL,            NULL           , NULL);
+        io_remove_block_handler(0x01f0, ide_read_pri_block, ide_write_pri_block, NULL);
 }
 
 void ide_sec_enable()
 {
         io_sethandler(0x0170, 0x0008, ide_read_sec, ide_read_sec_w, ide_read_sec_l, ide_write_sec, ide_write_sec_w, ide_write_sec_l, NULL);
         io_sethandler(0x0376, 0x0001, ide_read_sec, NULL,           NULL,           ide_write_sec, NULL,            NULL           , NULL);
+        io_set_block_handler(0x0170, ide_read_sec_block, ide_write_sec_block, NULL);
 }
 
 void ide_sec_disable()
 {
         io_removehandler(0x0170, 0x0008, ide_read_sec, ide_read_sec_w, ide_read_sec_l, ide_write_sec, ide_write_sec_w, ide_write_sec_l, NULL);
         io_removehandler(0x0376, 0x0001, ide_read_sec, NULL,           NULL,           ide_write_sec, NULL,            NULL           , NULL);
+        io_remove_block_handler(0x0170, ide_read_sec_block, ide_write_sec_block, NULL);
 }
 
 static void *ide_init()
@@ -1275,6 +1344,31 @@ static void *ide_init()
         return (void *)-1;
 }
 
+/*Only the ATA register file and transfer buffers are stored. The image files
+  are reopened from the configuration, and ATAPI devices are left in their
+  reset state*/
+static void ide_save(savestate_t *s, void *p)
+{
+        int c;
+
+        for (c = 0; c < 4; c++)
+                savestate_write(s, &ide_drives[c], offsetof(IDE, hdd_file));
+        savestate_write(s, cur_ide, sizeof(cur_ide));
+        savestate_write_timer(s, &ide_timer[0]);
+        savestate_write_timer(s, &ide_timer[1]);
+}
+
+static void ide_load(savestate_t *s, void *p)
+{
+        int c;
+
+        for (c = 0; c < 4; c++)
+                savestate_read(s, &ide_drives[c], offsetof(IDE, hdd_file));
+        savestate_read(s, cur_ide, sizeof(cur_ide));
+        savestate_read_timer(s, &ide_timer[0]);
+        savestate_read_timer(s, &ide_timer[1]);
+}
+
 static void ide_close(void *p)
 {
         int c;
@@ -1328,5 +1422,7 @@ device_t ide_device =
         NULL,
         NULL,
         NULL,
-        NULL
+        NULL,
+        ide_save,
+        ide_load
 };
@@ -7,11 +7,14 @@
 
 static void sff_bus_master_next_addr(sff_busmaster_t *busmaster, int channel)
 {
-        busmaster[channel].addr = (*(uint32_t *)(&ram[busmaster[channel].ptr_cur])) & ~1;
-        busmaster[channel].count = (*(uint32_t *)(&ram[busmaster[channel].ptr_cur + 4])) & 0xfffe;
+        uint32_t prd[2];
+        
+        mem_dma_read(busmaster[channel].ptr_cur, (uint8_t *)prd, 8);
+        busmaster[channel].addr = prd[0] & ~1;
+        busmaster[channel].count = prd[1] & 0xfffe;
         if (!busmaster[channel].count)
                 busmaster[channel].count = 0x10000;
-        busmaster[channel].eot = (*(uint32_t *)(&ram[busmaster[channel].ptr_cur + 4])) >> 31;
+        busmaster[channel].eot = prd[1] >> 31;
         busmaster[channel].ptr_cur += 8;
 //        pclog("New DMA settings on channel %i - Addr %08X Count %04X EOT %i\n", channel, piix_busmaster[channel].addr, piix_busmaster[channel].count, piix_busmaster[channel].eot);
 }
@@ -86,39 +89,17 @@ static int sff_bus_master_data_read(int channel, uint8_t *data, int size, void *
 
         while (transferred < size)
         {
+                int count = MIN(busmaster[channel].count, size - transferred);
+                
                 if (busmaster[channel].count < (size - transferred) && busmaster[channel].eot)
                         fatal("DMA on channel %i - Read count less than size! Addr %08X Count %04X EOT %i size %i\n", channel, busmaster[channel].addr, busmaster[channel].count, busmaster[channel].eot, size);
 
-                mem_invalidate_range(busmaster[channel].addr, busmaster[channel].addr+(size-1));
-
-                if (busmaster[channel].count < (size - transferred))
-                {
-//                        pclog("Transferring smaller - %i bytes\n", piix_busmaster[channel].count);
-                        if (busmaster[channel].addr < (mem_size * 1024))
-                        {
-                                int count = busmaster[channel].count;
-                                if ((busmaster[channel].addr + count) > (mem_size * 1024))
-                                        count = (mem_size * 1024) - busmaster[channel].addr;
-                                memcpy(&ram[busmaster[channel].addr], data + transferred, count);
-                        }
-                        transferred += busmaster[channel].count;
-                        busmaster[channel].addr += busmaster[channel].count;
-                        busmaster[channel].count = 0;
-                }
-                else
-                {
-//                        pclog("Transferring larger - %i bytes\n", size - transferred);
-                        if (busmaster[channel].addr < (mem_size * 1024))
-                        {
-                                int count = size - transferred;
-                                if ((busmaster[channel].addr + count) > (mem_size * 1024))
-                                        count = (mem_size * 1024) - busmaster[channel].addr;
-                                memcpy(&ram[busmaster[channel].addr], data + transferred, count);
-                        }
-                        busmaster[channel].addr += (size - transferred);
-                        busmaster[channel].count -= (size - transferred);
-                        transferred += (size - transferred);
-                }
+                /*Copy the whole PRD span in one go; mem_dma_write() takes care
+                  of dirty tracking for any code in the destination*/
+                mem_dma_write(busmaster[channel].addr, data + transferred, count);
+                transferred += count;
+                busmaster[channel].addr += count;
+                busmaster[channel].count -= count;
 
 //                pclog("DMA on channel %i - Addr %08X Count %04X EOT %i\n", channel, piix_busmaster[channel].addr, piix_busmaster[channel].count, piix_busmaster[channel].eot);
 
@@ -136,6 +117,7 @@ static int sff_bus_master_data_read(int channel, uint8_t *data, int size, void *
         }
         return 0;
 }
+
 static int sff_bus_master_data_write(int channel, uint8_t *data, int size, void *p)
 {
         sff_busmaster_t *busmaster = (sff_busmaster_t *)p;
@@ -146,37 +128,15 @@ static int sff_bus_master_data_write(int channel, uint8_t *data, int size, void
 
         while (transferred < size)
         {
+                int count = MIN(busmaster[channel].count, size - transferred);
+                
                 if (busmaster[channel].count < (size - transferred) && busmaster[channel].eot)
                         fatal("DMA on channel %i - Write count less than size! Addr %08X Count %04X EOT %i size %i\n", channel, busmaster[channel].addr, busmaster[channel].count, busmaster[channel].eot, size);
 
-                if (busmaster[channel].count < (size - transferred))
-                {
-//                        pclog("Transferring smaller - %i bytes\n", piix_busmaster[channel].count);
-                        if (busmaster[channel].addr < (mem_size * 1024))
-                        {
-                                int count = busmaster[channel].count;
-                                if ((busmaster[channel].addr + count) > (mem_size * 1024))
-                                        count = (mem_size * 1024) - busmaster[channel].addr;
-                                memcpy(data + transferred, &ram[busmaster[channel].addr], count);
-                        }
-                        transferred += busmaster[channel].count;
-                        busmaster[channel].addr += busmaster[channel].count;
-                        busmaster[channel].count = 0;
-                }
-                else
-                {
-//                        pclog("Transferring larger - %i bytes\n", size - transferred);
-                        if (busmaster[channel].addr < (mem_size * 1024))
-                        {
-                                int count = size - transferred;
-                                if ((busmaster[channel].addr + count) > (mem_size * 1024))
-                                        count = (mem_size * 1024) - busmaster[channel].addr;
-                                memcpy(data + transferred, &ram[busmaster[channel].addr], count);
-                        }
-                        busmaster[channel].addr += (size - transferred);
-                        busmaster[channel].count -= (size - transferred);
-                        transferred += (size - transferred);
-                }
+                mem_dma_read(busmaster[channel].addr, data + transferred, count);
+                transferred += count;
+                busmaster[channel].addr += count;
+                busmaster[channel].count -= count;
 
 //                pclog("DMA on channel %i - Addr %08X Count %04X EOT %i\n", channel, piix_busmaster[channel].addr, piix_busmaster[channel].count, piix_busmaster[channel].eot);
 
@@ -1,41 +1,71 @@
+#include <string.h>
 #include "ibm.h"
-#include "amstrad.h"
 #include "ide.h"
 #include "io.h"
 #include "video.h"
 #include "cpu.h"
 
-uint8_t  (*port_inb[0x10000][2])(uint16_t addr, void *priv);
-uint16_t (*port_inw[0x10000][2])(uint16_t addr, void *priv);
-uint32_t (*port_inl[0x10000][2])(uint16_t addr, void *priv);
+/*Handlers are stored once, as records holding the callbacks and priv
+  together, and each port holds the indices of up to two records. Record 0 has
+  no callbacks and marks an empty slot, so a lookup never needs a NULL check on
+  the record itself*/
+typedef struct io_handler_t
+{
+        uint8_t  (*inb)(uint16_t addr, void *priv);
+        uint16_t (*inw)(uint16_t addr, void *priv);
+        uint32_t (*inl)(uint16_t addr, void *priv);
+        void (*outb)(uint16_t addr, uint8_t  val, void *priv);
+        void (*outw)(uint16_t addr, uint16_t val, void *priv);
+        void (*outl)(uint16_t addr, uint32_t val, void *priv);
+        void *priv;
+
+        /*Number of port slots using this record, 0 if the record is free*/
+        int refcount;
+} io_handler_t;
+
+#define IO_MAX_HANDLERS 1024
 
-void (*port_outb[0x10000][2])(uint16_t addr, uint8_t  val, void *priv);
-void (*port_outw[0x10000][2])(uint16_t addr, uint16_t val, void *priv);
-void (*port_outl[0x10000][2])(uint16_t addr, uint32_t val, void *priv);
+static io_handler_t io_handlers[IO_MAX_HANDLERS];
+static uint16_t port_handler[0x10000][2];
+
+typedef struct io_block_handler_t
+{
+        int (*inw_block)(uint16_t addr, uint16_t *data, int count, void *priv);
+        int (*outw_block)(uint16_t addr, uint16_t *data, int count, void *priv);
+        void *priv;
 
-void *port_priv[0x10000][2];
+        int refcount;
+} io_block_handler_t;
+
+#define IO_MAX_BLOCK_HANDLERS 64
+
+static io_block_handler_t io_block_handlers[IO_MAX_BLOCK_HANDLERS];
+static uint8_t port_block_handler[0x10000];
+
+static void (*io_inb_watch)(uint16_t port);
 
 void io_init()
 {
-        int c;
         pclog("io_init\n");
-        for (c = 0; c < 0x10000; c++)
-        {
-                port_inb[c][0]  = NULL;
-                port_inw[c][0]  = NULL;
-                port_inl[c][0]  = NULL;
-                port_outb[c][0] = NULL;
-                port_outw[c][0] = NULL;
-                port_outl[c][0] = NULL;
-                port_inb[c][1]  = NULL;
-                port_inw[c][1]  = NULL;
-                port_inl[c][1]  = NULL;
-                port_outb[c][1] = NULL;
-                port_outw[c][1] = NULL;
-                port_outl[c][1] = NULL;
-                port_priv[c][0] = NULL;
-                port_priv[c][1] = NULL;
-        }
+        memset(io_handlers, 0, sizeof(io_handlers));
+        memset(port_handler, 0, sizeof(port_handler));
+        memset(io_block_handlers, 0, sizeof(io_block_handlers));
+        memset(port_block_handler, 0, sizeof(port_block_handler));
+        io_inb_watch = NULL;
+}
+
+static int io_handler_match(io_handler_t *h,
+                   uint8_t  (*inb)(uint16_t addr, void *priv),
+                   uint16_t (*inw)(uint16_t addr, void *priv),
+                   uint32_t (*inl)(uint16_t addr, void *priv),
+                   void (*outb)(uint16_t addr, uint8_t  val, void *priv),
+                   void (*outw)(uint16_t addr, uint16_t val, void *priv),
+                   void (*outl)(uint16_t addr, uint32_t val, void *priv),
+                   void *priv)
+{
+        return h->priv == priv &&
+                h->inb == inb  &&  h->inw == inw  &&  h->inl == inl &&
+               h->outb == outb && h->outw == outw && h->outl == outl;
 }
 
 void io_sethandler(uint16_t base, int size, 
@@ -47,30 +77,51 @@ void io_sethandler(uint16_t base, int size,
                    void (*outl)(uint16_t addr, uint32_t val, void *priv),
                    void *priv)
 {
-        int c;
+        io_handler_t *h;
+        int c, nr = 0;
+
+        /*A handler with no callbacks would not occupy a slot*/
+        if (!inb && !inw && !inl && !outb && !outw && !outl)
+                return;
+
+        /*Share the record with any other ranges registered with the same
+          callbacks, otherwise take the first free one*/
+        for (c = 1; c < IO_MAX_HANDLERS; c++)
+        {
+                if (io_handlers[c].refcount && io_handler_match(&io_handlers[c], inb, inw, inl, outb, outw, outl, priv))
+                {
+                        nr = c;
+                        break;
+                }
+                if (!nr && !io_handlers[c].refcount)
+                        nr = c;
+        }
+        if (!nr)
+                fatal("io_sethandler: out of handler records\n");
+
+        h = &io_handlers[nr];
+        if (!h->refcount)
+        {
+                h->inb  = inb;
+                h->inw  = inw;
+                h->inl  = inl;
+                h->outb = outb;
+                h->outw = outw;
+                h->outl = outl;
+                h->priv = priv;
+        }
+
         for (c = 0; c < size; c++)
         {
-                if (!port_inb[ base + c][0] && !port_inw[ base + c][0] && !port_inl[ base + c][0] &&
-                    !port_outb[base + c][0] && !port_outw[base + c][0] && !port_outl[base + c][0])
+                if (!port_handler[base + c][0])
                 {
-                        port_inb[ base + c][0] = inb;
-                        port_inw[ base + c][0] = inw;
-                        port_inl[ base + c][0] = inl;
-                        port_outb[base + c][0] = outb;
-                        port_outw[base + c][0] = outw;
-                        port_outl[base + c][0] = outl;
-                        port_priv[base + c][0] = priv;
+                        port_handler[base + c][0] = nr;
+                        h->refcount++;
                 }
-                else if (!port_inb[ base + c][1] && !port_inw[ base + c][1] && !port_inl[ base + c][1] &&
-                         !port_outb[base + c][1] && !port_outw[base + c][1] && !port_outl[base + c][1])
+                else if (!port_handler[base + c][1])
                 {
-                        port_inb[ base + c][1] = inb;
-                        port_inw[ base + c][1] = inw;
-                        port_inl[ base + c][1] = inl;
-                        port_outb[base + c][1] = outb;
-                        port_outw[base + c][1] = outw;
-                        port_outl[base + c][1] = outl;
-                        port_priv[base + c][1] = priv;
+                        port_handler[base + c][1] = nr;
+                        h->refcount++;
                 }
         }
 }
@@ -84,36 +135,100 @@ void io_removehandler(uint16_t base, int size,
                    void (*outl)(uint16_t addr, uint32_t val, void *priv),
                    void *priv)
 {
-        int c;
+        int c, slot;
+
         for (c = 0; c < size; c++)
         {
-                if (port_priv[base + c][0] == priv &&
-                     port_inb[base + c][0] == inb  &&  port_inw[base + c][0] == inw  &&  port_inl[base + c][0] == inl &&
-                    port_outb[base + c][0] == outb && port_outw[base + c][0] == outw && port_outl[base + c][0] == outl)
+                for (slot = 0; slot < 2; slot++)
                 {
-                        port_inb[ base + c][0] = NULL;
-                        port_inw[ base + c][0] = NULL;
-                        port_inl[ base + c][0] = NULL;
-                        port_outb[ base + c][0] = NULL;
-                        port_outw[ base + c][0] = NULL;
-                        port_outl[ base + c][0] = NULL;
-                        port_priv[base + c][0] = NULL;
+                        io_handler_t *h = &io_handlers[port_handler[base + c][slot]];
+
+                        if (port_handler[base + c][slot] && io_handler_match(h, inb, inw, inl, outb, outw, outl, priv))
+                        {
+                                port_handler[base + c][slot] = 0;
+                                h->refcount--;
+                        }
                 }
-                if (port_priv[base + c][1] == priv &&
-                     port_inb[base + c][1] == inb  &&  port_inw[base + c][1] == inw  &&  port_inl[base + c][1] == inl &&
-                    port_outb[base + c][1] == outb && port_outw[base + c][1] == outw && port_outl[base + c][1] == outl)
+        }
+}
+
+/*Block transfer handlers for REP INSW/OUTSW on data ports. These are an
+  optional fast path alongside the normal word handlers; a handler may
+  transfer fewer words than requested, and returning 0 makes the caller fall
+  back to a single inw()/outw()*/
+void io_set_block_handler(uint16_t port,
+                   int (*inw_block)(uint16_t addr, uint16_t *data, int count, void *priv),
+                   int (*outw_block)(uint16_t addr, uint16_t *data, int count, void *priv),
+                   void *priv)
+{
+        int c, nr = 0;
+
+        for (c = 1; c < IO_MAX_BLOCK_HANDLERS; c++)
+        {
+                io_block_handler_t *h = &io_block_handlers[c];
+
+                if (h->refcount && h->inw_block == inw_block && h->outw_block == outw_block && h->priv == priv)
                 {
-                        port_inb[ base + c][1] = NULL;
-                        port_inw[ base + c][1] = NULL;
-                        port_inl[ base + c][1] = NULL;
-                        port_outb[base + c][1] = NULL;
-                        port_outw[base + c][1] = NULL;
-                        port_outl[base + c][1] = NULL;
-                        port_priv[base + c][1] = NULL;
+                        nr = c;
+                        break;
                 }
+                if (!nr && !h->refcount)
+                        nr = c;
+        }
+        if (!nr)
+                fatal("io_set_block_handler: out of handler records\n");
+
+        if (port_block_handler[port])
+                io_block_handlers[port_block_handler[port]].refcount--;
+        if (!io_block_handlers[nr].refcount)
+        {
+                io_block_handlers[nr].inw_block  = inw_block;
+                io_block_handlers[nr].outw_block = outw_block;
+                io_block_handlers[nr].priv       = priv;
+        }
+        io_block_handlers[nr].refcount++;
+        port_block_handler[port] = nr;
+}
+
+void io_remove_block_handler(uint16_t port,
+                   int (*inw_block)(uint16_t addr, uint16_t *data, int count, void *priv),
+                   int (*outw_block)(uint16_t addr, uint16_t *data, int count, void *priv),
+                   void *priv)
+{
+        io_block_handler_t *h = &io_block_handlers[port_block_handler[port]];
+
+        if (port_block_handler[port] && h->inw_block == inw_block && h->outw_block == outw_block && h->priv == priv)
+        {
+                port_block_handler[port] = 0;
+                h->refcount--;
         }
 }
 
+void io_set_inb_watch(void (*watch)(uint16_t port))
+{
+        io_inb_watch = watch;
+}
+
+/*Only use the block handler when it is the sole owner of the port, otherwise
+  a second device sharing the port would miss accesses*/
+int inw_block(uint16_t port, uint16_t *data, int count)
+{
+        io_block_handler_t *h = &io_block_handlers[port_block_handler[port]];
+
+        if (!h->inw_block || io_handlers[port_handler[port][1]].inw)
+                return 0;
+        return h->inw_block(port, data, count, h->priv);
+}
+
+int outw_block(uint16_t port, uint16_t *data, int count)
+{
+        io_block_handler_t *h = &io_block_handlers[port_block_handler[port]];
+
+        if (!h->outw_block || io_handlers[port_handler[port][1]].outw)
+                return 0;
+        return h->outw_block(port, data, count, h->priv);
+}
+
 uint8_t cgamode,cgastat=0,cgacol;
 int hsync;
 uint8_t lpt2dat;
@@ -121,21 +236,22 @@ int sw9;
 int t237=0;
 uint8_t inb(uint16_t port)
 {
+        io_handler_t *h = &io_handlers[port_handler[port][0]];
         uint8_t temp = 0xff;
 
-        if (port_inb[port][0])
-           temp &= port_inb[port][0](port, port_priv[port][0]);
-        if (port_inb[port][1])
-           temp &= port_inb[port][1](port, port_priv[port][1]);
-           
-        if (port & 0x80)
-                amstrad_latch = AMSTRAD_NOLATCH;
-        else if (port & 0x4000)   
-                amstrad_latch = AMSTRAD_SW10;
-        else
-                amstrad_latch = AMSTRAD_SW9;
-
-/*           if (!port_inb[port][0] && !port_inb[port][1])
+        if (h->inb)
+           temp &= h->inb(port, h->priv);
+        if (port_handler[port][1])
+        {
+                h = &io_handlers[port_handler[port][1]];
+                if (h->inb)
+                   temp &= h->inb(port, h->priv);
+        }
+
+        if (io_inb_watch)
+                io_inb_watch(port);
+
+/*           if (!port_handler[port][0] && !port_handler[port][1])
            	pclog("Bad INB %04X %04X:%04X\n", port, CS, pc);*/
            	
         return temp;
@@ -145,39 +261,51 @@ uint8_t cpu_readport(uint32_t port) { return inb(port); }
 
 void outb(uint16_t port, uint8_t val)
 {
-        if (port_outb[port][0])
-           port_outb[port][0](port, val, port_priv[port][0]);
-        if (port_outb[port][1])
-           port_outb[port][1](port, val, port_priv[port][1]);
+        io_handler_t *h = &io_handlers[port_handler[port][0]];
+
+        if (h->outb)
+           h->outb(port, val, h->priv);
+        if (port_handler[port][1])
+        {
+                h = &io_handlers[port_handler[port][1]];
+                if (h->outb)
+                   h->outb(port, val, h->priv);
+        }
         
-/*        if (!port_outb[port][0] && !port_outb[port][1])
+/*        if (!port_handler[port][0] && !port_handler[port][1])
         	pclog("Bad OUTB %04X %02X %04X:%08X\n", port, val, CS, pc);*/
         return;
 }
 
 uint16_t inw(uint16_t port)
 {
+        io_handler_t *h0 = &io_handlers[port_handler[port][0]];
+        io_handler_t *h1 = &io_handlers[port_handler[port][1]];
+
 //        pclog("INW %04X\n", port);
-        if (port_inw[port][0])
-           return port_inw[port][0](port, port_priv[port][0]);
-        if (port_inw[port][1])
-           return port_inw[port][1](port, port_priv[port][1]);
+        if (h0->inw)
+           return h0->inw(port, h0->priv);
+        if (h1->inw)
+           return h1->inw(port, h1->priv);
            
         return inb(port) | (inb(port + 1) << 8);
 }
 
 void outw(uint16_t port, uint16_t val)
 {
+        io_handler_t *h0 = &io_handlers[port_handler[port][0]];
+        io_handler_t *h1 = &io_handlers[port_handler[port][1]];
+
 //        printf("OUTW %04X %04X %04X:%08X\n",port,val, CS, pc);
 /*        if ((port & ~0xf) == 0xf000)
            pclog("OUTW %04X %04X\n", port, val);*/
 
-        if (port_outw[port][0])
-           port_outw[port][0](port, val, port_priv[port][0]);
-        if (port_outw[port][1])
-           port_outw[port][1](port, val, port_priv[port][1]);
+        if (h0->outw)
+           h0->outw(port, val, h0->priv);
+        if (h1->outw)
+           h1->outw(port, val, h1->priv);
 
-        if (port_outw[port][0] || port_outw[port][1])
+        if (h0->outw || h1->outw)
            return;
 
         outb(port,val);
@@ -186,26 +314,32 @@ void outw(uint16_t port, uint16_t val)
 
 uint32_t inl(uint16_t port)
 {
+        io_handler_t *h0 = &io_handlers[port_handler[port][0]];
+        io_handler_t *h1 = &io_handlers[port_handler[port][1]];
+
 //        pclog("INL %04X\n", port);
-        if (port_inl[port][0])
-           return port_inl[port][0](port, port_priv[port][0]);
-        if (port_inl[port][1])
-           return port_inl[port][1](port, port_priv[port][1]);
+        if (h0->inl)
+           return h0->inl(port, h0->priv);
+        if (h1->inl)
+           return h1->inl(port, h1->priv);
            
         return inw(port) | (inw(port + 2) << 16);
 }
 
 void outl(uint16_t port, uint32_t val)
 {
+        io_handler_t *h0 = &io_handlers[port_handler[port][0]];
+        io_handler_t *h1 = &io_handlers[port_handler[port][1]];
+
 /*        if ((port & ~0xf) == 0xf000)
            pclog("OUTL %04X %08X\n", port, val);*/
 
-        if (port_outl[port][0])
-           port_outl[port][0](port, val, port_priv[port][0]);
-        if (port_outl[port][1])
-           port_outl[port][1](port, val, port_priv[port][1]);
+        if (h0->outl)
+           h0->outl(port, val, h0->priv);
+        if (h1->outl)
+           h1->outl(port, val, h1->priv);
 
-        if (port_outl[port][0] || port_outl[port][1])
+        if (h0->outl || h1->outl)
            return;
                 
         outw(port, val);
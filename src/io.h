@@ -17,3 +17,16 @@ void io_removehandler(uint16_t base, int size,
                    void (*outw)(uint16_t addr, uint16_t val, void *priv),
                    void (*outl)(uint16_t addr, uint32_t val, void *priv),
                    void *priv);
+
+void io_set_block_handler(uint16_t port,
+                   int (*inw_block)(uint16_t addr, uint16_t *data, int count, void *priv),
+                   int (*outw_block)(uint16_t addr, uint16_t *data, int count, void *priv),
+                   void *priv);
+void io_remove_block_handler(uint16_t port,
+                   int (*inw_block)(uint16_t addr, uint16_t *data, int count, void *priv),
+                   int (*outw_block)(uint16_t addr, uint16_t *data, int count, void *priv),
+                   void *priv);
+
+/*Call watch after every inb(), for hardware that latches the address of
+  reads from any port. Cleared by io_init()*/
+void io_set_inb_watch(void (*watch)(uint16_t port));
@@ -3,6 +3,7 @@
 #include "mem.h"
 #include "pic.h"
 #include "pit.h"
+#include "savestate.h"
 #include "sound.h"
 #include "sound_speaker.h"
 #include "t3100e.h"
@@ -796,6 +797,65 @@ void keyboard_at_init()
         timer_add(&keyboard_at.send_delay_timer, keyboard_at_poll, NULL, 1);
 }
 
+/*Machines with their own keyboard controller (eg the Amstrads) keep state
+  elsewhere, so nothing is stored unless this controller is in use*/
+void keyboard_at_save_state(savestate_t *s)
+{
+        if (keyboard_send != keyboard_at_adddata_keyboard)
+                return;
+
+        savestate_begin_section(s, "keyboard_at");
+        savestate_write(s, &keyboard_at, sizeof(keyboard_at));
+        savestate_write_timer(s, &keyboard_at.send_delay_timer);
+        savestate_write_timer(s, &keyboard_at.refresh_timer);
+        savestate_write(s, key_ctrl_queue, sizeof(key_ctrl_queue));
+        savestate_write(s, &key_ctrl_queue_start, sizeof(key_ctrl_queue_start));
+        savestate_write(s, &key_ctrl_queue_end, sizeof(key_ctrl_queue_end));
+        savestate_write(s, key_queue, sizeof(key_queue));
+        savestate_write(s, &key_queue_start, sizeof(key_queue_start));
+        savestate_write(s, &key_queue_end, sizeof(key_queue_end));
+        savestate_write(s, mouse_queue, sizeof(mouse_queue));
+        savestate_write(s, &mouse_queue_start, sizeof(mouse_queue_start));
+        savestate_write(s, &mouse_queue_end, sizeof(mouse_queue_end));
+        savestate_write(s, &keyboard_scan, sizeof(keyboard_scan));
+        savestate_write(s, &mouse_scan, sizeof(mouse_scan));
+        savestate_end_section(s);
+}
+
+void keyboard_at_load_state(savestate_t *s)
+{
+        void (*mouse_write)(uint8_t val, void *p) = keyboard_at.mouse_write;
+        void *mouse_p = keyboard_at.mouse_p;
+        pc_timer_t send_delay_timer = keyboard_at.send_delay_timer;
+        pc_timer_t refresh_timer = keyboard_at.refresh_timer;
+
+        if (keyboard_send != keyboard_at_adddata_keyboard)
+                return;
+        if (savestate_open_section(s, "keyboard_at"))
+                return;
+
+        savestate_read(s, &keyboard_at, sizeof(keyboard_at));
+        keyboard_at.mouse_write = mouse_write;
+        keyboard_at.mouse_p = mouse_p;
+        keyboard_at.send_delay_timer = send_delay_timer;
+        keyboard_at.refresh_timer = refresh_timer;
+        savestate_read_timer(s, &keyboard_at.send_delay_timer);
+        savestate_read_timer(s, &keyboard_at.refresh_timer);
+        savestate_read(s, key_ctrl_queue, sizeof(key_ctrl_queue));
+        savestate_read(s, &key_ctrl_queue_start, sizeof(key_ctrl_queue_start));
+        savestate_read(s, &key_ctrl_queue_end, sizeof(key_ctrl_queue_end));
+        savestate_read(s, key_queue, sizeof(key_queue));
+        savestate_read(s, &key_queue_start, sizeof(key_queue_start));
+        savestate_read(s, &key_queue_end, sizeof(key_queue_end));
+        savestate_read(s, mouse_queue, sizeof(mouse_queue));
+        savestate_read(s, &mouse_queue_start, sizeof(mouse_queue_start));
+        savestate_read(s, &mouse_queue_end, sizeof(mouse_queue_end));
+        savestate_read(s, &keyboard_scan, sizeof(keyboard_scan));
+        savestate_read(s, &mouse_scan, sizeof(mouse_scan));
+
+        keyboard_set_scancode_set(keyboard_at.scancode_set);
+}
+
 void keyboard_at_set_mouse(void (*mouse_write)(uint8_t val, void *p), void *p)
 {
         keyboard_at.mouse_write = mouse_write;
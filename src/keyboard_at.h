@@ -4,6 +4,9 @@ void keyboard_at_reset();
 void keyboard_at_poll();
 void keyboard_at_set_mouse(void (*mouse_write)(uint8_t val, void *p), void *p);
 void keyboard_at_adddata_mouse(uint8_t val);
+struct savestate_t;
+void keyboard_at_save_state(struct savestate_t *s);
+void keyboard_at_load_state(struct savestate_t *s);
 
 extern uint8_t mouse_queue[16];
 extern int mouse_queue_start, mouse_queue_end;
@@ -14,11 +14,13 @@ typedef struct lpt_dac_t
         
         int16_t buffer[2][MAXSOUNDBUFLEN];
         int pos;
+
+        biquad_t dac_iir;
 } lpt_dac_t;
 
 static void dac_update(lpt_dac_t *lpt_dac)
 {
-        for (; lpt_dac->pos < sound_pos_global; lpt_dac->pos++)
+        for (; lpt_dac->pos < sound_get_pos(); lpt_dac->pos++)
         {
                 lpt_dac->buffer[0][lpt_dac->pos] = (int8_t)(lpt_dac->dac_val_l ^ 0x80) * 0x40;
                 lpt_dac->buffer[1][lpt_dac->pos] = (int8_t)(lpt_dac->dac_val_r ^ 0x80) * 0x40;
@@ -59,15 +61,19 @@ static uint8_t dac_read_status(void *p)
 static void dac_get_buffer(int32_t *buffer, int len, void *p)
 {
         lpt_dac_t *lpt_dac = (lpt_dac_t *)p;
+        float dac_buf[len * 2];
         int c;
         
         dac_update(lpt_dac);
         
         for (c = 0; c < len; c++)
         {
-                buffer[c*2]     += dac_iir(0, lpt_dac->buffer[0][c]);
-                buffer[c*2 + 1] += dac_iir(1, lpt_dac->buffer[1][c]);
+                dac_buf[c*2]     = lpt_dac->buffer[0][c];
+                dac_buf[c*2 + 1] = lpt_dac->buffer[1][c];
         }
+        biquad_process_stereo(&lpt_dac->dac_iir, &dac_iir_coef, dac_buf, len);
+        for (c = 0; c < len * 2; c++)
+                buffer[c] += dac_buf[c];
         lpt_dac->pos = 0;
 }
 
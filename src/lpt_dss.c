@@ -16,11 +16,13 @@ typedef struct dss_t
         
         int16_t buffer[MAXSOUNDBUFLEN];
         int pos;
+
+        biquad_t dss_iir;
 } dss_t;
 
 static void dss_update(dss_t *dss)
 {
-        for (; dss->pos < sound_pos_global; dss->pos++)
+        for (; dss->pos < sound_get_pos(); dss->pos++)
                 dss->buffer[dss->pos] = (int8_t)(dss->dac_val ^ 0x80) * 0x40;
 }
 
@@ -53,13 +55,16 @@ static uint8_t dss_read_status(void *p)
 static void dss_get_buffer(int32_t *buffer, int len, void *p)
 {
         dss_t *dss = (dss_t *)p;
+        float dss_buf[len];
         int c;
         
         dss_update(dss);
         
+        filter_buf_from_int16(dss_buf, dss->buffer, len);
+        biquad_process_mono(&dss->dss_iir, &dss_iir_coef, dss_buf, len);
         for (c = 0; c < len*2; c += 2)
         {
-                int16_t val = (int16_t)dss_iir((float)dss->buffer[c >> 1]);
+                int16_t val = (int16_t)dss_buf[c >> 1];
                 
                 buffer[c] += val;
                 buffer[c+1] += val;
@@ -7,6 +7,10 @@
 
 #include <stdlib.h>
 #include <string.h>
+#if defined(__linux__) || defined(__APPLE__)
+#define MEM_RAM_MMAP
+#include <sys/mman.h>
+#endif
 #include "ibm.h"
 
 #include "config.h"
@@ -15,6 +19,7 @@
 #include "x86.h"
 #include "cpu.h"
 #include "rom.h"
+#include "savestate.h"
 #include "x86_ops.h"
 #include "codegen.h"
 #include "xi8088.h"
@@ -50,6 +55,11 @@ uint64_t *byte_dirty_mask;
 uint64_t *byte_code_present_mask;
 
 uint32_t mem_logical_addr;
+/*Physical page behind each read and write lookup, so that a mapping change
+  only has to remove the lookups it affects, and the mapping that owned the
+  page when the lookup was made, for mem_check_lookups()*/
+static uint32_t readlookup_phys[256], writelookup_phys[256];
+static mem_mapping_t *readlookup_owner[256], *writelookup_owner[256];
 
 void (*smram_enable)(void);
 void (*smram_disable)(void);
@@ -355,7 +365,9 @@ void mmu_invalidate(uint32_t addr)
         flushmmucache_cr3();
 }
 
-void addreadlookup(uint32_t virt, uint32_t phys)
+/*phys is the offset of the page in ram[], bus_addr the physical address the
+  CPU accessed. These differ for remapped RAM*/
+void addreadlookup(uint32_t virt, uint32_t phys, uint32_t bus_addr)
 {
 //        return;
 //        printf("Addreadlookup %08X %08X %08X %08X %08X %08X %02X %08X\n",virt,phys,cs,ds,es,ss,opcode,pc);
@@ -381,13 +393,15 @@ void addreadlookup(uint32_t virt, uint32_t phys)
         }
         readlookup2[virt>>12] = (uintptr_t)&ram[(uintptr_t)(phys & ~0xFFF) - (uintptr_t)(virt & ~0xfff)];
         readlookupp[readlnext]=mmu_perm;
+        readlookup_phys[readlnext] = bus_addr & ~0xfff;
+        readlookup_owner[readlnext] = read_mapping[bus_addr >> 14];
         readlookup[readlnext++]=virt>>12;
         readlnext&=(cachesize-1);
         
         cycles -= 9;
 }
 
-void addwritelookup(uint32_t virt, uint32_t phys)
+void addwritelookup(uint32_t virt, uint32_t phys, uint32_t bus_addr)
 {
 //        return;
 //        printf("Addwritelookup %08X %08X\n",virt,phys);
@@ -420,12 +434,64 @@ void addwritelookup(uint32_t virt, uint32_t phys)
                 writelookup2[virt>>12] = (uintptr_t)&ram[(uintptr_t)(phys & ~0xFFF) - (uintptr_t)(virt & ~0xfff)];
 //        pclog("addwritelookup %08x %08x %p %p %016llx %p\n", virt, phys, (void *)page_lookup[virt >> 12], (void *)writelookup2[virt >> 12], pages[phys >> 12].dirty_mask, (void *)&pages[phys >> 12]);
         writelookupp[writelnext] = mmu_perm;
+        writelookup_phys[writelnext] = bus_addr & ~0xfff;
+        writelookup_owner[writelnext] = write_mapping[bus_addr >> 14];
         writelookup[writelnext++] = virt >> 12;
         writelnext &= (cachesize - 1);
 
         cycles -= 9;
 }
 
+/*Map a write lookup straight to host memory outside of RAM, eg a video card
+  framebuffer. Writes through the mapping are plain stores that the owner
+  doesn't see, so it must do its own dirty tracking, and must remove the
+  mapping with mem_flush_write_range() before the memory stops being a plain
+  store target*/
+void addwritelookup_mem(uint32_t virt, uint8_t *mem, uint32_t bus_addr)
+{
+        if (virt == 0xffffffff)
+                return;
+
+        if (page_lookup[virt >> 12] || writelookup2[virt >> 12] != -1)
+                return;
+
+        if (writelookup[writelnext] != -1)
+        {
+                page_lookup[writelookup[writelnext]] = NULL;
+                writelookup2[writelookup[writelnext]] = -1;
+        }
+
+        writelookup2[virt >> 12] = (uintptr_t)mem - (uintptr_t)(virt & ~0xfff);
+        writelookupp[writelnext] = mmu_perm;
+        writelookup_phys[writelnext] = bus_addr & ~0xfff;
+        writelookup_owner[writelnext] = write_mapping[bus_addr >> 14];
+        writelookup[writelnext++] = virt >> 12;
+        writelnext &= (cachesize - 1);
+
+        cycles -= 9;
+}
+
+/*Remove any write lookups pointing into the given host memory range*/
+void mem_flush_write_range(uint8_t *mem, uint32_t size)
+{
+        int c;
+
+        for (c = 0; c < 256; c++)
+        {
+                if (writelookup[c] != 0xFFFFFFFF && writelookup2[writelookup[c]] != -1)
+                {
+                        uintptr_t target = writelookup2[writelookup[c]] + ((uintptr_t)writelookup[c] << 12);
+
+                        if (target >= (uintptr_t)mem && target < (uintptr_t)mem + size)
+                        {
+                                writelookup2[writelookup[c]] = -1;
+                                page_lookup[writelookup[c]] = NULL;
+                                writelookup[c] = 0xFFFFFFFF;
+                        }
+                }
+        }
+}
+
 uint8_t *getpccache(uint32_t a)
 {
         uint32_t a2=a;
@@ -595,6 +661,33 @@ void writememwl(uint32_t addr, uint16_t val)
 //        pclog("Bad writememwl %08X %04X\n", addr, val);
 }
 
+/*Block access to linear memory for string instructions. The block must not
+  cross a page boundary. Returns non-zero if translation faulted, in which case
+  nothing has been transferred*/
+int readmem_block(uint32_t addr, uint8_t *data, int size)
+{
+        if (cr0 >> 31)
+        {
+                addr = mmutranslate_read(addr);
+                if (addr == 0xffffffff)
+                        return 1;
+        }
+        mem_dma_read(addr & rammask, data, size);
+        return 0;
+}
+
+int writemem_block(uint32_t addr, uint8_t *data, int size)
+{
+        if (cr0 >> 31)
+        {
+                addr = mmutranslate_write(addr);
+                if (addr == 0xffffffff)
+                        return 1;
+        }
+        mem_dma_write(addr & rammask, data, size);
+        return 0;
+}
+
 uint32_t readmemll(uint32_t addr)
 {
         mem_mapping_t *map;
@@ -884,22 +977,103 @@ void mem_writel_phys(uint32_t addr, uint32_t val)
         }
 }
 
+/*Bulk physical memory access for bus-master DMA. Spans that hit plain RAM are
+  copied directly, and only the 64-byte lines that actually change are marked
+  dirty so that the recompiler sees the same invalidation as byte-wise writes.
+  Anything else (ROM, MMIO, unmapped) falls back to the per-byte handlers.*/
+static void mem_dma_mark_dirty(page_t *p, uint32_t addr, int size)
+{
+        uint32_t end_addr = addr + size;
+        
+        while (addr < end_addr)
+        {
+                int offset = addr & PAGE_BYTE_MASK_MASK;
+                int count = MIN(64 - offset, end_addr - addr);
+                uint64_t mask = (uint64_t)1 << ((addr >> PAGE_MASK_SHIFT) & PAGE_MASK_MASK);
+                int byte_offset = (addr >> PAGE_BYTE_MASK_SHIFT) & PAGE_BYTE_MASK_OFFSET_MASK;
+                uint64_t byte_mask = (count == 64) ? ~(uint64_t)0 : ((((uint64_t)1 << count) - 1) << offset);
+
+                p->dirty_mask |= mask;
+                p->byte_dirty_mask[byte_offset] |= byte_mask;
+                if (((p->code_present_mask & mask) || (p->byte_code_present_mask[byte_offset] & byte_mask)) && !page_in_evict_list(p))
+                        page_add_to_evict_list(p);
+                
+                addr += count;
+        }
+}
+
+void mem_dma_read(uint32_t addr, uint8_t *data, int size)
+{
+        mem_logical_addr = 0xffffffff;
+
+        while (size)
+        {
+                mem_mapping_t *map = read_mapping[addr >> 14];
+                int count = MIN(0x1000 - (addr & 0xfff), size);
+                
+                if (map && map->read_b == mem_read_ram)
+                        memcpy(data, &ram[addr], count);
+                else
+                {
+                        int c;
+                        
+                        for (c = 0; c < count; c++)
+                                data[c] = mem_readb_phys(addr + c);
+                }
+                
+                addr += count;
+                data += count;
+                size -= count;
+        }
+}
+
+void mem_dma_write(uint32_t addr, uint8_t *data, int size)
+{
+        mem_logical_addr = 0xffffffff;
+
+        while (size)
+        {
+                mem_mapping_t *map = write_mapping[addr >> 14];
+                int count = MIN(0x1000 - (addr & 0xfff), size);
+                
+                if (map && map->write_b == mem_write_ram)
+                {
+                        if (codegen_in_recompile || memcmp(&ram[addr], data, count))
+                        {
+                                memcpy(&ram[addr], data, count);
+                                mem_dma_mark_dirty(&pages[addr >> 12], addr, count);
+                        }
+                }
+                else
+                {
+                        int c;
+                        
+                        for (c = 0; c < count; c++)
+                                mem_writeb_phys(addr + c, data[c]);
+                }
+                
+                addr += count;
+                data += count;
+                size -= count;
+        }
+}
+
 uint8_t mem_read_ram(uint32_t addr, void *priv)
 {
 //        if (addr >= 0xc0000 && addr < 0x0c8000) pclog("Read RAMb %08X\n", addr);
-        addreadlookup(mem_logical_addr, addr);
+        addreadlookup(mem_logical_addr, addr, addr);
         return ram[addr];
 }
 uint16_t mem_read_ramw(uint32_t addr, void *priv)
 {
 //        if (addr >= 0xc0000 && addr < 0x0c8000)  pclog("Read RAMw %08X\n", addr);
-        addreadlookup(mem_logical_addr, addr);
+        addreadlookup(mem_logical_addr, addr, addr);
         return *(uint16_t *)&ram[addr];
 }
 uint32_t mem_read_raml(uint32_t addr, void *priv)
 {
 //        if (addr >= 0xc0000 && addr < 0x0c8000) pclog("Read RAMl %08X\n", addr);
-        addreadlookup(mem_logical_addr, addr);
+        addreadlookup(mem_logical_addr, addr, addr);
         return *(uint32_t *)&ram[addr];
 }
 
@@ -1032,17 +1206,17 @@ void mem_write_raml_page(uint32_t addr, uint32_t val, page_t *p)
 
 void mem_write_ram(uint32_t addr, uint8_t val, void *priv)
 {
-        addwritelookup(mem_logical_addr, addr);
+        addwritelookup(mem_logical_addr, addr, addr);
         mem_write_ramb_page(addr, val, &pages[addr >> 12]);
 }
 void mem_write_ramw(uint32_t addr, uint16_t val, void *priv)
 {
-        addwritelookup(mem_logical_addr, addr);
+        addwritelookup(mem_logical_addr, addr, addr);
         mem_write_ramw_page(addr, val, &pages[addr >> 12]);
 }
 void mem_write_raml(uint32_t addr, uint32_t val, void *priv)
 {
-        addwritelookup(mem_logical_addr, addr);
+        addwritelookup(mem_logical_addr, addr, addr);
         mem_write_raml_page(addr, val, &pages[addr >> 12]);
 }
 
@@ -1051,20 +1225,23 @@ static uint32_t remap_start_addr;
 
 uint8_t mem_read_remapped(uint32_t addr, void *priv)
 {
+        uint32_t oldaddr = addr;
         addr = 0xA0000 + (addr - remap_start_addr);
-        addreadlookup(mem_logical_addr, addr);
+        addreadlookup(mem_logical_addr, addr, oldaddr);
         return ram[addr];
 }
 uint16_t mem_read_remappedw(uint32_t addr, void *priv)
 {
+        uint32_t oldaddr = addr;
         addr = 0xA0000 + (addr - remap_start_addr);
-        addreadlookup(mem_logical_addr, addr);
+        addreadlookup(mem_logical_addr, addr, oldaddr);
         return *(uint16_t *)&ram[addr];
 }
 uint32_t mem_read_remappedl(uint32_t addr, void *priv)
 {
+        uint32_t oldaddr = addr;
         addr = 0xA0000 + (addr - remap_start_addr);
-        addreadlookup(mem_logical_addr, addr);
+        addreadlookup(mem_logical_addr, addr, oldaddr);
         return *(uint32_t *)&ram[addr];
 }
 
@@ -1072,21 +1249,21 @@ void mem_write_remapped(uint32_t addr, uint8_t val, void *priv)
 {
         uint32_t oldaddr = addr;
         addr = 0xA0000 + (addr - remap_start_addr);
-        addwritelookup(mem_logical_addr, addr);
+        addwritelookup(mem_logical_addr, addr, oldaddr);
         mem_write_ramb_page(addr, val, &pages[oldaddr >> 12]);
 }
 void mem_write_remappedw(uint32_t addr, uint16_t val, void *priv)
 {
         uint32_t oldaddr = addr;
         addr = 0xA0000 + (addr - remap_start_addr);
-        addwritelookup(mem_logical_addr, addr);
+        addwritelookup(mem_logical_addr, addr, oldaddr);
         mem_write_ramw_page(addr, val, &pages[oldaddr >> 12]);
 }
 void mem_write_remappedl(uint32_t addr, uint32_t val, void *priv)
 {
         uint32_t oldaddr = addr;
         addr = 0xA0000 + (addr - remap_start_addr);
-        addwritelookup(mem_logical_addr, addr);
+        addwritelookup(mem_logical_addr, addr, oldaddr);
         mem_write_raml_page(addr, val, &pages[oldaddr >> 12]);
 }
 
@@ -1184,53 +1361,251 @@ static inline int mem_mapping_write_allowed(uint32_t flags, int state)
         return 0;
 }
 
+/*Mappings sorted by base address, so that the mappings overlapping a range
+  can be found without walking the whole list. mapping_index_end[n] is the
+  highest end address of mappings 0 to n, which bounds the search. Disabled
+  mappings stay in the index. Priority still follows list order, kept in
+  mapping->order*/
+static mem_mapping_t **mapping_index;
+static uint64_t *mapping_index_end;
+static int mapping_index_nr, mapping_index_size;
+static int mapping_order;
+static mem_mapping_t **mapping_candidates;
+
+static void mem_mapping_index_recalc_end(int start)
+{
+        uint64_t end = start ? mapping_index_end[start - 1] : 0;
+        int c;
+
+        for (c = start; c < mapping_index_nr; c++)
+        {
+                uint64_t mapping_end = (uint64_t)mapping_index[c]->base + (uint64_t)mapping_index[c]->size;
+
+                if (mapping_end > end)
+                        end = mapping_end;
+                mapping_index_end[c] = end;
+        }
+}
+
+static void mem_mapping_index_add(mem_mapping_t *mapping)
+{
+        int c;
+
+        if (mapping_index_nr == mapping_index_size)
+        {
+                mapping_index_size = mapping_index_size ? mapping_index_size * 2 : 64;
+                mapping_index = realloc(mapping_index, mapping_index_size * sizeof(mem_mapping_t *));
+                mapping_index_end = realloc(mapping_index_end, mapping_index_size * sizeof(uint64_t));
+                mapping_candidates = realloc(mapping_candidates, mapping_index_size * sizeof(mem_mapping_t *));
+        }
+
+        for (c = mapping_index_nr; c > 0 && mapping_index[c - 1]->base > mapping->base; c--)
+                mapping_index[c] = mapping_index[c - 1];
+        mapping_index[c] = mapping;
+        mapping_index_nr++;
+
+        mem_mapping_index_recalc_end(c);
+}
+
+static void mem_mapping_index_remove(mem_mapping_t *mapping)
+{
+        int c;
+
+        for (c = 0; c < mapping_index_nr; c++)
+        {
+                if (mapping_index[c] == mapping)
+                {
+                        memmove(&mapping_index[c], &mapping_index[c + 1], (mapping_index_nr - c - 1) * sizeof(mem_mapping_t *));
+                        mapping_index_nr--;
+                        mem_mapping_index_recalc_end(c);
+                        return;
+                }
+        }
+}
+
+/*Remove the read and write lookups for physical pages in the given range*/
+static void mem_flush_lookup_range(uint64_t start, uint64_t end)
+{
+        int c;
+
+        start &= ~0xfff;
+        for (c = 0; c < 256; c++)
+        {
+                if (readlookup[c] != 0xFFFFFFFF && readlookup_phys[c] >= start && readlookup_phys[c] < end)
+                {
+                        readlookup2[readlookup[c]] = -1;
+                        readlookup[c] = 0xFFFFFFFF;
+                }
+                if (writelookup[c] != 0xFFFFFFFF && writelookup_phys[c] >= start && writelookup_phys[c] < end)
+                {
+                        page_lookup[writelookup[c]] = NULL;
+                        writelookup2[writelookup[c]] = -1;
+                        writelookup[c] = 0xFFFFFFFF;
+                }
+        }
+}
+
+/*Recompute the 16 KB slots covering the given range. A slot is owned by the
+  last mapping in the list that overlaps it and is allowed by the slot state.
+  Only lookups in slots that actually changed are removed*/
 static void mem_mapping_recalc(uint64_t base, uint64_t size)
 {
-        uint64_t c;
-        mem_mapping_t *mapping = base_mapping.next;
+        uint64_t first_changed = 0, last_changed = 0;
+        uint64_t slot_start, slot_end;
+        int nr_candidates = 0;
+        int c, d;
 
         if (!size)
                 return;
-        /*Clear out old mappings*/
-        for (c = base; c < base + size; c += 0x4000)
+
+        slot_start = base & ~0x3fff;
+        slot_end = (base + size + 0x3fff) & ~(uint64_t)0x3fff;
+
+        /*Find the enabled mappings overlapping the slots. Entries below c
+          all have base < slot_end, and the search can stop once none of
+          them can reach slot_start*/
+        c = mapping_index_nr;
+        while (c > 0 && mapping_index[c - 1]->base >= slot_end)
+                c--;
+        for (c--; c >= 0 && mapping_index_end[c] > slot_start; c--)
         {
-                read_mapping[c >> 14] = NULL;
-                write_mapping[c >> 14] = NULL;
-                _mem_exec[c >> 14] = NULL;
+                mem_mapping_t *mapping = mapping_index[c];
+
+                if (mapping->enable && ((uint64_t)mapping->base + (uint64_t)mapping->size) > slot_start)
+                {
+                        /*Keep candidates in list order*/
+                        for (d = nr_candidates; d > 0 && mapping_candidates[d - 1]->order > mapping->order; d--)
+                                mapping_candidates[d] = mapping_candidates[d - 1];
+                        mapping_candidates[d] = mapping;
+                        nr_candidates++;
+                }
         }
 
-        /*Walk mapping list*/
-        while (mapping != NULL)
+        for (; slot_start < slot_end; slot_start += 0x4000)
         {
-                /*In range?*/
-                if (mapping->enable && (uint64_t)mapping->base < ((uint64_t)base + (uint64_t)size) && ((uint64_t)mapping->base + (uint64_t)mapping->size) > (uint64_t)base)
+                mem_mapping_t *read_map = NULL, *write_map = NULL;
+                uint8_t *exec = NULL;
+                int slot = slot_start >> 14;
+
+                for (c = 0; c < nr_candidates; c++)
                 {
-                        uint64_t start = (mapping->base < base) ? mapping->base : base;
-                        uint64_t end   = (((uint64_t)mapping->base + (uint64_t)mapping->size) < (base + size)) ? ((uint64_t)mapping->base + (uint64_t)mapping->size) : (base + size);
-                        if (start < mapping->base)
-                                start = mapping->base;
+                        mem_mapping_t *mapping = mapping_candidates[c];
 
-                        for (c = start; c < end; c += 0x4000)
+                        if (mapping->base >= slot_start + 0x4000 || ((uint64_t)mapping->base + (uint64_t)mapping->size) <= slot_start)
+                                continue;
+
+                        if ((mapping->read_b || mapping->read_w || mapping->read_l) &&
+                             mem_mapping_read_allowed(mapping->flags, _mem_state[slot]))
+                        {
+                                read_map = mapping;
+                                if (mapping->exec)
+                                        exec = mapping->exec + (intptr_t)(slot_start - mapping->base);
+                                else
+                                        exec = NULL;
+                        }
+                        if ((mapping->write_b || mapping->write_w || mapping->write_l) &&
+                             mem_mapping_write_allowed(mapping->flags, _mem_state[slot]))
                         {
-                                if ((mapping->read_b || mapping->read_w || mapping->read_l) &&
-                                     mem_mapping_read_allowed(mapping->flags, _mem_state[c >> 14]))
-                                {
-                                        read_mapping[c >> 14] = mapping;
-                                        if (mapping->exec)
-                                                _mem_exec[c >> 14] = mapping->exec + (c - mapping->base);
-                                        else
-                                                _mem_exec[c >> 14] = NULL;
-                                }
-                                if ((mapping->write_b || mapping->write_w || mapping->write_l) &&
-                                     mem_mapping_write_allowed(mapping->flags, _mem_state[c >> 14]))
-                                {
-                                        write_mapping[c >> 14] = mapping;
-                                }
+                                write_map = mapping;
                         }
                 }
-                mapping = mapping->next;
-        }       
-        flushmmucache_cr3();
+
+                if (read_mapping[slot] != read_map || write_mapping[slot] != write_map || _mem_exec[slot] != exec)
+                {
+                        read_mapping[slot] = read_map;
+                        write_mapping[slot] = write_map;
+                        _mem_exec[slot] = exec;
+                        if (last_changed <= first_changed)
+                                first_changed = slot_start;
+                        last_changed = slot_start + 0x4000;
+                }
+        }
+
+        if (last_changed > first_changed)
+                mem_flush_lookup_range(first_changed, last_changed);
+}
+
+/*Check the incrementally maintained state against a full recalculation.
+  Every slot must have the owners that recomputing it from the whole mapping
+  list gives, and every lookup that survived must still be one a full flush
+  would give back - it records the physical page its virtual page translates
+  to, and that page still has the owner it had when the lookup was made.
+  Page tables must not have been changed since the last TLB flush. Returns
+  the number of mismatches*/
+int mem_check_lookups()
+{
+        static mem_mapping_t *full_read[0x40000], *full_write[0x40000];
+        static uint8_t *full_exec[0x40000];
+        mem_mapping_t *mapping;
+        int errors = 0;
+        int c;
+
+        memset(full_read, 0, sizeof(full_read));
+        memset(full_write, 0, sizeof(full_write));
+        memset(full_exec, 0, sizeof(full_exec));
+        for (mapping = base_mapping.next; mapping; mapping = mapping->next)
+        {
+                uint64_t end = (uint64_t)mapping->base + (uint64_t)mapping->size;
+                uint64_t slot_start;
+
+                if (!mapping->enable)
+                        continue;
+
+                for (slot_start = mapping->base & ~0x3fff; slot_start < end; slot_start += 0x4000)
+                {
+                        int slot = slot_start >> 14;
+
+                        if ((mapping->read_b || mapping->read_w || mapping->read_l) &&
+                             mem_mapping_read_allowed(mapping->flags, _mem_state[slot]))
+                        {
+                                full_read[slot] = mapping;
+                                full_exec[slot] = mapping->exec ? (mapping->exec + (intptr_t)(slot_start - mapping->base)) : NULL;
+                        }
+                        if ((mapping->write_b || mapping->write_w || mapping->write_l) &&
+                             mem_mapping_write_allowed(mapping->flags, _mem_state[slot]))
+                                full_write[slot] = mapping;
+                }
+        }
+
+        for (c = 0; c < 0x40000; c++)
+        {
+                if (read_mapping[c] != full_read[c] || write_mapping[c] != full_write[c] || _mem_exec[c] != full_exec[c])
+                {
+                        if (errors++ < 8)
+                                pclog("mem_check_lookups : slot %08x owned by %p/%p, should be %p/%p\n", c << 14,
+                                        (void *)read_mapping[c], (void *)write_mapping[c], (void *)full_read[c], (void *)full_write[c]);
+                }
+        }
+
+        for (c = 0; c < 256; c++)
+        {
+                uint32_t phys;
+
+                if (readlookup[c] != 0xFFFFFFFF)
+                {
+                        phys = (cr0 >> 31) ? mmutranslate_noabrt(readlookup[c] << 12, 0) : (readlookup[c] << 12);
+                        if (phys == 0xffffffff || (phys & ~0xfff) != readlookup_phys[c] ||
+                            read_mapping[readlookup_phys[c] >> 14] != readlookup_owner[c])
+                        {
+                                if (errors++ < 8)
+                                        pclog("mem_check_lookups : read lookup %05x000 recorded as %08x, translates to %08x\n",
+                                                readlookup[c], readlookup_phys[c], phys);
+                        }
+                }
+                if (writelookup[c] != 0xFFFFFFFF)
+                {
+                        phys = (cr0 >> 31) ? mmutranslate_noabrt(writelookup[c] << 12, 0) : (writelookup[c] << 12);
+                        if (phys == 0xffffffff || (phys & ~0xfff) != writelookup_phys[c] ||
+                            write_mapping[writelookup_phys[c] >> 14] != writelookup_owner[c])
+                        {
+                                if (errors++ < 8)
+                                        pclog("mem_check_lookups : write lookup %05x000 recorded as %08x, translates to %08x\n",
+                                                writelookup[c], writelookup_phys[c], phys);
+                        }
+                }
+        }
+
+        return errors;
 }
 
 void mem_mapping_add(mem_mapping_t *mapping,
@@ -1269,6 +1644,8 @@ void mem_mapping_add(mem_mapping_t *mapping,
         mapping->flags   = flags;
         mapping->p       = p;
         mapping->next    = NULL;
+        mapping->order   = mapping_order++;
+        mem_mapping_index_add(mapping);
         
         mem_mapping_recalc(mapping->base, mapping->size);
 }
@@ -1289,6 +1666,10 @@ void mem_mapping_set_handler(mem_mapping_t *mapping,
         mapping->write_l = write_l;
         
         mem_mapping_recalc(mapping->base, mapping->size);
+        /*Slot ownership may not change, but lookups made through the old
+          handlers can't be kept*/
+        if (mapping->enable)
+                mem_flush_lookup_range(mapping->base, (uint64_t)mapping->base + (uint64_t)mapping->size);
 }
 
 void mem_mapping_set_addr(mem_mapping_t *mapping, uint32_t base, uint32_t size)
@@ -1298,9 +1679,11 @@ void mem_mapping_set_addr(mem_mapping_t *mapping, uint32_t base, uint32_t size)
         mem_mapping_recalc(mapping->base, mapping->size);
         
         /*Set new mapping*/
+        mem_mapping_index_remove(mapping);
         mapping->enable = 1;
         mapping->base = base;
         mapping->size = size;
+        mem_mapping_index_add(mapping);
         
         mem_mapping_recalc(mapping->base, mapping->size);
 }
@@ -1342,6 +1725,68 @@ void mem_set_mem_state(uint32_t base, uint32_t size, int state)
         mem_mapping_recalc(base, size);
 }
 
+/*Chipset memory state - the internal/external state of each slot, as set by
+  shadow RAM registers, and the placement of every mapping. Mappings are
+  matched by their position in the list, which is the same for any machine
+  with the same configuration. Handlers are left to their owners*/
+void mem_save_state(savestate_t *s)
+{
+        mem_mapping_t *mapping;
+        uint32_t nr_mappings = 0;
+
+        for (mapping = base_mapping.next; mapping; mapping = mapping->next)
+                nr_mappings++;
+
+        savestate_begin_section(s, "mem");
+        savestate_write(s, _mem_state, sizeof(_mem_state));
+        savestate_write(s, &nr_mappings, sizeof(nr_mappings));
+        for (mapping = base_mapping.next; mapping; mapping = mapping->next)
+        {
+                int32_t enable = mapping->enable;
+
+                savestate_write(s, &enable, sizeof(enable));
+                savestate_write(s, &mapping->base, sizeof(mapping->base));
+                savestate_write(s, &mapping->size, sizeof(mapping->size));
+        }
+        savestate_end_section(s);
+}
+
+void mem_load_state(savestate_t *s)
+{
+        mem_mapping_t *mapping;
+        uint32_t nr_mappings, c;
+
+        if (savestate_open_section(s, "mem"))
+                return;
+        savestate_read(s, _mem_state, sizeof(_mem_state));
+        savestate_read(s, &nr_mappings, sizeof(nr_mappings));
+
+        mapping = base_mapping.next;
+        for (c = 0; c < nr_mappings && mapping; c++)
+        {
+                int32_t enable;
+                uint32_t base, size;
+
+                savestate_read(s, &enable, sizeof(enable));
+                savestate_read(s, &base, sizeof(base));
+                savestate_read(s, &size, sizeof(size));
+
+                if (base != mapping->base || size != mapping->size)
+                {
+                        mem_mapping_index_remove(mapping);
+                        mapping->base = base;
+                        mapping->size = size;
+                        mem_mapping_index_add(mapping);
+                }
+                mapping->enable = enable;
+                mapping = mapping->next;
+        }
+        if (c != nr_mappings || mapping)
+                pclog("mem_load_state : snapshot has %i mappings, machine has a different number\n", nr_mappings);
+
+        mem_mapping_recalc(0, 0x100000000ull);
+}
+
 void mem_add_bios()
 {
         if (AT || (romset == ROM_XI8088 && xi8088_bios_128kb()))
@@ -1428,13 +1873,47 @@ void mem_init()
         smram_disable = NULL;
 }
 
+#ifdef MEM_RAM_MMAP
+/*RAM is allocated as its own mapping, so that it can be replaced by a mapping
+  of a snapshot file*/
+static size_t ram_map_size;
+#endif
+
+int mem_map_ram_file(int fd, uint64_t offset)
+{
+#ifdef MEM_RAM_MMAP
+        if (offset & 4095)
+                return -1;
+        if (mmap(ram, ram_map_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_FIXED, fd, offset) == MAP_FAILED)
+        {
+                /*A failed fixed mapping may have removed the old one*/
+                if (mmap(ram, ram_map_size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE|MAP_FIXED, -1, 0) == MAP_FAILED)
+                        fatal("mem_map_ram_file : can't restore RAM mapping\n");
+                return -1;
+        }
+        return 0;
+#else
+        return -1;
+#endif
+}
+
 void mem_alloc()
 {
         int c;
         
+#ifdef MEM_RAM_MMAP
+        if (ram)
+                munmap(ram, ram_map_size);
+        ram_map_size = ((mem_size * 1024) + 4095) & ~4095;
+        /*Anonymous mappings are zero filled*/
+        ram = mmap(NULL, ram_map_size, PROT_READ|PROT_WRITE, MAP_ANON|MAP_PRIVATE, -1, 0);
+        if (ram == MAP_FAILED)
+                fatal("mem_alloc : can't allocate %i KB of RAM\n", mem_size);
+#else
         free(ram);
         ram = malloc(mem_size * 1024);
         memset(ram, 0, mem_size * 1024);
+#endif
         
         free(byte_dirty_mask);
         byte_dirty_mask = malloc((mem_size * 1024) / 8);
@@ -1464,6 +1943,11 @@ void mem_alloc()
         memset(_mem_exec, 0, sizeof(_mem_exec));
         
         memset(&base_mapping, 0, sizeof(base_mapping));
+        mapping_index_nr = 0;
+        mapping_order = 0;
+        /*Mapping recalcs only remove the lookups they affect, so clear out any
+          left over from the old RAM*/
+        flushmmucache();
         
         memset(_mem_state, 0, sizeof(_mem_state));
 
@@ -24,6 +24,9 @@ typedef struct mem_mapping_t
         uint32_t flags;
         
         void *p;
+
+        /*Position in the mapping list, later mappings take priority*/
+        int order;
 } mem_mapping_t;
 
 /*Only present on external bus (ISA/PCI)*/
@@ -87,6 +90,8 @@ uint32_t mem_readl_phys(uint32_t addr);
 void mem_writeb_phys(uint32_t addr, uint8_t val);
 void mem_writew_phys(uint32_t addr, uint16_t val);
 void mem_writel_phys(uint32_t addr, uint32_t val);
+void mem_dma_read(uint32_t addr, uint8_t *data, int size);
+void mem_dma_write(uint32_t addr, uint8_t *data, int size);
 
 uint8_t  mem_read_ram(uint32_t addr, void *priv);
 uint16_t mem_read_ramw(uint32_t addr, void *priv);
@@ -174,9 +179,11 @@ static inline uint32_t get_phys(uint32_t addr)
                 get_phys_phys = ((uintptr_t)readlookup2[addr >> 12] + (addr & ~0xfff)) - (uintptr_t)ram;
         else
         {
-                get_phys_phys = (mmutranslatereal(addr, 0) & rammask) & ~0xfff;
+                uint32_t bus_addr = mmutranslatereal(addr, 0);
+
+                get_phys_phys = (bus_addr & rammask) & ~0xfff;
                 if (!cpu_state.abrt && mem_addr_is_ram(get_phys_phys))
-                        addreadlookup(get_phys_virt, get_phys_phys);
+                        addreadlookup(get_phys_virt, get_phys_phys, bus_addr);
         }
                 
         return get_phys_phys | (addr & 0xfff);
@@ -185,7 +192,7 @@ static inline uint32_t get_phys(uint32_t addr)
 
 static inline uint32_t get_phys_noabrt(uint32_t addr)
 {
-        uint32_t phys_addr;
+        uint32_t bus_addr, phys_addr;
         
         if (!(cr0 >> 31))
                 return addr & rammask;
@@ -193,9 +200,10 @@ static inline uint32_t get_phys_noabrt(uint32_t addr)
         if (readlookup2[addr >> 12] != -1)
                 return ((uintptr_t)readlookup2[addr >> 12] + addr) - (uintptr_t)ram;
 
-        phys_addr = mmutranslate_noabrt(addr, 0) & rammask;
-        if (phys_addr != 0xffffffff && mem_addr_is_ram(phys_addr))
-                addreadlookup(addr, phys_addr);
+        bus_addr = mmutranslate_noabrt(addr, 0);
+        phys_addr = bus_addr & rammask;
+        if (bus_addr != 0xffffffff && mem_addr_is_ram(phys_addr))
+                addreadlookup(addr, phys_addr, bus_addr);
 
         return phys_addr;
 }
@@ -217,14 +225,29 @@ void mem_remap_top_256k();
 void mem_remap_top_384k();
 
 void mem_flush_write_page(uint32_t addr, uint32_t virt);
+void addwritelookup_mem(uint32_t virt, uint8_t *mem, uint32_t bus_addr);
+void mem_flush_write_range(uint8_t *mem, uint32_t size);
+
+int mem_check_lookups();
 
 void mem_add_bios();
 
 void mem_init();
 void mem_alloc();
+/*Replace the contents of RAM with a private, copy-on-write mapping of the file
+  fd at offset, which must be page aligned. Pages are only read from the file
+  when the guest touches them, and stay shared with every other process
+  mapping the same file until written. Returns 0 on success; on failure RAM
+  may have been cleared and must be filled in some other way. Not available on
+  all hosts*/
+int mem_map_ram_file(int fd, uint64_t offset);
 
 void mem_set_704kb();
 
+struct savestate_t;
+void mem_save_state(struct savestate_t *s);
+void mem_load_state(struct savestate_t *s);
+
 void flushmmucache();
 void flushmmucache_nopc();
 void flushmmucache_cr3();
@@ -6,6 +6,7 @@
 #include "nvr.h"
 #include "nvr_tc8521.h"
 #include "pic.h"
+#include "savestate.h"
 #include "timer.h"
 #include "rtc.h"
 #include "paths.h"
@@ -485,6 +486,35 @@ static void *nvr_init()
         return nvr;
 }
 
+static void nvr_save(savestate_t *s, void *p)
+{
+        nvr_t *nvr = (nvr_t *)p;
+
+        savestate_write(s, nvrram, sizeof(nvrram));
+        savestate_write(s, &nvraddr, sizeof(nvraddr));
+        savestate_write(s, &nvr_update_status, sizeof(nvr_update_status));
+        savestate_write(s, &nvr->onesec_cnt, sizeof(nvr->onesec_cnt));
+        savestate_write_timer(s, &nvr->rtc_timer);
+        savestate_write_timer(s, &nvr->onesec_timer);
+        savestate_write_timer(s, &nvr->update_end_timer);
+}
+
+static void nvr_load(savestate_t *s, void *p)
+{
+        nvr_t *nvr = (nvr_t *)p;
+
+        savestate_read(s, nvrram, sizeof(nvrram));
+        savestate_read(s, &nvraddr, sizeof(nvraddr));
+        savestate_read(s, &nvr_update_status, sizeof(nvr_update_status));
+        savestate_read(s, &nvr->onesec_cnt, sizeof(nvr->onesec_cnt));
+        savestate_read_timer(s, &nvr->rtc_timer);
+        savestate_read_timer(s, &nvr->onesec_timer);
+        savestate_read_timer(s, &nvr->update_end_timer);
+
+        /*The clock carries on from the time in the snapshot*/
+        time_internal_set_nvrram(nvrram);
+}
+
 static void nvr_close(void *p)
 {
         nvr_t *nvr = (nvr_t *)p;
@@ -502,5 +532,7 @@ device_t nvr_device =
         nvr_speed_changed,
         NULL,
         NULL,
-        NULL
+        NULL,
+        nvr_save,
+        nvr_load
 };
@@ -12,6 +12,7 @@
 #include "device.h"
 
 #include "ali1429.h"
+#include "bench.h"
 #include "cdrom-ioctl.h"
 #include "cdrom-image.h"
 #include "cpu.h"
@@ -43,6 +44,8 @@
 #include "plat-keyboard.h"
 #include "plat-midi.h"
 #include "plat-mouse.h"
+#include "profiler.h"
+#include "savestate.h"
 #include "scsi_cd.h"
 #include "scsi_zip.h"
 #include "serial.h"
@@ -58,6 +61,7 @@
 #include "video.h"
 #include "amstrad.h"
 #include "hdd.h"
+#include "hdd_file.h"
 #include "x86.h"
 #include "paths.h"
 
@@ -80,6 +84,13 @@ int cycles_lost = 0;
 
 int config_override = 0;
 
+int headless = 0;
+int headless_run_for = 0;
+int headless_max_speed = 0;
+
+/*Snapshot to write when the emulator exits, set by --save_state*/
+static char save_state_fn[512];
+
 int insc=0;
 float mips,flops;
 extern int mmuflush;
@@ -251,6 +262,19 @@ void initpc(int argc, char *argv[])
                         printf("--fullscreen      - start in fullscreen mode\n");
                         printf("--load_drive_a file.img - load drive A: with the given disc image\n");
                         printf("--load_drive_b file.img - load drive B: with the given disc image\n");
+                        printf("--load_state file.snp - restore the given snapshot on startup\n");
+                        printf("--save_state file.snp - write a snapshot of the machine on exit\n");
+                        printf("--headless        - run without a window or audio output\n");
+                        printf("--run-for time    - with --headless, exit after the given emulated time (eg 120s, 500ms, or seconds with no unit)\n");
+                        printf("--max-speed       - with --headless, run as fast as the host allows\n");
+                        printf("--bench name      - run a built-in benchmark headless and report the results as JSON\n");
+                        printf("--bench-output file - write the benchmark report to the given file\n");
+#ifdef PROFILER
+                        printf("--profile-output file - write guest profiler samples to the given file as folded stacks\n");
+                        printf("--perf-map        - write /tmp/perf-<pid>.map for code generated by the dynarec\n");
+#endif
+                        printf("\nAvailable benchmarks :\n");
+                        bench_list();
                         exit(-1);
                 }
                 else if (!strcasecmp(argv[c], "--fullscreen"))
@@ -294,12 +318,98 @@ void initpc(int argc, char *argv[])
                         c++;
                         override_drive_b = 1;
                 }
+                else if (!strcasecmp(argv[c], "--load_state"))
+                {
+                        if ((c+1) == argc)
+                                break;
+
+                        /*Carried out at the start of the first frame*/
+                        savestate_request_load(argv[c+1]);
+                        c++;
+                }
+                else if (!strcasecmp(argv[c], "--save_state"))
+                {
+                        if ((c+1) == argc)
+                                break;
+
+                        strncpy(save_state_fn, argv[c+1], sizeof(save_state_fn) - 1);
+                        c++;
+                }
+                else if (!strcasecmp(argv[c], "--headless"))
+                {
+                        headless = 1;
+                }
+                else if (!strcasecmp(argv[c], "--run-for"))
+                {
+                        char *end;
+                        double t;
+
+                        if ((c+1) == argc)
+                                break;
+
+                        /*Seconds by default, rounded up to whole ms*/
+                        t = strtod(argv[c+1], &end);
+                        if (end != argv[c+1] && (!end[0] || !strcasecmp(end, "s")))
+                                t *= 1000.0;
+                        else if (end == argv[c+1] || strcasecmp(end, "ms"))
+                                t = 0.0;
+                        if (!(t > 0.0) || t > 2147483647.0)
+                        {
+                                /*Not printf, which only goes to the log*/
+                                fprintf(stderr, "Invalid --run-for time '%s' - use eg 120s, 500ms or 2.5\n", argv[c+1]);
+                                exit(-1);
+                        }
+                        headless_run_for = (int)t;
+                        if (headless_run_for < t)
+                                headless_run_for++;
+                        c++;
+                }
+                else if (!strcasecmp(argv[c], "--max-speed"))
+                {
+                        headless_max_speed = 1;
+                }
+                else if (!strcasecmp(argv[c], "--bench"))
+                {
+                        if ((c+1) == argc)
+                                break;
+
+                        strncpy(bench_name, argv[c+1], sizeof(bench_name) - 1);
+                        headless = 1;
+                        headless_max_speed = 1;
+                        c++;
+                }
+                else if (!strcasecmp(argv[c], "--bench-output"))
+                {
+                        if ((c+1) == argc)
+                                break;
+
+                        strncpy(bench_output, argv[c+1], sizeof(bench_output) - 1);
+                        c++;
+                }
+#ifdef PROFILER
+                else if (!strcasecmp(argv[c], "--profile-output"))
+                {
+                        if ((c+1) == argc)
+                                break;
+
+                        strncpy(profiler_folded_fn, argv[c+1], sizeof(profiler_folded_fn) - 1);
+                        c++;
+                }
+                else if (!strcasecmp(argv[c], "--perf-map"))
+                {
+                        profiler_perf_map = 1;
+                }
+#endif
         }
 
 //        append_filename(config_file_default, pcempath, "pcem.cfg", 511);
         
         loadconfig(NULL);
         pclog("Config loaded\n");
+#ifdef PROFILER
+        profiler_guest_init();
+        profiler_reset();
+#endif
 //        if (config_file)
 //                saveconfig();
 
@@ -541,8 +651,11 @@ void runpc()
         
         override_drive_a = override_drive_b = 0;
 
+        savestate_poll();
+
         startblit();
         
+        PROFILER_ENTER(PROFILER_CPU);
         if (is386)   
         {
                 if (cpu_use_dynarec)
@@ -554,6 +667,7 @@ void runpc()
                 exec386(cycles_to_run);
         else
                 execx86(cycles_to_run);
+        PROFILER_EXIT();
         
         keyboard_poll_host();
         keyboard_process();
@@ -644,6 +758,14 @@ void speedchanged()
 
 void closepc()
 {
+        /*Before anything is torn down, so the machine is captured as it
+          stopped*/
+        if (save_state_fn[0])
+                savestate_save(save_state_fn, NULL);
+#ifdef PROFILER
+        profiler_dump();
+        profiler_guest_close();
+#endif
         codegen_close();
         atapi->exit();
 //        ioctl_close();
@@ -658,6 +780,7 @@ void closepc()
         lpt1_device_close();
         mouse_emu_close();
         device_close_all();
+        sound_close();
         zip_eject();
 }
 
@@ -722,6 +845,10 @@ void loadconfig(char *fn)
 
         sound_buf_len = config_get_int(CFG_GLOBAL, NULL, "sound_buf_len", 200);
         sound_gain = config_get_int(CFG_GLOBAL, NULL, "sound_gain", 0);
+        sound_latency = config_get_int(CFG_GLOBAL, NULL, "sound_latency", 100);
+        sound_output = config_get_int(CFG_GLOBAL, NULL, "sound_output", 1);
+        p = (char *)config_get_string(CFG_GLOBAL, NULL, "sound_capture_dir", "");
+        strncpy(sound_capture_dir, p, sizeof(sound_capture_dir) - 1);
         
         GAMEBLASTER = config_get_int(CFG_MACHINE, NULL, "gameblaster", 0);
         GUS = config_get_int(CFG_MACHINE, NULL, "gus", 0);
@@ -744,6 +871,7 @@ void loadconfig(char *fn)
         fpu_type = fpu_get_type(model, cpu_manufacturer, cpu, p);
         cpu_use_dynarec = config_get_int(CFG_MACHINE, NULL, "cpu_use_dynarec", 0);
         cpu_waitstates = config_get_int(CFG_MACHINE, NULL, "cpu_waitstates", 0);
+        hdd_overlay = config_get_int(CFG_MACHINE, NULL, "hdd_overlay", 0);
                 
         p = (char *)config_get_string(CFG_MACHINE, NULL, "gfxcard", "");
         if (p)
@@ -751,6 +879,7 @@ void loadconfig(char *fn)
         else
                 gfxcard = 0;
         video_speed = config_get_int(CFG_MACHINE, NULL, "video_speed", -1);
+        video_lfb_direct = config_get_int(CFG_MACHINE, NULL, "video_lfb_direct", 0);
         p = (char *)config_get_string(CFG_MACHINE, NULL, "sndcard", "");
         if (p)
                 sound_card_current = sound_card_get_from_internal_name(p);
@@ -924,6 +1053,9 @@ void saveconfig(char *fn)
 
         config_set_int(CFG_GLOBAL, NULL, "sound_buf_len", sound_buf_len);
         config_set_int(CFG_GLOBAL, NULL, "sound_gain", sound_gain);
+        config_set_int(CFG_GLOBAL, NULL, "sound_latency", sound_latency);
+        config_set_int(CFG_GLOBAL, NULL, "sound_output", sound_output);
+        config_set_string(CFG_GLOBAL, NULL, "sound_capture_dir", sound_capture_dir);
         
         config_set_int(CFG_MACHINE, NULL, "gameblaster", GAMEBLASTER);
         config_set_int(CFG_MACHINE, NULL, "gus", GUS);
@@ -936,9 +1068,11 @@ void saveconfig(char *fn)
         config_set_string(CFG_MACHINE, NULL, "fpu", (char *)fpu_get_internal_name(model, cpu_manufacturer, cpu, fpu_type));
         config_set_int(CFG_MACHINE, NULL, "cpu_use_dynarec", cpu_use_dynarec);
         config_set_int(CFG_MACHINE, NULL, "cpu_waitstates", cpu_waitstates);
+        config_set_int(CFG_MACHINE, NULL, "hdd_overlay", hdd_overlay);
         
         config_set_string(CFG_MACHINE, NULL, "gfxcard", video_get_internal_name(video_old_to_new(gfxcard)));
         config_set_int(CFG_MACHINE, NULL, "video_speed", video_speed);
+        config_set_int(CFG_MACHINE, NULL, "video_lfb_direct", video_lfb_direct);
         config_set_string(CFG_MACHINE, NULL, "sndcard", sound_card_get_internal_name(sound_card_current));
         config_set_int(CFG_MACHINE, NULL, "cpu_speed", cpuspeed);
         config_set_string(CFG_MACHINE, NULL, "disc_a", discfns[0]);
@@ -2,6 +2,7 @@
 #include "io.h"
 #include "pic.h"
 #include "pit.h"
+#include "savestate.h"
 #include "video.h"
 
 int intclear;
@@ -458,3 +459,23 @@ void dumppic()
         pclog("PIC2 : MASK %02X PEND %02X INS %02X VECTOR %02X\n",pic2.mask,pic2.pend,pic2.ins,pic2.vector);
 }
 
+
+void pic_save_state(savestate_t *s)
+{
+        savestate_begin_section(s, "pic");
+        savestate_write(s, &pic, sizeof(PIC));
+        savestate_write(s, &pic2, sizeof(PIC));
+        savestate_write(s, &pic_intpending, sizeof(pic_intpending));
+        savestate_write(s, pic_current, sizeof(pic_current));
+        savestate_end_section(s);
+}
+
+void pic_load_state(savestate_t *s)
+{
+        if (savestate_open_section(s, "pic"))
+                return;
+        savestate_read(s, &pic, sizeof(PIC));
+        savestate_read(s, &pic2, sizeof(PIC));
+        savestate_read(s, &pic_intpending, sizeof(pic_intpending));
+        savestate_read(s, pic_current, sizeof(pic_current));
+}
@@ -9,3 +9,7 @@ void picintc(uint16_t num);
 uint8_t picinterrupt();
 void picclear(int num);
 void dumppic();
+
+struct savestate_t;
+void pic_save_state(struct savestate_t *s);
+void pic_load_state(struct savestate_t *s);
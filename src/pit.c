@@ -12,6 +12,7 @@
 #include "io.h"
 #include "pic.h"
 #include "pit.h"
+#include "savestate.h"
 #include "sound_speaker.h"
 #include "timer.h"
 #include "video.h"
@@ -678,3 +679,44 @@ void pit_ps2_init()
         pit_set_out_func(&pit2, 0, pit_nmi_ps2);
 }
 
+
+static void pit_save_one(savestate_t *s, PIT *pit)
+{
+        int t;
+
+        savestate_write(s, pit, sizeof(PIT));
+        for (t = 0; t < 3; t++)
+                savestate_write_timer(s, &pit->timer[t]);
+}
+
+static void pit_load_one(savestate_t *s, PIT *pit)
+{
+        PIT temp;
+        int t;
+
+        /*Timers, back pointers and output callbacks belong to this machine,
+          not the snapshot*/
+        savestate_read(s, &temp, sizeof(PIT));
+        memcpy(temp.timer, pit->timer, sizeof(pit->timer));
+        memcpy(temp.pit_nr, pit->pit_nr, sizeof(pit->pit_nr));
+        memcpy(temp.set_out_funcs, pit->set_out_funcs, sizeof(pit->set_out_funcs));
+        *pit = temp;
+        for (t = 0; t < 3; t++)
+                savestate_read_timer(s, &pit->timer[t]);
+}
+
+void pit_save_state(savestate_t *s)
+{
+        savestate_begin_section(s, "pit");
+        pit_save_one(s, &pit);
+        pit_save_one(s, &pit2);
+        savestate_end_section(s);
+}
+
+void pit_load_state(savestate_t *s)
+{
+        if (savestate_open_section(s, "pit"))
+                return;
+        pit_load_one(s, &pit);
+        pit_load_one(s, &pit2);
+}
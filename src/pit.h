@@ -14,3 +14,7 @@ void pit_irq0_timer_pcjr(int new_out, int old_out);
 void pit_refresh_timer_xt(int new_out, int old_out);
 void pit_refresh_timer_at(int new_out, int old_out);
 void pit_speaker_timer(int new_out, int old_out);
+
+struct savestate_t;
+void pit_save_state(struct savestate_t *s);
+void pit_load_state(struct savestate_t *s);
@@ -0,0 +1,7 @@
+/*Pull model audio output. The mixer pushes each completed buffer into a ring,
+  and the platform audio callback pulls from the ring, resampling slightly to
+  keep the ring at the target latency as emulation speed varies*/
+int audio_stream_init(int freq);
+void audio_stream_close();
+void audio_stream_write(int32_t *buf, int len);
+void audio_stream_add_status_info(char *s, int max_len);
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ibm.h"
+#include "profiler.h"
+
+#ifdef PROFILER
+static const char *profiler_group_names[PROFILER_GROUP_MAX] =
+{
+        "CPU",
+        "Dynarec compiler",
+        "Timer callbacks",
+        "Video rendering",
+        "Sound",
+        "Disc I/O"
+};
+/*Member names for profiler_write_json()*/
+static const char *profiler_group_keys[PROFILER_GROUP_MAX] =
+{
+        "cpu",
+        "codegen",
+        "timers",
+        "video",
+        "sound",
+        "disc"
+};
+
+profiler_counter_t profiler_counters[PROFILER_MAX_COUNTERS] =
+{
+        {"Idle",             PROFILER_GROUP_NONE},
+        {"CPU",              PROFILER_GROUP_CPU},
+        {"Dynarec compiler", PROFILER_GROUP_CODEGEN},
+        {"SVGA render",      PROFILER_GROUP_VIDEO},
+        {"Disc I/O",         PROFILER_GROUP_DISC}
+};
+static int profiler_nr_counters = PROFILER_NR_FIXED_COUNTERS;
+static profiler_counter_t profiler_overflow = {"Other", PROFILER_GROUP_NONE};
+
+profiler_counter_t *profiler_stack[PROFILER_STACK_DEPTH] = {&profiler_counters[PROFILER_COUNTER_IDLE]};
+int profiler_sp = 0;
+int profiler_overflow_depth = 0;
+uint64_t profiler_last_time = 0;
+
+static uint64_t profiler_status_time;
+
+profiler_counter_t *profiler_get_counter(const void *key, const char *name, int group)
+{
+        profiler_counter_t *counter;
+        int len = strlen(name);
+        int c, nr_same_name = 0;
+
+        for (c = PROFILER_NR_FIXED_COUNTERS; c < profiler_nr_counters; c++)
+        {
+                if (profiler_counters[c].key == key && profiler_counters[c].group == group)
+                        return &profiler_counters[c];
+                if (!strncmp(profiler_counters[c].name, name, len) &&
+                    (!profiler_counters[c].name[len] || !strncmp(&profiler_counters[c].name[len], " #", 2)))
+                        nr_same_name++;
+        }
+        if (profiler_nr_counters == PROFILER_MAX_COUNTERS)
+                return &profiler_overflow;
+
+        counter = &profiler_counters[profiler_nr_counters];
+        memset(counter, 0, sizeof(profiler_counter_t));
+        /*Devices can have several timers, keep the names distinct*/
+        if (nr_same_name)
+                snprintf(counter->name, sizeof(counter->name), "%s #%i", name, nr_same_name + 1);
+        else
+                snprintf(counter->name, sizeof(counter->name), "%s", name);
+        counter->key = key;
+        counter->group = group;
+        profiler_nr_counters++;
+
+        return counter;
+}
+
+void profiler_reset()
+{
+        int c;
+
+        for (c = 0; c < profiler_nr_counters; c++)
+        {
+                profiler_counters[c].time = 0;
+                profiler_counters[c].calls = 0;
+                profiler_counters[c].status_time = 0;
+                profiler_counters[c].samples = 0;
+        }
+        profiler_overflow.time = profiler_overflow.calls = profiler_overflow.samples = 0;
+        profiler_guest_reset();
+        profiler_last_time = profiler_status_time = timer_read();
+}
+
+static void profiler_get_group_times(uint64_t *group_time, int since_status)
+{
+        int c;
+
+        memset(group_time, 0, PROFILER_GROUP_MAX * sizeof(uint64_t));
+        for (c = 0; c < profiler_nr_counters; c++)
+        {
+                profiler_counter_t *counter = &profiler_counters[c];
+
+                if (counter->group != PROFILER_GROUP_NONE)
+                        group_time[counter->group] += counter->time - (since_status ? counter->status_time : 0);
+        }
+}
+
+#define PROFILER_STATUS_TOP 8
+
+void profiler_add_status_info(char *s, int max_len)
+{
+        uint64_t group_time[PROFILER_GROUP_MAX];
+        profiler_counter_t *top[PROFILER_STATUS_TOP];
+        uint64_t top_time[PROFILER_STATUS_TOP];
+        uint64_t new_time = timer_read();
+        uint64_t status_diff = new_time - profiler_status_time;
+        char temps[256];
+        int c, d;
+
+        if (!status_diff)
+                status_diff = 1;
+
+        profiler_get_group_times(group_time, 1);
+
+        for (c = 0; c < PROFILER_GROUP_MAX; c++)
+        {
+                sprintf(temps, "Host time, %s : %.1f%%\n", profiler_group_names[c], ((double)group_time[c] * 100.0) / status_diff);
+                strncat(s, temps, max_len - strlen(s) - 1);
+        }
+
+        strncat(s, "\n", max_len - strlen(s) - 1);
+
+        /*Busiest individual counters over the last period*/
+        memset(top, 0, sizeof(top));
+        memset(top_time, 0, sizeof(top_time));
+        for (c = 0; c < profiler_nr_counters; c++)
+        {
+                profiler_counter_t *counter = &profiler_counters[c];
+                uint64_t time = counter->time - counter->status_time;
+
+                counter->status_time = counter->time;
+                if (counter->group == PROFILER_GROUP_NONE || !time)
+                        continue;
+
+                for (d = 0; d < PROFILER_STATUS_TOP; d++)
+                {
+                        if (time > top_time[d])
+                        {
+                                memmove(&top[d+1], &top[d], (PROFILER_STATUS_TOP-1 - d) * sizeof(top[0]));
+                                memmove(&top_time[d+1], &top_time[d], (PROFILER_STATUS_TOP-1 - d) * sizeof(top_time[0]));
+                                top[d] = counter;
+                                top_time[d] = time;
+                                break;
+                        }
+                }
+        }
+        for (c = 0; c < PROFILER_STATUS_TOP && top[c]; c++)
+        {
+                sprintf(temps, "Host time, %s : %.1f%%\n", top[c]->name, ((double)top_time[c] * 100.0) / status_diff);
+                strncat(s, temps, max_len - strlen(s) - 1);
+        }
+        strncat(s, "\n", max_len - strlen(s) - 1);
+
+        profiler_status_time = new_time;
+}
+
+void profiler_write_json(FILE *f)
+{
+        uint64_t group_time[PROFILER_GROUP_MAX];
+        int c;
+
+        profiler_get_group_times(group_time, 0);
+
+        for (c = 0; c < PROFILER_GROUP_MAX; c++)
+                fprintf(f, "    \"%s\": %.6f%s\n", profiler_group_keys[c], (double)group_time[c] / timer_freq, (c == PROFILER_GROUP_MAX-1) ? "" : ",");
+}
+
+void profiler_write_folded(FILE *f)
+{
+        int c;
+
+        for (c = 0; c < profiler_nr_counters; c++)
+        {
+                profiler_counter_t *counter = &profiler_counters[c];
+
+                /*CPU samples are broken down by guest code instead*/
+                if (counter->group == PROFILER_GROUP_NONE || c == PROFILER_COUNTER_CPU || !counter->samples)
+                        continue;
+                fprintf(f, "pcem;%s;%s %llu\n", profiler_group_names[counter->group], counter->name, (unsigned long long)counter->samples);
+        }
+        if (profiler_overflow.samples)
+                fprintf(f, "pcem;%s %llu\n", profiler_overflow.name, (unsigned long long)profiler_overflow.samples);
+}
+
+void profiler_dump()
+{
+        uint64_t group_time[PROFILER_GROUP_MAX];
+        int c;
+
+        profiler_get_group_times(group_time, 0);
+
+        pclog("Profile :\n");
+        for (c = 0; c < PROFILER_GROUP_MAX; c++)
+                pclog("  %-18s %10.3f s\n", profiler_group_names[c], (double)group_time[c] / timer_freq);
+        pclog("\n  %-30s %10s %12s %10s\n", "Counter", "Time (s)", "Calls", "Avg (us)");
+        for (c = 0; c < profiler_nr_counters; c++)
+        {
+                profiler_counter_t *counter = &profiler_counters[c];
+
+                if (counter->group == PROFILER_GROUP_NONE || !counter->calls)
+                        continue;
+                pclog("  %-30s %10.3f %12llu %10.2f\n", counter->name, (double)counter->time / timer_freq,
+                        (unsigned long long)counter->calls, ((double)counter->time * 1000000.0) / ((double)counter->calls * timer_freq));
+        }
+        if (profiler_overflow.calls)
+                pclog("  %-30s %10.3f %12llu\n", profiler_overflow.name, (double)profiler_overflow.time / timer_freq, (unsigned long long)profiler_overflow.calls);
+}
+#endif
@@ -0,0 +1,176 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+/*Host time profiler, built when PROFILER is defined (configure
+  --enable-profiler). Otherwise the hooks compile to nothing.
+
+  Time on the emulation thread is exclusive. Entering or leaving an
+  instrumented region charges the time since the last transition to the region
+  that was running, so nested regions (eg a disc access in a timer callback
+  called from the CPU loop) are not counted twice. Each transition costs one
+  timer_read().
+
+  Code running on other threads (threaded sound handlers) is timed with
+  profiler_add_time() instead, and is reported as extra host time on top of
+  the emulation thread.
+
+  Guest hot spots are tracked as well (profiler_guest.c). Each dynarec block
+  counts its executions, and a sampler thread polls which guest block (or, in
+  the interpreter, which CS:EIP) the emulation thread is running and which
+  counter is charging time. Both are aggregated by guest physical address and
+  CS:EIP, and the samples can be written as folded stacks for flamegraph.pl.
+  With --perf-map, the dynarec also writes /tmp/perf-<pid>.map, so that
+  `perf report` can name generated code.*/
+enum
+{
+        PROFILER_GROUP_NONE = -1,
+        PROFILER_GROUP_CPU = 0,
+        PROFILER_GROUP_CODEGEN,
+        PROFILER_GROUP_TIMERS,
+        PROFILER_GROUP_VIDEO,
+        PROFILER_GROUP_SOUND,
+        PROFILER_GROUP_DISC,
+        PROFILER_GROUP_MAX
+};
+
+#ifdef PROFILER
+typedef struct profiler_counter_t
+{
+        char name[64];
+        int group;
+        const void *key;
+
+        /*Totals since the last profiler_reset(), in timer_read() ticks*/
+        uint64_t time;
+        uint64_t calls;
+
+        /*Totals at the last status update*/
+        uint64_t status_time;
+
+        /*Guest profiler samples taken while this counter was charging time.
+          Only updated by the sampler thread*/
+        uint64_t samples;
+} profiler_counter_t;
+
+/*Counters for the fixed instrumentation points*/
+enum
+{
+        PROFILER_COUNTER_IDLE = 0, /*Outside the emulation loop, not reported*/
+        PROFILER_COUNTER_CPU,
+        PROFILER_COUNTER_CODEGEN,
+        PROFILER_COUNTER_SVGA_RENDER,
+        PROFILER_COUNTER_DISC,
+        PROFILER_NR_FIXED_COUNTERS
+};
+
+#define PROFILER_MAX_COUNTERS 256
+#define PROFILER_STACK_DEPTH 16
+
+extern profiler_counter_t profiler_counters[PROFILER_MAX_COUNTERS];
+
+#define PROFILER_CPU         (&profiler_counters[PROFILER_COUNTER_CPU])
+#define PROFILER_CODEGEN     (&profiler_counters[PROFILER_COUNTER_CODEGEN])
+#define PROFILER_SVGA_RENDER (&profiler_counters[PROFILER_COUNTER_SVGA_RENDER])
+#define PROFILER_DISC        (&profiler_counters[PROFILER_COUNTER_DISC])
+
+extern profiler_counter_t *profiler_stack[PROFILER_STACK_DEPTH];
+extern int profiler_sp;
+/*Enters that didn't fit on the stack*/
+extern int profiler_overflow_depth;
+extern uint64_t profiler_last_time;
+
+/*Also in ibm.h, which includes this header through timer.h*/
+uint64_t timer_read();
+
+/*Return the counter for key, creating it if it doesn't exist yet. Counters
+  are never freed. If the pool is exhausted, a shared overflow counter is
+  returned*/
+profiler_counter_t *profiler_get_counter(const void *key, const char *name, int group);
+
+/*Emulation thread only*/
+static inline void profiler_enter(profiler_counter_t *counter)
+{
+        uint64_t new_time = timer_read();
+
+        profiler_stack[profiler_sp]->time += new_time - profiler_last_time;
+        profiler_last_time = new_time;
+        /*Past the stack depth, keep charging the deepest counter, and skip
+          the matching exits*/
+        if (profiler_sp == PROFILER_STACK_DEPTH-1)
+        {
+                profiler_overflow_depth++;
+                return;
+        }
+        profiler_sp++;
+        profiler_stack[profiler_sp] = counter;
+        counter->calls++;
+}
+
+static inline void profiler_exit()
+{
+        uint64_t new_time = timer_read();
+
+        profiler_stack[profiler_sp]->time += new_time - profiler_last_time;
+        profiler_last_time = new_time;
+        if (profiler_overflow_depth)
+                profiler_overflow_depth--;
+        else if (profiler_sp)
+                profiler_sp--;
+}
+
+/*Any thread. Counters passed here must only be updated by one thread*/
+static inline void profiler_add_time(profiler_counter_t *counter, uint64_t time)
+{
+        counter->time += time;
+        counter->calls++;
+}
+
+void profiler_reset();
+void profiler_add_status_info(char *s, int max_len);
+/*Write per group host time, in seconds, as the members of a JSON object*/
+void profiler_write_json(FILE *f);
+void profiler_dump();
+/*Write the samples of every counter other than CPU as flamegraph.pl folded
+  stacks*/
+void profiler_write_folded(FILE *f);
+
+/*Guest code currently being run by the dynarec, polled by the sampler*/
+extern volatile uint32_t profiler_guest_phys, profiler_guest_cs_base, profiler_guest_pc;
+extern volatile int profiler_guest_in_block;
+
+static inline void profiler_guest_block_enter(uint32_t phys, uint32_t cs_base, uint32_t pc)
+{
+        profiler_guest_phys = phys;
+        profiler_guest_cs_base = cs_base;
+        profiler_guest_pc = pc;
+        profiler_guest_in_block = 1;
+}
+
+/*Output files, empty if not wanted*/
+extern char profiler_folded_fn[512];
+extern int profiler_perf_map;
+
+void profiler_guest_init();
+void profiler_guest_close();
+void profiler_guest_reset();
+/*Add executions of a guest block. Called by the dynarec when a block is
+  deleted, and from codegen_profiler_flush()*/
+void profiler_guest_add_execs(uint32_t phys, uint32_t cs_base, uint32_t pc, uint16_t cs_sel, uint64_t execs);
+/*Add a perf map entry for generated code*/
+void profiler_perf_map_add(void *start, int size, uint32_t phys, uint16_t cs_sel, uint32_t eip);
+
+/*In codegen_block.c. Add the executions of all live blocks*/
+void codegen_profiler_flush();
+
+#define PROFILER_ENTER(counter) profiler_enter(counter)
+#define PROFILER_EXIT() profiler_exit()
+#define PROFILER_GUEST_BLOCK_ENTER(phys, cs_base, pc) profiler_guest_block_enter(phys, cs_base, pc)
+#define PROFILER_GUEST_BLOCK_EXIT() profiler_guest_in_block = 0
+#else
+#define PROFILER_ENTER(counter)
+#define PROFILER_EXIT()
+#define PROFILER_GUEST_BLOCK_ENTER(phys, cs_base, pc)
+#define PROFILER_GUEST_BLOCK_EXIT()
+#endif
+
+#endif
@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+#include "ibm.h"
+#include "profiler.h"
+#include "thread.h"
+#include "x86.h"
+
+#ifdef PROFILER
+/*Sample period. The sampler polls the state published by the emulation
+  thread rather than interrupting it, so sampling costs the emulation thread
+  nothing beyond publishing the current block*/
+#define GUEST_SAMPLE_MS 1
+
+#define GUEST_HASH_SIZE 65536
+#define GUEST_HASH_MASK (GUEST_HASH_SIZE-1)
+/*Keep the table sparse enough for linear probing*/
+#define GUEST_MAX_ENTRIES ((GUEST_HASH_SIZE * 3) / 4)
+
+/*Physical address not known, the interpreter was running with paging on*/
+#define GUEST_NO_PHYS 0xffffffff
+
+#define GUEST_DUMP_TOP 32
+
+typedef struct profiler_guest_t
+{
+        uint32_t phys;
+        uint32_t cs_base, pc;
+        uint16_t cs_sel;
+        int used;
+
+        uint64_t execs;
+        uint64_t samples;
+} profiler_guest_t;
+
+volatile uint32_t profiler_guest_phys, profiler_guest_cs_base, profiler_guest_pc;
+volatile int profiler_guest_in_block;
+
+char profiler_folded_fn[512];
+int profiler_perf_map;
+
+static profiler_guest_t *guest_hash;
+static int guest_nr;
+static profiler_guest_t guest_overflow;
+static uint64_t guest_samples, guest_idle_samples;
+
+/*Protects the table, which is updated by both the sampler and the
+  emulation thread*/
+static mutex_t *guest_mutex;
+static volatile int guest_sampling;
+
+static FILE *perf_map_f;
+
+static profiler_guest_t *guest_get(uint32_t phys, uint32_t cs_base, uint32_t pc, uint16_t cs_sel)
+{
+        uint32_t hash = (phys * 0x9e3779b1) ^ (pc * 0x85ebca6b) ^ cs_base;
+        profiler_guest_t *entry;
+
+        hash = (hash ^ (hash >> 16)) & GUEST_HASH_MASK;
+        while (guest_hash[hash].used)
+        {
+                entry = &guest_hash[hash];
+                if (entry->phys == phys && entry->pc == pc && entry->cs_base == cs_base)
+                        return entry;
+                hash = (hash + 1) & GUEST_HASH_MASK;
+        }
+        if (guest_nr == GUEST_MAX_ENTRIES)
+                return &guest_overflow;
+
+        entry = &guest_hash[hash];
+        entry->phys = phys;
+        entry->cs_base = cs_base;
+        entry->pc = pc;
+        entry->cs_sel = cs_sel;
+        entry->used = 1;
+        guest_nr++;
+
+        return entry;
+}
+
+static void guest_sample_thread(void *param)
+{
+        while (1)
+        {
+                profiler_counter_t *counter;
+
+                thread_sleep(GUEST_SAMPLE_MS);
+
+                thread_lock_mutex(guest_mutex);
+                if (!guest_sampling)
+                {
+                        thread_unlock_mutex(guest_mutex);
+                        break;
+                }
+
+                counter = profiler_stack[profiler_sp];
+                guest_samples++;
+                if (!counter || counter == &profiler_counters[PROFILER_COUNTER_IDLE])
+                        guest_idle_samples++;
+                else if (counter == PROFILER_CPU)
+                {
+                        profiler_guest_t *entry;
+
+                        if (profiler_guest_in_block)
+                                entry = guest_get(profiler_guest_phys, profiler_guest_cs_base, profiler_guest_pc, CS);
+                        else
+                        {
+                                /*Interpreter, take the current instruction. The
+                                  physical address is only known without paging*/
+                                uint32_t pc = cs + cpu_state.pc;
+
+                                entry = guest_get((cr0 & 0x80000000) ? GUEST_NO_PHYS : pc, cs, pc, CS);
+                        }
+                        entry->samples++;
+                }
+                else
+                        counter->samples++;
+                thread_unlock_mutex(guest_mutex);
+        }
+}
+
+void profiler_guest_init()
+{
+        guest_hash = malloc(GUEST_HASH_SIZE * sizeof(profiler_guest_t));
+        memset(guest_hash, 0, GUEST_HASH_SIZE * sizeof(profiler_guest_t));
+        guest_nr = 0;
+
+        guest_mutex = thread_create_mutex();
+        guest_sampling = 1;
+        thread_create(guest_sample_thread, NULL);
+
+        if (profiler_perf_map)
+        {
+#if defined(__linux__) || defined(__APPLE__)
+                char fn[64];
+
+                sprintf(fn, "/tmp/perf-%i.map", (int)getpid());
+                perf_map_f = fopen(fn, "wt");
+                if (!perf_map_f)
+                        pclog("profiler_guest_init: can't open %s\n", fn);
+#else
+                pclog("profiler_guest_init: perf maps are not supported on this host\n");
+#endif
+        }
+}
+
+void profiler_guest_reset()
+{
+        if (!guest_mutex)
+                return;
+
+        /*Drop the executions pending in live blocks as well*/
+        codegen_profiler_flush();
+
+        thread_lock_mutex(guest_mutex);
+        memset(guest_hash, 0, GUEST_HASH_SIZE * sizeof(profiler_guest_t));
+        memset(&guest_overflow, 0, sizeof(profiler_guest_t));
+        guest_nr = 0;
+        guest_samples = guest_idle_samples = 0;
+        thread_unlock_mutex(guest_mutex);
+}
+
+void profiler_guest_add_execs(uint32_t phys, uint32_t cs_base, uint32_t pc, uint16_t cs_sel, uint64_t execs)
+{
+        if (!guest_mutex)
+                return;
+
+        thread_lock_mutex(guest_mutex);
+        guest_get(phys, cs_base, pc, cs_sel)->execs += execs;
+        thread_unlock_mutex(guest_mutex);
+}
+
+void profiler_perf_map_add(void *start, int size, uint32_t phys, uint16_t cs_sel, uint32_t eip)
+{
+        /*Code memory is reused as blocks are evicted, so an address can appear
+          several times. perf takes the most recent entry*/
+        if (perf_map_f)
+                fprintf(perf_map_f, "%llx %x guest %04x:%08x phys %08x\n", (unsigned long long)(uintptr_t)start, size, cs_sel, eip, phys);
+}
+
+static int guest_compare_samples(const void *p1, const void *p2)
+{
+        const profiler_guest_t *e1 = *(const profiler_guest_t **)p1;
+        const profiler_guest_t *e2 = *(const profiler_guest_t **)p2;
+
+        if (e1->samples != e2->samples)
+                return (e1->samples < e2->samples) ? 1 : -1;
+        return (e1->execs < e2->execs) ? 1 : ((e1->execs > e2->execs) ? -1 : 0);
+}
+
+static int guest_compare_execs(const void *p1, const void *p2)
+{
+        const profiler_guest_t *e1 = *(const profiler_guest_t **)p1;
+        const profiler_guest_t *e2 = *(const profiler_guest_t **)p2;
+
+        if (e1->execs != e2->execs)
+                return (e1->execs < e2->execs) ? 1 : -1;
+        return (e1->samples < e2->samples) ? 1 : ((e1->samples > e2->samples) ? -1 : 0);
+}
+
+static void guest_format_addr(char *s, profiler_guest_t *entry)
+{
+        if (entry == &guest_overflow)
+                sprintf(s, "Other");
+        else if (entry->phys == GUEST_NO_PHYS)
+                sprintf(s, "%04x:%08x", entry->cs_sel, entry->pc - entry->cs_base);
+        else
+                sprintf(s, "%04x:%08x phys %08x", entry->cs_sel, entry->pc - entry->cs_base, entry->phys);
+}
+
+static void guest_dump(profiler_guest_t **entries, int nr)
+{
+        uint64_t busy_samples = guest_samples - guest_idle_samples;
+        char s[64];
+        int c;
+
+        if (!busy_samples)
+                busy_samples = 1;
+
+        pclog("Guest hot spots : %i addresses, %llu samples\n", nr, (unsigned long long)(guest_samples - guest_idle_samples));
+
+        qsort(entries, nr, sizeof(profiler_guest_t *), guest_compare_samples);
+        pclog("\n  By host time :\n  %-28s %10s %8s %14s\n", "Address", "Samples", "Time", "Executions");
+        for (c = 0; c < nr && c < GUEST_DUMP_TOP && entries[c]->samples; c++)
+        {
+                guest_format_addr(s, entries[c]);
+                pclog("  %-28s %10llu %7.2f%% %14llu\n", s, (unsigned long long)entries[c]->samples,
+                        ((double)entries[c]->samples * 100.0) / busy_samples, (unsigned long long)entries[c]->execs);
+        }
+
+        qsort(entries, nr, sizeof(profiler_guest_t *), guest_compare_execs);
+        pclog("\n  By executions :\n  %-28s %10s %8s %14s\n", "Address", "Samples", "Time", "Executions");
+        for (c = 0; c < nr && c < GUEST_DUMP_TOP && entries[c]->execs; c++)
+        {
+                guest_format_addr(s, entries[c]);
+                pclog("  %-28s %10llu %7.2f%% %14llu\n", s, (unsigned long long)entries[c]->samples,
+                        ((double)entries[c]->samples * 100.0) / busy_samples, (unsigned long long)entries[c]->execs);
+        }
+}
+
+static void guest_write_folded(profiler_guest_t **entries, int nr)
+{
+        FILE *f = fopen(profiler_folded_fn, "wt");
+        char s[64];
+        int c;
+
+        if (!f)
+        {
+                pclog("profiler_guest_close: can't open %s\n", profiler_folded_fn);
+                return;
+        }
+
+        for (c = 0; c < nr; c++)
+        {
+                if (!entries[c]->samples)
+                        continue;
+                guest_format_addr(s, entries[c]);
+                fprintf(f, "pcem;CPU;%s %llu\n", s, (unsigned long long)entries[c]->samples);
+        }
+        profiler_write_folded(f);
+
+        fclose(f);
+}
+
+void profiler_guest_close()
+{
+        profiler_guest_t **entries;
+        int c, nr = 0;
+
+        if (!guest_mutex)
+                return;
+
+        codegen_profiler_flush();
+
+        thread_lock_mutex(guest_mutex);
+        guest_sampling = 0;
+
+        entries = malloc((guest_nr + 1) * sizeof(profiler_guest_t *));
+        for (c = 0; c < GUEST_HASH_SIZE; c++)
+        {
+                if (guest_hash[c].used)
+                        entries[nr++] = &guest_hash[c];
+        }
+        if (guest_overflow.execs || guest_overflow.samples)
+                entries[nr++] = &guest_overflow;
+
+        guest_dump(entries, nr);
+        if (profiler_folded_fn[0])
+                guest_write_folded(entries, nr);
+
+        free(entries);
+        thread_unlock_mutex(guest_mutex);
+
+        if (perf_map_f)
+        {
+                fclose(perf_map_f);
+                perf_map_f = NULL;
+        }
+}
+#endif
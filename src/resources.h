@@ -2,6 +2,8 @@
 #define IDM_FILE_HRESET    40001
 #define IDM_FILE_EXIT      40002
 #define IDM_FILE_RESET_CAD 40003
+#define IDM_FILE_SAVE_STATE 40004
+#define IDM_FILE_LOAD_STATE 40005
 #define IDM_DISC_A         40010
 #define IDM_DISC_B         40011
 #define IDM_EJECT_A        40012
@@ -56,6 +58,7 @@
 #define IDC_CHECKVOODOO 1016
 #define IDC_CHECKDYNAREC 1017
 #define IDC_CHECKSYNC 1018
+#define IDC_CHECKLFBDIRECT 1019
 #define IDC_STATIC 1020
 #define IDC_EDIT1  1030
 #define IDC_EDIT2  1031
@@ -0,0 +1,505 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ibm.h"
+#include "codegen.h"
+#include "cpu.h"
+#include "device.h"
+#include "dma.h"
+#include "fdc.h"
+#include "keyboard_at.h"
+#include "mem.h"
+#include "model.h"
+#include "pic.h"
+#include "pit.h"
+#include "savestate.h"
+#include "x86.h"
+
+#define SAVESTATE_MAGIC "PCEMSNAP"
+#define SAVESTATE_VERSION 2
+
+/*Header flags*/
+#define SAVESTATE_DELTA 1
+
+#define SECTION_NAME_LEN 64
+#define SAVESTATE_PAGE_SIZE 4096
+
+typedef struct savestate_header_t
+{
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint64_t id;
+        /*Full snapshot that a delta is relative to*/
+        uint64_t base_id;
+        char base_fn[512];
+        /*Machine configuration the snapshot was taken with*/
+        char model[24];
+        int32_t cpu_manufacturer, cpu;
+        int32_t mem_size;
+        uint32_t cpu_state_size;
+} savestate_header_t;
+
+struct savestate_t
+{
+        FILE *f;
+        savestate_header_t header;
+        int error;
+
+        /*Write - file offset of the current section's length field*/
+        long section_start;
+        /*Read - bytes remaining in the current section*/
+        uint32_t section_left;
+};
+
+/*Requests are made from the UI thread and carried out by the emulation
+  thread. Each one is a separate allocation handed over by an atomic
+  exchange, so neither thread writes a file name the other is reading, and a
+  request made while an earlier one is being carried out is kept for the
+  next poll. A newer request of the same kind replaces one not yet taken*/
+typedef struct savestate_request_t
+{
+        char fn[512];
+        char base_fn[512];
+} savestate_request_t;
+
+static _Atomic(savestate_request_t *) savestate_pending_save, savestate_pending_load;
+
+void savestate_begin_section(savestate_t *s, char *name)
+{
+        char section_name[SECTION_NAME_LEN];
+        uint32_t len = 0;
+
+        memset(section_name, 0, sizeof(section_name));
+        strncpy(section_name, name, SECTION_NAME_LEN - 1);
+        fwrite(section_name, SECTION_NAME_LEN, 1, s->f);
+        s->section_start = ftell(s->f);
+        fwrite(&len, 4, 1, s->f);
+}
+
+void savestate_end_section(savestate_t *s)
+{
+        long pos = ftell(s->f);
+        uint32_t len = pos - (s->section_start + 4);
+
+        fseek(s->f, s->section_start, SEEK_SET);
+        fwrite(&len, 4, 1, s->f);
+        fseek(s->f, pos, SEEK_SET);
+}
+
+int savestate_open_section(savestate_t *s, char *name)
+{
+        char section_name[SECTION_NAME_LEN];
+        uint32_t len;
+
+        fseek(s->f, sizeof(savestate_header_t), SEEK_SET);
+        while (fread(section_name, SECTION_NAME_LEN, 1, s->f) == 1 && fread(&len, 4, 1, s->f) == 1)
+        {
+                section_name[SECTION_NAME_LEN - 1] = 0;
+                if (!strcmp(section_name, name))
+                {
+                        s->section_left = len;
+                        return 0;
+                }
+                fseek(s->f, len, SEEK_CUR);
+        }
+
+        pclog("savestate : section %s not found\n", name);
+        s->section_left = 0;
+        s->error = 1;
+        return -1;
+}
+
+void savestate_write(savestate_t *s, void *data, int size)
+{
+        if (fwrite(data, size, 1, s->f) != 1)
+                s->error = 1;
+}
+
+void savestate_read(savestate_t *s, void *data, int size)
+{
+        int avail = (size > s->section_left) ? s->section_left : size;
+
+        if (avail < size)
+        {
+                memset((uint8_t *)data + avail, 0, size - avail);
+                s->error = 1;
+        }
+        if (avail && fread(data, avail, 1, s->f) != 1)
+                s->error = 1;
+        s->section_left -= avail;
+}
+
+void savestate_write_timer(savestate_t *s, pc_timer_t *timer)
+{
+        int32_t enabled = timer->enabled;
+        int64_t delay = 0;
+
+        if (enabled)
+                delay = (int64_t)((((uint64_t)timer->ts_integer << 32) | timer->ts_frac) - (tsc << 32));
+
+        savestate_write(s, &enabled, sizeof(enabled));
+        savestate_write(s, &delay, sizeof(delay));
+}
+
+void savestate_read_timer(savestate_t *s, pc_timer_t *timer)
+{
+        int32_t enabled;
+        int64_t delay;
+
+        savestate_read(s, &enabled, sizeof(enabled));
+        savestate_read(s, &delay, sizeof(delay));
+
+        timer_disable(timer);
+        if (enabled)
+        {
+                uint64_t ts = (tsc << 32) + delay;
+
+                timer->ts_integer = ts >> 32;
+                timer->ts_frac = ts & 0xffffffff;
+                timer_enable(timer);
+        }
+}
+
+static savestate_t *savestate_open(char *fn)
+{
+        savestate_t *s = malloc(sizeof(savestate_t));
+
+        memset(s, 0, sizeof(savestate_t));
+        s->f = fopen(fn, "rb");
+        if (!s->f)
+        {
+                pclog("savestate : can't open %s\n", fn);
+                free(s);
+                return NULL;
+        }
+        if (fread(&s->header, sizeof(savestate_header_t), 1, s->f) != 1)
+                s->error = 1;
+
+        return s;
+}
+
+static void savestate_close(savestate_t *s)
+{
+        fclose(s->f);
+        free(s);
+}
+
+static int savestate_check_header(savestate_t *s, char *fn)
+{
+        savestate_header_t *header = &s->header;
+
+        if (s->error || memcmp(header->magic, SAVESTATE_MAGIC, 8) || header->version != SAVESTATE_VERSION)
+        {
+                pclog("savestate : %s is not a snapshot\n", fn);
+                return -1;
+        }
+        header->model[sizeof(header->model) - 1] = 0;
+        if (strcmp(header->model, model_get_internal_name()) || header->cpu_manufacturer != cpu_manufacturer ||
+            header->cpu != cpu || header->mem_size != mem_size || header->cpu_state_size != sizeof(cpu_state))
+        {
+                pclog("savestate : %s was taken with a different configuration\n", fn);
+                return -1;
+        }
+
+        return 0;
+}
+
+/*Pad the file so that the data of the next section starts on a page
+  boundary. The padding is an ordinary section, so readers skip it*/
+static void savestate_align_next_section(savestate_t *s)
+{
+        static const uint8_t zero[SAVESTATE_PAGE_SIZE];
+        long pos = ftell(s->f) + 2 * (SECTION_NAME_LEN + 4);
+        int pad = (SAVESTATE_PAGE_SIZE - (pos % SAVESTATE_PAGE_SIZE)) % SAVESTATE_PAGE_SIZE;
+
+        savestate_begin_section(s, "pad");
+        if (pad)
+                savestate_write(s, (void *)zero, pad);
+        savestate_end_section(s);
+}
+
+/*Read RAM from an open "ram" section. Where possible RAM is mapped copy on
+  write from the file instead, which makes loading nearly free and lets every
+  machine restored from the same snapshot share the pages it hasn't written*/
+static void savestate_read_ram(savestate_t *s)
+{
+        long pos = ftell(s->f);
+
+        if (s->section_left >= mem_size * 1024 && !mem_map_ram_file(fileno(s->f), pos))
+        {
+                fseek(s->f, mem_size * 1024, SEEK_CUR);
+                s->section_left -= mem_size * 1024;
+                return;
+        }
+        savestate_read(s, ram, mem_size * 1024);
+}
+
+/*Store only the pages that differ from the RAM in the full snapshot base_fn*/
+static int savestate_save_ram_delta(savestate_t *s, char *base_fn)
+{
+        savestate_t *base = savestate_open(base_fn);
+        uint8_t page[SAVESTATE_PAGE_SIZE];
+        uint32_t c, changed = 0;
+
+        if (!base)
+                return -1;
+        if (savestate_check_header(base, base_fn) || (base->header.flags & SAVESTATE_DELTA))
+        {
+                pclog("savestate : %s is not a full snapshot for this machine\n", base_fn);
+                savestate_close(base);
+                return -1;
+        }
+        if (savestate_open_section(base, "ram"))
+        {
+                savestate_close(base);
+                return -1;
+        }
+
+        savestate_begin_section(s, "ram_delta");
+        for (c = 0; c < (mem_size * 1024) / SAVESTATE_PAGE_SIZE; c++)
+        {
+                savestate_read(base, page, SAVESTATE_PAGE_SIZE);
+                if (memcmp(page, &ram[c * SAVESTATE_PAGE_SIZE], SAVESTATE_PAGE_SIZE))
+                {
+                        savestate_write(s, &c, sizeof(c));
+                        savestate_write(s, &ram[c * SAVESTATE_PAGE_SIZE], SAVESTATE_PAGE_SIZE);
+                        changed++;
+                }
+        }
+        savestate_end_section(s);
+
+        s->header.flags |= SAVESTATE_DELTA;
+        s->header.base_id = base->header.id;
+        strncpy(s->header.base_fn, base_fn, sizeof(s->header.base_fn) - 1);
+        pclog("savestate : %i of %i RAM pages differ from %s\n", changed, (mem_size * 1024) / SAVESTATE_PAGE_SIZE, base_fn);
+
+        savestate_close(base);
+        return 0;
+}
+
+static int savestate_load_ram_delta(savestate_t *s)
+{
+        char *base_fn = s->header.base_fn;
+        savestate_t *base;
+        uint32_t page_nr;
+
+        base_fn[sizeof(s->header.base_fn) - 1] = 0;
+        base = savestate_open(base_fn);
+        if (!base)
+                return -1;
+        if (savestate_check_header(base, base_fn) || base->header.id != s->header.base_id)
+        {
+                pclog("savestate : %s does not match the snapshot it was taken against\n", base_fn);
+                savestate_close(base);
+                return -1;
+        }
+        if (savestate_open_section(base, "ram"))
+        {
+                savestate_close(base);
+                return -1;
+        }
+        savestate_read_ram(base);
+        savestate_close(base);
+
+        if (savestate_open_section(s, "ram_delta"))
+                return -1;
+        while (s->section_left >= sizeof(page_nr) + SAVESTATE_PAGE_SIZE)
+        {
+                savestate_read(s, &page_nr, sizeof(page_nr));
+                if (page_nr >= (mem_size * 1024) / SAVESTATE_PAGE_SIZE)
+                        return -1;
+                savestate_read(s, &ram[page_nr * SAVESTATE_PAGE_SIZE], SAVESTATE_PAGE_SIZE);
+        }
+
+        return 0;
+}
+
+static void savestate_save_misc(savestate_t *s)
+{
+        savestate_begin_section(s, "misc");
+        savestate_write(s, &ppi, sizeof(PPI));
+        savestate_write(s, &mem_a20_key, sizeof(mem_a20_key));
+        savestate_write(s, &mem_a20_alt, sizeof(mem_a20_alt));
+        savestate_end_section(s);
+}
+
+static void savestate_load_misc(savestate_t *s)
+{
+        if (savestate_open_section(s, "misc"))
+                return;
+        savestate_read(s, &ppi, sizeof(PPI));
+        savestate_read(s, &mem_a20_key, sizeof(mem_a20_key));
+        savestate_read(s, &mem_a20_alt, sizeof(mem_a20_alt));
+        mem_a20_recalc();
+}
+
+int savestate_save(char *fn, char *base_fn)
+{
+        savestate_t *s = malloc(sizeof(savestate_t));
+        savestate_header_t *header = &s->header;
+        int ret = 0;
+
+        memset(s, 0, sizeof(savestate_t));
+        /*Snapshots are mapped by the machines restored from them, so never
+          rewrite one in place. Removing it first leaves existing mappings
+          with the old contents*/
+        remove(fn);
+        s->f = fopen(fn, "wb");
+        if (!s->f)
+        {
+                pclog("savestate : can't create %s\n", fn);
+                free(s);
+                return -1;
+        }
+
+        memcpy(header->magic, SAVESTATE_MAGIC, 8);
+        header->version = SAVESTATE_VERSION;
+        header->id = ((uint64_t)time(NULL) << 32) ^ timer_read() ^ tsc;
+        strncpy(header->model, model_get_internal_name(), sizeof(header->model) - 1);
+        header->cpu_manufacturer = cpu_manufacturer;
+        header->cpu = cpu;
+        header->mem_size = mem_size;
+        header->cpu_state_size = sizeof(cpu_state);
+        /*Written again once all sections are complete*/
+        fwrite(header, sizeof(savestate_header_t), 1, s->f);
+
+        /*Disc images must be up to date for machines restored from this
+          snapshot with disc overlays*/
+        fflush(NULL);
+
+        cpu_save_state(s);
+        if (base_fn && base_fn[0])
+        {
+                if (savestate_save_ram_delta(s, base_fn))
+                        ret = -1;
+        }
+        else
+        {
+                savestate_align_next_section(s);
+                savestate_begin_section(s, "ram");
+                savestate_write(s, ram, mem_size * 1024);
+                savestate_end_section(s);
+        }
+        pic_save_state(s);
+        pit_save_state(s);
+        dma_save_state(s);
+        savestate_save_misc(s);
+        fdc_save_state(s);
+        keyboard_at_save_state(s);
+        device_save_all(s);
+        mem_save_state(s);
+
+        fseek(s->f, 0, SEEK_SET);
+        fwrite(header, sizeof(savestate_header_t), 1, s->f);
+        if (s->error)
+                ret = -1;
+        fclose(s->f);
+        free(s);
+
+        if (ret)
+        {
+                pclog("savestate : failed to save %s\n", fn);
+                remove(fn);
+        }
+        else
+                pclog("savestate : saved %s\n", fn);
+
+        return ret;
+}
+
+int savestate_load(char *fn)
+{
+        savestate_t *s = savestate_open(fn);
+
+        if (!s)
+                return -1;
+        if (savestate_check_header(s, fn))
+        {
+                savestate_close(s);
+                return -1;
+        }
+
+        /*Nothing has been changed up to this point. Start from a freshly
+          reset machine, so that devices are in their initial configuration
+          and state not in the snapshot is consistent. A failure past here
+          leaves the machine in an inconsistent state, so it is reset again*/
+        resetpchard();
+
+        if (s->header.flags & SAVESTATE_DELTA)
+        {
+                if (savestate_load_ram_delta(s))
+                        s->error = 1;
+        }
+        else if (!savestate_open_section(s, "ram"))
+                savestate_read_ram(s);
+
+        cpu_load_state(s);
+        pic_load_state(s);
+        pit_load_state(s);
+        dma_load_state(s);
+        savestate_load_misc(s);
+        fdc_load_state(s);
+        keyboard_at_load_state(s);
+        device_load_all(s);
+        /*After the devices, as their load functions can move mappings*/
+        mem_load_state(s);
+
+        /*Translations and recompiled code all refer to the old contents of
+          memory*/
+        flushmmucache();
+        codegen_reset();
+
+        if (s->error)
+        {
+                pclog("savestate : failed to load %s, resetting\n", fn);
+                savestate_close(s);
+                resetpchard();
+                return -1;
+        }
+
+        savestate_close(s);
+        pclog("savestate : loaded %s\n", fn);
+        return 0;
+}
+
+static void savestate_request(_Atomic(savestate_request_t *) *pending, char *fn, char *base_fn)
+{
+        savestate_request_t *request = calloc(1, sizeof(savestate_request_t));
+
+        strncpy(request->fn, fn, sizeof(request->fn) - 1);
+        if (base_fn)
+                strncpy(request->base_fn, base_fn, sizeof(request->base_fn) - 1);
+
+        free(atomic_exchange_explicit(pending, request, memory_order_acq_rel));
+}
+
+void savestate_request_save(char *fn, char *base_fn)
+{
+        savestate_request(&savestate_pending_save, fn, base_fn);
+}
+
+void savestate_request_load(char *fn)
+{
+        savestate_request(&savestate_pending_load, fn, NULL);
+}
+
+void savestate_poll()
+{
+        savestate_request_t *request;
+
+        request = atomic_exchange_explicit(&savestate_pending_save, NULL, memory_order_acquire);
+        if (request)
+        {
+                savestate_save(request->fn, request->base_fn);
+                free(request);
+        }
+        request = atomic_exchange_explicit(&savestate_pending_load, NULL, memory_order_acquire);
+        if (request)
+        {
+                savestate_load(request->fn);
+                free(request);
+        }
+}
@@ -0,0 +1,56 @@
+#ifndef _SAVESTATE_H_
+#define _SAVESTATE_H_
+
+#include "timer.h"
+
+/*Machine snapshots. A snapshot holds the CPU, RAM, core chipset (PIC, PIT,
+  DMA, PPI, memory mappings and shadow RAM state), the floppy controller and
+  drives, the AT keyboard controller, and the state of every device that
+  implements the save/load hooks in device_t (currently VGA/ET4000 video
+  including VRAM, IDE and the RTC/NVR). Loading a snapshot hard resets the
+  machine first. Snapshots can only be restored into a machine with the same
+  configuration, running the same build.
+
+  A snapshot can be taken relative to a full snapshot, in which case only the
+  RAM pages that differ from the full snapshot are stored. Restoring such a
+  delta reads the unchanged pages from the full snapshot, which must still
+  exist.
+
+  Timers are stored relative to the current TSC, so restoring a snapshot does
+  not change the TSC, and timers owned by code without save support stay
+  valid.
+
+  Where the host allows it, RAM is mapped copy-on-write from the snapshot
+  rather than read. This makes it cheap to fan a machine out into several
+  runs: take a full snapshot, then start any number of PCem processes that
+  load it with hdd_overlay set (see hdd_file.h). They share the unmodified
+  RAM pages and disc sectors, and each keeps its own changes to both. The
+  disc images must not change while such machines are running.*/
+typedef struct savestate_t savestate_t;
+
+/*Save and load must be called between frames on the emulation thread. They
+  return 0 on success*/
+int savestate_save(char *fn, char *base_fn);
+int savestate_load(char *fn);
+
+/*Queue a save or load from another thread. The request is carried out at the
+  start of the next frame*/
+void savestate_request_save(char *fn, char *base_fn);
+void savestate_request_load(char *fn);
+void savestate_poll();
+
+/*A snapshot is a sequence of named sections. Sections can be opened for
+  reading in any order; savestate_open_section() returns 0 if the section
+  is present*/
+void savestate_begin_section(savestate_t *s, char *name);
+void savestate_end_section(savestate_t *s);
+int savestate_open_section(savestate_t *s, char *name);
+
+/*Section data access, for use by subsystem and device save/load functions.
+  Reads past the end of a section return zeroes and mark the load as failed*/
+void savestate_write(savestate_t *s, void *data, int size);
+void savestate_read(savestate_t *s, void *data, int size);
+void savestate_write_timer(savestate_t *s, pc_timer_t *timer);
+void savestate_read_timer(savestate_t *s, pc_timer_t *timer);
+
+#endif
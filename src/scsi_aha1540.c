@@ -429,41 +429,44 @@ static int wait_for_bus(scsi_bus_t *bus, int state, int req_needed)
 
 static void process_cdb(aha154x_t *scsi)
 {
+        uint8_t ccb[0x12];
         int c;
         uint8_t temp;
         
-        scsi->ccb.opcode = mem_readb_phys(scsi->ccb.addr);
+        /*Fetch the fixed part of the CCB in one transfer rather than a byte
+          at a time*/
+        mem_dma_read(scsi->ccb.addr, ccb, sizeof(ccb));
+        scsi->ccb.opcode = ccb[0];
         switch (scsi->ccb.opcode)
         {
                 case CCB_INITIATOR:
                 case CCB_INITIATOR_RESIDUAL:
-                temp = mem_readb_phys(scsi->ccb.addr + 0x01);
+                temp = ccb[0x01];
 //                pclog("Read addr+ctrl %02x %06x\n", temp, scsi->ccb.addr+0x01);
                 scsi->ccb.transfer_dir = (temp >> 3) & 3;
-                scsi->ccb.scsi_cmd_len = mem_readb_phys(scsi->ccb.addr + 0x02);
-                scsi->ccb.req_sense_len = mem_readb_phys(scsi->ccb.addr + 0x03);
+                scsi->ccb.scsi_cmd_len = ccb[0x02];
+                scsi->ccb.req_sense_len = ccb[0x03];
 
                 if (scsi->mb_format == MB_FORMAT_4)
                 {
                         scsi->ccb.lun = temp & 7;
                         scsi->ccb.target_id = (temp >> 5) & 7;
                                                 
-                        scsi->ccb.data_len = mem_readb_phys(scsi->ccb.addr + 0x06) | (mem_readb_phys(scsi->ccb.addr + 0x05) << 8) | (mem_readb_phys(scsi->ccb.addr + 0x04) << 16);
-                        scsi->ccb.data_pointer = mem_readb_phys(scsi->ccb.addr + 0x09) | (mem_readb_phys(scsi->ccb.addr + 0x08) << 8) | (mem_readb_phys(scsi->ccb.addr + 0x07) << 16);
-                        scsi->ccb.link_pointer = mem_readb_phys(scsi->ccb.addr + 0x0c) | (mem_readb_phys(scsi->ccb.addr + 0x0b) << 8) | (mem_readb_phys(scsi->ccb.addr + 0x0a) << 16);
-                        scsi->ccb.link_id = mem_readb_phys(scsi->ccb.addr + 0x0d);
+                        scsi->ccb.data_len = ccb[0x06] | (ccb[0x05] << 8) | (ccb[0x04] << 16);
+                        scsi->ccb.data_pointer = ccb[0x09] | (ccb[0x08] << 8) | (ccb[0x07] << 16);
+                        scsi->ccb.link_pointer = ccb[0x0c] | (ccb[0x0b] << 8) | (ccb[0x0a] << 16);
+                        scsi->ccb.link_id = ccb[0x0d];
                 }
                 else
                 {
-                        scsi->ccb.data_len = mem_readl_phys(scsi->ccb.addr + 0x04);
-                        scsi->ccb.data_pointer = mem_readl_phys(scsi->ccb.addr + 0x08);
+                        scsi->ccb.data_len = *(uint32_t *)&ccb[0x04];
+                        scsi->ccb.data_pointer = *(uint32_t *)&ccb[0x08];
 
-                        scsi->ccb.target_id = mem_readb_phys(scsi->ccb.addr + 0x10);
-                        scsi->ccb.lun = mem_readb_phys(scsi->ccb.addr + 0x11) & 0x1f;
+                        scsi->ccb.target_id = ccb[0x10];
+                        scsi->ccb.lun = ccb[0x11] & 0x1f;
 //                        pclog("Target ID = %02x  addr=%08x len=%08x\n", scsi->ccb.target_id, scsi->ccb.data_pointer, scsi->ccb.data_len);
                 }
-                for (c = 0; c < scsi->ccb.scsi_cmd_len; c++)
-                        scsi->ccb.cdb[c] = mem_readb_phys(scsi->ccb.addr+0x12+c);
+                mem_dma_read(scsi->ccb.addr + 0x12, scsi->ccb.cdb, scsi->ccb.scsi_cmd_len);
 //                pclog("CCB_INITIATOR: target=%i lun=%i\n", scsi->ccb.target_id, scsi->ccb.lun);
 //                pclog("  scsi_len=%i data_len=%06x data_pointer=%06x\n", scsi->ccb.scsi_cmd_len, scsi->ccb.data_len, scsi->ccb.data_pointer);
                 scsi->ccb_state = CCB_STATE_SEND_COMMAND;
@@ -476,40 +479,39 @@ static void process_cdb(aha154x_t *scsi)
                 case CCB_INITIATOR_SCATTER_GATHER:
                 case CCB_INITIATOR_SCATTER_GATHER_RESIDUAL:
 //                pclog("Scatter-gather : %08x %08x %08x %08x %08x  %i  %02x\n", mem_readl_phys(scsi->ccb.addr),mem_readl_phys(scsi->ccb.addr+4),mem_readl_phys(scsi->ccb.addr+8),mem_readl_phys(scsi->ccb.addr+12),mem_readl_phys(scsi->ccb.addr+16), scsi->mb_format == MB_FORMAT_4,  scsi->ccb.opcode);
-                temp = mem_readb_phys(scsi->ccb.addr + 0x01);
+                temp = ccb[0x01];
 //                pclog("Read addr+ctrl %02x %06x\n", temp, scsi->ccb.addr+0x01);
                 scsi->ccb.transfer_dir = (temp >> 3) & 3;
-                scsi->ccb.scsi_cmd_len = mem_readb_phys(scsi->ccb.addr + 0x02);
-                scsi->ccb.req_sense_len = mem_readb_phys(scsi->ccb.addr + 0x03);
+                scsi->ccb.scsi_cmd_len = ccb[0x02];
+                scsi->ccb.req_sense_len = ccb[0x03];
                                         
                 if (scsi->mb_format == MB_FORMAT_4)
                 {
                         scsi->ccb.lun = temp & 7;
                         scsi->ccb.target_id = (temp >> 5) & 7;
                                                 
-                        scsi->ccb.data_seg_list_len = mem_readb_phys(scsi->ccb.addr + 0x06) | (mem_readb_phys(scsi->ccb.addr + 0x05) << 8) | (mem_readb_phys(scsi->ccb.addr + 0x04) << 16);
-                        scsi->ccb.data_seg_list_pointer = mem_readb_phys(scsi->ccb.addr + 0x09) | (mem_readb_phys(scsi->ccb.addr + 0x08) << 8) | (mem_readb_phys(scsi->ccb.addr + 0x07) << 16);
+                        scsi->ccb.data_seg_list_len = ccb[0x06] | (ccb[0x05] << 8) | (ccb[0x04] << 16);
+                        scsi->ccb.data_seg_list_pointer = ccb[0x09] | (ccb[0x08] << 8) | (ccb[0x07] << 16);
                         scsi->ccb.data_seg_list_idx = 0;
                         if (scsi->ccb.data_seg_list_len < 6)
                                 pclog("Scatter gather table < 6 bytes\n");
                         
-                        scsi->ccb.link_pointer = mem_readb_phys(scsi->ccb.addr + 0x0c) | (mem_readb_phys(scsi->ccb.addr + 0x0b) << 8) | (mem_readb_phys(scsi->ccb.addr + 0x0a) << 16);
-                        scsi->ccb.link_id = mem_readb_phys(scsi->ccb.addr + 0x0d);
+                        scsi->ccb.link_pointer = ccb[0x0c] | (ccb[0x0b] << 8) | (ccb[0x0a] << 16);
+                        scsi->ccb.link_id = ccb[0x0d];
                 }
                 else
                 {
-                        scsi->ccb.data_seg_list_len = mem_readl_phys(scsi->ccb.addr + 0x04);
-                        scsi->ccb.data_seg_list_pointer = mem_readl_phys(scsi->ccb.addr + 0x08);
+                        scsi->ccb.data_seg_list_len = *(uint32_t *)&ccb[0x04];
+                        scsi->ccb.data_seg_list_pointer = *(uint32_t *)&ccb[0x08];
                         scsi->ccb.data_seg_list_idx = 0;
                         if (scsi->ccb.data_seg_list_len < 8)
                                 pclog("Scatter gather table < 8 bytes\n");
                                                                                 
-                        scsi->ccb.target_id = mem_readb_phys(scsi->ccb.addr + 0x10);
-                        scsi->ccb.lun = mem_readb_phys(scsi->ccb.addr + 0x11) & 0x1f;
+                        scsi->ccb.target_id = ccb[0x10];
+                        scsi->ccb.lun = ccb[0x11] & 0x1f;
 //                        pclog("Target ID = %02x\n", scsi->ccb.target_id);
                 }
-                for (c = 0; c < scsi->ccb.scsi_cmd_len; c++)
-                        scsi->ccb.cdb[c] = mem_readb_phys(scsi->ccb.addr+0x12+c);
+                mem_dma_read(scsi->ccb.addr + 0x12, scsi->ccb.cdb, scsi->ccb.scsi_cmd_len);
 //                pclog("CCB_INITIATOR_SCATTER_GATHER: target=%i lun=%i\n", scsi->ccb.target_id, scsi->ccb.lun);
 //                pclog("  scsi_len=%i data_len=%06x data_pointer=%06x\n", scsi->ccb.scsi_cmd_len, scsi->ccb.data_len, scsi->ccb.data_pointer);
                 scsi->ccb_state = CCB_STATE_SEND_COMMAND;
@@ -537,7 +539,7 @@ static void process_cdb(aha154x_t *scsi)
                         }
                         else
                         {
-                                for (c = 0; c < scsi->ccb.data_seg_list_len; c += 6)
+                                for (c = 0; c < scsi->ccb.data_seg_list_len; c += 8)
                                 {
                                         uint32_t len = mem_readl_phys(addr + c);
                                         
@@ -958,10 +960,7 @@ static void process_cmd(aha154x_t *scsi)
                                         break;
                                         case 1:
                                         addr = scsi->params[9] | (scsi->params[8] << 8) | (scsi->params[7] << 16);
-                                        mem_writeb_phys(addr,   scsi->int_buffer[0]);
-                                        mem_writeb_phys(addr+1, scsi->int_buffer[1]);
-                                        mem_writeb_phys(addr+2, scsi->int_buffer[2]);
-                                        mem_writeb_phys(addr+3, scsi->int_buffer[3]);
+                                        mem_dma_write(addr, scsi->int_buffer, 4);
                                         pclog("Got size %06x %02x%02x%02x%02x\n", addr, scsi->int_buffer[3],scsi->int_buffer[2],scsi->int_buffer[1],scsi->int_buffer[0]);
                                         scsi->data_in = 0;
                                         set_irq(scsi, ISR_HACC);
@@ -1033,10 +1032,7 @@ static void process_cmd(aha154x_t *scsi)
                                         break;
                                         case 2:
                                         addr = scsi->params[9] | (scsi->params[8] << 8) | (scsi->params[7] << 16);
-                                        mem_writeb_phys(addr,   scsi->int_buffer[0]);
-                                        mem_writeb_phys(addr+1, scsi->int_buffer[1]);
-                                        mem_writeb_phys(addr+2, scsi->int_buffer[2]);
-                                        mem_writeb_phys(addr+3, scsi->int_buffer[3]);
+                                        mem_dma_write(addr, scsi->int_buffer, 4);
                                         pclog("Got size %06x %02x%02x%02x%02x\n", addr, scsi->int_buffer[3],scsi->int_buffer[2],scsi->int_buffer[1],scsi->int_buffer[0]);
                                         scsi->data_in = 0;
                                         set_irq(scsi, ISR_HACC);
@@ -1181,8 +1177,7 @@ static void process_cmd(aha154x_t *scsi)
                         case COMMAND_WRITE_CHANNEL_2_BUF:
                         addr = scsi->params[2] | (scsi->params[1] << 8) | (scsi->params[0] << 16);
                         pclog("WRITE_CHANNEL_2_BUF %06x\n", addr);
-                        for (c = 0; c < 64; c++)
-                                scsi->dma_buffer[c] = mem_readb_phys(addr + c);
+                        mem_dma_read(addr, scsi->dma_buffer, 64);
                         set_irq(scsi, ISR_HACC);
                         scsi->cmd_state = CMD_STATE_IDLE;
                         pclog("Command complete\n");
@@ -1191,8 +1186,7 @@ static void process_cmd(aha154x_t *scsi)
                         case COMMAND_READ_CHANNEL_2_BUF:
                         addr = scsi->params[2] | (scsi->params[1] << 8) | (scsi->params[0] << 16);
                         pclog("READ_CHANNEL_2_BUF %06x\n", addr);
-                        for (c = 0; c < 64; c++)
-                                mem_writeb_phys(addr + c, scsi->dma_buffer[c]);
+                        mem_dma_write(addr, scsi->dma_buffer, 64);
                         set_irq(scsi, ISR_HACC);
                         scsi->cmd_state = CMD_STATE_IDLE;
                         pclog("Command complete\n");
@@ -1784,9 +1778,32 @@ static void process_ccb(aha154x_t *scsi)
         }
 }
 
+static void next_sg_entry(aha154x_t *scsi)
+{
+        uint8_t entry[8];
+        
+        if (scsi->mb_format == MB_FORMAT_4)
+        {
+                mem_dma_read(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx, entry, 6);
+                scsi->cdb.data_len = entry[2] | (entry[1] << 8) | (entry[0] << 16);
+                scsi->cdb.data_pointer = entry[5] | (entry[4] << 8) | (entry[3] << 16);
+                scsi->cdb.data_seg_list_idx += 6;
+        }
+        else
+        {
+                mem_dma_read(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx, entry, 8);
+                scsi->cdb.data_len = *(uint32_t *)&entry[0];
+                scsi->cdb.data_pointer = *(uint32_t *)&entry[4];
+                scsi->cdb.data_seg_list_idx += 8;
+        }
+        scsi->cdb.data_idx = 0;
+}
+
 static void process_scsi(aha154x_t *scsi)
 {
         int c;
+        uint8_t buffer[MAX_BYTES_TRANSFERRED_PER_POLL];
+        int start_idx;
         int bytes_transferred = 0;
         
         switch (scsi->scsi_state)
@@ -1935,6 +1952,9 @@ static void process_scsi(aha154x_t *scsi)
                 
                 case SCSI_STATE_READ_DATA:
 //pclog("READ_DATA %i,%i %i\n", scsi->cdb.data_idx,scsi->cdb.data_len, scsi->cdb.scatter_gather);
+                /*Bytes are still clocked off the bus one at a time, but are
+                  gathered locally and copied to guest memory as one block*/
+                start_idx = scsi->cdb.data_idx;
                 while (scsi->cdb.data_idx < scsi->cdb.data_len && scsi->scsi_state == SCSI_STATE_READ_DATA && bytes_transferred < MAX_BYTES_TRANSFERRED_PER_POLL)
                 {
                         int d;
@@ -1961,7 +1981,7 @@ static void process_scsi(aha154x_t *scsi)
                                         if (scsi->cdb.data_pointer == -1)
                                                 scsi->int_buffer[scsi->cdb.data_idx] = data;
                                         else
-                                                mem_writeb_phys(scsi->cdb.data_pointer + scsi->cdb.data_idx, data);
+                                                buffer[scsi->cdb.data_idx - start_idx] = data;
                                         scsi->cdb.data_idx++;
                                         scsi->cdb.bytes_transferred++;
                                 
@@ -1974,6 +1994,8 @@ static void process_scsi(aha154x_t *scsi)
                         
                         bytes_transferred++;
                 }
+                if (scsi->cdb.data_pointer != -1 && scsi->cdb.data_idx != start_idx)
+                        mem_dma_write(scsi->cdb.data_pointer + start_idx, buffer, scsi->cdb.data_idx - start_idx);
                 if (scsi->cdb.data_idx == scsi->cdb.data_len)
                 {
                         if (scsi->cdb.scatter_gather)
@@ -1982,25 +2004,7 @@ static void process_scsi(aha154x_t *scsi)
                                         scsi->scsi_state = SCSI_STATE_NEXT_PHASE;
                                 else
                                 {
-                                        if (scsi->mb_format == MB_FORMAT_4)
-                                        {
-                                                scsi->cdb.data_len = mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 2) |
-                                                                        (mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 1) << 8) |
-                                                                        (mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx) << 16);
-                                                scsi->cdb.data_pointer = mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 5) |
-                                                                        (mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 4) << 8) |
-                                                                        (mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 3) << 16);
-                                                scsi->cdb.data_idx = 0;
-                                                scsi->cdb.data_seg_list_idx += 6;
-                                        }
-                                        else
-                                        {
-                                                scsi->cdb.data_len = mem_readl_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx);
-                                                scsi->cdb.data_pointer = mem_readl_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 4);
-                                                scsi->cdb.data_idx = 0;
-                                                scsi->cdb.data_seg_list_idx += 8;
-//                                                output = 3;
-                                        }
+                                        next_sg_entry(scsi);
                                         pclog("Got scatter gather %08x %08x\n", scsi->cdb.data_pointer, scsi->cdb.data_len);
                                 }
                         }
@@ -2010,6 +2014,9 @@ static void process_scsi(aha154x_t *scsi)
                 break;
                 
                 case SCSI_STATE_WRITE_DATA:
+                start_idx = scsi->cdb.data_idx;
+                if (scsi->cdb.data_pointer != -1)
+                        mem_dma_read(scsi->cdb.data_pointer + start_idx, buffer, MIN(scsi->cdb.data_len - start_idx, MAX_BYTES_TRANSFERRED_PER_POLL));
                 while (scsi->cdb.data_idx < scsi->cdb.data_len && bytes_transferred < MAX_BYTES_TRANSFERRED_PER_POLL)
                 {
                         int d;
@@ -2036,7 +2043,7 @@ static void process_scsi(aha154x_t *scsi)
                                         if (scsi->cdb.data_pointer == -1)
                                                 data = scsi->int_buffer[scsi->cdb.data_idx];
                                         else
-                                                data = mem_readb_phys(scsi->cdb.data_pointer + scsi->cdb.data_idx);
+                                                data = buffer[scsi->cdb.data_idx - start_idx];
                                         scsi->cdb.data_idx++;
                                         scsi->cdb.bytes_transferred++;
                                                                         
@@ -2058,24 +2065,7 @@ static void process_scsi(aha154x_t *scsi)
                                         scsi->scsi_state = SCSI_STATE_NEXT_PHASE;
                                 else
                                 {
-                                        if (scsi->mb_format == MB_FORMAT_4)
-                                        {
-                                                scsi->cdb.data_len = mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 2) |
-                                                                        (mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 1) << 8) |
-                                                                        (mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx) << 16);
-                                                scsi->cdb.data_pointer = mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 5) |
-                                                                        (mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 4) << 8) |
-                                                                        (mem_readb_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 3) << 16);
-                                                scsi->cdb.data_idx = 0;
-                                                scsi->cdb.data_seg_list_idx += 6;
-                                        }
-                                        else
-                                        {
-                                                scsi->cdb.data_len = mem_readl_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx);
-                                                scsi->cdb.data_pointer = mem_readl_phys(scsi->cdb.data_seg_list_pointer + scsi->cdb.data_seg_list_idx + 4);
-                                                scsi->cdb.data_idx = 0;
-                                                scsi->cdb.data_seg_list_idx += 8;
-                                        }
+                                        next_sg_entry(scsi);
                                         pclog("Got scatter gather %08x %08x\n", scsi->cdb.data_pointer, scsi->cdb.data_len);
                                 }
                         }
@@ -12,6 +12,7 @@
 #include "sound_opl.h"
 
 #include "sound.h"
+#include "sound_capture.h"
 #include "sound_adlib.h"
 #include "sound_adlibgold.h"
 #include "sound_audiopci.h"
@@ -20,6 +21,7 @@
 #include "sound_sb.h"
 #include "sound_sb_dsp.h"
 #include "sound_wss.h"
+#include "profiler.h"
 
 #include "timer.h"
 #include "thread.h"
@@ -113,13 +115,61 @@ static struct
 {
         void (*get_buffer)(int32_t *buffer, int len, void *p);
         void *priv;
+        char *name;
+        int capture_stem;
+#ifdef PROFILER
+        profiler_counter_t *profiler;
+#endif
 } sound_handlers[8];
 
 static int sound_handlers_num;
 
+/*Handlers added with sound_add_threaded_handler() only touch their own device
+  state when rendering, so they can run on worker threads while the emulation
+  thread waits in sound_poll(). Each renders into a private buffer, which is
+  then summed into the output buffer. The emulation thread renders its own
+  share of these handlers rather than idling*/
+#define SOUND_MAX_THREADED 8
+#define SOUND_MAX_WORKERS 3
+
+static struct
+{
+        void (*get_buffer)(int32_t *buffer, int len, void *p);
+        void *priv;
+        char *name;
+        int capture_stem;
+        int32_t *buffer;
+#ifdef PROFILER
+        profiler_counter_t *profiler;
+#endif
+} sound_threaded_handlers[SOUND_MAX_THREADED];
+
+static int sound_threaded_handlers_num;
+
+/*pending and quit are only accessed with the mutex held. The events just
+  wake the waiting side, which then rechecks them*/
+typedef struct sound_worker_t
+{
+        thread_t *thread;
+        event_t *wake_event;
+        event_t *done_event;
+        mutex_t *mutex;
+        int pending;
+        int quit;
+        int nr;
+} sound_worker_t;
+
+static sound_worker_t sound_workers[SOUND_MAX_WORKERS];
+static int sound_workers_num;
+
+/*There is no per-sample timer. The output position is derived from the TSC,
+  relative to the timestamp of the first sample of the current buffer, and
+  sound_poll_timer only fires when a buffer is complete*/
 static pc_timer_t sound_poll_timer;
-static uint64_t sound_poll_latch;
-int sound_pos_global = 0;
+uint64_t sound_poll_latch;
+uint64_t sound_buf_ts;
+uint64_t sound_pos_tsc;
+int sound_pos_cached;
 
 int soundon = 1;
 
@@ -129,7 +179,15 @@ static event_t *sound_cd_event;
 static unsigned int cd_vol_l, cd_vol_r;
 
 int sound_buf_len = 48000 / 10;
+int sound_latency = 100;
 int sound_gain = 0;
+int sound_output = 1;
+char sound_capture_dir[512] = "";
+
+/*Capture stems for the final mix and CD audio. Handler stems are created
+  in sound_poll() the first time the handler is rendered while capturing*/
+static int capture_mix_stem = -1, capture_cd_stem = -1;
+static int32_t *capture_buffer;
 
 void sound_update_buf_length()
 {
@@ -202,85 +260,354 @@ static void sound_cd_thread(void *param)
                                 cd_buffer[c+1] = cd_buffer_temp[1];
                         }
 
-                        givealbuffer_cd(cd_buffer);
+                        if (sound_output)
+                                givealbuffer_cd(cd_buffer);
+                        if (sound_capture_active)
+                                sound_capture_write16(capture_cd_stem, cd_buffer, CD_BUFLEN);
                 }
         }
 }
 
 static int32_t *outbuffer;
 
+/*Render the threaded handlers assigned to slot nr. Slot 0 is the emulation
+  thread, slots 1 onwards are the worker threads*/
+static void sound_render_threaded(int nr)
+{
+        int c;
+
+        for (c = nr; c < sound_threaded_handlers_num; c += sound_workers_num + 1)
+        {
+#ifdef PROFILER
+                /*Each handler always renders on the same thread, so only that
+                  thread updates its counter*/
+                uint64_t start_time = timer_read();
+
+                if (!nr)
+                        profiler_enter(sound_threaded_handlers[c].profiler);
+#endif
+                memset(sound_threaded_handlers[c].buffer, 0, SOUNDBUFLEN * 2 * sizeof(int32_t));
+                sound_threaded_handlers[c].get_buffer(sound_threaded_handlers[c].buffer, SOUNDBUFLEN, sound_threaded_handlers[c].priv);
+#ifdef PROFILER
+                if (!nr)
+                        profiler_exit();
+                else
+                        profiler_add_time(sound_threaded_handlers[c].profiler, timer_read() - start_time);
+#endif
+        }
+}
+
+static void sound_worker_thread(void *param)
+{
+        sound_worker_t *worker = (sound_worker_t *)param;
+
+        while (1)
+        {
+                int pending, quit;
+
+                thread_wait_event(worker->wake_event, -1);
+                thread_reset_event(worker->wake_event);
+
+                thread_lock_mutex(worker->mutex);
+                pending = worker->pending;
+                quit = worker->quit;
+                thread_unlock_mutex(worker->mutex);
+
+                if (quit)
+                        break;
+                if (!pending)
+                        continue;
+
+                sound_render_threaded(worker->nr);
+
+                thread_lock_mutex(worker->mutex);
+                worker->pending = 0;
+                thread_unlock_mutex(worker->mutex);
+                thread_set_event(worker->done_event);
+        }
+}
+
+static void sound_wake_worker(sound_worker_t *worker)
+{
+        thread_lock_mutex(worker->mutex);
+        worker->pending = 1;
+        thread_unlock_mutex(worker->mutex);
+        thread_set_event(worker->wake_event);
+}
+
+static void sound_wait_worker(sound_worker_t *worker)
+{
+        while (1)
+        {
+                int pending;
+
+                thread_lock_mutex(worker->mutex);
+                pending = worker->pending;
+                thread_unlock_mutex(worker->mutex);
+
+                if (!pending)
+                        break;
+                thread_wait_event(worker->done_event, -1);
+                thread_reset_event(worker->done_event);
+        }
+}
+
+static void sound_close_workers()
+{
+        int c;
+
+        for (c = 0; c < sound_workers_num; c++)
+        {
+                sound_worker_t *worker = &sound_workers[c];
+
+                thread_lock_mutex(worker->mutex);
+                worker->quit = 1;
+                thread_unlock_mutex(worker->mutex);
+                thread_set_event(worker->wake_event);
+                thread_wait(worker->thread);
+
+                thread_destroy_event(worker->wake_event);
+                thread_destroy_event(worker->done_event);
+                thread_destroy_mutex(worker->mutex);
+        }
+        sound_workers_num = 0;
+}
+
 void sound_init()
 {
-        initalmain(0,NULL);
-        inital();
+        int c;
+
+        if (sound_output)
+        {
+                initalmain(0,NULL);
+                inital();
+        }
 
         outbuffer = malloc(MAXSOUNDBUFLEN * 2 * sizeof(int32_t));
+        capture_buffer = malloc(MAXSOUNDBUFLEN * 2 * sizeof(int32_t));
+        for (c = 0; c < SOUND_MAX_THREADED; c++)
+                sound_threaded_handlers[c].buffer = malloc(MAXSOUNDBUFLEN * 2 * sizeof(int32_t));
         
         sound_cd_event = thread_create_event();
         sound_cd_thread_h = thread_create(sound_cd_thread, NULL);
+
+        if (sound_capture_dir[0])
+        {
+                sound_capture_start(sound_capture_dir);
+                capture_mix_stem = sound_capture_add_stem("mix", 48000);
+                capture_cd_stem = sound_capture_add_stem("cd", CD_FREQ);
+        }
+}
+
+void sound_close()
+{
+        sound_close_workers();
+        sound_capture_stop();
 }
 
 void sound_add_handler(void (*get_buffer)(int32_t *buffer, int len, void *p), void *p)
 {
         sound_handlers[sound_handlers_num].get_buffer = get_buffer;
         sound_handlers[sound_handlers_num].priv = p;
+        sound_handlers[sound_handlers_num].name = current_device_name ? current_device_name : "handler";
+        sound_handlers[sound_handlers_num].capture_stem = -1;
+#ifdef PROFILER
+        sound_handlers[sound_handlers_num].profiler = profiler_get_counter((const void *)get_buffer, sound_handlers[sound_handlers_num].name, PROFILER_GROUP_SOUND);
+#endif
         sound_handlers_num++;
 }
 
+void sound_add_threaded_handler(void (*get_buffer)(int32_t *buffer, int len, void *p), void *p)
+{
+        if (sound_threaded_handlers_num == SOUND_MAX_THREADED)
+        {
+                sound_add_handler(get_buffer, p);
+                return;
+        }
+
+        sound_threaded_handlers[sound_threaded_handlers_num].get_buffer = get_buffer;
+        sound_threaded_handlers[sound_threaded_handlers_num].priv = p;
+        sound_threaded_handlers[sound_threaded_handlers_num].name = current_device_name ? current_device_name : "handler";
+        sound_threaded_handlers[sound_threaded_handlers_num].capture_stem = -1;
+#ifdef PROFILER
+        sound_threaded_handlers[sound_threaded_handlers_num].profiler = profiler_get_counter((const void *)get_buffer, sound_threaded_handlers[sound_threaded_handlers_num].name, PROFILER_GROUP_SOUND);
+#endif
+        sound_threaded_handlers_num++;
+
+        /*Workers are started on demand and kept until sound_close(). One
+          handler is always rendered on the emulation thread*/
+        if (sound_workers_num < SOUND_MAX_WORKERS && sound_workers_num < sound_threaded_handlers_num - 1)
+        {
+                sound_worker_t *worker = &sound_workers[sound_workers_num];
+
+                worker->nr = sound_workers_num + 1;
+                worker->pending = 0;
+                worker->quit = 0;
+                worker->wake_event = thread_create_event();
+                worker->done_event = thread_create_event();
+                worker->mutex = thread_create_mutex();
+                worker->thread = thread_create(sound_worker_thread, worker);
+                sound_workers_num++;
+        }
+}
+
 static int cd_pos = 0;
+
+/*Recalculate the cached output position for the current TSC*/
+int sound_update_pos()
+{
+        int64_t elapsed = (tsc << 32) - sound_buf_ts;
+        int pos = 0;
+
+        if (elapsed > 0 && sound_poll_latch)
+        {
+                uint64_t samples = (uint64_t)elapsed / sound_poll_latch;
+
+                pos = (samples > SOUNDBUFLEN) ? SOUNDBUFLEN : (int)samples;
+        }
+
+        sound_pos_tsc = tsc;
+        sound_pos_cached = pos;
+
+        return pos;
+}
+
+/*Called once per output buffer, when the sample clock reaches SOUNDBUFLEN*/
 void sound_poll(void *priv)
 {
-	timer_advance_u64(&sound_poll_timer, sound_poll_latch);
+        int c;
+/*        int16_t buf16[SOUNDBUFLEN * 2 ];*/
+
+        /*The timer can fire up to a cycle before the fractional end of the
+          buffer; all samples are due at this point regardless*/
+        sound_pos_tsc = tsc;
+        sound_pos_cached = SOUNDBUFLEN;
 
-        cd_pos++;
-        if (cd_pos == (CD_BUFLEN * 48000) / CD_FREQ)
+        cd_pos += SOUNDBUFLEN;
+        if (cd_pos >= (CD_BUFLEN * 48000) / CD_FREQ)
         {
-                cd_pos = 0;
+                cd_pos -= (CD_BUFLEN * 48000) / CD_FREQ;
                 thread_set_event(sound_cd_event);
         }
-        
-        sound_pos_global++;
-        if (sound_pos_global == SOUNDBUFLEN)
+
+        memset(outbuffer, 0, SOUNDBUFLEN * 2 * sizeof(int32_t));
+
+        if (sound_threaded_handlers_num)
         {
-                int c;
-/*                int16_t buf16[SOUNDBUFLEN * 2 ];*/
+                int d;
 
-                memset(outbuffer, 0, SOUNDBUFLEN * 2 * sizeof(int32_t));
+                for (c = 0; c < sound_workers_num; c++)
+                {
+                        if (sound_workers[c].nr < sound_threaded_handlers_num)
+                                sound_wake_worker(&sound_workers[c]);
+                }
+                sound_render_threaded(0);
+                for (c = 0; c < sound_workers_num; c++)
+                        sound_wait_worker(&sound_workers[c]);
 
-                for (c = 0; c < sound_handlers_num; c++)
-                        sound_handlers[c].get_buffer(outbuffer, SOUNDBUFLEN, sound_handlers[c].priv);
+                for (c = 0; c < sound_threaded_handlers_num; c++)
+                {
+                        int32_t *buf = sound_threaded_handlers[c].buffer;
 
+                        for (d = 0; d < SOUNDBUFLEN * 2; d++)
+                                outbuffer[d] += buf[d];
 
-/*                for (c=0;c<SOUNDBUFLEN*2;c++)
+                        if (sound_capture_active)
+                        {
+                                if (sound_threaded_handlers[c].capture_stem == -1)
+                                        sound_threaded_handlers[c].capture_stem = sound_capture_add_stem(sound_threaded_handlers[c].name, 48000);
+                                sound_capture_write(sound_threaded_handlers[c].capture_stem, buf, SOUNDBUFLEN);
+                        }
+                }
+        }
+
+        /*Serial handlers may depend on state rendered by the threaded
+          handlers, so run them afterwards*/
+        if (sound_capture_active)
+        {
+                /*Handlers add into the buffer they are given, so render each
+                  one separately to isolate its output*/
+                for (c = 0; c < sound_handlers_num; c++)
                 {
-                        if (outbuffer[c] < -32768)
-                                buf16[c] = -32768;
-                        else if (outbuffer[c] > 32767)
-                                buf16[c] = 32767;
-                        else
-                                buf16[c] = outbuffer[c];
+                        int d;
+
+                        memset(capture_buffer, 0, SOUNDBUFLEN * 2 * sizeof(int32_t));
+                        PROFILER_ENTER(sound_handlers[c].profiler);
+                        sound_handlers[c].get_buffer(capture_buffer, SOUNDBUFLEN, sound_handlers[c].priv);
+                        PROFILER_EXIT();
+                        for (d = 0; d < SOUNDBUFLEN * 2; d++)
+                                outbuffer[d] += capture_buffer[d];
+
+                        if (sound_handlers[c].capture_stem == -1)
+                                sound_handlers[c].capture_stem = sound_capture_add_stem(sound_handlers[c].name, 48000);
+                        sound_capture_write(sound_handlers[c].capture_stem, capture_buffer, SOUNDBUFLEN);
                 }
+                sound_capture_write(capture_mix_stem, outbuffer, SOUNDBUFLEN);
+        }
+        else
+        {
+                for (c = 0; c < sound_handlers_num; c++)
+                {
+                        PROFILER_ENTER(sound_handlers[c].profiler);
+                        sound_handlers[c].get_buffer(outbuffer, SOUNDBUFLEN, sound_handlers[c].priv);
+                        PROFILER_EXIT();
+                }
+        }
+
+
+/*        for (c=0;c<SOUNDBUFLEN*2;c++)
+        {
+                if (outbuffer[c] < -32768)
+                        buf16[c] = -32768;
+                else if (outbuffer[c] > 32767)
+                        buf16[c] = 32767;
+                else
+                        buf16[c] = outbuffer[c];
+        }
 
         if (!soundf) soundf=fopen("sound.pcm","wb");
         fwrite(buf16,(SOUNDBUFLEN)*2*2,1,soundf);*/
         
-                if (soundon) givealbuffer(outbuffer);
+        if (soundon && sound_output) givealbuffer(outbuffer);
 
-                sound_pos_global = 0;
-                sound_update_buf_length();
-        }
+        sound_buf_ts += SOUNDBUFLEN * sound_poll_latch;
+        sound_update_buf_length();
+        timer_advance_u64(&sound_poll_timer, SOUNDBUFLEN * sound_poll_latch);
+        sound_update_pos();
 }
 
 void sound_speed_changed()
 {
+        int pos = sound_get_pos();
+
         sound_poll_latch = (uint64_t)((double)TIMER_USEC * (1000000.0 / 48000.0));
+
+        /*Keep the current position in the buffer, and move the end of the
+          buffer to match the new sample period*/
+        sound_buf_ts = (tsc << 32) - pos * sound_poll_latch;
+        if (timer_is_enabled(&sound_poll_timer))
+                timer_set_delay_u64(&sound_poll_timer, (SOUNDBUFLEN - pos) * sound_poll_latch);
+        sound_update_pos();
 }
 
 void sound_reset()
 {
-        timer_add(&sound_poll_timer, sound_poll, NULL, 1);
+        int c;
 
+        sound_poll_latch = (uint64_t)((double)TIMER_USEC * (1000000.0 / 48000.0));
+        sound_buf_ts = tsc << 32;
+        timer_add(&sound_poll_timer, sound_poll, NULL, 0);
+        timer_set_delay_u64(&sound_poll_timer, SOUNDBUFLEN * sound_poll_latch);
+        sound_update_pos();
+
+        /*Handlers are added again after the reset, and take their stems
+          back by name*/
+        for (c = 0; c < sound_handlers_num; c++)
+                sound_capture_release_stem(sound_handlers[c].capture_stem);
+        for (c = 0; c < sound_threaded_handlers_num; c++)
+                sound_capture_release_stem(sound_threaded_handlers[c].capture_stem);
         sound_handlers_num = 0;
+        sound_threaded_handlers_num = 0;
         
         sound_set_cd_volume(65535, 65535);
         ioctl_audio_stop();
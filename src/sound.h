@@ -1,6 +1,14 @@
+#ifndef _SOUND_H_
+#define _SOUND_H_
+
 #include "timer.h"
 
 void sound_add_handler(void (*get_buffer)(int32_t *buffer, int len, void *p), void *p);
+/*Add a handler that may run on a worker thread, in parallel with other
+  threaded handlers. It must only access its own device state - no IRQs, DMA,
+  shared filters or other devices. Threaded handlers run before the handlers
+  added with sound_add_handler()*/
+void sound_add_threaded_handler(void (*get_buffer)(int32_t *buffer, int len, void *p), void *p);
 
 extern int sound_card_current;
 
@@ -16,7 +24,25 @@ void sound_set_cd_volume(unsigned int vol_l, unsigned int vol_r);
 #define CD_FREQ 44100
 #define CD_BUFLEN (CD_FREQ / 10)
 
-extern int sound_pos_global;
+/*Output sample clock. sound_poll_latch is the period of a 48 kHz sample in
+  32:32 format, and sound_buf_ts is the timestamp of the first sample of the
+  current buffer*/
+extern uint64_t sound_poll_latch;
+extern uint64_t sound_buf_ts;
+extern uint64_t sound_pos_tsc;
+extern int sound_pos_cached;
+int sound_update_pos();
+
+/*Return the number of 48 kHz samples in the current output buffer that are due
+  at the current time. Devices render up to this position; it reaches
+  SOUNDBUFLEN when the buffer is mixed and then restarts from 0*/
+static inline int sound_get_pos()
+{
+        if (tsc == sound_pos_tsc)
+                return sound_pos_cached;
+        return sound_update_pos();
+}
+
 void sound_speed_changed();
 
 void sound_init();
@@ -29,9 +55,21 @@ void givealbuffer(int32_t *buf);
 void givealbuffer_cd(int16_t *buf);
 
 extern int sound_buf_len;
+/*Target output latency in ms, for backends that support it*/
+extern int sound_latency;
 void sound_update_buf_length();
 
 extern int sound_gain;
 
+/*When 0, no host audio device is opened and emulation is not throttled to
+  the audio clock. Used together with capture for deterministic, faster than
+  real time runs*/
+extern int sound_output;
+/*Directory to write capture stems to. Capture is disabled when empty*/
+extern char sound_capture_dir[512];
+void sound_close();
+
 extern int SOUNDBUFLEN;
 #define MAXSOUNDBUFLEN (48000 / 10)
+
+#endif
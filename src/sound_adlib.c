@@ -87,6 +87,7 @@ void adlib_close(void *p)
 {
         adlib_t *adlib = (adlib_t *)p;
 
+        opl_close(&adlib->opl);
         free(adlib);
 }
 
@@ -62,6 +62,8 @@ typedef struct adgold_t
         int pos;
         
         int surround_enabled;
+
+        biquad_t pseudo_stereo_iir, lowpass_iir, highpass_iir;
 } adgold_t;
 
 static int attenuation[0x40];
@@ -521,7 +523,7 @@ uint8_t adgold_read(uint16_t addr, void *p)
 
 void adgold_update(adgold_t *adgold)
 {
-        for (; adgold->pos < sound_pos_global; adgold->pos++)
+        for (; adgold->pos < sound_get_pos(); adgold->pos++)
         {
                 adgold->mma_buffer[0][adgold->pos] = adgold->mma_buffer[1][adgold->pos] = 0;
         
@@ -657,6 +659,8 @@ static void adgold_get_buffer(int32_t *buffer, int len, void *p)
 {
         adgold_t *adgold = (adgold_t *)p;
         int16_t adgold_buffer[len*2];
+        int32_t temp_buf[len*2];
+        float lowpass_buf[len*2], highpass_buf[len*2];
         
         int c;
 
@@ -703,8 +707,11 @@ static void adgold_get_buffer(int32_t *buffer, int len, void *p)
                 case 0x10: /*Pseudo stereo*/
                 /*Filter left channel, leave right channel unchanged*/
                 /*Filter cutoff is largely a guess*/
-                for (c = 0; c < len * 2; c += 2)
-                        adgold_buffer[c] += adgold_pseudo_stereo_iir(adgold_buffer[c]);
+                for (c = 0; c < len; c++)
+                        lowpass_buf[c] = (float)adgold_buffer[c*2];
+                biquad_process_mono(&adgold->pseudo_stereo_iir, &adgold_pseudo_stereo_iir_coef, lowpass_buf, len);
+                for (c = 0; c < len; c++)
+                        adgold_buffer[c*2] += lowpass_buf[c];
                 break;
                 case 0x18: /*Spatial stereo*/
                 /*Quite probably wrong, I only have the diagram in the TDA8425 datasheet
@@ -720,14 +727,24 @@ static void adgold_get_buffer(int32_t *buffer, int len, void *p)
                 break;
         }
 
+        for (c = 0; c < len * 2; c += 2)
+        {
+                /*Output is deliberately halved to avoid clipping*/
+                temp_buf[c]   = ((int32_t)adgold_buffer[c]   * adgold->vol_l) >> 17;
+                temp_buf[c+1] = ((int32_t)adgold_buffer[c+1] * adgold->vol_r) >> 17;
+        }
+        filter_buf_from_int32(lowpass_buf, temp_buf, len*2);
+        filter_buf_from_int32(highpass_buf, temp_buf, len*2);
+        biquad_process_stereo(&adgold->lowpass_iir, &adgold_lowpass_iir_coef, lowpass_buf, len);
+        biquad_process_stereo(&adgold->highpass_iir, &adgold_highpass_iir_coef, highpass_buf, len);
+
         for (c = 0; c < len * 2; c += 2)
         {
                 int32_t temp, lowpass, highpass;
                 
-                /*Output is deliberately halved to avoid clipping*/
-                temp = ((int32_t)adgold_buffer[c] * adgold->vol_l) >> 17;
-                lowpass = adgold_lowpass_iir(0, temp);
-                highpass = adgold_highpass_iir(0, temp);
+                temp = temp_buf[c];
+                lowpass = lowpass_buf[c];
+                highpass = highpass_buf[c];
                 if (adgold->bass > 6)
                         temp += (lowpass * bass_attenuation[adgold->bass]) >> 14;
                 else if (adgold->bass < 6)
@@ -742,9 +759,9 @@ static void adgold_get_buffer(int32_t *buffer, int len, void *p)
                         temp = 32767;
                 buffer[c] += temp;
 
-                temp = ((int32_t)adgold_buffer[c+1] * adgold->vol_r) >> 17;
-                lowpass = adgold_lowpass_iir(1, temp);
-                highpass = adgold_highpass_iir(1, temp);
+                temp = temp_buf[c+1];
+                lowpass = lowpass_buf[c+1];
+                highpass = highpass_buf[c+1];
                 if (adgold->bass > 6)
                         temp += (lowpass * bass_attenuation[adgold->bass]) >> 14;
                 else if (adgold->bass < 6)
@@ -837,6 +854,7 @@ void adgold_close(void *p)
                 fclose(f);
         }
 
+        opl_close(&adgold->opl);
         free(adgold);
 }
 
@@ -0,0 +1,321 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ibm.h"
+#include "sound.h"
+#include "sound_capture.h"
+#include "thread.h"
+
+#define CAPTURE_QUEUE_LEN 64
+#define CAPTURE_BLOCK_LEN MAXSOUNDBUFLEN
+
+typedef struct capture_block_t
+{
+        int stem;
+        int len;
+        int16_t data[CAPTURE_BLOCK_LEN * 2];
+} capture_block_t;
+
+/*Single producer, single consumer queue of blocks. write_idx is only written
+  by the producing thread and read_idx only by the writer thread. Each side
+  publishes its index with a release store once it has finished with the
+  block, and loads the other side's index with an acquire load before
+  touching the block it refers to*/
+typedef struct capture_queue_t
+{
+        capture_block_t *blocks;
+        atomic_int write_idx, read_idx;
+        int dropped;
+} capture_queue_t;
+
+enum
+{
+        CAPTURE_QUEUE_EMU = 0,
+        CAPTURE_QUEUE_CD,
+        CAPTURE_NR_QUEUES
+};
+
+typedef struct capture_stem_t
+{
+        char name[64];
+        int freq;
+        FILE *f;
+        uint32_t data_len;
+        int in_use; /*Only used by the emulation thread*/
+} capture_stem_t;
+
+int sound_capture_active = 0;
+
+static char capture_dir[512];
+static capture_stem_t capture_stems[CAPTURE_MAX_STEMS];
+static int capture_nr_stems;
+static capture_queue_t capture_queues[CAPTURE_NR_QUEUES];
+
+static thread_t *capture_thread_h;
+static event_t *capture_event;
+static atomic_int capture_quit;
+
+static void capture_put16(uint8_t *p, uint16_t val)
+{
+        p[0] = val & 0xff;
+        p[1] = val >> 8;
+}
+static void capture_put32(uint8_t *p, uint32_t val)
+{
+        p[0] = val & 0xff;
+        p[1] = (val >> 8) & 0xff;
+        p[2] = (val >> 16) & 0xff;
+        p[3] = val >> 24;
+}
+
+/*Canonical 44 byte header for 16-bit stereo PCM*/
+static void capture_write_header(FILE *f, int freq, uint32_t data_len)
+{
+        uint8_t header[44];
+
+        memcpy(&header[0], "RIFF", 4);
+        capture_put32(&header[4], data_len + 36);
+        memcpy(&header[8], "WAVEfmt ", 8);
+        capture_put32(&header[16], 16);
+        capture_put16(&header[20], 1); /*PCM*/
+        capture_put16(&header[22], 2); /*Channels*/
+        capture_put32(&header[24], freq);
+        capture_put32(&header[28], freq * 4); /*Bytes per second*/
+        capture_put16(&header[32], 4); /*Block align*/
+        capture_put16(&header[34], 16); /*Bits per sample*/
+        memcpy(&header[36], "data", 4);
+        capture_put32(&header[40], data_len);
+
+        fseek(f, 0, SEEK_SET);
+        fwrite(header, 44, 1, f);
+}
+
+static void capture_write_block(capture_block_t *block)
+{
+        capture_stem_t *stem = &capture_stems[block->stem];
+
+        if (!stem->f)
+        {
+                char fn[1024];
+
+                snprintf(fn, sizeof(fn), "%s/%02i_%s.wav", capture_dir, block->stem, stem->name);
+                stem->f = fopen(fn, "wb");
+                if (!stem->f)
+                {
+                        pclog("sound_capture : can't open %s\n", fn);
+                        return;
+                }
+                capture_write_header(stem->f, stem->freq, 0);
+        }
+
+        fwrite(block->data, block->len * 4, 1, stem->f);
+        stem->data_len += block->len * 4;
+}
+
+static void capture_thread(void *param)
+{
+        while (1)
+        {
+                /*Sample quit before draining, so that every block queued
+                  before sound_capture_stop() is written out*/
+                int quit = atomic_load_explicit(&capture_quit, memory_order_acquire);
+                int q, did_work = 0;
+
+                for (q = 0; q < CAPTURE_NR_QUEUES; q++)
+                {
+                        capture_queue_t *queue = &capture_queues[q];
+                        int read_idx = atomic_load_explicit(&queue->read_idx, memory_order_relaxed);
+                        int write_idx = atomic_load_explicit(&queue->write_idx, memory_order_acquire);
+
+                        while (read_idx != write_idx)
+                        {
+                                capture_write_block(&queue->blocks[read_idx]);
+                                read_idx = (read_idx + 1) % CAPTURE_QUEUE_LEN;
+                                atomic_store_explicit(&queue->read_idx, read_idx, memory_order_release);
+                                did_work = 1;
+                        }
+                }
+
+                if (quit)
+                        break;
+                if (!did_work)
+                        thread_wait_event(capture_event, 10);
+        }
+}
+
+void sound_capture_start(char *dir)
+{
+        int q;
+
+        if (sound_capture_active)
+                return;
+
+        strncpy(capture_dir, dir, sizeof(capture_dir) - 1);
+        capture_dir[sizeof(capture_dir) - 1] = 0;
+        capture_nr_stems = 0;
+        memset(capture_stems, 0, sizeof(capture_stems));
+
+        for (q = 0; q < CAPTURE_NR_QUEUES; q++)
+        {
+                capture_queues[q].blocks = malloc(CAPTURE_QUEUE_LEN * sizeof(capture_block_t));
+                atomic_init(&capture_queues[q].write_idx, 0);
+                atomic_init(&capture_queues[q].read_idx, 0);
+                capture_queues[q].dropped = 0;
+        }
+
+        atomic_init(&capture_quit, 0);
+        capture_event = thread_create_event();
+        capture_thread_h = thread_create(capture_thread, NULL);
+
+        pclog("sound_capture : capturing to %s\n", capture_dir);
+        sound_capture_active = 1;
+}
+
+void sound_capture_stop()
+{
+        int c;
+
+        if (!sound_capture_active)
+                return;
+        sound_capture_active = 0;
+
+        /*Let the writer drain the queues before finishing the files*/
+        atomic_store_explicit(&capture_quit, 1, memory_order_release);
+        thread_set_event(capture_event);
+        thread_wait(capture_thread_h);
+        thread_destroy_event(capture_event);
+
+        for (c = 0; c < capture_nr_stems; c++)
+        {
+                if (capture_stems[c].f)
+                {
+                        capture_write_header(capture_stems[c].f, capture_stems[c].freq, capture_stems[c].data_len);
+                        fclose(capture_stems[c].f);
+                        capture_stems[c].f = NULL;
+                }
+        }
+
+        for (c = 0; c < CAPTURE_NR_QUEUES; c++)
+        {
+                if (capture_queues[c].dropped)
+                        pclog("sound_capture : %i blocks dropped from queue %i\n", capture_queues[c].dropped, c);
+                free(capture_queues[c].blocks);
+                capture_queues[c].blocks = NULL;
+        }
+}
+
+int sound_capture_add_stem(char *name, int freq)
+{
+        capture_stem_t *stem;
+        char stem_name[64];
+        int c;
+
+        strncpy(stem_name, name, sizeof(stem_name) - 1);
+        stem_name[sizeof(stem_name) - 1] = 0;
+        /*Keep file names portable*/
+        for (c = 0; stem_name[c]; c++)
+        {
+                char ch = stem_name[c];
+
+                if (!((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '-'))
+                        stem_name[c] = '_';
+        }
+
+        /*A released stem carries on in the same file for the next user with
+          the same name, eg the same device after a hard reset*/
+        for (c = 0; c < capture_nr_stems; c++)
+        {
+                if (!capture_stems[c].in_use && capture_stems[c].freq == freq && !strcmp(capture_stems[c].name, stem_name))
+                {
+                        capture_stems[c].in_use = 1;
+                        return c;
+                }
+        }
+
+        if (capture_nr_stems == CAPTURE_MAX_STEMS)
+                return -1;
+
+        stem = &capture_stems[capture_nr_stems];
+        strcpy(stem->name, stem_name);
+        stem->freq = freq;
+        stem->f = NULL;
+        stem->data_len = 0;
+        stem->in_use = 1;
+
+        return capture_nr_stems++;
+}
+
+void sound_capture_release_stem(int stem)
+{
+        if (stem >= 0)
+                capture_stems[stem].in_use = 0;
+}
+
+static capture_block_t *capture_get_block(capture_queue_t *queue)
+{
+        int write_idx = atomic_load_explicit(&queue->write_idx, memory_order_relaxed);
+        int next = (write_idx + 1) % CAPTURE_QUEUE_LEN;
+
+        if (next == atomic_load_explicit(&queue->read_idx, memory_order_acquire))
+        {
+                /*Writer has fallen behind - drop rather than stall*/
+                queue->dropped++;
+                return NULL;
+        }
+
+        return &queue->blocks[write_idx];
+}
+
+static void capture_put_block(capture_queue_t *queue)
+{
+        int write_idx = atomic_load_explicit(&queue->write_idx, memory_order_relaxed);
+
+        atomic_store_explicit(&queue->write_idx, (write_idx + 1) % CAPTURE_QUEUE_LEN, memory_order_release);
+        thread_set_event(capture_event);
+}
+
+void sound_capture_write(int stem, int32_t *buf, int len)
+{
+        capture_queue_t *queue = &capture_queues[CAPTURE_QUEUE_EMU];
+        capture_block_t *block;
+        int c;
+
+        if (!sound_capture_active || stem < 0)
+                return;
+        block = capture_get_block(queue);
+        if (!block)
+                return;
+
+        block->stem = stem;
+        block->len = MIN(len, CAPTURE_BLOCK_LEN);
+        for (c = 0; c < block->len * 2; c++)
+        {
+                if (buf[c] < -32768)
+                        block->data[c] = -32768;
+                else if (buf[c] > 32767)
+                        block->data[c] = 32767;
+                else
+                        block->data[c] = buf[c];
+        }
+
+        capture_put_block(queue);
+}
+
+void sound_capture_write16(int stem, int16_t *buf, int len)
+{
+        capture_queue_t *queue = &capture_queues[CAPTURE_QUEUE_CD];
+        capture_block_t *block;
+
+        if (!sound_capture_active || stem < 0)
+                return;
+        block = capture_get_block(queue);
+        if (!block)
+                return;
+
+        block->stem = stem;
+        block->len = MIN(len, CAPTURE_BLOCK_LEN);
+        memcpy(block->data, buf, block->len * 4);
+
+        capture_put_block(queue);
+}
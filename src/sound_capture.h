@@ -0,0 +1,25 @@
+/*Audio capture. The output of each sound handler, the final mix and CD audio
+  can be written to separate WAV files ("stems") for comparing output between
+  builds. Buffers are queued on the thread that produces them and written to
+  disc by a background thread, so capture never waits on file I/O.*/
+
+#define CAPTURE_MAX_STEMS 32
+
+extern int sound_capture_active;
+
+void sound_capture_start(char *dir);
+void sound_capture_stop();
+
+/*Register a stem, or take back a released one with the same name and rate.
+  Returns the stem number, or -1 if no more stems are available. The file is
+  created by the writer thread on first use. Emulation thread only*/
+int sound_capture_add_stem(char *name, int freq);
+/*Give up a stem once its user is removed. A later sound_capture_add_stem()
+  with the same name and rate gets it back. Emulation thread only*/
+void sound_capture_release_stem(int stem);
+
+/*Queue len stereo samples for a stem. sound_capture_write() must only be
+  called from the emulation thread, sound_capture_write16() only from the CD
+  audio thread*/
+void sound_capture_write(int stem, int32_t *buf, int len);
+void sound_capture_write16(int stem, int16_t *buf, int len);
@@ -4,6 +4,7 @@
 
 #include "device.h"
 #include "io.h"
+#include "savestate.h"
 #include "sound.h"
 #include "sound_cms.h"
 
@@ -32,7 +33,7 @@ typedef struct cms_t
 
 void cms_update(cms_t *cms)
 {
-        for (; cms->pos < sound_pos_global; cms->pos++)
+        for (; cms->pos < sound_get_pos(); cms->pos++)
         {
                 int c, d;
                 int16_t out_l = 0, out_r = 0;
@@ -181,7 +182,7 @@ void *cms_init()
 
         pclog("cms_init\n");
         io_sethandler(0x0220, 0x0010, cms_read, NULL, NULL, cms_write, NULL, NULL, cms);
-        sound_add_handler(cms_get_buffer, cms);
+        sound_add_threaded_handler(cms_get_buffer, cms);
         return cms;
 }
 
@@ -192,6 +193,26 @@ void cms_close(void *p)
         free(cms);
 }
 
+static void cms_save(savestate_t *s, void *p)
+{
+        cms_t *cms = (cms_t *)p;
+
+        cms_update(cms);
+        savestate_write(s, cms, sizeof(cms_t));
+}
+
+static void cms_load(savestate_t *s, void *p)
+{
+        cms_t *cms = (cms_t *)p;
+        cms_t temp;
+
+        /*Keep the partially rendered output buffer of the running machine*/
+        savestate_read(s, &temp, sizeof(cms_t));
+        memcpy(temp.buffer, cms->buffer, sizeof(cms->buffer));
+        temp.pos = cms->pos;
+        *cms = temp;
+}
+
 device_t cms_device =
 {
         "Creative Music System / Game Blaster",
@@ -201,5 +222,8 @@ device_t cms_device =
         NULL,
         NULL,
         NULL,
-        NULL
+        NULL,
+        NULL,
+        cms_save,
+        cms_load
 };
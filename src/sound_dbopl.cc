@@ -7,6 +7,7 @@ static struct
         DBOPL::Chip chip;
         struct opl3_chip opl3chip;
         int addr;
+        int opl3_active;
         int timer[2];
         uint8_t timer_ctrl;
         uint8_t status_mask;
@@ -53,6 +54,8 @@ void opl_init(void (*timer_callback)(void *param, int timer, int64_t period), vo
                 opl[nr].is_opl3 = is_opl3;	
                 opl[nr].opl_emu = opl_emu;
 	}
+	opl[nr].addr = 0;
+	opl[nr].opl3_active = 0;
 }
 
 void opl_status_update(int nr)
@@ -79,21 +82,27 @@ void opl_timer_over(int nr, int timer)
         opl_status_update(nr);
 }
 
+/*Register writes are split in two halves. opl_write() runs on the emulation
+  thread and handles the address latch, timers and status, all of which are
+  visible to the guest. The write to the synthesis core itself is applied by
+  opl_write_reg() on the OPL render thread, once output has been generated up
+  to the time of the write.*/
 void opl_write(int nr, uint16_t addr, uint8_t val)
 {
         if (!(addr & 1))
 	{
-		if (!opl[nr].is_opl3 || !opl[nr].opl_emu)
-			opl[nr].addr = (int)opl[nr].chip.WriteAddr(addr, val) & (opl[nr].is_opl3 ? 0x1ff : 0xff);
-		else
-			opl[nr].addr = (int)OPL3_WriteAddr(&opl[nr].opl3chip, addr, val) & 0x1ff;
+	        /*Same address decode as Chip::WriteAddr() and OPL3_WriteAddr(),
+	          using our own copy of the OPL3 mode bit*/
+	        int new_addr = val;
+	        
+	        if ((addr & 2) && (val == 0x05 || opl[nr].opl3_active))
+	                new_addr |= 0x100;
+		opl[nr].addr = new_addr & (opl[nr].is_opl3 ? 0x1ff : 0xff);
 	}
         else
         {
-		if (!opl[nr].is_opl3 || !opl[nr].opl_emu)
-			opl[nr].chip.WriteReg(opl[nr].addr, val);
-		else
-			OPL3_WriteReg(&opl[nr].opl3chip, opl[nr].addr, val);
+                if (opl[nr].addr == 0x105)
+                        opl[nr].opl3_active = val & 1;
 
                 switch (opl[nr].addr)
                 {
@@ -132,6 +141,19 @@ void opl_write(int nr, uint16_t addr, uint8_t val)
                 
 }
 
+int opl_get_addr(int nr)
+{
+        return opl[nr].addr;
+}
+
+void opl_write_reg(int nr, uint16_t reg, uint8_t val)
+{
+	if (!opl[nr].is_opl3 || !opl[nr].opl_emu)
+		opl[nr].chip.WriteReg(reg, val);
+	else
+		OPL3_WriteReg(&opl[nr].opl3chip, reg, val);
+}
+
 uint8_t opl_read(int nr, uint16_t addr)
 {
         if (!(addr & 1))
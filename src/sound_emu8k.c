@@ -7,6 +7,9 @@
 #include "sound_emu8k.h"
 #include "timer.h"
 #include <inttypes.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #if !defined FILTER_INITIAL && !defined FILTER_MOOG && !defined FILTER_CONSTANT
 //#define FILTER_INITIAL
@@ -19,6 +22,11 @@
 #define RESAMPLER_CUBIC
 #endif
 
+/* Voices are rendered in blocks of this many samples */
+#define EMU8K_BLOCK_LEN 256
+/* and in groups of this many voices, whose filters run together */
+#define EMU8K_FILTER_VOICES 4
+
 //#define EMU8K_DEBUG_REGISTERS
 
 char *PORT_NAMES[][8] =
@@ -1565,22 +1573,71 @@ void emu8k_work_chorus(int32_t *inbuf, int32_t *outbuf, emu8k_chorus_eng_t *engi
         
 }
 
-int32_t emu8k_reverb_comb_work(emu8k_reverb_combfilter_t* comb, int32_t in)
+/* The six reflection combs all take the same input, so for the duration of a
+ * block their filter state is kept in lanes and they are run together. Lanes 6
+ * and 7 are padding. */
+typedef struct emu8k_reverb_lanes_t
 {
-     
-        int32_t bufin;
+        float damp1[8];
+        float damp2[8];
+        float feedback[8];
+        float output_gain[8];
+        int32_t filterstore[8];
+        int32_t output[8];
+        int32_t bufin[8];
+        int32_t result[8];
+} emu8k_reverb_lanes_t;
+
+static inline void emu8k_reverb_combs_work(emu8k_reverb_eng_t *engine, emu8k_reverb_lanes_t *lanes, int32_t in, int scalar)
+{
+        int c;
+
         /* get echo */
-        int32_t output = comb->reflection[comb->read_pos];
-        /* apply lowpass */
-        comb->filterstore = (output*comb->damp2) + (comb->filterstore*comb->damp1);
-        /* appply feedback */
-        bufin = in - (comb->filterstore*comb->feedback);
-        /* store new value in delayed buffer */
-        comb->reflection[comb->read_pos] = bufin;
+        for (c = 0; c < 6; c++)
+                lanes->output[c] = engine->reflections[c].reflection[engine->reflections[c].read_pos];
 
-        if(++comb->read_pos>=comb->bufsize) comb->read_pos = 0;
+#ifdef __SSE2__
+        if (!scalar)
+        {
+                __m128 in_v = _mm_set1_ps((float)in);
+
+                for (c = 0; c < 8; c += 4)
+                {
+                        __m128 output = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i *)&lanes->output[c]));
+                        __m128 filterstore = _mm_cvtepi32_ps(_mm_loadu_si128((__m128i *)&lanes->filterstore[c]));
+                        __m128i filterstore_i;
+
+                        /* apply lowpass */
+                        filterstore = _mm_add_ps(_mm_mul_ps(output, _mm_loadu_ps(&lanes->damp2[c])),
+                                                 _mm_mul_ps(filterstore, _mm_loadu_ps(&lanes->damp1[c])));
+                        filterstore_i = _mm_cvttps_epi32(filterstore);
+                        _mm_storeu_si128((__m128i *)&lanes->filterstore[c], filterstore_i);
+                        /* appply feedback */
+                        filterstore = _mm_mul_ps(_mm_cvtepi32_ps(filterstore_i), _mm_loadu_ps(&lanes->feedback[c]));
+                        _mm_storeu_si128((__m128i *)&lanes->bufin[c], _mm_cvttps_epi32(_mm_sub_ps(in_v, filterstore)));
+
+                        _mm_storeu_si128((__m128i *)&lanes->result[c], _mm_cvttps_epi32(_mm_mul_ps(output, _mm_loadu_ps(&lanes->output_gain[c]))));
+                }
+        }
+        else
+#endif
+        for (c = 0; c < 6; c++)
+        {
+                /* apply lowpass */
+                lanes->filterstore[c] = (lanes->output[c]*lanes->damp2[c]) + (lanes->filterstore[c]*lanes->damp1[c]);
+                /* appply feedback */
+                lanes->bufin[c] = in - (lanes->filterstore[c]*lanes->feedback[c]);
+                lanes->result[c] = lanes->output[c]*lanes->output_gain[c];
+        }
+
+        /* store new value in delayed buffer */
+        for (c = 0; c < 6; c++)
+        {
+                emu8k_reverb_combfilter_t *comb = &engine->reflections[c];
 
-        return output*comb->output_gain;
+                comb->reflection[comb->read_pos] = lanes->bufin[c];
+                if(++comb->read_pos>=comb->bufsize) comb->read_pos = 0;
+        }
 }
 
 int32_t emu8k_reverb_diffuser_work(emu8k_reverb_combfilter_t* comb, int32_t in)
@@ -1613,6 +1670,58 @@ int32_t emu8k_reverb_tail_work(emu8k_reverb_combfilter_t* comb, emu8k_reverb_com
         
         return output;
 }
+
+/* Both tails, with the left one in lane 0 and the right one in lane 1. The
+ * diffusers are done in float like emu8k_reverb_diffuser_work(), so the result
+ * is the same as calling emu8k_reverb_tail_work() for each side. */
+static inline void emu8k_reverb_tails_work(emu8k_reverb_eng_t *engine, int32_t *dat1, int32_t in1, int32_t *dat2, int32_t in2)
+{
+        emu8k_reverb_combfilter_t *tail[2] = { &engine->tailL, &engine->tailR };
+        int32_t output[2];
+        int c, side;
+
+        for (side = 0; side < 2; side++)
+        {
+                output[side] = tail[side]->reflection[tail[side]->read_pos];
+                /* store new value in delayed buffer */
+                tail[side]->reflection[tail[side]->read_pos] = side ? in2 : in1;
+                if(++tail[side]->read_pos>=tail[side]->bufsize) tail[side]->read_pos = 0;
+        }
+
+#ifdef __SSE2__
+        __m128i out_v = _mm_set_epi32(0, 0, output[1], output[0]);
+
+        for (c = 1; c < 3; c++)
+        {
+                emu8k_reverb_combfilter_t *diffL = &engine->allpass[c];
+                emu8k_reverb_combfilter_t *diffR = &engine->allpass[4+c];
+                __m128 bufout = _mm_cvtepi32_ps(_mm_set_epi32(0, 0, diffR->reflection[diffR->read_pos], diffL->reflection[diffL->read_pos]));
+                __m128 feedback = _mm_set_ps(0.0f, 0.0f, diffR->feedback, diffL->feedback);
+                __m128i bufin;
+
+                /*diffuse*/
+                bufin = _mm_cvttps_epi32(_mm_sub_ps(_mm_mul_ps(bufout, feedback), _mm_cvtepi32_ps(out_v)));
+                out_v = _mm_cvttps_epi32(_mm_sub_ps(bufout, _mm_mul_ps(_mm_cvtepi32_ps(bufin), feedback)));
+                /* store new value in delayed buffer */
+                diffL->reflection[diffL->read_pos] = _mm_cvtsi128_si32(bufin);
+                diffR->reflection[diffR->read_pos] = _mm_cvtsi128_si32(_mm_srli_si128(bufin, 4));
+                if(++diffL->read_pos>=diffL->bufsize) diffL->read_pos = 0;
+                if(++diffR->read_pos>=diffR->bufsize) diffR->read_pos = 0;
+        }
+        output[0] = _mm_cvtsi128_si32(out_v);
+        output[1] = _mm_cvtsi128_si32(_mm_srli_si128(out_v, 4));
+#else
+        for (c = 1; c < 3; c++)
+        {
+                output[0] = emu8k_reverb_diffuser_work(&engine->allpass[c], output[0]);
+                output[1] = emu8k_reverb_diffuser_work(&engine->allpass[4+c], output[1]);
+        }
+#endif
+
+        *dat1 += (output[0]*engine->link_return_amp) >> 8;
+        *dat2 += (output[1]*engine->link_return_amp) >> 8;
+}
+
 int32_t emu8k_reverb_damper_work(emu8k_reverb_combfilter_t* comb, int32_t in)
 {
         /* apply lowpass */
@@ -1621,9 +1730,22 @@ int32_t emu8k_reverb_damper_work(emu8k_reverb_combfilter_t* comb, int32_t in)
 }
 
 /* TODO: This is not a correct emulation, just a workalike implementation. */
-void emu8k_work_reverb(int32_t *inbuf, int32_t *outbuf, emu8k_reverb_eng_t *engine, int count)
+void emu8k_work_reverb(int32_t *inbuf, int32_t *outbuf, emu8k_reverb_eng_t *engine, int count, int scalar)
 {
+        emu8k_reverb_lanes_t lanes;
         int pos;
+        int c;
+
+        memset(&lanes, 0, sizeof(lanes));
+        for (c = 0; c < 6; c++)
+        {
+                lanes.damp1[c] = engine->reflections[c].damp1;
+                lanes.damp2[c] = engine->reflections[c].damp2;
+                lanes.feedback[c] = engine->reflections[c].feedback;
+                lanes.output_gain[c] = engine->reflections[c].output_gain;
+                lanes.filterstore[c] = engine->reflections[c].filterstore;
+        }
+
         if (engine->link_return_type)
         {
                 for (pos = 0; pos < count; pos++)
@@ -1631,15 +1753,21 @@ void emu8k_work_reverb(int32_t *inbuf, int32_t *outbuf, emu8k_reverb_eng_t *engi
                         int32_t dat1, dat2, in, in2;
                         in = emu8k_reverb_damper_work(&engine->damper, inbuf[pos]);
                         in2 = (in * engine->refl_in_amp) >> 8;
-                        dat2  = emu8k_reverb_comb_work(&engine->reflections[0], in2);
-                        dat2 += emu8k_reverb_comb_work(&engine->reflections[1], in2);
-                        dat1  = emu8k_reverb_comb_work(&engine->reflections[2], in2);
-                        dat2 += emu8k_reverb_comb_work(&engine->reflections[3], in2);
-                        dat1 += emu8k_reverb_comb_work(&engine->reflections[4], in2);
-                        dat2 += emu8k_reverb_comb_work(&engine->reflections[5], in2);
+                        emu8k_reverb_combs_work(engine, &lanes, in2, scalar);
+                        dat2  = lanes.result[0];
+                        dat2 += lanes.result[1];
+                        dat1  = lanes.result[2];
+                        dat2 += lanes.result[3];
+                        dat1 += lanes.result[4];
+                        dat2 += lanes.result[5];
                         
-                        dat1 += (emu8k_reverb_tail_work(&engine->tailL,&engine->allpass[0], in+dat1)*engine->link_return_amp) >> 8;
-                        dat2 += (emu8k_reverb_tail_work(&engine->tailR,&engine->allpass[4], in+dat2)*engine->link_return_amp) >> 8;
+                        if (scalar)
+                        {
+                                dat1 += (emu8k_reverb_tail_work(&engine->tailL,&engine->allpass[0], in+dat1)*engine->link_return_amp) >> 8;
+                                dat2 += (emu8k_reverb_tail_work(&engine->tailR,&engine->allpass[4], in+dat2)*engine->link_return_amp) >> 8;
+                        }
+                        else
+                                emu8k_reverb_tails_work(engine, &dat1, in+dat1, &dat2, in+dat2);
                         
                         (*outbuf++) += (dat1 * engine->out_mix) >> 8;
                         (*outbuf++) += (dat2 * engine->out_mix) >> 8;
@@ -1652,21 +1780,30 @@ void emu8k_work_reverb(int32_t *inbuf, int32_t *outbuf, emu8k_reverb_eng_t *engi
                         int32_t dat1, dat2, in, in2;
                         in = emu8k_reverb_damper_work(&engine->damper, inbuf[pos]);
                         in2 = (in * engine->refl_in_amp) >> 8;
-                        dat1  = emu8k_reverb_comb_work(&engine->reflections[0], in2);
-                        dat1 += emu8k_reverb_comb_work(&engine->reflections[1], in2);
-                        dat1 += emu8k_reverb_comb_work(&engine->reflections[2], in2);
-                        dat1 += emu8k_reverb_comb_work(&engine->reflections[3], in2);
-                        dat1 += emu8k_reverb_comb_work(&engine->reflections[4], in2);
-                        dat1 += emu8k_reverb_comb_work(&engine->reflections[5], in2);
+                        emu8k_reverb_combs_work(engine, &lanes, in2, scalar);
+                        dat1  = lanes.result[0];
+                        dat1 += lanes.result[1];
+                        dat1 += lanes.result[2];
+                        dat1 += lanes.result[3];
+                        dat1 += lanes.result[4];
+                        dat1 += lanes.result[5];
                         dat2 = dat1;
                         
-                        dat1 += (emu8k_reverb_tail_work(&engine->tailL,&engine->allpass[0], in+dat1)*engine->link_return_amp) >> 8;
-                        dat2 += (emu8k_reverb_tail_work(&engine->tailR,&engine->allpass[4], in+dat2)*engine->link_return_amp) >> 8;
+                        if (scalar)
+                        {
+                                dat1 += (emu8k_reverb_tail_work(&engine->tailL,&engine->allpass[0], in+dat1)*engine->link_return_amp) >> 8;
+                                dat2 += (emu8k_reverb_tail_work(&engine->tailR,&engine->allpass[4], in+dat2)*engine->link_return_amp) >> 8;
+                        }
+                        else
+                                emu8k_reverb_tails_work(engine, &dat1, in+dat1, &dat2, in+dat2);
                         
                         (*outbuf++) += (dat1 * engine->out_mix) >> 8;
                         (*outbuf++) += (dat2 * engine->out_mix) >> 8;
                 }
         }
+
+        for (c = 0; c < 6; c++)
+                engine->reflections[c].filterstore = lanes.filterstore[c];
 }
 void emu8k_work_eq(int32_t *inoutbuf, int count)
 {
@@ -1689,381 +1826,685 @@ int32_t emu8k_vol_slide(emu8k_slide_t* slide, int32_t target)
         return slide->last;
 }
 
-//int32_t old_pitch[32]={0};
-//int32_t old_cut[32]={0};
-//int32_t old_vol[32]={0};
-void emu8k_update(emu8k_t *emu8k)
+/* Advance the oscillator of a voice that is not producing any sound. This is
+ * the same address update that emu8k_update() does for every sample. */
+static void emu8k_advance_silent_voice(emu8k_voice_t *emu_voice, int count)
 {
-        int new_pos = (sound_pos_global * 44100) / 48000;
-        if (emu8k->pos >= new_pos)
-                return;
-
-        int32_t *buf;
-        emu8k_voice_t* emu_voice;
         int pos;
-        int c;
-
-        /* Clean the buffers since we will accumulate into them. */
-        buf = &emu8k->buffer[emu8k->pos*2];
-        memset(buf, 0, 2*(new_pos-emu8k->pos)*sizeof(emu8k->buffer[0]));
-        memset(&emu8k->chorus_in_buffer[emu8k->pos], 0, (new_pos-emu8k->pos)*sizeof(emu8k->chorus_in_buffer[0]));
-        memset(&emu8k->reverb_in_buffer[emu8k->pos], 0, (new_pos-emu8k->pos)*sizeof(emu8k->reverb_in_buffer[0]));
 
-        /* Voices section  */
-        for (c = 0; c < 32; c++)
+        for (pos = 0; pos < count; pos++)
         {
-                emu_voice = &emu8k->voice[c];
-                buf = &emu8k->buffer[emu8k->pos*2];
-                
-                for (pos = emu8k->pos; pos < new_pos; pos++)
+                emu_voice->addr.addr += ((uint64_t)emu_voice->cpf_curr_pitch) << 18;
+                if (emu_voice->addr.addr >= emu_voice->loop_end.addr)
                 {
-                        int32_t dat;
-
-                        if (emu_voice->cvcf_curr_volume)
-                        {
-                                /* Waveform oscillator */
-        #ifdef RESAMPLER_LINEAR
-                                dat = EMU8K_READ_INTERP_LINEAR(emu8k, emu_voice->addr.int_address,
-                                                        emu_voice->addr.fract_address);
-
-        #elif defined RESAMPLER_CUBIC
-                                dat = EMU8K_READ_INTERP_CUBIC(emu8k, emu_voice->addr.int_address,
-                                                        emu_voice->addr.fract_address);
-        #endif
-
-                                /* Filter section */
-                                if (emu_voice->filterq_idx || emu_voice->cvcf_curr_filt_ctoff != 0xFFFF )
-                                {
-                                        int cutoff = emu_voice->cvcf_curr_filt_ctoff >> 8;
-                                        const int64_t coef0 = filt_coeffs[emu_voice->filterq_idx][cutoff][0];
-                                        const int64_t coef1 = filt_coeffs[emu_voice->filterq_idx][cutoff][1];
-                                        const int64_t coef2 = filt_coeffs[emu_voice->filterq_idx][cutoff][2];
-                        /* clip at twice the range */
-                        #define ClipBuffer(buf) (buf < -16777216) ? -16777216 : (buf > 16777216) ? 16777216 : buf
-
-                        #ifdef FILTER_INITIAL
-                                        #define NOOP(x) (void)x;
-                                        NOOP(coef1)
-                                        /* Apply expected attenuation. (FILTER_MOOG does it implicitly, but this one doesn't).
-                                         * Work in 24bits. */
-                                        dat = (dat * emu_voice->filt_att) >> 8;
-                                
-                                        int64_t vhp = ((-emu_voice->filt_buffer[0] * coef2) >> 24) - emu_voice->filt_buffer[1] - dat;
-                                        emu_voice->filt_buffer[1] += (emu_voice->filt_buffer[0] * coef0) >> 24;
-                                        emu_voice->filt_buffer[0] += (vhp * coef0) >> 24;
-                                        dat = (int32_t)(emu_voice->filt_buffer[1] >> 8);
-                                        if (dat > 32767) { dat = 32767; }
-                                        else if (dat < -32768) { dat = -32768; }
-
-                        #elif defined FILTER_MOOG
-
-                                        /*move to 24bits*/
-                                        dat <<= 8;
-                                
-                                        dat -= (coef2 * emu_voice->filt_buffer[4]) >> 24; /*feedback*/
-                                        int64_t t1 = emu_voice->filt_buffer[1];
-                                        emu_voice->filt_buffer[1] = ((dat + emu_voice->filt_buffer[0]) * coef0 - emu_voice->filt_buffer[1] * coef1) >> 24;
-                                        emu_voice->filt_buffer[1] = ClipBuffer(emu_voice->filt_buffer[1]);
-
-                                        int64_t t2 = emu_voice->filt_buffer[2];
-                                        emu_voice->filt_buffer[2] = ((emu_voice->filt_buffer[1] + t1) * coef0 - emu_voice->filt_buffer[2] * coef1) >> 24;
-                                        emu_voice->filt_buffer[2] = ClipBuffer(emu_voice->filt_buffer[2]);
-
-                                        int64_t t3 = emu_voice->filt_buffer[3];
-                                        emu_voice->filt_buffer[3] = ((emu_voice->filt_buffer[2] + t2) * coef0 - emu_voice->filt_buffer[3] * coef1) >> 24;
-                                        emu_voice->filt_buffer[3] = ClipBuffer(emu_voice->filt_buffer[3]);
-
-                                        emu_voice->filt_buffer[4] = ((emu_voice->filt_buffer[3] + t3) * coef0 - emu_voice->filt_buffer[4] * coef1) >> 24;
-                                        emu_voice->filt_buffer[4] = ClipBuffer(emu_voice->filt_buffer[4]);
-
-                                        emu_voice->filt_buffer[0] = ClipBuffer(dat);
-
-                                        dat = (int32_t)(emu_voice->filt_buffer[4] >> 8);
-                                        if (dat > 32767) { dat = 32767; }
-                                        else if (dat < -32768) { dat = -32768; }
-
-                        #elif defined FILTER_CONSTANT
-
-                                        /* Apply expected attenuation. (FILTER_MOOG does it implicitly, but this one is constant gain).
-                                         * Also stay at 24bits.*/
-                                        dat = (dat * emu_voice->filt_att) >> 8;
-
-                                        emu_voice->filt_buffer[0] = (coef1 * emu_voice->filt_buffer[0]
-                                                + coef0 * (dat +
-                                                    ((coef2 * (emu_voice->filt_buffer[0] - emu_voice->filt_buffer[1]))>>24))
-                                                ) >> 24;
-                                        emu_voice->filt_buffer[1] = (coef1 * emu_voice->filt_buffer[1]
-                                                + coef0 * emu_voice->filt_buffer[0]) >> 24;
+                        emu_voice->addr.int_address -= (emu_voice->loop_end.int_address - emu_voice->loop_start.int_address);
+                        emu_voice->addr.int_address &= EMU8K_MEM_ADDRESS_MASK;
+                }
+                emu_voice->cpf_curr_pitch = emu_voice->ptrx_pit_target;
+        }
+        if (count)
+                emu_voice->cvcf_curr_filt_ctoff = emu_voice->vtft_filter_target;
+}
 
-                                        emu_voice->filt_buffer[0] = ClipBuffer(emu_voice->filt_buffer[0]);
-                                        emu_voice->filt_buffer[1] = ClipBuffer(emu_voice->filt_buffer[1]);
+/* Per sample state of a voice for one block. emu8k_voice_control() records
+ * where the oscillator is and what the volume and filter are at each sample,
+ * then the oscillator, filter and mix stages work on the whole block. */
+typedef struct emu8k_voice_block_t
+{
+        uint32_t int_addr[EMU8K_BLOCK_LEN];
+        uint16_t fract_addr[EMU8K_BLOCK_LEN];
+        int32_t volume[EMU8K_BLOCK_LEN];
+        /* filterq_idx*256 + cutoff, or -1 if the filter is bypassed */
+        int32_t filt_row[EMU8K_BLOCK_LEN];
+        /* Oscillator output, then filter output */
+        int32_t dat[EMU8K_BLOCK_LEN];
+} emu8k_voice_block_t;
+
+/* Record the oscillator position, volume and filter for each sample of a
+ * block, and run the envelopes, LFOs and the pitch, volume and cutoff updates. */
+static void emu8k_voice_control(emu8k_voice_t *emu_voice, emu8k_voice_block_t *vb, int count)
+{
+        int pos;
 
-                                        dat = (int32_t)(emu_voice->filt_buffer[1] >> 8);
-                                        if (dat > 32767) { dat = 32767; }
-                                        else if (dat < -32768) { dat = -32768; }
+        for (pos = 0; pos < count; pos++)
+        {
+                vb->int_addr[pos] = emu_voice->addr.int_address;
+                vb->fract_addr[pos] = emu_voice->addr.fract_address;
+                vb->volume[pos] = emu_voice->cvcf_curr_volume;
+                if (emu_voice->filterq_idx || emu_voice->cvcf_curr_filt_ctoff != 0xFFFF )
+                        vb->filt_row[pos] = (emu_voice->filterq_idx << 8) | (emu_voice->cvcf_curr_filt_ctoff >> 8);
+                else
+                        vb->filt_row[pos] = -1;
 
-                        #endif
-                                
+                if ( emu_voice->env_engine_on)
+                {
+                        int32_t attenuation = emu_voice->initial_att;
+                        int32_t filtercut = emu_voice->initial_filter;
+                        int32_t currentpitch = emu_voice->ip;
+                        /* run envelopes */
+                        emu8k_envelope_t *volenv = &emu_voice->vol_envelope;
+                        switch (volenv->state)
+                        {
+                                case ENV_DELAY:
+                                volenv->delay_samples--;
+                                if (volenv->delay_samples <=0)
+                                {
+                                        volenv->state=ENV_ATTACK;
+                                        volenv->delay_samples=0;
                                 }
-                                if (( emu8k->hwcf3 & 0x04) && !CCCA_DMA_ACTIVE(emu_voice->ccca))
+                                attenuation = 0x1FFFFF;
+                                break;
+                        
+                                case ENV_ATTACK:
+                                /* Attack amount is in linear amplitude */
+                                volenv->value_amp_hz += volenv->attack_amount_amp_hz;
+                                if (volenv->value_amp_hz >= (1 << 21))
                                 {
-                                        /*volume and pan*/
-                                        dat = (dat * emu_voice->cvcf_curr_volume) >> 16;
-
-                                        (*buf++) += (dat * emu_voice->vol_l) >> 8;
-                                        (*buf++) += (dat * emu_voice->vol_r) >> 8;
-
-                                        /* Effects section */
-                                        if (emu_voice->ptrx_revb_send > 0)
+                                        volenv->value_amp_hz = 1 << 21;
+                                        volenv->value_db_oct = 0;
+                                        if (volenv->hold_samples)
                                         {
-                                                emu8k->reverb_in_buffer[pos]+=(dat*emu_voice->ptrx_revb_send) >> 8;
+                                                volenv->state = ENV_HOLD;
                                         }
-                                        if (emu_voice->csl_chor_send > 0)
+                                        else
                                         {
-                                                emu8k->chorus_in_buffer[pos]+=(dat*emu_voice->csl_chor_send) >> 8;
+                                                /* RAMP_UP since db value is inverted and it is 0 at this point. */
+                                                volenv->state = ENV_RAMP_UP;
                                         }
                                 }
-                        }
-
-                        if ( emu_voice->env_engine_on)
-                        {
-                                int32_t attenuation = emu_voice->initial_att;
-                                int32_t filtercut = emu_voice->initial_filter;
-                                int32_t currentpitch = emu_voice->ip;
-                                /* run envelopes */
-                                emu8k_envelope_t *volenv = &emu_voice->vol_envelope;
-                                switch (volenv->state)
+                                attenuation += env_vol_amplitude_to_db[volenv->value_amp_hz >> 5] << 5;
+                                break;
+        
+                                case ENV_HOLD:
+                                volenv->hold_samples--;
+                                if (volenv->hold_samples <=0)
                                 {
-                                        case ENV_DELAY:
-                                        volenv->delay_samples--;
-                                        if (volenv->delay_samples <=0)
-                                        {
-                                                volenv->state=ENV_ATTACK;
-                                                volenv->delay_samples=0;
-                                        }
-                                        attenuation = 0x1FFFFF;
-                                        break;
-                                        
-                                        case ENV_ATTACK:
-                                        /* Attack amount is in linear amplitude */
-                                        volenv->value_amp_hz += volenv->attack_amount_amp_hz;
-                                        if (volenv->value_amp_hz >= (1 << 21))
-                                        {
-                                                volenv->value_amp_hz = 1 << 21;
-                                                volenv->value_db_oct = 0;
-                                                if (volenv->hold_samples)
-                                                {
-                                                        volenv->state = ENV_HOLD;
-                                                }
-                                                else
-                                                {
-                                                        /* RAMP_UP since db value is inverted and it is 0 at this point. */
-                                                        volenv->state = ENV_RAMP_UP;
-                                                }
-                                        }
-                                        attenuation += env_vol_amplitude_to_db[volenv->value_amp_hz >> 5] << 5;
-                                        break;
-                        
-                                        case ENV_HOLD:
-                                        volenv->hold_samples--;
-                                        if (volenv->hold_samples <=0)
-                                        {
-                                            volenv->state=ENV_RAMP_UP;
-                                        }
-                                        attenuation += volenv->value_db_oct;
-                                        break;
-
-                                        case ENV_RAMP_DOWN:
-                                        /* Decay/release amount is in fraction of dBs and is always positive */
-                                        volenv->value_db_oct -= volenv->ramp_amount_db_oct;
-                                        if (volenv->value_db_oct <= volenv->sustain_value_db_oct)
-                                        {
-                                                volenv->value_db_oct = volenv->sustain_value_db_oct;
-                                                volenv->state = ENV_SUSTAIN;
-                                        }
-                                        attenuation += volenv->value_db_oct;
-                                        break;
+                                    volenv->state=ENV_RAMP_UP;
+                                }
+                                attenuation += volenv->value_db_oct;
+                                break;
 
-                                        case ENV_RAMP_UP:
-                                        /* Decay/release amount is in fraction of dBs and is always positive */
-                                        volenv->value_db_oct += volenv->ramp_amount_db_oct;
-                                        if (volenv->value_db_oct >= volenv->sustain_value_db_oct)
-                                        {
-                                                volenv->value_db_oct = volenv->sustain_value_db_oct;
-                                                volenv->state = ENV_SUSTAIN;
-                                        }
-                                        attenuation += volenv->value_db_oct;
-                                        break;
-                                        
-                                        case ENV_SUSTAIN:
-                                        attenuation += volenv->value_db_oct;
-                                        break;
-                                        
-                                        case ENV_STOPPED:
-                                        attenuation = 0x1FFFFF;
-                                        break;
+                                case ENV_RAMP_DOWN:
+                                /* Decay/release amount is in fraction of dBs and is always positive */
+                                volenv->value_db_oct -= volenv->ramp_amount_db_oct;
+                                if (volenv->value_db_oct <= volenv->sustain_value_db_oct)
+                                {
+                                        volenv->value_db_oct = volenv->sustain_value_db_oct;
+                                        volenv->state = ENV_SUSTAIN;
                                 }
+                                attenuation += volenv->value_db_oct;
+                                break;
 
-                                emu8k_envelope_t *modenv = &emu_voice->mod_envelope;
-                                switch (modenv->state)
+                                case ENV_RAMP_UP:
+                                /* Decay/release amount is in fraction of dBs and is always positive */
+                                volenv->value_db_oct += volenv->ramp_amount_db_oct;
+                                if (volenv->value_db_oct >= volenv->sustain_value_db_oct)
                                 {
-                                        case ENV_DELAY:
-                                        modenv->delay_samples--;
-                                        if (modenv->delay_samples <=0)
-                                        {
-                                                modenv->state=ENV_ATTACK;
-                                                modenv->delay_samples=0;
-                                        }
-                                        break;
-                                        
-                                        case ENV_ATTACK:
-                                        /* Attack amount is in linear amplitude */
-                                        modenv->value_amp_hz += modenv->attack_amount_amp_hz;
-                                        modenv->value_db_oct = env_mod_hertz_to_octave[modenv->value_amp_hz >> 5] << 5;
-                                        if (modenv->value_amp_hz >= (1 << 21))
-                                        {
-                                                modenv->value_amp_hz = 1 << 21;
-                                                modenv->value_db_oct = 1 << 21;
-                                                if (modenv->hold_samples)
-                                                {
-                                                        modenv->state = ENV_HOLD;
-                                                }
-                                                else
-                                                {
-                                                        modenv->state = ENV_RAMP_DOWN;
-                                                }
-                                        }
-                                        break;
+                                        volenv->value_db_oct = volenv->sustain_value_db_oct;
+                                        volenv->state = ENV_SUSTAIN;
+                                }
+                                attenuation += volenv->value_db_oct;
+                                break;
+                        
+                                case ENV_SUSTAIN:
+                                attenuation += volenv->value_db_oct;
+                                break;
+                        
+                                case ENV_STOPPED:
+                                attenuation = 0x1FFFFF;
+                                break;
+                        }
 
-                                        case ENV_HOLD:
-                                        modenv->hold_samples--;
-                                        if (modenv->hold_samples <=0)
-                                        {
-                                                modenv->state=ENV_RAMP_UP;
-                                        }
-                                        break;
-                                        
-                                        case ENV_RAMP_DOWN:
-                                        /* Decay/release amount is in fraction of octave and is always positive */
-                                        modenv->value_db_oct -= modenv->ramp_amount_db_oct;
-                                        if (modenv->value_db_oct <= modenv->sustain_value_db_oct)
+                        emu8k_envelope_t *modenv = &emu_voice->mod_envelope;
+                        switch (modenv->state)
+                        {
+                                case ENV_DELAY:
+                                modenv->delay_samples--;
+                                if (modenv->delay_samples <=0)
+                                {
+                                        modenv->state=ENV_ATTACK;
+                                        modenv->delay_samples=0;
+                                }
+                                break;
+                        
+                                case ENV_ATTACK:
+                                /* Attack amount is in linear amplitude */
+                                modenv->value_amp_hz += modenv->attack_amount_amp_hz;
+                                modenv->value_db_oct = env_mod_hertz_to_octave[modenv->value_amp_hz >> 5] << 5;
+                                if (modenv->value_amp_hz >= (1 << 21))
+                                {
+                                        modenv->value_amp_hz = 1 << 21;
+                                        modenv->value_db_oct = 1 << 21;
+                                        if (modenv->hold_samples)
                                         {
-                                                modenv->value_db_oct = modenv->sustain_value_db_oct;
-                                                modenv->state = ENV_SUSTAIN;
+                                                modenv->state = ENV_HOLD;
                                         }
-                                        break;
-
-                                        case ENV_RAMP_UP:
-                                        /* Decay/release amount is in fraction of octave and is always positive */
-                                        modenv->value_db_oct += modenv->ramp_amount_db_oct;
-                                        if (modenv->value_db_oct >= modenv->sustain_value_db_oct)
+                                        else
                                         {
-                                                modenv->value_db_oct = modenv->sustain_value_db_oct;
-                                                modenv->state = ENV_SUSTAIN;
+                                                modenv->state = ENV_RAMP_DOWN;
                                         }
-                                        break;
                                 }
+                                break;
 
-                                /* run lfos */
-                                if (emu_voice->lfo1_delay_samples)
-                                {
-                                        emu_voice->lfo1_delay_samples--;
-                                }
-                                else
+                                case ENV_HOLD:
+                                modenv->hold_samples--;
+                                if (modenv->hold_samples <=0)
                                 {
-                                        emu_voice->lfo1_count.addr += emu_voice->lfo1_speed;
-                                        emu_voice->lfo1_count.int_address &= 0xFFFF;
+                                        modenv->state=ENV_RAMP_UP;
                                 }
-                                if (emu_voice->lfo2_delay_samples)
+                                break;
+                        
+                                case ENV_RAMP_DOWN:
+                                /* Decay/release amount is in fraction of octave and is always positive */
+                                modenv->value_db_oct -= modenv->ramp_amount_db_oct;
+                                if (modenv->value_db_oct <= modenv->sustain_value_db_oct)
                                 {
-                                        emu_voice->lfo2_delay_samples--;
+                                        modenv->value_db_oct = modenv->sustain_value_db_oct;
+                                        modenv->state = ENV_SUSTAIN;
                                 }
-                                else
+                                break;
+
+                                case ENV_RAMP_UP:
+                                /* Decay/release amount is in fraction of octave and is always positive */
+                                modenv->value_db_oct += modenv->ramp_amount_db_oct;
+                                if (modenv->value_db_oct >= modenv->sustain_value_db_oct)
                                 {
-                                        emu_voice->lfo2_count.addr += emu_voice->lfo2_speed;
-                                        emu_voice->lfo2_count.int_address &= 0xFFFF;
+                                        modenv->value_db_oct = modenv->sustain_value_db_oct;
+                                        modenv->state = ENV_SUSTAIN;
                                 }
+                                break;
+                        }
 
+                        /* run lfos */
+                        if (emu_voice->lfo1_delay_samples)
+                        {
+                                emu_voice->lfo1_delay_samples--;
+                        }
+                        else
+                        {
+                                emu_voice->lfo1_count.addr += emu_voice->lfo1_speed;
+                                emu_voice->lfo1_count.int_address &= 0xFFFF;
+                        }
+                        if (emu_voice->lfo2_delay_samples)
+                        {
+                                emu_voice->lfo2_delay_samples--;
+                        }
+                        else
+                        {
+                                emu_voice->lfo2_count.addr += emu_voice->lfo2_speed;
+                                emu_voice->lfo2_count.int_address &= 0xFFFF;
+                        }
 
-                                if (emu_voice->fixed_modenv_pitch_height)
-                                {
-                                        /* modenv range 1<<21, pitch height range 1<<14 desired range 0x1000 (+/-one octave) */
-                                        currentpitch += ((modenv->value_db_oct>>9)*emu_voice->fixed_modenv_pitch_height) >> 14;
-                                }
 
-                                if (emu_voice->fixed_lfo1_vibrato)
-                                {
-                                        /* table range 1<<15, pitch mod range 1<<14 desired range 0x1000 (+/-one octave) */
-                                        int32_t lfo1_vibrato = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_vibrato) >> 17;
-                                        currentpitch += lfo1_vibrato;
-                                }
-                                if (emu_voice->fixed_lfo2_vibrato)
-                                {
-                                        /* table range 1<<15, pitch mod range 1<<14 desired range 0x1000 (+/-one octave) */
-                                        int32_t lfo2_vibrato = (lfotable[emu_voice->lfo2_count.int_address]*emu_voice->fixed_lfo2_vibrato) >> 17;
-                                        currentpitch += lfo2_vibrato;
-                                }
+                        if (emu_voice->fixed_modenv_pitch_height)
+                        {
+                                /* modenv range 1<<21, pitch height range 1<<14 desired range 0x1000 (+/-one octave) */
+                                currentpitch += ((modenv->value_db_oct>>9)*emu_voice->fixed_modenv_pitch_height) >> 14;
+                        }
 
-                                if (emu_voice->fixed_modenv_filter_height)
-                                {
-                                        /* modenv range 1<<21, pitch height range 1<<14 desired range 0x200000 (+/-full filter range) */
-                                        filtercut += ((modenv->value_db_oct>>9)*emu_voice->fixed_modenv_filter_height) >> 5;
-                                }
+                        if (emu_voice->fixed_lfo1_vibrato)
+                        {
+                                /* table range 1<<15, pitch mod range 1<<14 desired range 0x1000 (+/-one octave) */
+                                int32_t lfo1_vibrato = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_vibrato) >> 17;
+                                currentpitch += lfo1_vibrato;
+                        }
+                        if (emu_voice->fixed_lfo2_vibrato)
+                        {
+                                /* table range 1<<15, pitch mod range 1<<14 desired range 0x1000 (+/-one octave) */
+                                int32_t lfo2_vibrato = (lfotable[emu_voice->lfo2_count.int_address]*emu_voice->fixed_lfo2_vibrato) >> 17;
+                                currentpitch += lfo2_vibrato;
+                        }
 
-                                if (emu_voice->fixed_lfo1_filt_mod)
-                                {
-                                        /* table range 1<<15, pitch mod range 1<<14 desired range 0x100000 (+/-three octaves) */
-                                        int32_t lfo1_filtmod = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_filt_mod) >> 9;
-                                        filtercut += lfo1_filtmod;
-                                }
+                        if (emu_voice->fixed_modenv_filter_height)
+                        {
+                                /* modenv range 1<<21, pitch height range 1<<14 desired range 0x200000 (+/-full filter range) */
+                                filtercut += ((modenv->value_db_oct>>9)*emu_voice->fixed_modenv_filter_height) >> 5;
+                        }
+
+                        if (emu_voice->fixed_lfo1_filt_mod)
+                        {
+                                /* table range 1<<15, pitch mod range 1<<14 desired range 0x100000 (+/-three octaves) */
+                                int32_t lfo1_filtmod = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_filt_mod) >> 9;
+                                filtercut += lfo1_filtmod;
+                        }
+
+                        if (emu_voice->fixed_lfo1_tremolo)
+                        {
+                                /* table range 1<<15, pitch mod range 1<<14 desired range 0x40000 (+/-12dBs). */
+                                int32_t lfo1_tremolo = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_tremolo) >> 11;
+                                attenuation += lfo1_tremolo;
+                        }
+
+                        if (currentpitch > 0xFFFF) currentpitch = 0xFFFF;
+                        if (currentpitch < 0) currentpitch = 0;
+                        if (attenuation > 0x1FFFFF) attenuation = 0x1FFFFF;
+                        if (attenuation < 0) attenuation = 0;
+                        if (filtercut > 0x1FFFFF) filtercut = 0x1FFFFF;
+                        if (filtercut < 0) filtercut = 0;
+
+                        emu_voice->vtft_vol_target = env_vol_db_to_vol_target[attenuation >> 5];
+                        emu_voice->vtft_filter_target = filtercut >> 5;
+                        emu_voice->ptrx_pit_target = freqtable[currentpitch]>>18;
+
+                }
+        /*
+        I've recopilated these sentences to get an idea of how to loop
+
+        - Set its PSST register and its CLS register to zero to cause no loops to occur.
+        -Setting the Loop Start Offset and the Loop End Offset to the same value, will cause the oscillator to loop the entire memory.
+
+        -Setting the PlayPosition greater than the Loop End Offset, will cause the oscillator to play in reverse, back to the Loop End Offset.
+           It's pretty neat, but appears to be uncontrollable (the rate at which the samples are played in reverse).
+
+        -Note that due to interpolator offset, the actual loop point is one greater than the start address
+        -Note that due to interpolator offset, the actual loop point will end at an address one greater than the loop address
+        -Note that the actual audio location is the point 1 word higher than this value due to interpolation offset
+        -In programs that use the awe, they generally set the loop address as "loopaddress -1" to compensate for the above.
+        (Note: I am already using address+1 in the interpolators so these things are already as they should.)
+        */
+                emu_voice->addr.addr += ((uint64_t)emu_voice->cpf_curr_pitch) << 18;
+                if (emu_voice->addr.addr >= emu_voice->loop_end.addr)
+                {
+                        emu_voice->addr.int_address -= (emu_voice->loop_end.int_address - emu_voice->loop_start.int_address);
+                        emu_voice->addr.int_address &= EMU8K_MEM_ADDRESS_MASK;
+                }
+
+                /* TODO: How and when are the target and current values updated */
+                emu_voice->cpf_curr_pitch = emu_voice->ptrx_pit_target;
+                emu_voice->cvcf_curr_volume = emu8k_vol_slide(&emu_voice->volumeslide,emu_voice->vtft_vol_target);
+                emu_voice->cvcf_curr_filt_ctoff = emu_voice->vtft_filter_target;
+        }
+}
+
+/* Waveform oscillator. Samples that end up with zero volume are interpolated
+ * too, their output is thrown away by the later stages. */
+static void emu8k_voice_oscillator(emu8k_t *emu8k, emu8k_voice_block_t *vb, int count)
+{
+        int pos = 0;
+
+#if defined RESAMPLER_CUBIC && defined __SSE2__
+        if (!emu8k->scalar_render)
+        {
+                /* Four samples at a time. Each sample's taps are multiplied by its
+                 * table row, then the products are transposed so that each lane
+                 * adds them up in the same order as EMU8K_READ_INTERP_CUBIC(),
+                 * which gives the same result. */
+                for (; pos + 4 <= count; pos += 4)
+                {
+                        __m128 prod[4];
+                        int c;
+
+                        for (c = 0; c < 4; c++)
+                        {
+                                const uint32_t int_addr = vb->int_addr[pos + c];
+                                const int fract = (vb->fract_addr[pos + c] >> (16-CUBIC_RESOLUTION_LOG)) << 2;
+                                const emu8k_mem_pointers_t addrmem = {{int_addr}};
+                                __m128i taps;
 
-                                if (emu_voice->fixed_lfo1_tremolo)
+                                if (addrmem.lw_address <= 0xfffc)
                                 {
-                                        /* table range 1<<15, pitch mod range 1<<14 desired range 0x40000 (+/-12dBs). */
-                                        int32_t lfo1_tremolo = (lfotable[emu_voice->lfo1_count.int_address]*emu_voice->fixed_lfo1_tremolo) >> 11;
-                                        attenuation += lfo1_tremolo;
+                                        /* All four taps are in the same block */
+                                        taps = _mm_loadl_epi64((__m128i *)&emu8k->ram_pointers[addrmem.hb_address][addrmem.lw_address]);
+                                        taps = _mm_srai_epi32(_mm_unpacklo_epi16(taps, taps), 16);
                                 }
+                                else
+                                        taps = _mm_set_epi32(EMU8K_READ(emu8k, int_addr+3), EMU8K_READ(emu8k, int_addr+2),
+                                                             EMU8K_READ(emu8k, int_addr+1), EMU8K_READ(emu8k, int_addr));
+                                prod[c] = _mm_mul_ps(_mm_cvtepi32_ps(taps), _mm_loadu_ps(&cubic_table[fract]));
+                        }
+                        _MM_TRANSPOSE4_PS(prod[0], prod[1], prod[2], prod[3]);
+
+                        prod[0] = _mm_add_ps(_mm_add_ps(_mm_add_ps(prod[0], prod[1]), prod[2]), prod[3]);
+                        _mm_storeu_si128((__m128i *)&vb->dat[pos], _mm_cvttps_epi32(prod[0]));
+                }
+        }
+#endif
+        for (; pos < count; pos++)
+        {
+#ifdef RESAMPLER_LINEAR
+                vb->dat[pos] = EMU8K_READ_INTERP_LINEAR(emu8k, vb->int_addr[pos], vb->fract_addr[pos]);
+#elif defined RESAMPLER_CUBIC
+                vb->dat[pos] = EMU8K_READ_INTERP_CUBIC(emu8k, vb->int_addr[pos], vb->fract_addr[pos]);
+#endif
+        }
+}
+
+/* Filter section, for the samples of the block that have volume and don't
+ * bypass the filter. */
+static void emu8k_voice_filter(emu8k_voice_t *emu_voice, emu8k_voice_block_t *vb, int count)
+{
+        int pos;
+
+        for (pos = 0; pos < count; pos++)
+        {
+                int32_t dat = vb->dat[pos];
+
+                if (!vb->volume[pos] || vb->filt_row[pos] < 0)
+                        continue;
+
+                const int64_t coef0 = filt_coeffs[vb->filt_row[pos] >> 8][vb->filt_row[pos] & 0xff][0];
+                const int64_t coef1 = filt_coeffs[vb->filt_row[pos] >> 8][vb->filt_row[pos] & 0xff][1];
+                const int64_t coef2 = filt_coeffs[vb->filt_row[pos] >> 8][vb->filt_row[pos] & 0xff][2];
+
+                /* clip at twice the range */
+                #define ClipBuffer(buf) (buf < -16777216) ? -16777216 : (buf > 16777216) ? 16777216 : buf
+
+                #ifdef FILTER_INITIAL
+                #define NOOP(x) (void)x;
+                NOOP(coef1)
+                /* Apply expected attenuation. (FILTER_MOOG does it implicitly, but this one doesn't).
+                 * Work in 24bits. */
+                dat = (dat * emu_voice->filt_att) >> 8;
+
+                int64_t vhp = ((-emu_voice->filt_buffer[0] * coef2) >> 24) - emu_voice->filt_buffer[1] - dat;
+                emu_voice->filt_buffer[1] += (emu_voice->filt_buffer[0] * coef0) >> 24;
+                emu_voice->filt_buffer[0] += (vhp * coef0) >> 24;
+                dat = (int32_t)(emu_voice->filt_buffer[1] >> 8);
+                if (dat > 32767) { dat = 32767; }
+                else if (dat < -32768) { dat = -32768; }
+
+                #elif defined FILTER_MOOG
+
+                /*move to 24bits*/
+                dat <<= 8;
+
+                dat -= (coef2 * emu_voice->filt_buffer[4]) >> 24; /*feedback*/
+                int64_t t1 = emu_voice->filt_buffer[1];
+                emu_voice->filt_buffer[1] = ((dat + emu_voice->filt_buffer[0]) * coef0 - emu_voice->filt_buffer[1] * coef1) >> 24;
+                emu_voice->filt_buffer[1] = ClipBuffer(emu_voice->filt_buffer[1]);
+
+                int64_t t2 = emu_voice->filt_buffer[2];
+                emu_voice->filt_buffer[2] = ((emu_voice->filt_buffer[1] + t1) * coef0 - emu_voice->filt_buffer[2] * coef1) >> 24;
+                emu_voice->filt_buffer[2] = ClipBuffer(emu_voice->filt_buffer[2]);
+
+                int64_t t3 = emu_voice->filt_buffer[3];
+                emu_voice->filt_buffer[3] = ((emu_voice->filt_buffer[2] + t2) * coef0 - emu_voice->filt_buffer[3] * coef1) >> 24;
+                emu_voice->filt_buffer[3] = ClipBuffer(emu_voice->filt_buffer[3]);
+
+                emu_voice->filt_buffer[4] = ((emu_voice->filt_buffer[3] + t3) * coef0 - emu_voice->filt_buffer[4] * coef1) >> 24;
+                emu_voice->filt_buffer[4] = ClipBuffer(emu_voice->filt_buffer[4]);
+
+                emu_voice->filt_buffer[0] = ClipBuffer(dat);
+
+                dat = (int32_t)(emu_voice->filt_buffer[4] >> 8);
+                if (dat > 32767) { dat = 32767; }
+                else if (dat < -32768) { dat = -32768; }
+
+                #elif defined FILTER_CONSTANT
+
+                /* Apply expected attenuation. (FILTER_MOOG does it implicitly, but this one is constant gain).
+                 * Also stay at 24bits.*/
+                dat = (dat * emu_voice->filt_att) >> 8;
+
+                emu_voice->filt_buffer[0] = (coef1 * emu_voice->filt_buffer[0]
+                        + coef0 * (dat +
+                            ((coef2 * (emu_voice->filt_buffer[0] - emu_voice->filt_buffer[1]))>>24))
+                        ) >> 24;
+                emu_voice->filt_buffer[1] = (coef1 * emu_voice->filt_buffer[1]
+                        + coef0 * emu_voice->filt_buffer[0]) >> 24;
+
+                emu_voice->filt_buffer[0] = ClipBuffer(emu_voice->filt_buffer[0]);
+                emu_voice->filt_buffer[1] = ClipBuffer(emu_voice->filt_buffer[1]);
+
+                dat = (int32_t)(emu_voice->filt_buffer[1] >> 8);
+                if (dat > 32767) { dat = 32767; }
+                else if (dat < -32768) { dat = -32768; }
+
+                #endif
+
+                vb->dat[pos] = dat;
+        }
+}
+
+#if defined FILTER_MOOG && defined __SSE2__
+/* filt_coeffs[] as doubles, divided by 2^24 so that the products come out
+ * already shifted. */
+static double filt_coeffs_pd[16][256][3];
+
+/* emu8k_voice_filter() for up to EMU8K_FILTER_VOICES voices at once, two per
+ * register.
+ * The filter buffers are clipped to 2^24 and the coefficients are below 2^26,
+ * so the sums of products in the int64 version need at most 51 bits. Divided
+ * by 2^24 they have 24 fraction bits and are exact in a double, and with the
+ * rounding mode set to round down, adding and taking away 1.5 * 2^52 leaves
+ * the floor, which is what >> 24 does. So the result is the same.
+ * Each sample depends on the previous one, so the voices are worked on side by
+ * side to hide the latency, and the products that don't depend on the current
+ * sample are taken out of the chain. */
+static void emu8k_voice_filter_lanes(emu8k_voice_t **voice, emu8k_voice_block_t *vb, int nr_voices, int count)
+{
+        const __m128d clip_min = _mm_set1_pd(-16777216.0);
+        const __m128d clip_max = _mm_set1_pd(16777216.0);
+        const __m128d round = _mm_set1_pd(6755399441055744.0);
+        const __m128d sign = _mm_set1_pd(-0.0);
+        const unsigned int old_rounding = _MM_GET_ROUNDING_MODE();
+        __m128d filt_buffer[EMU8K_FILTER_VOICES/2][5];
+        double store[EMU8K_FILTER_VOICES][5];
+        int pos, c, v;
+
+#define FloorPD(x) _mm_sub_pd(_mm_add_pd(x, round), round)
+#define ClipBufferPD(buf) _mm_min_pd(_mm_max_pd(buf, clip_min), clip_max)
+
+        _MM_SET_ROUNDING_MODE(_MM_ROUND_DOWN);
+
+        for (v = 0; v < EMU8K_FILTER_VOICES; v++)
+        {
+                for (c = 0; c < 5; c++)
+                        store[v][c] = (v < nr_voices) ? (double)voice[v]->filt_buffer[c] : 0.0;
+        }
+        for (v = 0; v < EMU8K_FILTER_VOICES; v += 2)
+        {
+                for (c = 0; c < 5; c++)
+                        filt_buffer[v/2][c] = _mm_set_pd(store[v+1][c], store[v][c]);
+        }
 
-                                if (currentpitch > 0xFFFF) currentpitch = 0xFFFF;
-                                if (currentpitch < 0) currentpitch = 0;
-                                if (attenuation > 0x1FFFFF) attenuation = 0x1FFFFF;
-                                if (attenuation < 0) attenuation = 0;
-                                if (filtercut > 0x1FFFFF) filtercut = 0x1FFFFF;
-                                if (filtercut < 0) filtercut = 0;
+        for (pos = 0; pos < count; pos++)
+        {
+                for (v = 0; v < EMU8K_FILTER_VOICES; v += 2)
+                {
+                        const int active0 = v < nr_voices && vb[v].volume[pos] && vb[v].filt_row[pos] >= 0;
+                        const int active1 = v+1 < nr_voices && vb[v+1].volume[pos] && vb[v+1].filt_row[pos] >= 0;
+                        __m128d *fb = filt_buffer[v/2];
+                        __m128d coef0, coef1, coef2, mask, dat, out;
+                        __m128d part[5], new_buffer[5];
+                        __m128i out_i;
 
-                                emu_voice->vtft_vol_target = env_vol_db_to_vol_target[attenuation >> 5];
-                                emu_voice->vtft_filter_target = filtercut >> 5;
-                                emu_voice->ptrx_pit_target = freqtable[currentpitch]>>18;
+                        if (!active0 && !active1)
+                                continue;
 
+                        {
+                                const int row0 = active0 ? vb[v].filt_row[pos] : 0;
+                                const int row1 = active1 ? vb[v+1].filt_row[pos] : 0;
+                                const double *coefs0 = filt_coeffs_pd[row0 >> 8][row0 & 0xff];
+                                const double *coefs1 = filt_coeffs_pd[row1 >> 8][row1 & 0xff];
+
+                                coef0 = _mm_set_pd(coefs1[0], coefs0[0]);
+                                coef1 = _mm_set_pd(coefs1[1], coefs0[1]);
+                                coef2 = _mm_set_pd(coefs1[2], coefs0[2]);
+                                mask = _mm_castsi128_pd(_mm_set_epi32(-active1, -active1, -active0, -active0));
                         }
-/*
-I've recopilated these sentences to get an idea of how to loop
 
-- Set its PSST register and its CLS register to zero to cause no loops to occur.
--Setting the Loop Start Offset and the Loop End Offset to the same value, will cause the oscillator to loop the entire memory.
+                        /* (in + t) * coef0 - old * coef1, with t and old from the last sample */
+                        for (c = 1; c < 5; c++)
+                                part[c] = _mm_sub_pd(_mm_mul_pd(fb[c-1], coef0), _mm_mul_pd(fb[c], coef1));
+
+                        /*move to 24bits*/
+                        dat = _mm_set_pd(active1 ? vb[v+1].dat[pos] * 256.0 : 0.0, active0 ? vb[v].dat[pos] * 256.0 : 0.0);
+
+                        /*feedback*/
+                        dat = _mm_sub_pd(dat, FloorPD(_mm_mul_pd(coef2, fb[4])));
+
+                        /* The buffers rarely need clipping, so first go without, and
+                         * only do it again with clipping if a value is out of range */
+                        new_buffer[0] = dat;
+                        new_buffer[1] = FloorPD(_mm_add_pd(_mm_mul_pd(new_buffer[0], coef0), part[1]));
+                        new_buffer[2] = FloorPD(_mm_add_pd(_mm_mul_pd(new_buffer[1], coef0), part[2]));
+                        new_buffer[3] = FloorPD(_mm_add_pd(_mm_mul_pd(new_buffer[2], coef0), part[3]));
+                        new_buffer[4] = FloorPD(_mm_add_pd(_mm_mul_pd(new_buffer[3], coef0), part[4]));
+                        out = _mm_max_pd(_mm_max_pd(_mm_max_pd(_mm_andnot_pd(sign, new_buffer[0]), _mm_andnot_pd(sign, new_buffer[1])),
+                                                    _mm_max_pd(_mm_andnot_pd(sign, new_buffer[2]), _mm_andnot_pd(sign, new_buffer[3]))),
+                                         _mm_andnot_pd(sign, new_buffer[4]));
+                        if (_mm_movemask_pd(_mm_cmpgt_pd(out, clip_max)))
+                        {
+                                new_buffer[0] = ClipBufferPD(dat);
+                                new_buffer[1] = ClipBufferPD(FloorPD(_mm_add_pd(_mm_mul_pd(dat, coef0), part[1])));
+                                new_buffer[2] = ClipBufferPD(FloorPD(_mm_add_pd(_mm_mul_pd(new_buffer[1], coef0), part[2])));
+                                new_buffer[3] = ClipBufferPD(FloorPD(_mm_add_pd(_mm_mul_pd(new_buffer[2], coef0), part[3])));
+                                new_buffer[4] = ClipBufferPD(FloorPD(_mm_add_pd(_mm_mul_pd(new_buffer[3], coef0), part[4])));
+                        }
 
--Setting the PlayPosition greater than the Loop End Offset, will cause the oscillator to play in reverse, back to the Loop End Offset.
-   It's pretty neat, but appears to be uncontrollable (the rate at which the samples are played in reverse).
+                        out = FloorPD(_mm_mul_pd(new_buffer[4], _mm_set1_pd(1.0 / 256.0)));
+                        out = _mm_min_pd(_mm_max_pd(out, _mm_set1_pd(-32768.0)), _mm_set1_pd(32767.0));
+                        out_i = _mm_cvttpd_epi32(out);
+
+                        /* Lanes without filter keep their state and their output */
+                        for (c = 0; c < 5; c++)
+                                fb[c] = _mm_or_pd(_mm_and_pd(mask, new_buffer[c]), _mm_andnot_pd(mask, fb[c]));
+                        if (active0)
+                                vb[v].dat[pos] = _mm_cvtsi128_si32(out_i);
+                        if (active1)
+                                vb[v+1].dat[pos] = _mm_cvtsi128_si32(_mm_srli_si128(out_i, 4));
+                }
+        }
 
--Note that due to interpolator offset, the actual loop point is one greater than the start address
--Note that due to interpolator offset, the actual loop point will end at an address one greater than the loop address
--Note that the actual audio location is the point 1 word higher than this value due to interpolation offset
--In programs that use the awe, they generally set the loop address as "loopaddress -1" to compensate for the above.
-(Note: I am already using address+1 in the interpolators so these things are already as they should.)
-*/
-                        emu_voice->addr.addr += ((uint64_t)emu_voice->cpf_curr_pitch) << 18;
-                        if (emu_voice->addr.addr >= emu_voice->loop_end.addr)
+#undef ClipBufferPD
+#undef FloorPD
+
+        _MM_SET_ROUNDING_MODE(old_rounding);
+
+        for (v = 0; v < EMU8K_FILTER_VOICES; v += 2)
+        {
+                for (c = 0; c < 5; c++)
+                {
+                        _mm_storeu_pd(&store[0][0], filt_buffer[v/2][c]);
+                        if (v < nr_voices)
+                                voice[v]->filt_buffer[c] = (int64_t)store[0][0];
+                        if (v+1 < nr_voices)
+                                voice[v+1]->filt_buffer[c] = (int64_t)store[0][1];
+                }
+        }
+}
+#endif
+
+/* Apply volume, pan and the effect sends to a block of voice output. Pan and
+ * send amounts don't change during an update, so these loops are simple
+ * enough for the compiler to vectorise. */
+static void emu8k_mix_voice(emu8k_t *emu8k, emu8k_voice_t *emu_voice, const emu8k_voice_block_t *vb, int start, int count)
+{
+        int32_t voice_out[EMU8K_BLOCK_LEN];
+        int32_t *buf = &emu8k->buffer[start*2];
+        const int32_t vol_l = emu_voice->vol_l;
+        const int32_t vol_r = emu_voice->vol_r;
+        int pos;
+
+        /*volume*/
+        for (pos = 0; pos < count; pos++)
+                voice_out[pos] = (vb->dat[pos] * vb->volume[pos]) >> 16;
+
+        for (pos = 0; pos < count; pos++)
+        {
+                buf[pos*2]     += (voice_out[pos] * vol_l) >> 8;
+                buf[pos*2 + 1] += (voice_out[pos] * vol_r) >> 8;
+        }
+        /* Effects section */
+        if (emu_voice->ptrx_revb_send > 0)
+        {
+                int32_t *reverb_in = &emu8k->reverb_in_buffer[start];
+                const int32_t send = emu_voice->ptrx_revb_send;
+
+                for (pos = 0; pos < count; pos++)
+                        reverb_in[pos] += (voice_out[pos] * send) >> 8;
+        }
+        if (emu_voice->csl_chor_send > 0)
+        {
+                int32_t *chorus_in = &emu8k->chorus_in_buffer[start];
+                const int32_t send = emu_voice->csl_chor_send;
+
+                for (pos = 0; pos < count; pos++)
+                        chorus_in[pos] += (voice_out[pos] * send) >> 8;
+        }
+}
+
+//int32_t old_pitch[32]={0};
+//int32_t old_cut[32]={0};
+//int32_t old_vol[32]={0};
+/* Render the output up to new_pos. */
+void emu8k_render(emu8k_t *emu8k, int new_pos)
+{
+        emu8k_voice_block_t vb[EMU8K_FILTER_VOICES];
+        int active[32];
+        int nr_active = 0;
+        int32_t *buf;
+        emu8k_voice_t* emu_voice;
+        int pos;
+        int c;
+
+        if (emu8k->pos >= new_pos)
+                return;
+
+        /* Clean the buffers since we will accumulate into them. */
+        buf = &emu8k->buffer[emu8k->pos*2];
+        memset(buf, 0, 2*(new_pos-emu8k->pos)*sizeof(emu8k->buffer[0]));
+        memset(&emu8k->chorus_in_buffer[emu8k->pos], 0, (new_pos-emu8k->pos)*sizeof(emu8k->chorus_in_buffer[0]));
+        memset(&emu8k->reverb_in_buffer[emu8k->pos], 0, (new_pos-emu8k->pos)*sizeof(emu8k->reverb_in_buffer[0]));
+
+        /* Voices section  */
+        for (c = 0; c < 32; c++)
+        {
+                emu_voice = &emu8k->voice[c];
+
+                if (!emu_voice->cvcf_curr_volume && !emu_voice->volumeslide.last &&
+                    !emu_voice->vtft_vol_target && !emu_voice->env_engine_on)
+                {
+                        /* Silent voice. Nothing is output and the envelopes are not
+                         * running, so only the oscillator address moves. */
+                        emu8k_advance_silent_voice(emu_voice, new_pos - emu8k->pos);
+                }
+                else
+                        active[nr_active++] = c;
+        }
+
+        /* The other voices are rendered in groups, so that their filters can run
+         * side by side. */
+        for (c = 0; c < nr_active; c += EMU8K_FILTER_VOICES)
+        {
+                emu8k_voice_t *voice[EMU8K_FILTER_VOICES];
+                int nr_voices = MIN(EMU8K_FILTER_VOICES, nr_active - c);
+                int block, v;
+
+                for (v = 0; v < nr_voices; v++)
+                        voice[v] = &emu8k->voice[active[c + v]];
+
+                for (block = emu8k->pos; block < new_pos; block += EMU8K_BLOCK_LEN)
+                {
+                        int count = MIN(new_pos, block + EMU8K_BLOCK_LEN) - block;
+
+                        for (v = 0; v < nr_voices; v++)
                         {
-                                emu_voice->addr.int_address -= (emu_voice->loop_end.int_address - emu_voice->loop_start.int_address);
-                                emu_voice->addr.int_address &= EMU8K_MEM_ADDRESS_MASK;
+                                emu8k_voice_control(voice[v], &vb[v], count);
+                                emu8k_voice_oscillator(emu8k, &vb[v], count);
                         }
 
-                        /* TODO: How and when are the target and current values updated */
-                        emu_voice->cpf_curr_pitch = emu_voice->ptrx_pit_target;
-                        emu_voice->cvcf_curr_volume = emu8k_vol_slide(&emu_voice->volumeslide,emu_voice->vtft_vol_target);
-                        emu_voice->cvcf_curr_filt_ctoff = emu_voice->vtft_filter_target;
+#if defined FILTER_MOOG && defined __SSE2__
+                        if (nr_voices >= 2 && !emu8k->scalar_render)
+                                emu8k_voice_filter_lanes(voice, vb, nr_voices, count);
+                        else
+#endif
+                        for (v = 0; v < nr_voices; v++)
+                                emu8k_voice_filter(voice[v], &vb[v], count);
+
+                        for (v = 0; v < nr_voices; v++)
+                        {
+                                if (( emu8k->hwcf3 & 0x04) && !CCCA_DMA_ACTIVE(voice[v]->ccca))
+                                        emu8k_mix_voice(emu8k, voice[v], &vb[v], block, count);
+                        }
                 }
-                
+        }
+
+        for (c = 0; c < 32; c++)
+        {
+                emu_voice = &emu8k->voice[c];
+
                 /* Update EMU voice registers. */
                 emu_voice->ccca = (((uint32_t)emu_voice->ccca_qcontrol) << 24) | emu_voice->addr.int_address;
                 emu_voice->cpf_curr_frac_addr = emu_voice->addr.fract_address;
@@ -2077,7 +2518,7 @@ I've recopilated these sentences to get an idea of how to loop
 
         
         buf = &emu8k->buffer[emu8k->pos*2];
-        emu8k_work_reverb(&emu8k->reverb_in_buffer[emu8k->pos], buf, &emu8k->reverb_engine, new_pos-emu8k->pos);
+        emu8k_work_reverb(&emu8k->reverb_in_buffer[emu8k->pos], buf, &emu8k->reverb_engine, new_pos-emu8k->pos, emu8k->scalar_render);
         emu8k_work_chorus(&emu8k->chorus_in_buffer[emu8k->pos], buf, &emu8k->chorus_engine, new_pos-emu8k->pos);
         emu8k_work_eq(buf, new_pos-emu8k->pos);
         
@@ -2102,6 +2543,11 @@ I've recopilated these sentences to get an idea of how to loop
         
         emu8k->pos = new_pos;
 }
+
+void emu8k_update(emu8k_t *emu8k)
+{
+        emu8k_render(emu8k, (sound_get_pos() * 44100) / 48000);
+}
 /* onboard_ram in kilobytes */
 void emu8k_init(emu8k_t *emu8k, uint16_t emu_addr, int onboard_ram)
 {
@@ -2295,6 +2741,11 @@ void emu8k_init(emu8k_t *emu8k, uint16_t emu_addr, int onboard_ram)
                         filt_coeffs[qidx][c][0] = (int32_t)(p * 16777216.0);
                         filt_coeffs[qidx][c][1] = (int32_t)(f * 16777216.0);
                         filt_coeffs[qidx][c][2] = (int32_t)(q * 16777216.0);
+#ifdef __SSE2__
+                        filt_coeffs_pd[qidx][c][0] = filt_coeffs[qidx][c][0] / 16777216.0;
+                        filt_coeffs_pd[qidx][c][1] = filt_coeffs[qidx][c][1] / 16777216.0;
+                        filt_coeffs_pd[qidx][c][2] = filt_coeffs[qidx][c][2] / 16777216.0;
+#endif
 #elif defined FILTER_CONSTANT
                         float q = (1.0-pow(2.0,-qidx*24.0/90.0))*0.8;
                         float coef0 = sin(2.0*M_PI*out / 44100.0);
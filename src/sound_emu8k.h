@@ -379,6 +379,10 @@ typedef struct emu8k_t
         
         int pos;
         int32_t buffer[MAXSOUNDBUFLEN * 2];
+
+        /* Use the scalar code for the voices and the reverb instead of the SSE2
+           code. Both give the same output, the emu8k benchmark compares them. */
+        int scalar_render;
 } emu8k_t;
 
 
@@ -387,6 +391,9 @@ void emu8k_init(emu8k_t *emu8k, uint16_t emu_addr, int onboard_ram);
 void emu8k_close(emu8k_t *emu8k);
 
 void emu8k_update(emu8k_t *emu8k);
+void emu8k_render(emu8k_t *emu8k, int new_pos);
+
+void emu8k_outw(uint16_t addr, uint16_t val, void *p);
 
 
 
@@ -42,8 +42,9 @@ typedef struct gus_t
         int16_t buffer[2][MAXSOUNDBUFLEN];
         int pos;
         
-        pc_timer_t samp_timer;
+        pc_timer_t samp_timer; /*Next wave/ramp IRQ*/
 	uint64_t samp_latch;
+	uint64_t samp_ts; /*Time of next GUS sample, 32:32*/
         
         uint8_t *ram;
         
@@ -73,6 +74,11 @@ typedef struct gus_t
         uint8_t usrr;
 } gus_t;
 
+/*Maximum number of GUS samples rendered in one go*/
+#define GUS_BLOCK_LEN 256
+/*Limit on how far ahead the IRQ event timer is set; must be under a second*/
+#define GUS_MAX_EVENT_SAMPLES 16384
+
 static int gus_irqs[8] = {-1, 2, 5, 3, 7, 11, 12, 15};
 static int gus_irqs_midi[8] = {-1, 2, 5, 3, 7, 11, 12, 15};
 static int gus_dmas[8] = {-1, 1, 3, 5, 6, 7, -1, -1};
@@ -110,6 +116,9 @@ enum
         GUS_TIMER_CTRL_AUTO = 0x01
 };
 
+static void gus_update(gus_t *gus);
+static void gus_schedule_irq(gus_t *gus);
+
 void gus_update_int_status(gus_t *gus)
 {
         int c;
@@ -205,6 +214,8 @@ void writegus(uint16_t addr, uint8_t val, void *p)
         int c, d;
         int old;
 //        pclog("Write GUS %04X %02X %04X:%04X\n",addr,val,CS,pc);
+        if (addr == 0x344 || addr == 0x345 || addr == 0x347)
+                gus_update(gus);
         if (gus->latch_enable && addr != 0x24b)
                 gus->latch_enable = 0;
         switch (addr)
@@ -653,6 +664,9 @@ gus->curx[gus->voice]=(gus->curx[gus->voice]&0xFFF8000)|((val&0x7F)<<8);
                 gus->reg_ctrl = val;
                 break;
         }
+
+        if (addr == 0x344 || addr == 0x345)
+                gus_schedule_irq(gus);
 }
 
 uint8_t readgus(uint16_t addr, void *p)
@@ -660,6 +674,8 @@ uint8_t readgus(uint16_t addr, void *p)
         gus_t *gus = (gus_t *)p;
         uint8_t val = 0xff;
 //        /*if (addr!=0x246) */printf("Read GUS %04X %04X(%06X):%04X %02X\n",addr,CS,cs,pc,gus->global);
+        if (addr == 0x344 || addr == 0x345 || addr == 0x347)
+                gus_update(gus);
         switch (addr)
         {
                 case 0x340: /*MIDI status*/
@@ -706,6 +722,7 @@ uint8_t readgus(uint16_t addr, void *p)
                         gus->rampirqs[gus->irqstatus2&0x1F]=0;
                         gus->waveirqs[gus->irqstatus2&0x1F]=0;
                         gus_update_int_status(gus);
+                        gus_schedule_irq(gus);
                         return val;
                         
                         case 0x00: case 0x01: case 0x02: case 0x03:
@@ -754,6 +771,7 @@ uint8_t readgus(uint16_t addr, void *p)
                         gus->rampirqs[gus->irqstatus2&0x1F]=0;
                         gus->waveirqs[gus->irqstatus2&0x1F]=0;
                         gus_update_int_status(gus);
+                        gus_schedule_irq(gus);
 //                        pclog("Read IRQ status - %02X  %i %i\n",val, gus->waveirqs[gus->irqstatus2&0x1F], gus->rampirqs[gus->irqstatus2&0x1F]);
                         return val;
 
@@ -915,194 +933,316 @@ void gus_poll_timer_2(void *p)
         gus_update_int_status(gus);
 }
 
-static void gus_update(gus_t *gus)
-{
-        for (; gus->pos < sound_pos_global; gus->pos++)
-        {
-                if (gus->out_l < -32768)
-                        gus->buffer[0][gus->pos] = -32768;
-                else if (gus->out_l > 32767)
-                        gus->buffer[0][gus->pos] = 32767;
-                else
-                        gus->buffer[0][gus->pos] = gus->out_l;
-                if (gus->out_r < -32768)
-                        gus->buffer[1][gus->pos] = -32768;
-                else if (gus->out_r > 32767)
-                        gus->buffer[1][gus->pos] = 32767;
-                else
-                        gus->buffer[1][gus->pos] = gus->out_r;
-        }
-}
-
-void gus_poll_wave(void *p)
+/*Render n samples of all voices into out_l/out_r. Each voice is run over the
+  whole block with its state held in locals; voices only interact through the
+  IRQ status, which is updated once at the end of the block.*/
+static int gus_render_voice(gus_t *gus, int d, int32_t *mix_l, int32_t *mix_r, int n)
 {
-        gus_t *gus = (gus_t *)p;
-        uint32_t addr;
-        int d;
-        int16_t v;
-        int32_t vl;
+        uint32_t cur = gus->cur[d];
+        uint32_t start = gus->start[d], end = gus->end[d];
+        uint32_t step = gus->freq[d] >> 1;
+        int interpolate = !(gus->freq[d] >> 10);
+        int rcur = gus->rcur[d];
+        int rstart = gus->rstart[d], rend = gus->rend[d];
+        int rfreq = gus->rfreq[d];
+        uint8_t ctrl = gus->ctrl[d], rctrl = gus->rctrl[d];
+        int pan_l = gus->pan_l[d], pan_r = gus->pan_r[d];
+        uint8_t *ram = gus->ram;
         int update_irqs = 0;
-        
-        gus_update(gus);
-        
-        timer_advance_u64(&gus->samp_timer, gus->samp_latch);
-        
-        gus->out_l = gus->out_r = 0;
+        int c;
 
-        if ((gus->reset & 3) != 3)
-                return;
-//pclog("gus_poll_wave\n");        
-        for (d=0;d<32;d++)
+        for (c = 0; c < n; c++)
         {
-                if (!(gus->ctrl[d] & 3))
+                if (!(ctrl & 3))
                 {
-                        if (gus->ctrl[d] & 4)
+                        int16_t v;
+                        int32_t vl;
+
+                        if (ctrl & 4)
                         {
-                                addr = gus->cur[d] >> 9;
+                                uint32_t addr = cur >> 9;
+
                                 addr = (addr & 0xC0000) | ((addr << 1) & 0x3FFFE);
-                                if (!(gus->freq[d] >> 10)) /*Interpolate*/
+                                if (interpolate)
                                 {
-                                        vl  = (int16_t)(int8_t)((gus->ram[(addr + 1) & 0xFFFFF] ^ 0x80) - 0x80) * (511 - (gus->cur[d] & 511));
-                                        vl += (int16_t)(int8_t)((gus->ram[(addr + 3) & 0xFFFFF] ^ 0x80) - 0x80) * (gus->cur[d] & 511);
+                                        vl  = (int16_t)(int8_t)((ram[(addr + 1) & 0xFFFFF] ^ 0x80) - 0x80) * (511 - (cur & 511));
+                                        vl += (int16_t)(int8_t)((ram[(addr + 3) & 0xFFFFF] ^ 0x80) - 0x80) * (cur & 511);
                                         v = vl >> 9;
                                 }
                                 else
-                                        v = (int16_t)(int8_t)((gus->ram[(addr + 1) & 0xFFFFF] ^ 0x80) - 0x80);
+                                        v = (int16_t)(int8_t)((ram[(addr + 1) & 0xFFFFF] ^ 0x80) - 0x80);
                         }
                         else
                         {
-                                if (!(gus->freq[d] >> 10)) /*Interpolate*/
+                                if (interpolate)
                                 {
-                                        vl  = ((int8_t)((gus->ram[(gus->cur[d] >> 9) & 0xFFFFF] ^ 0x80) - 0x80)) * (511 - (gus->cur[d] & 511));
-                                        vl += ((int8_t)((gus->ram[((gus->cur[d] >> 9) + 1) & 0xFFFFF] ^ 0x80) - 0x80)) * (gus->cur[d] & 511);
+                                        vl  = ((int8_t)((ram[(cur >> 9) & 0xFFFFF] ^ 0x80) - 0x80)) * (511 - (cur & 511));
+                                        vl += ((int8_t)((ram[((cur >> 9) + 1) & 0xFFFFF] ^ 0x80) - 0x80)) * (cur & 511);
                                         v = vl >> 9;
                                 }
                                 else
-                                        v = (int16_t)(int8_t)((gus->ram[(gus->cur[d] >> 9) & 0xFFFFF] ^ 0x80) - 0x80);
+                                        v = (int16_t)(int8_t)((ram[(cur >> 9) & 0xFFFFF] ^ 0x80) - 0x80);
                         }
 
-//                        pclog("Voice %i : %04X %05X %04X ", d, v, gus->cur[d] >> 9, gus->rcur[d] >> 10);
-                        if ((gus->rcur[d] >> 14) > 4095) v = (int16_t)(float)(v) * 24.0 * vol16bit[4095];
-                        else                            v = (int16_t)(float)(v) * 24.0 * vol16bit[(gus->rcur[d]>>10) & 4095];
-//                        pclog("%f %04X\n", vol16bit[(gus->rcur[d]>>10) & 4095], v);
+                        if ((rcur >> 14) > 4095) v = (int16_t)(float)(v) * 24.0 * vol16bit[4095];
+                        else                     v = (int16_t)(float)(v) * 24.0 * vol16bit[(rcur >> 10) & 4095];
 
-                        gus->out_l += (v * gus->pan_l[d]) / 7;
-                        gus->out_r += (v * gus->pan_r[d]) / 7;
+                        mix_l[c] += (v * pan_l) / 7;
+                        mix_r[c] += (v * pan_r) / 7;
 
-                        if (gus->ctrl[d]&0x40)
+                        if (ctrl & 0x40)
                         {
-                                gus->cur[d] -= (gus->freq[d] >> 1);
-                                if (gus->cur[d] <= gus->start[d])
+                                cur -= step;
+                                if (cur <= start)
                                 {
-                                        int diff = gus->start[d] - gus->cur[d];
+                                        int diff = start - cur;
 
-                                        if (gus->ctrl[d]&8)
+                                        if (ctrl & 8)
                                         {
-                                                if (gus->ctrl[d]&0x10) gus->ctrl[d]^=0x40;
-                                                gus->cur[d] = (gus->ctrl[d] & 0x40) ? (gus->end[d] - diff) : (gus->start[d] + diff);
+                                                if (ctrl & 0x10) ctrl ^= 0x40;
+                                                cur = (ctrl & 0x40) ? (end - diff) : (start + diff);
                                         }
-                                        else if (!(gus->rctrl[d]&4))
+                                        else if (!(rctrl & 4))
                                         {
-                                                gus->ctrl[d] |= 1;
-                                                gus->cur[d] = (gus->ctrl[d] & 0x40) ? gus->end[d] : gus->start[d];
-                                        }                                                
-                                        
-                                        if ((gus->ctrl[d] & 0x20) && !gus->waveirqs[d])
+                                                ctrl |= 1;
+                                                cur = (ctrl & 0x40) ? end : start;
+                                        }
+
+                                        if ((ctrl & 0x20) && !gus->waveirqs[d])
                                         {
                                                 gus->waveirqs[d] = 1;
                                                 update_irqs = 1;
-//                                                pclog("Causing wave IRQ %02X %i\n", gus->ctrl[d], d);
                                         }
                                 }
                         }
                         else
                         {
-                                gus->cur[d] += (gus->freq[d] >> 1);
-
-                                if (gus->cur[d] >= gus->end[d])
+                                cur += step;
+                                if (cur >= end)
                                 {
-                                        int diff = gus->cur[d] - gus->end[d];
+                                        int diff = cur - end;
 
-                                        if (gus->ctrl[d]&8)
+                                        if (ctrl & 8)
                                         {
-                                                if (gus->ctrl[d]&0x10) gus->ctrl[d]^=0x40;
-                                                gus->cur[d] = (gus->ctrl[d] & 0x40) ? (gus->end[d] - diff) : (gus->start[d] + diff);
+                                                if (ctrl & 0x10) ctrl ^= 0x40;
+                                                cur = (ctrl & 0x40) ? (end - diff) : (start + diff);
                                         }
-                                        else if (!(gus->rctrl[d]&4))
+                                        else if (!(rctrl & 4))
                                         {
-                                                gus->ctrl[d] |= 1;
-                                                gus->cur[d] = (gus->ctrl[d] & 0x40) ? gus->end[d] : gus->start[d];
-                                        } 
+                                                ctrl |= 1;
+                                                cur = (ctrl & 0x40) ? end : start;
+                                        }
 
-                                        if ((gus->ctrl[d] & 0x20) && !gus->waveirqs[d]) 
+                                        if ((ctrl & 0x20) && !gus->waveirqs[d])
                                         {
                                                 gus->waveirqs[d] = 1;
                                                 update_irqs = 1;
-//                                                pclog("Causing wave IRQ %02X %i\n", gus->ctrl[d], d);
                                         }
                                 }
                         }
                 }
-                if (!(gus->rctrl[d] & 3))
+                if (!(rctrl & 3))
                 {
-                        if (gus->rctrl[d] & 0x40)
+                        if (rctrl & 0x40)
                         {
-                                gus->rcur[d] -= gus->rfreq[d];
-                                if (gus->rcur[d] <= gus->rstart[d])
+                                rcur -= rfreq;
+                                if (rcur <= rstart)
                                 {
-                                        int diff = gus->rstart[d] - gus->rcur[d];
-                                        if (!(gus->rctrl[d] & 8)) 
+                                        int diff = rstart - rcur;
+
+                                        if (!(rctrl & 8))
                                         {
-                                                gus->rctrl[d] |= 1;
-                                                gus->rcur[d] = (gus->rctrl[d] & 0x40) ? gus->rstart[d] : gus->rend[d];
-                                        }                                                
-                                        else 
+                                                rctrl |= 1;
+                                                rcur = (rctrl & 0x40) ? rstart : rend;
+                                        }
+                                        else
                                         {
-                                                if (gus->rctrl[d] & 0x10) gus->rctrl[d] ^= 0x40;
-                                                gus->rcur[d] = (gus->rctrl[d] & 0x40) ? (gus->rend[d] - diff) : (gus->rstart[d] + diff);
+                                                if (rctrl & 0x10) rctrl ^= 0x40;
+                                                rcur = (rctrl & 0x40) ? (rend - diff) : (rstart + diff);
                                         }
 
-                                        if ((gus->rctrl[d] & 0x20) && !gus->rampirqs[d])
+                                        if ((rctrl & 0x20) && !gus->rampirqs[d])
                                         {
                                                 gus->rampirqs[d] = 1;
                                                 update_irqs = 1;
-//                                                pclog("Causing ramp IRQ %02X %i\n",gus->rctrl[d], d);
                                         }
                                 }
                         }
                         else
                         {
-                                gus->rcur[d] += gus->rfreq[d];
-//                                        if (d == 1) printf("RCUR+ %i %08X %08X %08X %08X\n",d,gus->rfreq[d],gus->rcur[d],gus->rstart[d],gus->rend[d]);
-                                if (gus->rcur[d] >= gus->rend[d])
+                                rcur += rfreq;
+                                if (rcur >= rend)
                                 {
-                                        int diff = gus->rcur[d] - gus->rend[d];
-                                        if (!(gus->rctrl[d] & 8)) 
+                                        int diff = rcur - rend;
+
+                                        if (!(rctrl & 8))
                                         {
-                                                gus->rctrl[d] |= 1;
-                                                gus->rcur[d] = (gus->rctrl[d] & 0x40) ? gus->rstart[d] : gus->rend[d];
-                                        }                                                
-                                        else 
+                                                rctrl |= 1;
+                                                rcur = (rctrl & 0x40) ? rstart : rend;
+                                        }
+                                        else
                                         {
-                                                if (gus->rctrl[d] & 0x10) gus->rctrl[d] ^= 0x40;
-                                                gus->rcur[d] = (gus->rctrl[d] & 0x40) ? (gus->rend[d] - diff) : (gus->rstart[d] + diff);
+                                                if (rctrl & 0x10) rctrl ^= 0x40;
+                                                rcur = (rctrl & 0x40) ? (rend - diff) : (rstart + diff);
                                         }
 
-                                        if ((gus->rctrl[d] & 0x20) && !gus->rampirqs[d])
+                                        if ((rctrl & 0x20) && !gus->rampirqs[d])
                                         {
                                                 gus->rampirqs[d] = 1;
                                                 update_irqs = 1;
-//                                                        pclog("Causing ramp IRQ %02X %i\n",gus->rctrl[d], d);
                                         }
                                 }
                         }
                 }
+                else if (ctrl & 3)
+                        break; /*Voice and ramp both stopped, nothing left to do*/
+        }
+
+        gus->cur[d] = cur;
+        gus->ctrl[d] = ctrl;
+        gus->rcur[d] = rcur;
+        gus->rctrl[d] = rctrl;
+
+        return update_irqs;
+}
+
+static void gus_render_block(gus_t *gus, int16_t *out_l, int16_t *out_r, int n)
+{
+        int32_t mix_l[GUS_BLOCK_LEN], mix_r[GUS_BLOCK_LEN];
+        int update_irqs = 0;
+        int c, d;
+
+        memset(mix_l, 0, n * sizeof(int32_t));
+        memset(mix_r, 0, n * sizeof(int32_t));
+
+        if ((gus->reset & 3) == 3)
+        {
+                for (d = 0; d < 32; d++)
+                {
+                        if ((gus->ctrl[d] & 3) && (gus->rctrl[d] & 3))
+                                continue;
+                        update_irqs |= gus_render_voice(gus, d, mix_l, mix_r, n);
+                }
+        }
+
+        for (c = 0; c < n; c++)
+        {
+                if (mix_l[c] < -32768)
+                        out_l[c] = -32768;
+                else if (mix_l[c] > 32767)
+                        out_l[c] = 32767;
+                else
+                        out_l[c] = mix_l[c];
+                if (mix_r[c] < -32768)
+                        out_r[c] = -32768;
+                else if (mix_r[c] > 32767)
+                        out_r[c] = 32767;
+                else
+                        out_r[c] = mix_r[c];
         }
 
         if (update_irqs)
                 gus_update_int_status(gus);
 }
 
+/*Bring the wavetable up to the current time. All GUS samples due since the
+  last update are rendered in blocks, and the output buffer is filled up to
+  sound_get_pos(), with each output sample holding the last GUS sample
+  produced before it.*/
+static void gus_update(gus_t *gus)
+{
+        int16_t block_l[GUS_BLOCK_LEN], block_r[GUS_BLOCK_LEN];
+        uint64_t now = (tsc << 32) | 0xffffffff; /*Include samples due within the current cycle*/
+        int n = 0, m = sound_get_pos() - gus->pos;
+        int done = 0, j = 0;
+
+        if ((int64_t)(now - gus->samp_ts) >= 0)
+                n = ((now - gus->samp_ts) / gus->samp_latch) + 1;
+        gus->samp_ts += (uint64_t)n * gus->samp_latch;
+
+        while (j < m && !(((int64_t)j * n) / m))
+        {
+                gus->buffer[0][gus->pos + j] = gus->out_l;
+                gus->buffer[1][gus->pos + j] = gus->out_r;
+                j++;
+        }
+
+        while (done < n)
+        {
+                int count = MIN(n - done, GUS_BLOCK_LEN);
+
+                gus_render_block(gus, block_l, block_r, count);
+                for (; j < m; j++)
+                {
+                        int k = (int)(((int64_t)j * n) / m);
+
+                        if (k > done + count)
+                                break;
+                        gus->buffer[0][gus->pos + j] = block_l[k - 1 - done];
+                        gus->buffer[1][gus->pos + j] = block_r[k - 1 - done];
+                }
+                done += count;
+                gus->out_l = block_l[count - 1];
+                gus->out_r = block_r[count - 1];
+        }
+
+        gus->pos = sound_get_pos();
+}
+
+/*Work out how many samples until the next wave or ramp boundary that would
+  raise an IRQ, and set the event timer to update the voices at that point*/
+static void gus_schedule_irq(gus_t *gus)
+{
+        int64_t next = GUS_MAX_EVENT_SAMPLES;
+        int d;
+
+        if ((gus->reset & 3) == 3)
+        {
+                for (d = 0; d < 32; d++)
+                {
+                        int64_t diff, step;
+
+                        if (!(gus->ctrl[d] & 3) && (gus->ctrl[d] & 0x20) && !gus->waveirqs[d])
+                        {
+                                step = gus->freq[d] >> 1;
+                                if (gus->ctrl[d] & 0x40)
+                                        diff = (int64_t)gus->cur[d] - gus->start[d];
+                                else
+                                        diff = (int64_t)gus->end[d] - gus->cur[d];
+                                if (diff <= 0)
+                                        next = 1;
+                                else if (step)
+                                        next = MIN(next, (diff + step - 1) / step);
+                        }
+                        if (!(gus->rctrl[d] & 3) && (gus->rctrl[d] & 0x20) && !gus->rampirqs[d])
+                        {
+                                step = gus->rfreq[d];
+                                if (gus->rctrl[d] & 0x40)
+                                        diff = (int64_t)gus->rcur[d] - gus->rstart[d];
+                                else
+                                        diff = (int64_t)gus->rend[d] - gus->rcur[d];
+                                if (diff <= 0)
+                                        next = 1;
+                                else if (step)
+                                        next = MIN(next, (diff + step - 1) / step);
+                        }
+                }
+        }
+
+        if (next == GUS_MAX_EVENT_SAMPLES)
+                timer_disable(&gus->samp_timer);
+        else
+                timer_set_delay_u64(&gus->samp_timer, gus->samp_ts + (next - 1) * gus->samp_latch - (tsc << 32));
+}
+
+void gus_poll_wave(void *p)
+{
+        gus_t *gus = (gus_t *)p;
+
+        gus_update(gus);
+        gus_schedule_irq(gus);
+}
+
 static void gus_get_buffer(int32_t *buffer, int len, void *p)
 {
         gus_t *gus = (gus_t *)p;
@@ -1154,7 +1294,8 @@ void *gus_init()
         io_sethandler(0x0340, 0x0010, readgus, NULL, NULL, writegus, NULL, NULL,  gus);
         io_sethandler(0x0746, 0x0001, readgus, NULL, NULL, writegus, NULL, NULL,  gus);        
         io_sethandler(0x0388, 0x0002, readgus, NULL, NULL, writegus, NULL, NULL,  gus);
-        timer_add(&gus->samp_timer, gus_poll_wave, gus, 1);
+        gus->samp_ts = tsc << 32;
+        timer_add(&gus->samp_timer, gus_poll_wave, gus, 0);
         timer_add(&gus->timer_1, gus_poll_timer_1, gus, 1);
         timer_add(&gus->timer_2, gus_poll_timer_2, gus, 1);
 
@@ -1179,6 +1320,7 @@ void gus_speed_changed(void *p)
                 gus->samp_latch = (uint64_t)(TIMER_USEC * (1000000.0 / 44100.0));
         else
                 gus->samp_latch = (uint64_t)(TIMER_USEC * (1000000.0 / gusfreqs[gus->voices - 14]));
+        gus_schedule_irq(gus);
 }
 
 static void gus_add_status_info(char *s, int max_len, void *p)
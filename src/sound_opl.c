@@ -1,108 +1,194 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "ibm.h"
 #include "io.h"
 #include "sound.h"
 #include "sound_opl.h"
 #include "sound_dbopl.h"
+#include "thread.h"
 #include "x86.h"
 
 /*Interfaces between PCem and the actual OPL emulator*/
 
+/*Synthesis runs on a separate thread, one sound frame behind the emulation.
+  Register writes are timestamped with sound_get_pos() and queued for the
+  frame being emulated; at the end of the frame the queue is handed to the
+  render thread, which generates output up to each write before applying it,
+  so timing within the frame is kept to the sample. The address latch, timers
+  and status register are still handled immediately by opl_write().*/
+static void opl_queue_write(opl_t *opl, int nr, uint16_t a, uint8_t v)
+{
+        if (a & 1)
+        {
+                opl_frame_t *frame = &opl->frame[opl->cur_frame];
+                opl_cmd_t *cmd;
+
+                if (frame->nr_cmds == frame->max_cmds)
+                {
+                        frame->max_cmds = frame->max_cmds ? frame->max_cmds * 2 : 256;
+                        frame->cmds = realloc(frame->cmds, frame->max_cmds * sizeof(opl_cmd_t));
+                }
+                cmd = &frame->cmds[frame->nr_cmds++];
+                cmd->pos = sound_get_pos();
+                cmd->reg = opl_get_addr(nr);
+                cmd->nr = nr;
+                cmd->val = v;
+        }
+        opl_write(nr, a, v);
+}
+
 
 uint8_t opl2_read(uint16_t a, void *priv)
 {
-        opl_t *opl = (opl_t *)priv;
-
         cycles -= (int)(isa_timing * 8);
-        opl2_update2(opl);
         return opl_read(0, a);
 }
 void opl2_write(uint16_t a, uint8_t v, void *priv)
 {
         opl_t *opl = (opl_t *)priv;
 
-        opl2_update2(opl);
-        opl_write(0, a, v);
-        opl_write(1, a, v);
+        opl_queue_write(opl, 0, a, v);
+        opl_queue_write(opl, 1, a, v);
 }
 
 uint8_t opl2_l_read(uint16_t a, void *priv)
 {
-        opl_t *opl = (opl_t *)priv;
-
         cycles -= (int)(isa_timing * 8);
-        opl2_update2(opl);
         return opl_read(0, a);
 }
 void opl2_l_write(uint16_t a, uint8_t v, void *priv)
 {
         opl_t *opl = (opl_t *)priv;
 
-        opl2_update2(opl);
-        opl_write(0, a, v);
+        opl_queue_write(opl, 0, a, v);
 }
 
 uint8_t opl2_r_read(uint16_t a, void *priv)
 {
-        opl_t *opl = (opl_t *)priv;
-
         cycles -= (int)(isa_timing * 8);
-        opl2_update2(opl);
         return opl_read(1, a);
 }
 void opl2_r_write(uint16_t a, uint8_t v, void *priv)
 {
         opl_t *opl = (opl_t *)priv;
 
-        opl2_update2(opl);
-        opl_write(1, a, v);
+        opl_queue_write(opl, 1, a, v);
 }
 
 uint8_t opl3_read(uint16_t a, void *priv)
 {
-        opl_t *opl = (opl_t *)priv;
-
         cycles -= (int)(isa_timing * 8);
-        opl3_update2(opl);
         return opl_read(0, a);
 }
 void opl3_write(uint16_t a, uint8_t v, void *priv)
 {
         opl_t *opl = (opl_t *)priv;
-        
-        opl3_update2(opl);
-        opl_write(0, a, v);
+
+        opl_queue_write(opl, 0, a, v);
 }
 
 
-void opl2_update2(opl_t *opl)
+static void opl_render(opl_t *opl, int16_t *buffer, int start, int end)
 {
-        if (opl->pos < sound_pos_global)
+        int c;
+
+        if (end <= start)
+                return;
+
+        if (opl->is_opl3)
+                opl3_update(0, &buffer[start*2], end - start);
+        else
         {
-                opl2_update(0, &opl->buffer[opl->pos*2], sound_pos_global - opl->pos);
-                opl2_update(1, &opl->buffer[opl->pos*2 + 1], sound_pos_global - opl->pos);
-                for (; opl->pos < sound_pos_global; opl->pos++)
-                {
-                        opl->filtbuf[0] = opl->buffer[opl->pos*2]   = (opl->buffer[opl->pos*2]   / 2);
-                        opl->filtbuf[1] = opl->buffer[opl->pos*2+1] = (opl->buffer[opl->pos*2+1] / 2);
-                }
+                opl2_update(0, &buffer[start*2], end - start);
+                opl2_update(1, &buffer[start*2 + 1], end - start);
         }
+        for (c = start*2; c < end*2; c++)
+                buffer[c] /= 2;
 }
 
-void opl3_update2(opl_t *opl)
+static void opl_render_thread(void *param)
 {
-        if (opl->pos < sound_pos_global)
+        opl_t *opl = (opl_t *)param;
+
+        while (1)
         {
-                opl3_update(0, &opl->buffer[opl->pos*2], sound_pos_global - opl->pos);
-                for (; opl->pos < sound_pos_global; opl->pos++)
+                opl_frame_t *frame;
+                int c, pos = 0;
+
+                while (!opl->render_pending)
+                {
+                        thread_wait_event(opl->wake_render_thread, 1);
+                        thread_reset_event(opl->wake_render_thread);
+                }
+
+                frame = &opl->frame[opl->cur_frame ^ 1];
+                for (c = 0; c < frame->nr_cmds; c++)
                 {
-                        opl->filtbuf[0] = opl->buffer[opl->pos*2]   = (opl->buffer[opl->pos*2]   / 2);
-                        opl->filtbuf[1] = opl->buffer[opl->pos*2+1] = (opl->buffer[opl->pos*2+1] / 2);
+                        opl_cmd_t *cmd = &frame->cmds[c];
+                        int cmd_pos = MIN(cmd->pos, frame->len);
+
+                        if (cmd_pos > pos)
+                        {
+                                opl_render(opl, frame->buffer, pos, cmd_pos);
+                                pos = cmd_pos;
+                        }
+                        opl_write_reg(cmd->nr, cmd->reg, cmd->val);
                 }
+                opl_render(opl, frame->buffer, pos, frame->len);
+
+                opl->render_pending = 0;
+                thread_set_event(opl->render_done_event);
         }
 }
 
+/*Called from the sound card's get_buffer() at the end of each sound frame.
+  Collects the previously rendered frame into opl->buffer and passes the
+  writes made during this frame on to the render thread.*/
+static void opl_update_frame(opl_t *opl)
+{
+        opl_frame_t *frame;
+        int len = sound_get_pos();
+
+        while (opl->render_pending)
+        {
+                thread_wait_event(opl->render_done_event, 1);
+                thread_reset_event(opl->render_done_event);
+        }
+
+        frame = &opl->frame[opl->cur_frame ^ 1];
+        if (frame->len >= len)
+                memcpy(opl->buffer, frame->buffer, len * 2 * sizeof(int16_t));
+        else
+        {
+                memcpy(opl->buffer, frame->buffer, frame->len * 2 * sizeof(int16_t));
+                memset(&opl->buffer[frame->len * 2], 0, (len - frame->len) * 2 * sizeof(int16_t));
+        }
+        if (len)
+        {
+                opl->filtbuf[0] = opl->buffer[(len - 1) * 2];
+                opl->filtbuf[1] = opl->buffer[(len - 1) * 2 + 1];
+        }
+        opl->pos = len;
+
+        frame->nr_cmds = 0;
+        frame = &opl->frame[opl->cur_frame];
+        frame->len = len;
+        opl->cur_frame ^= 1;
+        opl->render_pending = 1;
+        thread_set_event(opl->wake_render_thread);
+}
+
+void opl2_update2(opl_t *opl)
+{
+        opl_update_frame(opl);
+}
+
+void opl3_update2(opl_t *opl)
+{
+        opl_update_frame(opl);
+}
+
 void ym3812_timer_set_0(void *param, int timer, int64_t period)
 {
         opl_t *opl = (opl_t *)param;
@@ -149,20 +235,53 @@ static void opl_timer_callback11(void *p)
         opl_timer_over(1, 1);
 }
         
+static void opl_start_thread(opl_t *opl)
+{
+        memset(opl->frame, 0, sizeof(opl->frame));
+        opl->cur_frame = 0;
+        opl->render_pending = 0;
+
+        opl->wake_render_thread = thread_create_event();
+        opl->render_done_event = thread_create_event();
+        opl->render_thread = thread_create(opl_render_thread, opl);
+}
+
 void opl2_init(opl_t *opl)
 {
+        opl->is_opl3 = 0;
         opl_init(ym3812_timer_set_0, opl, 0, 0, 0);
         opl_init(ym3812_timer_set_1, opl, 1, 0, 0);
         timer_add(&opl->timers[0][0], opl_timer_callback00, (void *)opl, 0);
         timer_add(&opl->timers[0][1], opl_timer_callback01, (void *)opl, 0);
         timer_add(&opl->timers[1][0], opl_timer_callback10, (void *)opl, 0);
         timer_add(&opl->timers[1][1], opl_timer_callback11, (void *)opl, 0);
+        opl_start_thread(opl);
 }
 
 void opl3_init(opl_t *opl, int opl_emu)
 {
+        opl->is_opl3 = 1;
         opl_init(ymf262_timer_set, opl, 0, 1, opl_emu);
         timer_add(&opl->timers[0][0], opl_timer_callback00, (void *)opl, 0);
         timer_add(&opl->timers[0][1], opl_timer_callback01, (void *)opl, 0);
+        opl_start_thread(opl);
 }
 
+void opl_close(opl_t *opl)
+{
+        int c;
+
+        if (!opl->render_thread)
+                return;
+
+        thread_kill(opl->render_thread);
+        thread_destroy_event(opl->wake_render_thread);
+        thread_destroy_event(opl->render_done_event);
+        opl->render_thread = NULL;
+
+        for (c = 0; c < 2; c++)
+        {
+                if (opl->frame[c].cmds)
+                        free(opl->frame[c].cmds);
+        }
+}
@@ -1,8 +1,29 @@
 #include "sound.h"
+#include "thread.h"
+
+typedef struct opl_cmd_t
+{
+        int pos;
+        uint16_t reg;
+        uint8_t nr;
+        uint8_t val;
+} opl_cmd_t;
+
+/*One sound frame worth of register writes, timestamped in samples from the
+  start of the frame, and the output rendered from them*/
+typedef struct opl_frame_t
+{
+        opl_cmd_t *cmds;
+        int nr_cmds, max_cmds;
+        int len;
+
+        int16_t buffer[MAXSOUNDBUFLEN * 2];
+} opl_frame_t;
 
 typedef struct opl_t
 {
         int chip_nr[2];
+        int is_opl3;
         
         pc_timer_t timers[2][2];
 
@@ -10,6 +31,16 @@ typedef struct opl_t
 
         int16_t buffer[MAXSOUNDBUFLEN * 2];
         int     pos;
+
+        /*frame[cur_frame] collects writes from the emulation thread while the
+          render thread works on the other one*/
+        opl_frame_t frame[2];
+        int cur_frame;
+        volatile int render_pending;
+
+        thread_t *render_thread;
+        event_t *wake_render_thread;
+        event_t *render_done_event;
 } opl_t;
 
 uint8_t opl2_read(uint16_t a, void *priv);
@@ -26,6 +57,7 @@ void opl3_poll(opl_t *opl, int16_t *bufl, int16_t *bufr);
 
 void opl2_init(opl_t *opl);
 void opl3_init(opl_t *opl, int opl_emu);
+void opl_close(opl_t *opl);
 
 void opl2_update2(opl_t *opl);
 void opl3_update2(opl_t *opl);
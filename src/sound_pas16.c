@@ -137,6 +137,8 @@ typedef struct pas16_t
         int16_t pcm_buffer[2][MAXSOUNDBUFLEN];
 
         int pos;
+
+        biquad_t dsp_iir;
 } pas16_t;
 
 static uint8_t pas16_pit_in(uint16_t port, void *priv);
@@ -695,7 +697,7 @@ static void pas16_update(pas16_t *pas16)
 {
         if (!(pas16->audiofilt & PAS16_FILT_MUTE))
         {
-                for (; pas16->pos < sound_pos_global; pas16->pos++)
+                for (; pas16->pos < sound_get_pos(); pas16->pos++)
                 {
                         pas16->pcm_buffer[0][pas16->pos] = 0;
                         pas16->pcm_buffer[1][pas16->pos] = 0;
@@ -703,7 +705,7 @@ static void pas16_update(pas16_t *pas16)
         }
         else
         {
-                for (; pas16->pos < sound_pos_global; pas16->pos++)
+                for (; pas16->pos < sound_get_pos(); pas16->pos++)
                 {
                         pas16->pcm_buffer[0][pas16->pos] = (int16_t)pas16->pcm_dat_l;
                         pas16->pcm_buffer[1][pas16->pos] = (int16_t)pas16->pcm_dat_r;
@@ -714,15 +716,18 @@ static void pas16_update(pas16_t *pas16)
 void pas16_get_buffer(int32_t *buffer, int len, void *p)
 {
         pas16_t *pas16 = (pas16_t *)p;
+        float dsp_buf[len * 2];
         int c;
 
         opl3_update2(&pas16->opl);
         sb_dsp_update(&pas16->dsp);
         pas16_update(pas16);
+        filter_buf_from_int16(dsp_buf, pas16->dsp.buffer, len * 2);
+        biquad_process_stereo(&pas16->dsp_iir, &sb_iir_coef, dsp_buf, len);
         for (c = 0; c < len * 2; c++)
         {
                 buffer[c] += pas16->opl.buffer[c];
-                buffer[c] += (int16_t)(sb_iir(c & 1, (float)pas16->dsp.buffer[c]) / 1.3) / 2;
+                buffer[c] += (int16_t)(dsp_buf[c] / 1.3) / 2;
                 buffer[c] += (pas16->pcm_buffer[c & 1][c >> 1] / 2);
         }
 
@@ -752,6 +757,8 @@ void pas16_close(void *p)
 {
         pas16_t *pas16 = (pas16_t *)p;
         
+        sb_dsp_close(&pas16->dsp);
+        opl_close(&pas16->opl);
         free(pas16);
 }
 
@@ -103,7 +103,7 @@ static void ps1_audio_write(uint16_t port, uint8_t val, void *p)
 
 static void ps1_audio_update(ps1_audio_t *ps1)
 {
-        for (; ps1->pos < sound_pos_global; ps1->pos++)        
+        for (; ps1->pos < sound_get_pos(); ps1->pos++)        
                 ps1->buffer[ps1->pos] = (int8_t)(ps1->dac_val ^ 0x80) * 0x20;
 }
 
@@ -112,7 +112,7 @@ static uint8_t pssj_read(uint16_t port, void *p)
 
 static void pssj_update(pssj_t *pssj)
 {
-        for (; pssj->pos < sound_pos_global; pssj->pos++)        
+        for (; pssj->pos < sound_get_pos(); pssj->pos++)        
                 pssj->buffer[pssj->pos] = (((int8_t)(pssj->dac_val ^ 0x80) * 0x20) * pssj->amplitude) / 15;
 }
 
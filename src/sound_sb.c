@@ -12,8 +12,6 @@
 #include "sound_sb.h"
 #include "sound_sb_dsp.h"
 
-#include "filters.h"
-
 //#define SB_DSP_RECORD_DEBUG
 
 #ifdef SB_DSP_RECORD_DEBUG
@@ -49,17 +47,21 @@ const int32_t sb_att_7dbstep_2bits[]=
 static void sb_get_buffer_sb2(int32_t *buffer, int len, void *p)
 {
         sb_t *sb = (sb_t *)p;
+        float dsp_buf[len];
                 
         int c;
 
         opl2_update2(&sb->opl);
         sb_dsp_update(&sb->dsp);
+        for (c = 0; c < len; c++)
+                dsp_buf[c] = (float)sb->dsp.buffer[c * 2];
+        biquad_process_mono(&sb->dsp_iir, &sb_iir_coef, dsp_buf, len);
         for (c = 0; c < len * 2; c += 2)
         {
                 int32_t out;
                 out = ((sb->opl.buffer[c]     * 51000) >> 16);
                 //TODO: Recording: Mic and line In with AGC
-                out += (int32_t)(((sb_iir(0, (float)sb->dsp.buffer[c]) / 1.3) * 65536) / 3) >> 16;
+                out += (int32_t)(((dsp_buf[c >> 1] / 1.3) * 65536) / 3) >> 16;
         
                 buffer[c]     += out;
                 buffer[c + 1] += out;
@@ -74,11 +76,15 @@ static void sb_get_buffer_sb2_mixer(int32_t *buffer, int len, void *p)
 {
         sb_t *sb = (sb_t *)p;
         sb_ct1335_mixer_t *mixer = &sb->mixer_sb2;
+        float dsp_buf[len];
                 
         int c;
 
         opl2_update2(&sb->opl);
         sb_dsp_update(&sb->dsp);
+        for (c = 0; c < len; c++)
+                dsp_buf[c] = (float)sb->dsp.buffer[c * 2];
+        biquad_process_mono(&sb->dsp_iir, &sb_iir_coef, dsp_buf, len);
         for (c = 0; c < len * 2; c += 2)
         {
                 int32_t out;
@@ -86,7 +92,7 @@ static void sb_get_buffer_sb2_mixer(int32_t *buffer, int len, void *p)
                 out = ((((sb->opl.buffer[c]     * mixer->fm) >> 16) * 51000) >> 15);
                 /* TODO: Recording : I assume it has direct mic and line in like sb2 */
                 /* It is unclear from the docs if it has a filter, but it probably does */
-                out += (int32_t)(((sb_iir(0, (float)sb->dsp.buffer[c])     / 1.3) * mixer->voice) / 3) >> 15;
+                out += (int32_t)(((dsp_buf[c >> 1] / 1.3) * mixer->voice) / 3) >> 15;
                 
                 out = (out * mixer->master) >> 15;
                         
@@ -103,6 +109,7 @@ void sb_get_buffer_sbpro(int32_t *buffer, int len, void *p)
 {
         sb_t *sb = (sb_t *)p;
         sb_ct1345_mixer_t *mixer = &sb->mixer_sbpro;
+        float dsp_buf[len * 2];
                 
         int c;
 
@@ -112,6 +119,11 @@ void sb_get_buffer_sbpro(int32_t *buffer, int len, void *p)
                 opl3_update2(&sb->opl);
 
         sb_dsp_update(&sb->dsp);
+        if (mixer->output_filter)
+        {
+                filter_buf_from_int16(dsp_buf, sb->dsp.buffer, len * 2);
+                biquad_process_stereo(&sb->dsp_iir, &sb_iir_coef, dsp_buf, len);
+        }
         for (c = 0; c < len * 2; c += 2)
         {
                 int32_t out_l, out_r;
@@ -122,8 +134,8 @@ void sb_get_buffer_sbpro(int32_t *buffer, int len, void *p)
                 /*TODO: Implement the stereo switch on the mixer instead of on the dsp? */
                 if (mixer->output_filter)
                 {
-                        out_l += (int32_t)(((sb_iir(0, (float)sb->dsp.buffer[c])     / 1.3) * mixer->voice_l) / 3) >> 15;
-                        out_r += (int32_t)(((sb_iir(1, (float)sb->dsp.buffer[c + 1]) / 1.3) * mixer->voice_r) / 3) >> 15;
+                        out_l += (int32_t)(((dsp_buf[c]     / 1.3) * mixer->voice_l) / 3) >> 15;
+                        out_r += (int32_t)(((dsp_buf[c + 1] / 1.3) * mixer->voice_r) / 3) >> 15;
                 }
                 else
                 {
@@ -144,15 +156,69 @@ void sb_get_buffer_sbpro(int32_t *buffer, int len, void *p)
         sb->dsp.pos = 0;
 }
 
+/*One stage of the CT1745 bass/treble controls. Levels above 8 add the
+  filtered signal (boost), levels below 8 blend towards it (cut). The whole
+  block is filtered once, and only channels with the stage active change.
+  This is not exactly how one does bass/treble controls, but the end result
+  is like it*/
+static void sb_ct1745_tone_stage(biquad_t *f, const biquad_coef_t *coef, int32_t *out, int len, int level_l, int level_r, int boost)
+{
+        float tone_buf[len * 2];
+        int level[2] = {level_l, level_r};
+        int active[2];
+        int c, d;
+
+        for (d = 0; d < 2; d++)
+                active[d] = boost ? (level[d] > 8) : (level[d] < 8);
+        if (!active[0] && !active[1])
+                return;
+
+        filter_buf_from_int32(tone_buf, out, len * 2);
+        biquad_process_stereo(f, coef, tone_buf, len);
+
+        for (d = 0; d < 2; d++)
+        {
+                float k = sb_bass_treble_4bits[level[d]];
+
+                if (!active[d])
+                        continue;
+                if (boost)
+                {
+                        for (c = d; c < len * 2; c += 2)
+                                out[c] += (int32_t)(tone_buf[c] * k);
+                }
+                else
+                {
+                        for (c = d; c < len * 2; c += 2)
+                                out[c] = (int32_t)(out[c] * k + tone_buf[c] * (1.f - k));
+                }
+        }
+}
+
+static void sb_ct1745_tone(sb_t *sb, sb_ct1745_mixer_t *mixer, int32_t *out, int len)
+{
+        if (mixer->bass_l == 8 && mixer->bass_r == 8 && mixer->treble_l == 8 && mixer->treble_r == 8)
+                return;
+
+        sb_ct1745_tone_stage(&sb->bass_iir,       &low_iir_coef,      out, len, mixer->bass_l,   mixer->bass_r,   1);
+        sb_ct1745_tone_stage(&sb->treble_iir,     &high_iir_coef,     out, len, mixer->treble_l, mixer->treble_r, 1);
+        sb_ct1745_tone_stage(&sb->bass_cut_iir,   &low_cut_iir_coef,  out, len, mixer->bass_l,   mixer->bass_r,   0);
+        sb_ct1745_tone_stage(&sb->treble_cut_iir, &high_cut_iir_coef, out, len, mixer->treble_l, mixer->treble_r, 0);
+}
+
 static void sb_get_buffer_sb16(int32_t *buffer, int len, void *p)
 {
         sb_t *sb = (sb_t *)p;
         sb_ct1745_mixer_t *mixer = &sb->mixer_sb16;
+        float dsp_buf[len * 2];
+        int32_t out_buf[len * 2];
                 
         int c;
 
         opl3_update2(&sb->opl);
         sb_dsp_update(&sb->dsp);
+        filter_buf_from_int16(dsp_buf, sb->dsp.buffer, len * 2);
+        low_fir_sb16_process(&sb->dsp_fir, dsp_buf, len);
         const int dsp_rec_pos = sb->dsp.record_pos_write;
         for (c = 0; c < len * 2; c += 2)
         {
@@ -165,24 +231,15 @@ static void sb_get_buffer_sb16(int32_t *buffer, int len, void *p)
                 in_l = (mixer->input_selector_left&INPUT_MIDI_L) ? out_l : 0 + (mixer->input_selector_left&INPUT_MIDI_R) ? out_r : 0;
                 in_r = (mixer->input_selector_right&INPUT_MIDI_L) ? out_l : 0 + (mixer->input_selector_right&INPUT_MIDI_R) ? out_r : 0;
         
-                out_l += ((int32_t)(low_fir_sb16(0, (float)sb->dsp.buffer[c])     * mixer->voice_l) / 3) >> 15;
-                out_r += ((int32_t)(low_fir_sb16(1, (float)sb->dsp.buffer[c + 1]) * mixer->voice_r) / 3) >> 15;
+                out_l += ((int32_t)(dsp_buf[c]     * mixer->voice_l) / 3) >> 15;
+                out_r += ((int32_t)(dsp_buf[c + 1] * mixer->voice_r) / 3) >> 15;
                 
                 out_l = (out_l * mixer->master_l) >> 15;
                 out_r = (out_r * mixer->master_r) >> 15;
                 
-                if (mixer->bass_l != 8 || mixer->bass_r != 8 || mixer->treble_l != 8 || mixer->treble_r != 8)
-                {
-                        /* This is not exactly how one does bass/treble controls, but the end result is like it. A better implementation would reduce the cpu usage */
-                        if (mixer->bass_l>8) out_l += (int32_t)(low_iir(0, (float)out_l)*sb_bass_treble_4bits[mixer->bass_l]);
-                        if (mixer->bass_r>8)  out_r += (int32_t)(low_iir(1, (float)out_r)*sb_bass_treble_4bits[mixer->bass_r]);
-                        if (mixer->treble_l>8) out_l += (int32_t)(high_iir(0, (float)out_l)*sb_bass_treble_4bits[mixer->treble_l]);
-                        if (mixer->treble_r>8) out_r += (int32_t)(high_iir(1, (float)out_r)*sb_bass_treble_4bits[mixer->treble_r]);
-                        if (mixer->bass_l<8)   out_l = (int32_t)((out_l )*sb_bass_treble_4bits[mixer->bass_l] + low_cut_iir(0, (float)out_l)*(1.f-sb_bass_treble_4bits[mixer->bass_l]));
-                        if (mixer->bass_r<8)   out_r = (int32_t)((out_r )*sb_bass_treble_4bits[mixer->bass_r] + low_cut_iir(1, (float)out_r)*(1.f-sb_bass_treble_4bits[mixer->bass_r])); 
-                        if (mixer->treble_l<8) out_l = (int32_t)((out_l )*sb_bass_treble_4bits[mixer->treble_l] + high_cut_iir(0, (float)out_l)*(1.f-sb_bass_treble_4bits[mixer->treble_l]));
-                        if (mixer->treble_r<8) out_r = (int32_t)((out_r )*sb_bass_treble_4bits[mixer->treble_r] + high_cut_iir(1, (float)out_r)*(1.f-sb_bass_treble_4bits[mixer->treble_r]));
-                }
+                out_buf[c]     = out_l;
+                out_buf[c + 1] = out_r;
+
                 if (sb->dsp.sb_enable_i)
                 {
                         int c_record = dsp_rec_pos;
@@ -202,9 +259,13 @@ static void sb_get_buffer_sb16(int32_t *buffer, int len, void *p)
                         sb->dsp.record_buffer[c_record&0xFFFF] = in_l;
                         sb->dsp.record_buffer[(c_record+1)&0xFFFF] = in_r;
                 }
+        }
 
-                buffer[c]     += (out_l << mixer->output_gain_L);
-                buffer[c + 1] += (out_r << mixer->output_gain_R);
+        sb_ct1745_tone(sb, mixer, out_buf, len);
+        for (c = 0; c < len * 2; c += 2)
+        {
+                buffer[c]     += (out_buf[c]     << mixer->output_gain_L);
+                buffer[c + 1] += (out_buf[c + 1] << mixer->output_gain_R);
         }
         sb->dsp.record_pos_write+=((len * sb->dsp.sb_freq) / 48000)*2;
         sb->dsp.record_pos_write&=0xFFFF;
@@ -218,16 +279,29 @@ int old_dsp_rec_pos=0;
 int buf_written=0;
 int last_crecord=0;
 #endif
+/*Render the EMU8K voices on a sound worker thread. The result is mixed by
+  sb_get_buffer_emu8k(), which runs after all threaded handlers*/
+static void sb_render_emu8k(int32_t *buffer, int len, void *p)
+{
+        sb_t *sb = (sb_t *)p;
+
+        emu8k_update(&sb->emu8k);
+}
+
 static void sb_get_buffer_emu8k(int32_t *buffer, int len, void *p)
 {
         sb_t *sb = (sb_t *)p;
         sb_ct1745_mixer_t *mixer = &sb->mixer_sb16;
+        float dsp_buf[len * 2];
+        int32_t out_buf[len * 2];
                 
         int c;
 
         opl3_update2(&sb->opl);
         emu8k_update(&sb->emu8k);
         sb_dsp_update(&sb->dsp);
+        filter_buf_from_int16(dsp_buf, sb->dsp.buffer, len * 2);
+        low_fir_sb16_process(&sb->dsp_fir, dsp_buf, len);
         const int dsp_rec_pos = sb->dsp.record_pos_write;
         for (c = 0; c < len * 2; c += 2)
         {
@@ -244,24 +318,15 @@ static void sb_get_buffer_emu8k(int32_t *buffer, int len, void *p)
                 in_l = (mixer->input_selector_left&INPUT_MIDI_L) ? out_l : 0 + (mixer->input_selector_left&INPUT_MIDI_R) ? out_r : 0;
                 in_r = (mixer->input_selector_right&INPUT_MIDI_L) ? out_l : 0 + (mixer->input_selector_right&INPUT_MIDI_R) ? out_r : 0;
                 
-                out_l += ((int32_t)(low_fir_sb16(0, (float)sb->dsp.buffer[c])     * mixer->voice_l) / 3) >> 15;
-                out_r += ((int32_t)(low_fir_sb16(1, (float)sb->dsp.buffer[c + 1]) * mixer->voice_r) / 3) >> 15;
+                out_l += ((int32_t)(dsp_buf[c]     * mixer->voice_l) / 3) >> 15;
+                out_r += ((int32_t)(dsp_buf[c + 1] * mixer->voice_r) / 3) >> 15;
 
                 out_l = (out_l * mixer->master_l) >> 15;
                 out_r = (out_r * mixer->master_r) >> 15;
 
-                if (mixer->bass_l != 8 || mixer->bass_r != 8 || mixer->treble_l != 8 || mixer->treble_r != 8)
-                {
-                        /* This is not exactly how one does bass/treble controls, but the end result is like it. A better implementation would reduce the cpu usage */
-                        if (mixer->bass_l>8) out_l += (int32_t)(low_iir(0, (float)out_l)*sb_bass_treble_4bits[mixer->bass_l]);
-                        if (mixer->bass_r>8)  out_r += (int32_t)(low_iir(1, (float)out_r)*sb_bass_treble_4bits[mixer->bass_r]);
-                        if (mixer->treble_l>8) out_l += (int32_t)(high_iir(0, (float)out_l)*sb_bass_treble_4bits[mixer->treble_l]);
-                        if (mixer->treble_r>8) out_r += (int32_t)(high_iir(1, (float)out_r)*sb_bass_treble_4bits[mixer->treble_r]);
-                        if (mixer->bass_l<8)   out_l = (int32_t)(out_l *sb_bass_treble_4bits[mixer->bass_l] + low_cut_iir(0, (float)out_l)*(1.f-sb_bass_treble_4bits[mixer->bass_l]));
-                        if (mixer->bass_r<8)   out_r = (int32_t)(out_r *sb_bass_treble_4bits[mixer->bass_r] + low_cut_iir(1, (float)out_r)*(1.f-sb_bass_treble_4bits[mixer->bass_r])); 
-                        if (mixer->treble_l<8) out_l = (int32_t)(out_l *sb_bass_treble_4bits[mixer->treble_l] + high_cut_iir(0, (float)out_l)*(1.f-sb_bass_treble_4bits[mixer->treble_l]));
-                        if (mixer->treble_r<8) out_r = (int32_t)(out_r *sb_bass_treble_4bits[mixer->treble_r] + high_cut_iir(1, (float)out_r)*(1.f-sb_bass_treble_4bits[mixer->treble_r]));
-                }
+                out_buf[c]     = out_l;
+                out_buf[c + 1] = out_r;
+
                 if (sb->dsp.sb_enable_i)
                 {
 //                      in_l += (mixer->input_selector_left&INPUT_CD_L) ? audio_cd_buffer[cd_read_pos+c_emu8k] : 0 + (mixer->input_selector_left&INPUT_CD_R) ? audio_cd_buffer[cd_read_pos+c_emu8k+1] : 0;
@@ -301,9 +366,13 @@ static void sb_get_buffer_emu8k(int32_t *buffer, int len, void *p)
                                 }
                         #endif
                 }
+        }
 
-                buffer[c]     += (out_l << mixer->output_gain_L);
-                buffer[c + 1] += (out_r << mixer->output_gain_R);
+        sb_ct1745_tone(sb, mixer, out_buf, len);
+        for (c = 0; c < len * 2; c += 2)
+        {
+                buffer[c]     += (out_buf[c]     << mixer->output_gain_L);
+                buffer[c + 1] += (out_buf[c + 1] << mixer->output_gain_R);
         }
         #ifdef SB_DSP_RECORD_DEBUG
         if (old_dsp_rec_pos > dsp_rec_pos)
@@ -1081,6 +1150,7 @@ void *sb_awe32_init()
         io_sethandler(addr+8, 0x0002, opl3_read,   NULL, NULL, opl3_write,   NULL, NULL, &sb->opl);
         io_sethandler(0x0388, 0x0004, opl3_read,   NULL, NULL, opl3_write,   NULL, NULL, &sb->opl);
         io_sethandler(addr+4, 0x0002, sb_ct1745_mixer_read, NULL, NULL, sb_ct1745_mixer_write, NULL, NULL, sb);
+        sound_add_threaded_handler(sb_render_emu8k, sb);
         sound_add_handler(sb_get_buffer_emu8k, sb);
         mpu401_uart_init(&sb->mpu, 0x330, -1, 0);
         emu8k_init(&sb->emu8k, emu_addr, onboard_ram);
@@ -1092,6 +1162,7 @@ void sb_close(void *p)
 {
         sb_t *sb = (sb_t *)p;
         sb_dsp_close(&sb->dsp);
+        opl_close(&sb->opl);
         #ifdef SB_DSP_RECORD_DEBUG
             if (soundfsb != 0)
             {
@@ -1,6 +1,7 @@
 #ifndef SOUND_SB_H
 #define SOUND_SB_H
 
+#include "filters.h"
 #include "sound_emu8k.h"
 #include "sound_mpu401_uart.h"
 #include "sound_sb_dsp.h"
@@ -108,6 +109,11 @@ typedef struct sb_t
         uint8_t pos_regs[8];
         
         int opl_emu;
+
+        /*Output filter history*/
+        biquad_t dsp_iir;
+        fir_sb16_t dsp_fir;
+        biquad_t bass_iir, bass_cut_iir, treble_iir, treble_cut_iir;
 } sb_t;
 
 // exported for clone cards
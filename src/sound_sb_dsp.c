@@ -6,6 +6,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <limits.h>
 #include <math.h>
 #include "ibm.h"
 
@@ -26,6 +27,9 @@
 
 void pollsb(void *p);
 void sb_poll_i(void *p);
+static void sb_dsp_output_update(sb_dsp_t *dsp);
+static void sb_dsp_schedule(sb_dsp_t *dsp);
+static void sb_dsp_dma_sync(void *p);
 
 //#define SB_DSP_RECORD_DEBUG
 //#define SB_TEST_RECORDING_SAW
@@ -167,6 +171,7 @@ void sb_irqc(sb_dsp_t *dsp, int irq8)
 
 void sb_dsp_reset(sb_dsp_t *dsp)
 {
+        dsp->output_running = 0;
 	timer_disable(&dsp->output_timer);
 	timer_disable(&dsp->input_timer);
 
@@ -228,6 +233,8 @@ void sb_doreset(sb_dsp_t *dsp)
 
 void sb_dsp_speed_changed(sb_dsp_t *dsp)
 {
+        sb_dsp_output_update(dsp);
+
         if (dsp->sb_timeo < 256)
                 dsp->sblatcho = TIMER_USEC * (256 - dsp->sb_timeo);
         else
@@ -237,6 +244,8 @@ void sb_dsp_speed_changed(sb_dsp_t *dsp)
                 dsp->sblatchi = TIMER_USEC * (256 - dsp->sb_timei);
         else
                 dsp->sblatchi = (uint64_t)(TIMER_USEC * (1000000.0f / (float)(dsp->sb_timei - 256)));
+
+        sb_dsp_schedule(dsp);
 }
 
 void sb_add_data(sb_dsp_t *dsp, uint8_t v)
@@ -261,8 +270,11 @@ void sb_start_dma(sb_dsp_t *dsp, int dma8, int autoinit, uint8_t format, int len
                 dsp->sb_8_enable = 1;
                 if (dsp->sb_16_enable && dsp->sb_16_output) dsp->sb_16_enable = 0;
                 dsp->sb_8_output = 1;
-		if (!timer_is_enabled(&dsp->output_timer))
-			timer_set_delay_u64(&dsp->output_timer, dsp->sblatcho);
+                if (!dsp->output_running)
+                {
+                        dsp->output_ts = (tsc << 32) + dsp->sblatcho;
+                        dsp->output_running = 1;
+                }
                 dsp->sbleftright = 0;
                 dsp->sbdacpos = 0;
 //                pclog("Start 8-bit DMA addr %06X len %04X\n",dma.ac[1]+(dma.page[1]<<16),len);
@@ -276,8 +288,11 @@ void sb_start_dma(sb_dsp_t *dsp, int dma8, int autoinit, uint8_t format, int len
                 dsp->sb_16_enable = 1;
                 if (dsp->sb_8_enable && dsp->sb_8_output) dsp->sb_8_enable = 0;
                 dsp->sb_16_output = 1;
-		if (!timer_is_enabled(&dsp->output_timer))
-			timer_set_delay_u64(&dsp->output_timer, dsp->sblatcho);
+                if (!dsp->output_running)
+                {
+                        dsp->output_ts = (tsc << 32) + dsp->sblatcho;
+                        dsp->output_running = 1;
+                }
 //                pclog("Start 16-bit DMA addr %06X len %04X\n",dma16.ac[1]+(dma16.page[1]<<16),len);
         }
 }
@@ -338,6 +353,8 @@ void sb_start_dma_i(sb_dsp_t *dsp, int dma8, int autoinit, uint8_t format, int l
 
 int sb_8_read_dma(sb_dsp_t *dsp)
 {
+        if (dsp->dma_buf_active)
+                return (dsp->dma_buf_pos < dsp->dma_buf_len) ? dsp->dma_buf[dsp->dma_buf_pos++] : DMA_NODATA;
         return dma_channel_read(dsp->sb_8_dmanum);
 }
 void sb_8_write_dma(sb_dsp_t *dsp, uint8_t val)
@@ -350,6 +367,8 @@ void sb_8_write_dma(sb_dsp_t *dsp, uint8_t val)
 }
 int sb_16_read_dma(sb_dsp_t *dsp)
 {
+        if (dsp->dma_buf_active)
+                return (dsp->dma_buf_pos < dsp->dma_buf_len) ? dsp->dma_buf[dsp->dma_buf_pos++] : DMA_NODATA;
         return dma_channel_read(dsp->sb_16_dmanum);
 }
 int sb_16_write_dma(sb_dsp_t *dsp, uint16_t val)
@@ -369,12 +388,16 @@ void sb_dsp_setirq(sb_dsp_t *dsp, int irq)
 
 void sb_dsp_setdma8(sb_dsp_t *dsp, int dma)
 {
+        dma_remove_sync_callback(dsp->sb_8_dmanum, dsp);
         dsp->sb_8_dmanum = dma;
+        dma_set_sync_callback(dsp->sb_8_dmanum, sb_dsp_dma_sync, dsp);
 }
 
 void sb_dsp_setdma16(sb_dsp_t *dsp, int dma)
 {
+        dma_remove_sync_callback(dsp->sb_16_dmanum, dsp);
         dsp->sb_16_dmanum = dma;
+        dma_set_sync_callback(dsp->sb_16_dmanum, sb_dsp_dma_sync, dsp);
 }
 void sb_exec_command(sb_dsp_t *dsp)
 {
@@ -500,8 +523,11 @@ void sb_exec_command(sb_dsp_t *dsp)
                 case 0x80: /*Pause DAC*/
                 dsp->sb_pausetime = dsp->sb_data[0] + (dsp->sb_data[1] << 8);
 //                pclog("SB pause %04X\n",sb_pausetime);
-		if (!timer_is_enabled(&dsp->output_timer))
-			timer_set_delay_u64(&dsp->output_timer, dsp->sblatcho);
+                if (!dsp->output_running)
+                {
+                        dsp->output_ts = (tsc << 32) + dsp->sblatcho;
+                        dsp->output_running = 1;
+                }
                 break;
                 case 0x90: /*High speed 8-bit autoinit DMA output*/
                 if (dsp->sb_type < SB2) break;
@@ -735,7 +761,7 @@ void sb_exec_command(sb_dsp_t *dsp)
         }
 }
         
-void sb_write(uint16_t a, uint8_t v, void *priv)
+static void sb_write_port(uint16_t a, uint8_t v, void *priv)
 {
         sb_dsp_t *dsp = (sb_dsp_t *)priv;
 //        pclog("sb_write : Write soundblaster %04X %02X %04X:%04X %02X\n",a,v,CS,pc,dsp->sb_command);
@@ -795,10 +821,20 @@ void sb_write(uint16_t a, uint8_t v, void *priv)
         }
 }
 
+void sb_write(uint16_t a, uint8_t v, void *priv)
+{
+        sb_dsp_t *dsp = (sb_dsp_t *)priv;
+
+        sb_dsp_output_update(dsp);
+        sb_write_port(a, v, priv);
+        sb_dsp_schedule(dsp);
+}
+
 uint8_t sb_read(uint16_t a, void *priv)
 {
         sb_dsp_t *dsp = (sb_dsp_t *)priv;
 //        pclog("sb_read : Read soundblaster %04X %04X:%04X\n",a,CS,pc);
+        sb_dsp_output_update(dsp);
         switch (a & 0xf)
         {
                 case 0xA: /*Read data*/
@@ -869,6 +905,8 @@ void sb_dsp_init(sb_dsp_t *dsp, int type, int subtype, void *parent)
         sb_doreset(dsp);
 
         timer_add(&dsp->output_timer, pollsb, dsp, 0);
+        dma_set_sync_callback(dsp->sb_8_dmanum, sb_dsp_dma_sync, dsp);
+        dma_set_sync_callback(dsp->sb_16_dmanum, sb_dsp_dma_sync, dsp);
         timer_add(&dsp->input_timer, sb_poll_i, dsp, 0);
         timer_add(&dsp->wb_timer, sb_wb_clear, dsp, 0);
 
@@ -895,19 +933,16 @@ void sb_dsp_set_stereo(sb_dsp_t *dsp, int stereo)
         dsp->stereo = stereo;
 }
 
-void pollsb(void *p)
+/*Play one output sample*/
+static void sb_dsp_output_sample(sb_dsp_t *dsp)
 {
-        sb_dsp_t *dsp = (sb_dsp_t *)p;
         int tempi,ref;
-        
-        timer_advance_u64(&dsp->output_timer, dsp->sblatcho);
 
 //        pclog("PollSB %i %i %i %i\n",sb_8_enable,sb_8_pause,sb_pausetime,sb_8_output);
         if (dsp->sb_8_enable && !dsp->sb_8_pause && dsp->sb_pausetime < 0 && dsp->sb_8_output)
         {
                 int data[2];
                 
-                sb_dsp_update(dsp);
 //                pclog("Dopoll %i %02X %i\n", sb_8_length, sb_8_format, sblatcho);
                 switch (dsp->sb_8_format)
                 {
@@ -1070,7 +1105,7 @@ void pollsb(void *p)
                         else
 			{
 				dsp->sb_8_enable = 0;
-				timer_disable(&dsp->output_timer);
+				dsp->output_running = 0;
 			}
                         sb_irq(dsp, 1);
                 }
@@ -1079,7 +1114,6 @@ void pollsb(void *p)
         {
                 int data[2];
                 
-                sb_dsp_update(dsp);
                 
                 switch (dsp->sb_16_format)
                 {
@@ -1127,7 +1161,7 @@ void pollsb(void *p)
                         else
 			{
 				dsp->sb_16_enable = 0;
-				timer_disable(&dsp->output_timer);
+				dsp->output_running = 0;
 			}
                         sb_irq(dsp, 0);
                 }
@@ -1139,12 +1173,150 @@ void pollsb(void *p)
                 {
                         sb_irq(dsp, 1);
 			if (!dsp->sb_8_enable)
-				timer_disable(&dsp->output_timer);
+				dsp->output_running = 0;
 //                        pclog("SB pause over\n");
                 }
         }
 }
 
+/*Return the number of samples until the output next raises an IRQ, assuming
+  DMA keeps supplying data*/
+static int sb_dsp_samples_to_irq(sb_dsp_t *dsp)
+{
+        int samples = INT_MAX;
+
+        if (dsp->sb_8_enable && !dsp->sb_8_pause && dsp->sb_pausetime < 0 && dsp->sb_8_output)
+        {
+                if (dsp->sb_8_format == 0x00 || dsp->sb_8_format == 0x10)
+                        samples = MIN(samples, dsp->sb_8_length + 1);
+                else if (dsp->sb_8_format == 0x20 || dsp->sb_8_format == 0x30)
+                        samples = MIN(samples, (dsp->sb_8_length + 2) / 2);
+                else
+                        samples = 1; /*ADPCM, run sample by sample*/
+        }
+        if (dsp->sb_16_enable && !dsp->sb_16_pause && dsp->sb_pausetime < 0 && dsp->sb_16_output)
+        {
+                if (dsp->sb_16_format == 0x00 || dsp->sb_16_format == 0x10)
+                        samples = MIN(samples, dsp->sb_16_length + 1);
+                else
+                        samples = MIN(samples, (dsp->sb_16_length + 2) / 2);
+        }
+        if (dsp->sb_pausetime > -1)
+                samples = MIN(samples, dsp->sb_pausetime + 1);
+
+        return MAX(samples, 1);
+}
+
+/*Fetch the DMA data for up to max_samples of PCM output in one block. Returns
+  the number of samples that the block covers; the block never runs past the
+  end of the current DSP transfer.*/
+static int sb_dsp_prefetch(sb_dsp_t *dsp, int max_samples)
+{
+        int out_8 = dsp->sb_8_enable && !dsp->sb_8_pause && dsp->sb_pausetime < 0 && dsp->sb_8_output;
+        int out_16 = dsp->sb_16_enable && !dsp->sb_16_pause && dsp->sb_pausetime < 0 && dsp->sb_16_output;
+        int samples = MIN(max_samples, MIN(SB_DMA_BLOCK_LEN, sb_dsp_samples_to_irq(dsp)));
+
+        dsp->dma_buf_active = 0;
+        if (out_8 && !out_16 && dsp->sb_8_format <= 0x30 && !(dsp->sb_8_format & 0x0f))
+        {
+                int transfers = (dsp->sb_8_format & 0x20) ? samples * 2 : samples;
+
+                dsp->dma_buf_len = dma_channel_read_block(dsp->sb_8_dmanum, dsp->dma_buf, transfers);
+                dsp->dma_buf_pos = 0;
+                dsp->dma_buf_active = 1;
+        }
+        else if (out_16 && !out_8)
+        {
+                int transfers = (dsp->sb_16_format & 0x20) ? samples * 2 : samples;
+
+                dsp->dma_buf_len = dma_channel_read_block(dsp->sb_16_dmanum, dsp->dma_buf, transfers);
+                dsp->dma_buf_pos = 0;
+                dsp->dma_buf_active = 1;
+        }
+
+        return samples;
+}
+
+static void sb_dsp_fill(sb_dsp_t *dsp, int pos)
+{
+        if (dsp->muted)
+        {
+                dsp->sbdatl=0;
+                dsp->sbdatr=0;
+        }
+        for (; dsp->pos < pos; dsp->pos++)
+        {
+                dsp->buffer[dsp->pos*2] = dsp->sbdatl;
+                dsp->buffer[dsp->pos*2 + 1] = dsp->sbdatr;
+        }
+}
+
+/*Play all output samples due since the last update. Output buffer positions
+  are spread evenly across the samples played, each holding the value that was
+  current before the sample.*/
+static void sb_dsp_output_update(sb_dsp_t *dsp)
+{
+        uint64_t now = (tsc << 32) | 0xffffffff;
+        int start_pos = dsp->pos;
+        int m = sound_get_pos() - start_pos;
+        int n, i = 0;
+
+        if (!dsp->output_running || (int64_t)(now - dsp->output_ts) < 0)
+                return;
+
+        n = ((now - dsp->output_ts) / dsp->sblatcho) + 1;
+
+        while (i < n && dsp->output_running)
+        {
+                int count = sb_dsp_prefetch(dsp, n - i);
+                int c;
+
+                for (c = 0; c < count && dsp->output_running; c++, i++)
+                {
+                        sb_dsp_fill(dsp, start_pos + (int)(((int64_t)i * m) / n));
+                        sb_dsp_output_sample(dsp);
+                        dsp->output_ts += dsp->sblatcho;
+                }
+                dsp->dma_buf_active = 0;
+        }
+}
+
+/*Set output_timer for the sample that will next raise an IRQ*/
+static void sb_dsp_schedule(sb_dsp_t *dsp)
+{
+        uint64_t max_samples;
+        int samples;
+
+        if (!dsp->output_running)
+        {
+                timer_disable(&dsp->output_timer);
+                return;
+        }
+
+        samples = sb_dsp_samples_to_irq(dsp);
+        /*Timer period must be under a second*/
+        max_samples = (TIMER_USEC * 500000) / dsp->sblatcho;
+        if (samples > max_samples)
+                samples = MAX(max_samples, 1);
+
+        timer_set_delay_u64(&dsp->output_timer, dsp->output_ts + (samples - 1) * dsp->sblatcho - (tsc << 32));
+}
+
+void pollsb(void *p)
+{
+        sb_dsp_t *dsp = (sb_dsp_t *)p;
+
+        sb_dsp_output_update(dsp);
+        sb_dsp_schedule(dsp);
+}
+
+static void sb_dsp_dma_sync(void *p)
+{
+        sb_dsp_t *dsp = (sb_dsp_t *)p;
+
+        sb_dsp_output_update(dsp);
+}
+
 void sb_poll_i(void *p)
 {
         sb_dsp_t *dsp = (sb_dsp_t *)p;
@@ -1301,19 +1473,14 @@ void sb_poll_i(void *p)
 
 void sb_dsp_update(sb_dsp_t *dsp)
 {
-        if (dsp->muted)
-        {
-                dsp->sbdatl=0;
-                dsp->sbdatr=0;
-        }
-        for (; dsp->pos < sound_pos_global; dsp->pos++)
-        {
-                dsp->buffer[dsp->pos*2] = dsp->sbdatl;
-                dsp->buffer[dsp->pos*2 + 1] = dsp->sbdatr;
-        }
+        sb_dsp_output_update(dsp);
+        sb_dsp_fill(dsp, sound_get_pos());
 }
 void sb_dsp_close(sb_dsp_t *dsp)
 {
+        dma_remove_sync_callback(dsp->sb_8_dmanum, dsp);
+        dma_remove_sync_callback(dsp->sb_16_dmanum, dsp);
+
         #ifdef SB_DSP_RECORD_DEBUG
             if (soundf != 0)
             {
@@ -10,6 +10,9 @@
 #define IS_AZTECH(dsp) ((dsp)->sb_subtype == SB_SUBTYPE_CLONE_AZT2316A_0X11 || (dsp)->sb_subtype == SB_SUBTYPE_CLONE_AZT1605_0X0C) // check for future AZT cards here
 #define AZTECH_EEPROM_SIZE             16
 
+/*Maximum number of output samples fetched from DMA in one go*/
+#define SB_DMA_BLOCK_LEN 256
+
 typedef struct sb_dsp_t
 {
         int sb_type;
@@ -64,6 +67,15 @@ typedef struct sb_dsp_t
         pc_timer_t output_timer, input_timer;
         
         uint64_t sblatcho, sblatchi;
+
+        /*DMA output is run lazily. output_ts is the time of the next output
+          sample in 32:32 format, and output_timer is only used to bring the
+          output up to date when the next IRQ is due.*/
+        int output_running;
+        uint64_t output_ts;
+        uint16_t dma_buf[SB_DMA_BLOCK_LEN * 2];
+        int dma_buf_pos, dma_buf_len;
+        int dma_buf_active;
         
         uint16_t sb_addr;
         
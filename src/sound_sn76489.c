@@ -2,6 +2,7 @@
 #include "ibm.h"
 #include "device.h"
 #include "io.h"
+#include "savestate.h"
 #include "sound.h"
 #include "sound_sn76489.h"
 
@@ -19,7 +20,7 @@ static float volslog[16]=
 
 void sn76489_update(sn76489_t *sn76489)
 {
-        for (; sn76489->pos < sound_pos_global; sn76489->pos++)
+        for (; sn76489->pos < sound_get_pos(); sn76489->pos++)
         {
                 int c;
                 int16_t result = 0;
@@ -177,7 +178,7 @@ void sn74689_set_extra_divide(sn76489_t *sn76489, int enable)
 
 void sn76489_init(sn76489_t *sn76489, uint16_t base, uint16_t size, int type, int freq)
 {
-        sound_add_handler(sn76489_get_buffer, sn76489);
+        sound_add_threaded_handler(sn76489_get_buffer, sn76489);
 
         sn76489->latch[0] = sn76489->latch[1] = sn76489->latch[2] = sn76489->latch[3] = 0x3FF << 6;
         sn76489->vol[0] = 0;
@@ -223,6 +224,26 @@ void sn76489_device_close(void *p)
         free(sn76489);        
 }
 
+static void sn76489_save(savestate_t *s, void *p)
+{
+        sn76489_t *sn76489 = (sn76489_t *)p;
+
+        sn76489_update(sn76489);
+        savestate_write(s, sn76489, sizeof(sn76489_t));
+}
+
+static void sn76489_load(savestate_t *s, void *p)
+{
+        sn76489_t *sn76489 = (sn76489_t *)p;
+        sn76489_t temp;
+
+        /*Keep the partially rendered output buffer of the running machine*/
+        savestate_read(s, &temp, sizeof(sn76489_t));
+        memcpy(temp.buffer, sn76489->buffer, sizeof(sn76489->buffer));
+        temp.pos = sn76489->pos;
+        *sn76489 = temp;
+}
+
 device_t sn76489_device =
 {
         "TI SN74689 PSG",
@@ -232,7 +253,10 @@ device_t sn76489_device =
         NULL,
         NULL,
         NULL,
-        NULL
+        NULL,
+        NULL,
+        sn76489_save,
+        sn76489_load
 };
 device_t ncr8496_device =
 {
@@ -243,5 +267,8 @@ device_t ncr8496_device =
         NULL,
         NULL,
         NULL,
-        NULL
+        NULL,
+        NULL,
+        sn76489_save,
+        sn76489_load
 };
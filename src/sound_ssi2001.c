@@ -16,11 +16,11 @@ typedef struct ssi2001_t
 
 static void ssi2001_update(ssi2001_t *ssi2001)
 {
-        if (ssi2001->pos >= sound_pos_global)
+        if (ssi2001->pos >= sound_get_pos())
                 return;
         
-        sid_fillbuf(&ssi2001->buffer[ssi2001->pos], sound_pos_global - ssi2001->pos, ssi2001->psid);
-        ssi2001->pos = sound_pos_global;
+        sid_fillbuf(&ssi2001->buffer[ssi2001->pos], sound_get_pos() - ssi2001->pos, ssi2001->psid);
+        ssi2001->pos = sound_get_pos();
 }
 
 static void ssi2001_get_buffer(int32_t *buffer, int len, void *p)
@@ -62,7 +62,7 @@ void *ssi2001_init()
         ssi2001->psid = sid_init();
         sid_reset(ssi2001->psid);
         io_sethandler(0x0280, 0x0020, ssi2001_read, NULL, NULL, ssi2001_write, NULL, NULL, ssi2001);
-        sound_add_handler(ssi2001_get_buffer, ssi2001);
+        sound_add_threaded_handler(ssi2001_get_buffer, ssi2001);
         return ssi2001;
 }
 
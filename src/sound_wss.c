@@ -102,6 +102,7 @@ void wss_close(void *p)
 {
         wss_t *wss = (wss_t *)p;
         
+        opl_close(&wss->opl);
         free(wss);
 }
 
@@ -14,6 +14,7 @@
 #endif
 #include "ibm.h"
 #include "sound.h"
+#include "plat-sound.h"
 
 FILE *allog;
 #ifdef USE_OPENAL
@@ -27,6 +28,10 @@ int SOUNDBUFLEN = 48000/20;
 
 #define BUFLEN SOUNDBUFLEN
 
+/*When the pull model stream is available, the main mixer output goes through
+  it and OpenAL is only used for CD audio*/
+static int audio_stream_active = 0;
+
 void closeal();
 ALvoid  alutInit(ALint *argc,ALbyte **argv) 
 {
@@ -73,6 +78,7 @@ void initalmain(int argc, char *argv[])
 
 void closeal()
 {
+        audio_stream_close();
 #ifdef USE_OPENAL
         alutExit();
 #endif
@@ -134,13 +140,21 @@ void inital()
                 alBufferData(buffers_cd[c], AL_FORMAT_STEREO16, cd_buf, CD_BUFLEN*2*2, CD_FREQ);
         }
 
-        alSourceQueueBuffers(source[0], 4, buffers);
-        check();
+        audio_stream_active = audio_stream_init(FREQ);
+
+        if (!audio_stream_active)
+        {
+                alSourceQueueBuffers(source[0], 4, buffers);
+                check();
+        }
         alSourceQueueBuffers(source[1], 4, buffers_cd);
         check();
 //        printf("6 %08X\n",source);
-        alSourcePlay(source[0]);
-        check();
+        if (!audio_stream_active)
+        {
+                alSourcePlay(source[0]);
+                check();
+        }
         alSourcePlay(source[1]);
         check();
 //        printf("InitAL!!! %08X\n",source);
@@ -149,6 +163,11 @@ void inital()
 
 void givealbuffer(int32_t *buf)
 {
+        if (audio_stream_active)
+        {
+                audio_stream_write(buf, BUFLEN);
+                return;
+        }
 #ifdef USE_OPENAL
         int16_t buf16[BUFLEN*2];
         int processed;
@@ -29,6 +29,15 @@ void thread_kill(thread_t *handle)
 	free(thread);
 }
 
+void thread_wait(thread_t *handle)
+{
+	pthread_t *thread = (pthread_t *)handle;
+
+	pthread_join(*thread, NULL);
+
+	free(thread);
+}
+
 event_t *thread_create_event()
 {
 	event_pthread_t *event = malloc(sizeof(event_pthread_t));
@@ -1,5 +1,6 @@
 #include "ibm.h"
 
+#include "device.h"
 #include "timer.h"
 
 uint64_t TIMER_USEC;
@@ -107,7 +108,9 @@ void timer_process()
 			break;
 
 		timer_remove_head();
+		PROFILER_ENTER(timer->profiler);
 		timer->callback(timer->p);
+		PROFILER_EXIT();
 	}
 
 	timer_target = timer_head->ts_integer;
@@ -129,6 +132,18 @@ void timer_add(pc_timer_t *timer, void (*callback)(void *p), void *p, int start_
 	timer->p = p;
 	timer->enabled = 0;
 	timer->prev = timer->next = NULL;
+#ifdef PROFILER
+	/*Timers are attributed to the device being initialised, if any*/
+	if (current_device_name)
+		timer->profiler = profiler_get_counter((const void *)callback, current_device_name, PROFILER_GROUP_TIMERS);
+	else
+	{
+		char name[64];
+
+		snprintf(name, sizeof(name), "Timer %p", callback);
+		timer->profiler = profiler_get_counter((const void *)callback, name, PROFILER_GROUP_TIMERS);
+	}
+#endif
 	if (start_timer)
 		timer_set_delay_u64(timer, 0);
 }
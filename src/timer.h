@@ -2,6 +2,7 @@
 #define _TIMER_H_
 
 #include "cpu.h"
+#include "profiler.h"
 
 /*Timers are based on the CPU Time Stamp Counter. Timer timestamps are in a
   32:32 fixed point format, with the integer part compared against the TSC. The
@@ -25,6 +26,9 @@ typedef struct pc_timer_t
 	void *p;
 
 	struct pc_timer_t *prev, *next;
+#ifdef PROFILER
+	profiler_counter_t *profiler;
+#endif
 } pc_timer_t;
 
 /*Timestamp of nearest enabled timer. CPU emulation must call timer_process()
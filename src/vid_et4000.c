@@ -5,6 +5,7 @@
 #include "io.h"
 #include "mem.h"
 #include "rom.h"
+#include "savestate.h"
 #include "video.h"
 #include "vid_svga.h"
 #include "vid_svga_render.h"
@@ -625,6 +626,28 @@ void et4000_add_status_info(char *s, int max_len, void *p)
         svga_add_status_info(s, max_len, &et4000->svga);
 }
 
+static void et4000_save(savestate_t *s, void *p)
+{
+        et4000_t *et4000 = (et4000_t *)p;
+
+        savestate_write(s, &et4000->ramdac, sizeof(unk_ramdac_t));
+        savestate_write(s, &et4000->banking, sizeof(et4000->banking));
+        savestate_write(s, &et4000->port_22cb_val, sizeof(et4000->port_22cb_val));
+        savestate_write(s, &et4000->port_32cb_val, sizeof(et4000->port_32cb_val));
+        svga_save(s, &et4000->svga);
+}
+
+static void et4000_load(savestate_t *s, void *p)
+{
+        et4000_t *et4000 = (et4000_t *)p;
+
+        savestate_read(s, &et4000->ramdac, sizeof(unk_ramdac_t));
+        savestate_read(s, &et4000->banking, sizeof(et4000->banking));
+        savestate_read(s, &et4000->port_22cb_val, sizeof(et4000->port_22cb_val));
+        savestate_read(s, &et4000->port_32cb_val, sizeof(et4000->port_32cb_val));
+        svga_load(s, &et4000->svga);
+}
+
 device_t et4000_device =
 {
         "Tseng Labs ET4000AX",
@@ -634,7 +657,10 @@ device_t et4000_device =
         et4000_available,
         et4000_speed_changed,
         et4000_force_redraw,
-        et4000_add_status_info
+        et4000_add_status_info,
+        NULL,
+        et4000_save,
+        et4000_load
 };
 
 device_t et4000k_device =
@@ -646,7 +672,10 @@ device_t et4000k_device =
         et4000k_available,
         et4000_speed_changed,
         et4000_force_redraw,
-        et4000_add_status_info
+        et4000_add_status_info,
+        NULL,
+        et4000_save,
+        et4000_load
 };
 
 device_t et4000_kasan_device =
@@ -1189,7 +1189,7 @@ void *et4000w32p_init()
         if (PCI && et4000->is_pci)
                 mem_mapping_disable(&et4000->bios_rom.mapping);
 
-        mem_mapping_add(&et4000->linear_mapping, 0, 0, svga_read_linear, svga_readw_linear, svga_readl_linear, svga_write_linear, svga_writew_linear, svga_writel_linear, NULL, 0, &et4000->svga);
+        mem_mapping_add(&et4000->linear_mapping, 0, 0, svga_read_linear, svga_readw_linear, svga_readl_linear, svga_write_lfb, svga_writew_lfb, svga_writel_lfb, NULL, 0, &et4000->svga);
         mem_mapping_add(&et4000->mmu_mapping,    0, 0, et4000w32p_mmu_read, NULL, NULL, et4000w32p_mmu_write, NULL, NULL, NULL, 0, et4000);
 
         et4000w32p_io_set(et4000);
@@ -921,7 +921,7 @@ void mystique_recalctimings(svga_t *svga)
 
                 mem_mapping_set_handler(&mystique->lfb_mapping,
                         svga_read_linear, svga_readw_linear, svga_readl_linear,
-                        svga_write_linear, svga_writew_linear, svga_writel_linear);
+                        svga_write_lfb, svga_writew_lfb, svga_writel_lfb);
         }
 }
 
@@ -5280,7 +5280,7 @@ void *mystique_init()
                         NULL, 0, mystique);
         mem_mapping_add(&mystique->lfb_mapping, 0, 0,
                         svga_read_linear, svga_readw_linear, svga_readl_linear,
-                        svga_write_linear, svga_writew_linear, svga_writel_linear,
+                        svga_write_lfb, svga_writew_lfb, svga_writel_lfb,
                         NULL, 0, mystique);
         mem_mapping_add(&mystique->iload_mapping, 0, 0,
                         mystique_iload_read_b, NULL, mystique_iload_read_l,
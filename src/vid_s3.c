@@ -2753,7 +2753,7 @@ static void *s3_init(char *bios_fn, int chip)
         if (PCI)
                 mem_mapping_disable(&s3->bios_rom.mapping);
 
-        mem_mapping_add(&s3->linear_mapping, 0,       0,       svga_read_linear, svga_readw_linear, svga_readl_linear, svga_write_linear, svga_writew_linear, svga_writel_linear, NULL, MEM_MAPPING_EXTERNAL, &s3->svga);
+        mem_mapping_add(&s3->linear_mapping, 0,       0,       svga_read_linear, svga_readw_linear, svga_readl_linear, svga_write_lfb, svga_writew_lfb, svga_writel_lfb, NULL, MEM_MAPPING_EXTERNAL, &s3->svga);
         mem_mapping_add(&s3->mmio_mapping,   0xa0000, 0x10000, s3_accel_read, NULL, NULL, s3_accel_write, s3_accel_write_w, s3_accel_write_l, NULL, MEM_MAPPING_EXTERNAL, s3);
         mem_mapping_disable(&s3->mmio_mapping);
 
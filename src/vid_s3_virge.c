@@ -3892,9 +3892,9 @@ static void *s3_virge_init()
         mem_mapping_add(&virge->linear_mapping,   0, 0, svga_read_linear,
                                                         svga_readw_linear,
                                                         svga_readl_linear,
-                                                        svga_write_linear,
-                                                        svga_writew_linear,
-                                                        svga_writel_linear,
+                                                        svga_write_lfb,
+                                                        svga_writew_lfb,
+                                                        svga_writel_lfb,
                                                         NULL,
                                                         0,
                                                         &virge->svga);
@@ -3992,9 +3992,9 @@ static void *s3_virge_375_init()
         mem_mapping_add(&virge->linear_mapping,   0, 0, svga_read_linear,
                                                         svga_readw_linear,
                                                         svga_readl_linear,
-                                                        svga_write_linear,
-                                                        svga_writew_linear,
-                                                        svga_writel_linear,
+                                                        svga_write_lfb,
+                                                        svga_writew_lfb,
+                                                        svga_writel_lfb,
                                                         NULL,
                                                         0,
                                                         &virge->svga);
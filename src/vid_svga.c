@@ -7,6 +7,8 @@
 #include "vid_svga.h"
 #include "vid_svga_render.h"
 #include "io.h"
+#include "profiler.h"
+#include "savestate.h"
 #include "timer.h"
 
 #define svga_output 0
@@ -39,6 +41,10 @@ void svga_out(uint16_t addr, uint8_t val, void *p)
         uint8_t o;
         
         // pclog("OUT SVGA %03X %02X %04X:%04X\n",addr,val,CS,cpu_state.pc);
+        /*Sequencer and graphics controller writes can change the write path*/
+        if (addr == 0x3c5 || addr == 0x3cf)
+                svga_lfb_direct_flush(svga);
+
         switch (addr)
         {
                 case 0x3C0:
@@ -299,6 +305,8 @@ void svga_recalctimings(svga_t *svga)
         double crtcconst;
         double _dispontime, _dispofftime, disptime;
 
+        svga_lfb_direct_flush(svga);
+
         svga->vtotal = svga->crtc[6];
         svga->dispend = svga->crtc[0x12];
         svga->vsyncstart = svga->crtc[0x10];
@@ -512,7 +520,11 @@ void svga_poll(void *p)
                                 svga->changedvram[svga->ma >> 12] = svga->changedvram[(svga->ma >> 12) + 1] = svga->interlace ? 3 : 2;
                       
                         if (!svga->override)
+                        {
+                                PROFILER_ENTER(PROFILER_SVGA_RENDER);
                                 svga->render(svga);
+                                PROFILER_EXIT();
+                        }
                         
                         if (svga->overlay_on)
                         {
@@ -626,6 +638,9 @@ void svga_poll(void *p)
                                 svga->fullchange = 2;
                         svga->blink++;
 
+                        /*Pages written through the direct mapping this frame*/
+                        svga_lfb_direct_flush(svga);
+
                         for (x = 0; x < ((svga->vram_mask+1) >> 12); x++) 
                         {
                                 if (svga->changedvram[x]) 
@@ -777,6 +792,10 @@ int svga_init(svga_t *svga, void *p, int memsize,
         svga->vram_mask = memsize - 1;
         svga->decode_mask = 0x7fffff;
         svga->changedvram = malloc(/*(memsize >> 12) << 1*/0x1000000 >> 12);
+        svga->lfb_direct = malloc(0x1000000 >> 12);
+        memset(svga->lfb_direct, 0, 0x1000000 >> 12);
+        svga->lfb_direct_nr = 0;
+        svga->lfb_direct_end = 0;
         svga->recalctimings_ex = recalctimings_ex;
         svga->video_in  = video_in;
         svga->video_out = video_out;
@@ -797,8 +816,63 @@ int svga_init(svga_t *svga, void *p, int memsize,
         return 0;
 }
 
+void svga_save(savestate_t *s, svga_t *svga)
+{
+        /*VRAM must be up to date, and no pages mapped into the CPU*/
+        svga_lfb_direct_flush(svga);
+
+        savestate_write(s, svga, sizeof(svga_t));
+        savestate_write(s, svga->vram, svga->vram_max);
+        savestate_write_timer(s, &svga->timer);
+}
+
+void svga_load(savestate_t *s, svga_t *svga)
+{
+        svga_t temp;
+
+        svga_lfb_direct_flush(svga);
+
+        savestate_read(s, &temp, sizeof(svga_t));
+        /*Keep everything that points into the running machine. The card
+          callbacks and memory mapping are set up by init; mapping placement
+          is restored with the rest of the memory state*/
+        temp.mapping = svga->mapping;
+        temp.vram = svga->vram;
+        temp.changedvram = svga->changedvram;
+        temp.timer = svga->timer;
+        temp.render = svga->render;
+        temp.recalctimings_ex = svga->recalctimings_ex;
+        temp.video_in = svga->video_in;
+        temp.video_out = svga->video_out;
+        temp.hwcursor_draw = svga->hwcursor_draw;
+        temp.overlay_draw = svga->overlay_draw;
+        temp.vblank_start = svga->vblank_start;
+        temp.line_compare = svga->line_compare;
+        temp.vsync_callback = svga->vsync_callback;
+        temp.p = svga->p;
+        temp.remap_func = svga->remap_func;
+        temp.lfb_direct = svga->lfb_direct;
+        temp.lfb_direct_nr = svga->lfb_direct_nr;
+        temp.lfb_direct_end = svga->lfb_direct_end;
+        *svga = temp;
+
+        savestate_read(s, svga->vram, svga->vram_max);
+        savestate_read_timer(s, &svga->timer);
+
+        /*As for a write to the miscellaneous output register*/
+        io_removehandler(0x03a0, 0x0020, svga->video_in, NULL, NULL, svga->video_out, NULL, NULL, svga->p);
+        if (!(svga->miscout & 1))
+                io_sethandler(0x03a0, 0x0020, svga->video_in, NULL, NULL, svga->video_out, NULL, NULL, svga->p);
+
+        /*Recalculating picks the renderer for the restored mode*/
+        svga_recalctimings(svga);
+        svga->fullchange = changeframecount;
+}
+
 void svga_close(svga_t *svga)
 {
+        svga_lfb_direct_flush(svga);
+        free(svga->lfb_direct);
         free(svga->changedvram);
         free(svga->vram);
         
@@ -1084,6 +1158,48 @@ uint8_t svga_read(uint32_t addr, void *p)
         return svga->vram[addr | readplane];
 }
 
+/*In packed pixel modes with no raster ops, rotation or plane masking an LFB
+  write is a plain store, so the page is mapped into the CPU write lookup like
+  RAM and later writes to it bypass the handlers. Mapped pages are marked as
+  changed and unmapped once a frame, and whenever the write path may change*/
+static inline int svga_lfb_direct_allowed(svga_t *svga)
+{
+        return video_lfb_direct && svga->fast && ((svga->chain4 && svga->packed_chain4) || svga->fb_only) &&
+                (svga->gdcreg[6] & 1) && !svga->writemode && !(svga->gdcreg[3] & 7) && (svga->writemask & 0xf) == 0xf;
+}
+
+static inline void svga_lfb_direct_map(svga_t *svga, uint32_t addr, uint32_t bus_addr)
+{
+        addwritelookup_mem(mem_logical_addr, &svga->vram[addr & ~0xfff], bus_addr);
+        if (!svga->lfb_direct[addr >> 12])
+        {
+                svga->lfb_direct[addr >> 12] = 1;
+                svga->lfb_direct_nr++;
+                if (((addr & ~0xfff) + 0x1000) > svga->lfb_direct_end)
+                        svga->lfb_direct_end = (addr & ~0xfff) + 0x1000;
+        }
+}
+
+void svga_lfb_direct_flush(svga_t *svga)
+{
+        int c;
+
+        if (!svga->lfb_direct_nr)
+                return;
+
+        mem_flush_write_range(svga->vram, svga->lfb_direct_end);
+        for (c = 0; c < (svga->lfb_direct_end >> 12); c++)
+        {
+                if (svga->lfb_direct[c])
+                {
+                        svga->changedvram[c] = changeframecount;
+                        svga->lfb_direct[c] = 0;
+                }
+        }
+        svga->lfb_direct_nr = 0;
+        svga->lfb_direct_end = 0;
+}
+
 void svga_write_linear(uint32_t addr, uint8_t val, void *p)
 {
         svga_t *svga = (svga_t *)p;
@@ -1531,6 +1647,50 @@ void svga_writel_linear(uint32_t addr, uint32_t val, void *p)
         *(uint32_t *)&svga->vram[addr] = val;
 }
 
+/*LFB write handlers for cards that map VRAM linearly. As svga_write*_linear(),
+  but may also map the page into the CPU write lookup*/
+void svga_write_lfb(uint32_t addr, uint8_t val, void *p)
+{
+        svga_t *svga = (svga_t *)p;
+        uint32_t bus_addr = addr;
+
+        svga_write_linear(addr, val, p);
+        if (svga_lfb_direct_allowed(svga))
+        {
+                addr &= svga->decode_mask;
+                if (addr < svga->vram_max)
+                        svga_lfb_direct_map(svga, addr & svga->vram_mask, bus_addr);
+        }
+}
+
+void svga_writew_lfb(uint32_t addr, uint16_t val, void *p)
+{
+        svga_t *svga = (svga_t *)p;
+        uint32_t bus_addr = addr;
+
+        svga_writew_linear(addr, val, p);
+        if (svga_lfb_direct_allowed(svga))
+        {
+                addr &= svga->decode_mask;
+                if (addr < svga->vram_max)
+                        svga_lfb_direct_map(svga, addr & svga->vram_mask, bus_addr);
+        }
+}
+
+void svga_writel_lfb(uint32_t addr, uint32_t val, void *p)
+{
+        svga_t *svga = (svga_t *)p;
+        uint32_t bus_addr = addr;
+
+        svga_writel_linear(addr, val, p);
+        if (svga_lfb_direct_allowed(svga))
+        {
+                addr &= svga->decode_mask;
+                if (addr < svga->vram_max)
+                        svga_lfb_direct_map(svga, addr & svga->vram_mask, bus_addr);
+        }
+}
+
 uint16_t svga_readw_linear(uint32_t addr, void *p)
 {
         svga_t *svga = (svga_t *)p;
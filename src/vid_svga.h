@@ -158,6 +158,12 @@ typedef struct svga_t
 
         int remap_required;
         uint32_t (*remap_func)(struct svga_t *svga, uint32_t in_addr);
+
+        /*VRAM pages currently mapped into the CPU write lookup, see
+          svga_lfb_direct_flush()*/
+        uint8_t *lfb_direct;
+        int lfb_direct_nr;
+        uint32_t lfb_direct_end;
 } svga_t;
 
 extern int svga_init(svga_t *svga, void *p, int memsize, 
@@ -167,7 +173,14 @@ extern int svga_init(svga_t *svga, void *p, int memsize,
                void (*hwcursor_draw)(struct svga_t *svga, int displine),
                void (*overlay_draw)(struct svga_t *svga, int displine));
 void svga_close(svga_t *svga);
+/*Store and restore the state common to all SVGA cards, including VRAM. Card
+  state that affects svga_recalctimings() must be restored before
+  svga_load()*/
+struct savestate_t;
+void svga_save(struct savestate_t *s, svga_t *svga);
+void svga_load(struct savestate_t *s, svga_t *svga);
 extern void svga_recalctimings(svga_t *svga);
+void svga_lfb_direct_flush(svga_t *svga);
 
 
 uint8_t  svga_read(uint32_t addr, void *p);
@@ -182,6 +195,11 @@ uint32_t svga_readl_linear(uint32_t addr, void *p);
 void     svga_write_linear(uint32_t addr, uint8_t val, void *p);
 void     svga_writew_linear(uint32_t addr, uint16_t val, void *p);
 void     svga_writel_linear(uint32_t addr, uint32_t val, void *p);
+/*As svga_write*_linear(), for LFB mappings. Pages may be mapped straight into
+  the CPU write lookup when video_lfb_direct is set*/
+void     svga_write_lfb(uint32_t addr, uint8_t val, void *p);
+void     svga_writew_lfb(uint32_t addr, uint16_t val, void *p);
+void     svga_writel_lfb(uint32_t addr, uint32_t val, void *p);
 
 void svga_add_status_info(char *s, int max_len, void *p);
 
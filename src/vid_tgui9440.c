@@ -563,7 +563,7 @@ void tgui_recalcmapping(tgui_t *tgui)
                 {
                         mem_mapping_set_handler(&tgui->linear_mapping,
                                         svga_read_linear,  svga_readw_linear,  svga_readl_linear,
-                                        svga_write_linear, svga_writew_linear, svga_writel_linear);
+                                        svga_write_lfb,    svga_writew_lfb,    svga_writel_lfb);
                         mem_mapping_set_handler(&svga->mapping,
                                         svga_read, svga_readw, svga_readl,
                                         svga_write, svga_writew, svga_writel);
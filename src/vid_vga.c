@@ -5,6 +5,7 @@
 #include "io.h"
 #include "mem.h"
 #include "rom.h"
+#include "savestate.h"
 #include "video.h"
 #include "vid_svga.h"
 #include "vid_vga.h"
@@ -190,6 +191,20 @@ void vga_add_status_info(char *s, int max_len, void *p)
         svga_add_status_info(s, max_len, &vga->svga);
 }
 
+static void vga_save(savestate_t *s, void *p)
+{
+        vga_t *vga = (vga_t *)p;
+
+        svga_save(s, &vga->svga);
+}
+
+static void vga_load(savestate_t *s, void *p)
+{
+        vga_t *vga = (vga_t *)p;
+
+        svga_load(s, &vga->svga);
+}
+
 device_t vga_device =
 {
         "VGA",
@@ -199,7 +214,10 @@ device_t vga_device =
         vga_available,
         vga_speed_changed,
         vga_force_redraw,
-        vga_add_status_info
+        vga_add_status_info,
+        NULL,
+        vga_save,
+        vga_load
 };
 device_t ps1vga_device =
 {
@@ -210,5 +228,8 @@ device_t ps1vga_device =
         vga_available,
         vga_speed_changed,
         vga_force_redraw,
-        vga_add_status_info
+        vga_add_status_info,
+        NULL,
+        vga_save,
+        vga_load
 };
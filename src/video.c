@@ -558,6 +558,7 @@ Fast VLB/PCI -
 */
 
 int video_speed = 0;
+int video_lfb_direct = 0;
 int video_timing[7][4] =
 {
         {VIDEO_ISA, 8, 16, 32},
@@ -75,6 +75,10 @@ extern void (*video_blit_memtoscreen_func)(int x, int y, int y1, int y2, int w,
 extern int video_timing_read_b, video_timing_read_w, video_timing_read_l;
 extern int video_timing_write_b, video_timing_write_w, video_timing_write_l;
 extern int video_speed;
+/*Map packed pixel linear framebuffer pages straight into the CPU write
+  lookup. Much faster, but writes through the mapping skip the video bus
+  timing*/
+extern int video_lfb_direct;
 
 extern int video_res_x, video_res_y, video_bpp;
 
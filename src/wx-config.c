@@ -678,6 +678,9 @@ int config_dlgsave(void* hdlg)
         h = wx_getdlgitem(hdlg, WX_ID("IDC_COMBOSPD"));
         video_speed = wx_sendmessage(h, WX_CB_GETCURSEL, 0, 0) - 1;
 
+        h = wx_getdlgitem(hdlg, WX_ID("IDC_CHECKLFBDIRECT"));
+        video_lfb_direct = wx_sendmessage(h, WX_BM_GETCHECK, 0, 0);
+
         cpu_manufacturer = temp_cpu_m;
         cpu = temp_cpu;
         cpu_set();
@@ -821,6 +824,9 @@ int config_dlgproc(void* hdlg, int message, INT_PARAM wParam, LONG_PARAM lParam)
                         wx_sendmessage(h, WX_CB_ADDSTRING, 0, (LONG_PARAM) "Fast VLB/PCI");
                         wx_sendmessage(h, WX_CB_SETCURSEL, video_speed+1, 0);
 
+                        h = wx_getdlgitem(hdlg, WX_ID("IDC_CHECKLFBDIRECT"));
+                        wx_sendmessage(h, WX_BM_SETCHECK, video_lfb_direct, 0);
+
                         h = wx_getdlgitem(hdlg, WX_ID("IDC_MEMSPIN"));
                         printf("%d\n", models[model].ram_granularity);
                         wx_sendmessage(h, WX_UDM_SETRANGE, 0,
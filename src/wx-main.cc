@@ -4,6 +4,8 @@
 extern "C"
 {
 int pc_main(int, char**);
+int pc_headless_run();
+extern int headless;
 }
 
 int main(int argc, char **argv)
@@ -11,6 +13,10 @@ int main(int argc, char **argv)
         if (!pc_main(argc, argv))
                 return -1;
 
+        /*Batch mode never creates a window*/
+        if (headless)
+                return pc_headless_run();
+
         wxApp::SetInstance(new App());
         wxEntry(argc, argv);
         return 0;
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+#include "ibm.h"
+#include "sound.h"
+#include "plat-sound.h"
+
+/*Ring size in frames. Must be a power of 2*/
+#define RING_SIZE 32768
+#define RING_MASK (RING_SIZE - 1)
+
+/*Maximum adjustment of the resampling ratio used to pull the ring back to
+  the target latency. 0.5% is below what is audible as a pitch change*/
+#define MAX_DRIFT 0.005
+
+static SDL_AudioDeviceID audio_dev;
+static int audio_freq_in, audio_freq_out;
+static int audio_device_frames;
+static double audio_ratio_nominal;
+
+/*Ring of 32-bit stereo frames, as produced by the mixer. ring_write and
+  ring_read are free running frame counts; ring_write is only written by the
+  emulation thread and ring_read only by the audio callback*/
+static int32_t ring[RING_SIZE * 2];
+static SDL_atomic_t ring_write, ring_read;
+
+/*Resampler state, only used by the audio callback*/
+static double resample_frac;
+static double fill_average;
+static int playing;
+
+static SDL_atomic_t underruns, overruns;
+static volatile int current_latency_ms;
+
+static int audio_target_frames()
+{
+        int target = (sound_latency * audio_freq_in) / 1000;
+
+        /*The mixer delivers a whole buffer at a time, so the ring must be able
+          to cover one buffer plus one device period*/
+        if (target < SOUNDBUFLEN + audio_device_frames)
+                target = SOUNDBUFLEN + audio_device_frames;
+        if (target > RING_SIZE / 2)
+                target = RING_SIZE / 2;
+
+        return target;
+}
+
+static inline int16_t audio_clip(double val)
+{
+        if (val < -32768.0)
+                return -32768;
+        if (val > 32767.0)
+                return 32767;
+        return (int16_t)val;
+}
+
+static void audio_callback(void *userdata, Uint8 *stream, int len)
+{
+        int16_t *out = (int16_t *)stream;
+        int frames = len / 4;
+        unsigned int w = (unsigned int)SDL_AtomicGet(&ring_write);
+        unsigned int r = (unsigned int)SDL_AtomicGet(&ring_read);
+        int fill = w - r;
+        int target = audio_target_frames();
+        double gain = pow(10.0, (double)sound_gain / 20.0);
+        double drift, ratio;
+        int c;
+
+        if (!playing)
+        {
+                /*Prebuffer up to the target latency before starting, so that a
+                  single late buffer does not immediately underrun again*/
+                if (fill < target)
+                {
+                        memset(stream, 0, len);
+                        return;
+                }
+                playing = 1;
+                fill_average = fill;
+                resample_frac = 0.0;
+        }
+
+        /*Track the average fill level, and consume slightly faster or slower
+          than nominal to bring it back to the target*/
+        fill_average += (fill - fill_average) * 0.01;
+        drift = (fill_average - target) / target;
+        if (drift > 1.0)
+                drift = 1.0;
+        else if (drift < -1.0)
+                drift = -1.0;
+        ratio = audio_ratio_nominal * (1.0 + MAX_DRIFT * drift);
+
+        for (c = 0; c < frames; c++)
+        {
+                int32_t *s0, *s1;
+
+                if ((int)(w - r) < 2)
+                {
+                        /*Out of data - output silence and rebuffer*/
+                        SDL_AtomicAdd(&underruns, 1);
+                        memset(&out[c * 2], 0, (frames - c) * 4);
+                        playing = 0;
+                        break;
+                }
+
+                s0 = &ring[(r & RING_MASK) * 2];
+                s1 = &ring[((r + 1) & RING_MASK) * 2];
+                out[c * 2]     = audio_clip((s0[0] + (s1[0] - s0[0]) * resample_frac) * gain);
+                out[c * 2 + 1] = audio_clip((s0[1] + (s1[1] - s0[1]) * resample_frac) * gain);
+
+                resample_frac += ratio;
+                while (resample_frac >= 1.0 && r != w)
+                {
+                        resample_frac -= 1.0;
+                        r++;
+                }
+        }
+
+        SDL_AtomicSet(&ring_read, (int)r);
+        current_latency_ms = ((int)(w - r) * 1000) / audio_freq_in;
+}
+
+int audio_stream_init(int freq)
+{
+        SDL_AudioSpec want, have;
+
+        if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+        {
+                pclog("SDL audio init failed : %s\n", SDL_GetError());
+                return 0;
+        }
+
+        memset(&want, 0, sizeof(want));
+        want.freq = freq;
+        want.format = AUDIO_S16SYS;
+        want.channels = 2;
+        want.samples = 512;
+        want.callback = audio_callback;
+
+        audio_dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+        if (!audio_dev)
+        {
+                pclog("SDL_OpenAudioDevice failed : %s\n", SDL_GetError());
+                SDL_QuitSubSystem(SDL_INIT_AUDIO);
+                return 0;
+        }
+
+        audio_freq_in = freq;
+        audio_freq_out = have.freq;
+        audio_device_frames = have.samples;
+        audio_ratio_nominal = (double)freq / (double)have.freq;
+        SDL_AtomicSet(&ring_write, 0);
+        SDL_AtomicSet(&ring_read, 0);
+        playing = 0;
+
+        pclog("SDL audio : %iHz, %i sample buffer\n", have.freq, have.samples);
+        SDL_PauseAudioDevice(audio_dev, 0);
+
+        return 1;
+}
+
+void audio_stream_close()
+{
+        if (audio_dev)
+        {
+                SDL_CloseAudioDevice(audio_dev);
+                SDL_QuitSubSystem(SDL_INIT_AUDIO);
+                audio_dev = 0;
+        }
+}
+
+void audio_stream_write(int32_t *buf, int len)
+{
+        unsigned int w = (unsigned int)SDL_AtomicGet(&ring_write);
+        unsigned int r = (unsigned int)SDL_AtomicGet(&ring_read);
+        int c;
+
+        if (RING_SIZE - (int)(w - r) < len)
+        {
+                /*Emulation is running ahead of the audio device - drop this
+                  buffer*/
+                SDL_AtomicAdd(&overruns, 1);
+                return;
+        }
+
+        for (c = 0; c < len; c++)
+        {
+                ring[((w + c) & RING_MASK) * 2]     = buf[c * 2];
+                ring[((w + c) & RING_MASK) * 2 + 1] = buf[c * 2 + 1];
+        }
+
+        SDL_AtomicSet(&ring_write, (int)(w + len));
+}
+
+void audio_stream_add_status_info(char *s, int max_len)
+{
+        char temps[256];
+
+        if (!audio_dev)
+                return;
+
+        sprintf(temps, "Audio output : %iHz\nAudio latency : %ims (target %ims)\nAudio underruns : %i\nAudio overruns : %i\n\n",
+                audio_freq_out, current_latency_ms, (audio_target_frames() * 1000) / audio_freq_in,
+                SDL_AtomicGet(&underruns), SDL_AtomicGet(&overruns));
+        strncat(s, temps, max_len);
+}
@@ -4,6 +4,7 @@
 #include "wx-sdl2-video.h"
 #include "ibm.h"
 #include "device.h"
+#include "plat-sound.h"
 #include "x86_ops.h"
 #include "mem.h"
 #include "codegen.h"
@@ -15,6 +16,7 @@
 #include "cdrom-image.h"
 #include "scsi_zip.h"
 #include "codegen_allocator.h"
+#include "profiler.h"
 #include "wx-common.h"
 
 drive_info_t drive_info[10];
@@ -174,6 +176,10 @@ int get_status(char* machine, char* device)
 //        device_s[0] = 0;
         device[0] = 0;
         device_add_status_info(device, 4096);
+        audio_stream_add_status_info(device, 4096);
+#ifdef PROFILER
+        profiler_add_status_info(device, 4096);
+#endif
 
         return 1;
 }
@@ -25,11 +25,13 @@
 
 #include "ibm.h"
 #include "device.h"
+#include "bench.h"
 #include "cassette.h"
 #include "cdrom-ioctl.h"
 #include "cdrom-image.h"
 #include "config.h"
 #include "video.h"
+#include "codegen.h"
 #include "cpu.h"
 #include "ide.h"
 #include "model.h"
@@ -40,10 +42,12 @@
 #include "scsi_zip.h"
 #include "sound.h"
 #include "thread.h"
+#include "x86.h"
 #include "disc.h"
 #include "disc_img.h"
 #include "mem.h"
 #include "paths.h"
+#include "savestate.h"
 
 #include "wx-sdl2-video.h"
 #include "wx-utils.h"
@@ -202,7 +206,9 @@ int mainthread(void* param)
                 drawits += new_time - old_time;
                 old_time = new_time;
 
-                if (drawits > 0 && !pause)
+                /*With no audio output there is nothing to stay in step
+                  with, so run as fast as possible*/
+                if ((drawits > 0 || !sound_output) && !pause)
                 {
                         uint64_t start_time = timer_read();
                         uint64_t end_time;
@@ -564,6 +570,14 @@ int pc_main(int argc, char** argv)
         initpc(argc, argv);
         resetpchard();
 
+        if (headless)
+        {
+                /*Sound is still rendered, for capture, but not played*/
+                sound_output = 0;
+                sound_init();
+                return TRUE;
+        }
+
         sound_init();
 
 #ifdef __linux__
@@ -582,6 +596,117 @@ int pc_main(int argc, char** argv)
         return TRUE;
 }
 
+extern int framecountx;
+void video_blit_complete();
+
+static void headless_blit_memtoscreen(int x, int y, int y1, int y2, int w, int h)
+{
+        video_blit_complete();
+}
+
+/*The summary goes to the console, not the log*/
+#undef printf
+
+/*Run the machine set up by pc_main() without any windows, then print a
+  summary and return the process exit status. Nothing is saved unless
+  --save_state is given, so repeated runs of the same configuration start
+  from the same state. With --bench the machine runs a built-in benchmark
+  instead of booting, and the summary is the benchmark report*/
+int pc_headless_run()
+{
+        int frames_to_run;
+        int nr_frames = 0;
+        uint64_t start_time, run_time;
+        double total_ins = 0.0;
+        uint64_t total_recomp_blocks = 0;
+        uint32_t old_time, new_time;
+
+        SDL_Init(SDL_INIT_TIMER);
+        timer_freq = SDL_GetPerformanceFrequency();
+        ghMutex = SDL_CreateMutex();
+        video_blit_memtoscreen_func = headless_blit_memtoscreen;
+
+        if (!loadbios())
+        {
+                printf("Configured romset not available\n");
+                return 2;
+        }
+        if (!video_card_available(video_old_to_new(gfxcard)))
+        {
+                printf("Configured video BIOS not available\n");
+                return 2;
+        }
+        resetpchard();
+
+        if (bench_name[0])
+        {
+                if (bench_start())
+                        return 2;
+                if (!headless_run_for)
+                        headless_run_for = 10000;
+        }
+        /*Frames are 10 ms, and any non-zero time runs at least one*/
+        frames_to_run = (headless_run_for + 9) / 10;
+
+        pclog("Running headless for %i ms%s\n", headless_run_for, headless_max_speed ? " at maximum speed" : "");
+
+        drawits = 0;
+        old_time = SDL_GetTicks();
+        start_time = timer_read();
+        while (!frames_to_run || nr_frames < frames_to_run)
+        {
+                if (!headless_max_speed)
+                {
+                        new_time = SDL_GetTicks();
+                        drawits += new_time - old_time;
+                        old_time = new_time;
+                        if (drawits <= 0)
+                        {
+                                SDL_Delay(1);
+                                continue;
+                        }
+                        drawits -= 10;
+                        if (drawits > 50)
+                                drawits = 0;
+                }
+
+                if (bench_name[0])
+                        bench_frame();
+                runpc();
+                nr_frames++;
+
+                /*runpc() latches and clears the counters every emulated
+                  second*/
+                if (!framecountx)
+                {
+                        total_ins += (double)mips * 1000000.0;
+                        total_recomp_blocks += cpu_recomp_blocks_latched;
+                }
+        }
+        run_time = timer_read() - start_time;
+        total_ins += insc;
+        total_recomp_blocks += cpu_recomp_blocks;
+
+        if (bench_name[0])
+        {
+                int ret = bench_report(nr_frames, run_time, total_ins, total_recomp_blocks);
+
+                closepc();
+                return ret ? 1 : 0;
+        }
+
+        printf("Emulated time     : %i.%02i s\n", nr_frames / 100, nr_frames % 100);
+        printf("Host time         : %.2f s\n", (double)run_time / timer_freq);
+        printf("Speed             : %.1f%%\n", ((double)nr_frames * timer_freq) / (double)run_time);
+        printf("MIPS              : %.2f\n", (total_ins * timer_freq) / ((double)run_time * 1000000.0));
+        printf("Recompiled blocks : %llu\n", (unsigned long long)total_recomp_blocks);
+        printf("Video frames      : %i\n", video_frames);
+
+        closepc();
+
+        return 0;
+}
+
 int wx_load_config(void* hwnd)
 {
         if (!config_override)
@@ -886,6 +1011,27 @@ int wx_handle_command(void* hwnd, int wParam, int checked)
                 resetpc_cad();
                 pause = 0;
         }
+        else if (ID_IS("IDM_FILE_SAVE_STATE"))
+        {
+                if (!getsfile(hwnd,
+                                "Snapshot (*.snp)|*.snp|All files (*.*)|*.*",
+                                "",
+                                NULL,
+                                "snp"))
+                {
+                        /*Taken by the emulation thread between frames*/
+                        savestate_request_save(openfilestring, NULL);
+                }
+        }
+        else if (ID_IS("IDM_FILE_LOAD_STATE"))
+        {
+                if (!getfile(hwnd,
+                                "Snapshot (*.snp)|*.snp|All files (*.*)|*.*",
+                                ""))
+                {
+                        savestate_request_load(openfilestring);
+                }
+        }
         else if (ID_IS("IDM_FILE_EXIT"))
         {
 //                wx_exit(hwnd, 0);
@@ -1164,7 +1310,11 @@ int wx_handle_command(void* hwnd, int wParam, int checked)
         else if (ID_IS("IDM_CDROM_IMAGE") || ID_IS("IDM_CDROM_IMAGE_LOAD"))
         {
                 if (!getfile(hwnd,
+#ifdef USE_CHD
+                                "CD-ROM image (*.iso;*.cue;*.chd)|*.iso;*.cue;*.chd|All files (*.*)|*.*",
+#else
                                 "CD-ROM image (*.iso;*.cue)|*.iso;*.cue|All files (*.*)|*.*",
+#endif
                                 image_path))
                 {
                         old_cdrom_drive = cdrom_drive;
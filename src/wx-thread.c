@@ -8,14 +8,44 @@
 #if defined WIN32 || defined _WIN32 || defined _WIN32
 #include <windows.h>
 #include <process.h>
+typedef struct win_thread_start_t
+{
+        void (*thread_rout)(void *param);
+        void *param;
+} win_thread_start_t;
+
+static unsigned __stdcall thread_start(void *p)
+{
+        win_thread_start_t start = *(win_thread_start_t *)p;
+
+        free(p);
+        start.thread_rout(start.param);
+
+        return 0;
+}
+
+/*Threads are started with _beginthreadex so the handle stays valid until
+  thread_wait() has joined it*/
 void *thread_create(void (*thread_rout)(void *param), void *param)
 {
-        return (void *)_beginthread(thread_rout, 0, param);
+        win_thread_start_t *start = malloc(sizeof(win_thread_start_t));
+
+        start->thread_rout = thread_rout;
+        start->param = param;
+
+        return (void *)_beginthreadex(NULL, 0, thread_start, start, 0, NULL);
 }
 
 void thread_kill(void *handle)
 {
         TerminateThread(handle, 0);
+        CloseHandle(handle);
+}
+
+void thread_wait(void *handle)
+{
+        WaitForSingleObject(handle, INFINITE);
+        CloseHandle(handle);
 }
 
 void thread_sleep(int t)
@@ -139,6 +169,15 @@ void thread_kill(thread_t *handle)
 	free(thread);
 }
 
+void thread_wait(thread_t *handle)
+{
+	pthread_t *thread = (pthread_t *)handle;
+
+	pthread_join(*thread, NULL);
+
+	free(thread);
+}
+
 event_t *thread_create_event()
 {
 	event_pthread_t *event = malloc(sizeof(event_pthread_t));
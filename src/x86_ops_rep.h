@@ -1,3 +1,161 @@
+#define REP_ADDR_MASK_a16 0xffff
+#define REP_ADDR_MASK_a32 0xffffffff
+
+/*Number of words that REP INSW/OUTSW can move as a single block, or 0 if the
+  word-at-a-time path must be used. Blocks stay within one page and within the
+  segment limit, and are only attempted when the page can't fault, so a block
+  is never partially applied*/
+static inline int rep_io_block_words(x86seg *seg, uint32_t offset, uint32_t count, uint32_t addr_mask, int rw)
+{
+        uint32_t addr = seg->base + offset;
+        uint32_t words;
+        
+        if (count < 2 || (cpu_state.flags & D_FLAG) || trap || (addr & 1))
+                return 0;
+
+        words = MIN(count, (0x1000 - (addr & 0xfff)) >> 1);
+        words = MIN(words, ((addr_mask - offset) >> 1) + 1);
+        if (offset < seg->limit_low || (offset + words*2 - 1) > seg->limit_high)
+                return 0;
+        if ((cr0 >> 31) && mmutranslate_noabrt(addr, rw) == 0xffffffff)
+                return 0;
+
+        return words;
+}
+
+/*Number of elements at addr that can be accessed before crossing a page
+  boundary or wrapping offset, in the direction of the string operation. The
+  address must be aligned to the element size*/
+static inline int rep_block_page_elements(uint32_t addr, uint32_t offset, int count, uint32_t addr_mask, int size)
+{
+        if ((addr & (size - 1)) || count < 1)
+                return 0;
+
+        if (cpu_state.flags & D_FLAG)
+        {
+                count = MIN(count, ((addr & 0xfff) / size) + 1);
+                if ((uint32_t)(count - 1) > offset / size)
+                        count = (offset / size) + 1;
+        }
+        else
+        {
+                count = MIN(count, (0x1000 - (addr & 0xfff)) / size);
+                if ((uint32_t)(count - 1) > (addr_mask - offset) / size)
+                        count = ((addr_mask - offset) / size) + 1;
+        }
+        return count;
+}
+
+/*Number of elements that REP MOVS/STOS can write to ES:dest_offset as a single
+  block on host memory, or 0 if the element-at-a-time path must be used. Blocks
+  only use pages already in the write lookup, which are plain RAM without code
+  present, and stay within one page, within the segment limit and within the
+  cycle budget of the element loop, so a block has the same result and cycle
+  cost as running the loop*/
+static inline int rep_block_elements(uint32_t dest_offset, uint32_t count, uint32_t addr_mask, int size, int elem_cycles, int cycles_end)
+{
+        uint32_t dest_addr = es + dest_offset;
+        uint32_t low_offset;
+        int elements;
+
+        if (count < 2 || writelookup2[dest_addr >> 12] == -1 || cycles < cycles_end)
+                return 0;
+
+        elements = rep_block_page_elements(dest_addr, dest_offset, MIN(count, 0x1000), addr_mask, size);
+        /*The element loop stops once cycles drops below cycles_end*/
+        elements = MIN(elements, ((cycles - cycles_end) / elem_cycles) + 1);
+        if (elements < 2)
+                return 0;
+
+        low_offset = (cpu_state.flags & D_FLAG) ? dest_offset - (elements - 1) * size : dest_offset;
+        if (low_offset < cpu_state.seg_es.limit_low || (low_offset + elements * size - 1) > cpu_state.seg_es.limit_high)
+                return 0;
+
+        return elements;
+}
+
+/*Run up to count iterations of REP MOVS as a block, returning the number of
+  elements moved or 0 if nothing was done. Overlapping blocks are copied an
+  element at a time, as the guest would see them*/
+static inline int rep_movs_block(uint32_t src_offset, uint32_t dest_offset, uint32_t count, uint32_t addr_mask, int size, int elem_cycles, int cycles_end)
+{
+        uint32_t src_addr = cpu_state.ea_seg->base + src_offset;
+        uint32_t dest_addr = es + dest_offset;
+        uint8_t *src, *dest;
+        int elements, len;
+
+        elements = rep_block_elements(dest_offset, count, addr_mask, size, elem_cycles, cycles_end);
+        if (!elements || readlookup2[src_addr >> 12] == -1)
+                return 0;
+        elements = rep_block_page_elements(src_addr, src_offset, elements, addr_mask, size);
+        if (elements < 2)
+                return 0;
+
+        len = elements * size;
+        if (cpu_state.flags & D_FLAG)
+        {
+                src_addr -= len - size;
+                dest_addr -= len - size;
+        }
+        src = (uint8_t *)(readlookup2[src_addr >> 12] + src_addr);
+        dest = (uint8_t *)(writelookup2[dest_addr >> 12] + dest_addr);
+
+        if (dest + len <= src || dest >= src + len)
+                memcpy(dest, src, len);
+        else if ((cpu_state.flags & D_FLAG) ? (dest >= src) : (dest <= src))
+                memmove(dest, src, len);
+        else
+        {
+                /*Destination overlaps source ahead of the copy, so elements
+                  already written are copied again*/
+                uint8_t temp[4];
+                int c;
+
+                for (c = 0; c < len; c += size)
+                {
+                        int off = (cpu_state.flags & D_FLAG) ? (len - size - c) : c;
+
+                        memcpy(temp, &src[off], size);
+                        memcpy(&dest[off], temp, size);
+                }
+        }
+
+        return elements;
+}
+
+/*As rep_movs_block(), for REP STOS*/
+static inline int rep_stos_block(uint32_t dest_offset, uint32_t count, uint32_t addr_mask, int size, uint32_t val, int elem_cycles, int cycles_end)
+{
+        uint32_t dest_addr = es + dest_offset;
+        uint8_t *dest;
+        int elements, c;
+
+        elements = rep_block_elements(dest_offset, count, addr_mask, size, elem_cycles, cycles_end);
+        if (!elements)
+                return 0;
+
+        if (cpu_state.flags & D_FLAG)
+                dest_addr -= (elements - 1) * size;
+        dest = (uint8_t *)(writelookup2[dest_addr >> 12] + dest_addr);
+
+        switch (size)
+        {
+                case 1:
+                memset(dest, val, elements);
+                break;
+                case 2:
+                for (c = 0; c < elements; c++)
+                        ((uint16_t *)dest)[c] = val;
+                break;
+                case 4:
+                for (c = 0; c < elements; c++)
+                        ((uint32_t *)dest)[c] = val;
+                break;
+        }
+
+        return elements;
+}
+
 #define REP_OPS(size, CNT_REG, SRC_REG, DEST_REG) \
 static int opREP_INSB_ ## size(uint32_t fetchdat)                               \
 {                                                                               \
@@ -34,18 +192,35 @@ static int opREP_INSW_ ## size(uint32_t fetchdat)
         if (CNT_REG > 0)                                                        \
         {                                                                       \
                 uint16_t temp;                                                  \
+                uint16_t block[2048];                                           \
+                int words;                                                      \
                                                                                 \
                 SEG_CHECK_WRITE(&cpu_state.seg_es);                             \
                 check_io_perm(DX);                                               \
                 check_io_perm(DX+1);                                             \
-                temp = inw(DX);                                                 \
-                writememw(es, DEST_REG, temp); if (cpu_state.abrt) return 1;       \
+                words = rep_io_block_words(&cpu_state.seg_es, DEST_REG, CNT_REG, REP_ADDR_MASK_ ## size, 1); \
+                if (words)                                                      \
+                        words = inw_block(DX, block, words);                    \
+                if (words)                                                      \
+                {                                                               \
+                        if (writemem_block(es + DEST_REG, (uint8_t *)block, words * 2)) return 1; \
                                                                                 \
-                if (cpu_state.flags & D_FLAG) DEST_REG -= 2;                              \
-                else                          DEST_REG += 2;                              \
-                CNT_REG--;                                                      \
-                cycles -= 15;                                                   \
-                reads++; writes++; total_cycles += 15;                          \
+                        DEST_REG += words * 2;                                  \
+                        CNT_REG -= words;                                       \
+                        cycles -= 15 * words;                                   \
+                        reads += words; writes += words; total_cycles += 15 * words; \
+                }                                                               \
+                else                                                            \
+                {                                                               \
+                        temp = inw(DX);                                         \
+                        writememw(es, DEST_REG, temp); if (cpu_state.abrt) return 1; \
+                                                                                \
+                        if (cpu_state.flags & D_FLAG) DEST_REG -= 2;            \
+                        else                          DEST_REG += 2;            \
+                        CNT_REG--;                                              \
+                        cycles -= 15;                                           \
+                        reads++; writes++; total_cycles += 15;                  \
+                }                                                               \
         }                                                                       \
         PREFETCH_RUN(total_cycles, 1, -1, reads, 0, writes, 0, 0);              \
         if (CNT_REG > 0)                                                        \
@@ -121,16 +296,36 @@ static int opREP_OUTSW_ ## size(uint32_t fetchdat)
         if (CNT_REG > 0)                                                        \
         {                                                                       \
                 uint16_t temp;                                                  \
+                uint16_t block[2048];                                           \
+                int words;                                                      \
                 SEG_CHECK_READ(cpu_state.ea_seg);                               \
-                temp = readmemw(cpu_state.ea_seg->base, SRC_REG); if (cpu_state.abrt) return 1;   \
-                check_io_perm(DX);                                               \
-                check_io_perm(DX+1);                                             \
-                outw(DX, temp);                                                 \
-                if (cpu_state.flags & D_FLAG) SRC_REG -= 2;                               \
-                else                          SRC_REG += 2;                               \
-                CNT_REG--;                                                      \
-                cycles -= 14;                                                   \
-                reads++; writes++; total_cycles += 14;                          \
+                words = rep_io_block_words(cpu_state.ea_seg, SRC_REG, CNT_REG, REP_ADDR_MASK_ ## size, 0); \
+                if (words)                                                      \
+                {                                                               \
+                        check_io_perm(DX);                                       \
+                        check_io_perm(DX+1);                                     \
+                        if (readmem_block(cpu_state.ea_seg->base + SRC_REG, (uint8_t *)block, words * 2)) return 1; \
+                        words = outw_block(DX, block, words);                   \
+                }                                                               \
+                if (words)                                                      \
+                {                                                               \
+                        SRC_REG += words * 2;                                   \
+                        CNT_REG -= words;                                       \
+                        cycles -= 14 * words;                                   \
+                        reads += words; writes += words; total_cycles += 14 * words; \
+                }                                                               \
+                else                                                            \
+                {                                                               \
+                        temp = readmemw(cpu_state.ea_seg->base, SRC_REG); if (cpu_state.abrt) return 1; \
+                        check_io_perm(DX);                                       \
+                        check_io_perm(DX+1);                                     \
+                        outw(DX, temp);                                         \
+                        if (cpu_state.flags & D_FLAG) SRC_REG -= 2;             \
+                        else                          SRC_REG += 2;             \
+                        CNT_REG--;                                              \
+                        cycles -= 14;                                           \
+                        reads++; writes++; total_cycles += 14;                  \
+                }                                                               \
         }                                                                       \
         PREFETCH_RUN(total_cycles, 1, -1, reads, 0, writes, 0, 0);              \
         if (CNT_REG > 0)                                                        \
@@ -185,6 +380,21 @@ static int opREP_MOVSB_ ## size(uint32_t fetchdat)
         while (CNT_REG > 0)                                                     \
         {                                                                       \
                 uint8_t temp;                                                   \
+                int elements;                                                   \
+                                                                                \
+                elements = rep_movs_block(SRC_REG, DEST_REG, CNT_REG, REP_ADDR_MASK_ ## size, 1, is486 ? 3 : 4, cycles_end); \
+                if (elements)                                                   \
+                {                                                               \
+                        if (cpu_state.flags & D_FLAG) { DEST_REG -= elements * 1; SRC_REG -= elements * 1; } \
+                        else                          { DEST_REG += elements * 1; SRC_REG += elements * 1; } \
+                        CNT_REG -= elements;                                    \
+                        cycles -= (is486 ? 3 : 4) * elements;                   \
+                        ins += elements;                                        \
+                        reads += elements; writes += elements; total_cycles += (is486 ? 3 : 4) * elements; \
+                        if (cycles < cycles_end)                                \
+                                break;                                          \
+                        continue;                                               \
+                }                                                               \
                                                                                 \
                 CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG);         \
                 temp = readmemb(cpu_state.ea_seg->base, SRC_REG); if (cpu_state.abrt) return 1;    \
@@ -223,6 +433,21 @@ static int opREP_MOVSW_ ## size(uint32_t fetchdat)
         while (CNT_REG > 0)                                                     \
         {                                                                       \
                 uint16_t temp;                                                  \
+                int elements;                                                   \
+                                                                                \
+                elements = rep_movs_block(SRC_REG, DEST_REG, CNT_REG, REP_ADDR_MASK_ ## size, 2, is486 ? 3 : 4, cycles_end); \
+                if (elements)                                                   \
+                {                                                               \
+                        if (cpu_state.flags & D_FLAG) { DEST_REG -= elements * 2; SRC_REG -= elements * 2; } \
+                        else                          { DEST_REG += elements * 2; SRC_REG += elements * 2; } \
+                        CNT_REG -= elements;                                    \
+                        cycles -= (is486 ? 3 : 4) * elements;                   \
+                        ins += elements;                                        \
+                        reads += elements; writes += elements; total_cycles += (is486 ? 3 : 4) * elements; \
+                        if (cycles < cycles_end)                                \
+                                break;                                          \
+                        continue;                                               \
+                }                                                               \
                                                                                 \
                 CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG);         \
                 temp = readmemw(cpu_state.ea_seg->base, SRC_REG); if (cpu_state.abrt) return 1;    \
@@ -261,6 +486,21 @@ static int opREP_MOVSL_ ## size(uint32_t fetchdat)
         while (CNT_REG > 0)                                                     \
         {                                                                       \
                 uint32_t temp;                                                  \
+                int elements;                                                   \
+                                                                                \
+                elements = rep_movs_block(SRC_REG, DEST_REG, CNT_REG, REP_ADDR_MASK_ ## size, 4, is486 ? 3 : 4, cycles_end); \
+                if (elements)                                                   \
+                {                                                               \
+                        if (cpu_state.flags & D_FLAG) { DEST_REG -= elements * 4; SRC_REG -= elements * 4; } \
+                        else                          { DEST_REG += elements * 4; SRC_REG += elements * 4; } \
+                        CNT_REG -= elements;                                    \
+                        cycles -= (is486 ? 3 : 4) * elements;                   \
+                        ins += elements;                                        \
+                        reads += elements; writes += elements; total_cycles += (is486 ? 3 : 4) * elements; \
+                        if (cycles < cycles_end)                                \
+                                break;                                          \
+                        continue;                                               \
+                }                                                               \
                                                                                 \
                 CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG);         \
                 temp = readmeml(cpu_state.ea_seg->base, SRC_REG); if (cpu_state.abrt) return 1;    \
@@ -297,6 +537,21 @@ static int opREP_STOSB_ ## size(uint32_t fetchdat)
                 SEG_CHECK_WRITE(&cpu_state.seg_es);                             \
         while (CNT_REG > 0)                                                     \
         {                                                                       \
+                int elements = rep_stos_block(DEST_REG, CNT_REG, REP_ADDR_MASK_ ## size, 1, AL, is486 ? 4 : 5, cycles_end); \
+                                                                                \
+                if (elements)                                                   \
+                {                                                               \
+                        if (cpu_state.flags & D_FLAG) DEST_REG -= elements * 1; \
+                        else                          DEST_REG += elements * 1; \
+                        CNT_REG -= elements;                                    \
+                        cycles -= (is486 ? 4 : 5) * elements;                   \
+                        writes += elements; total_cycles += (is486 ? 4 : 5) * elements; \
+                        ins += elements;                                        \
+                        if (cycles < cycles_end)                                \
+                                break;                                          \
+                        continue;                                               \
+                }                                                               \
+                                                                                \
                 CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG);         \
                 writememb(es, DEST_REG, AL); if (cpu_state.abrt) return 1;         \
                 if (cpu_state.flags & D_FLAG) DEST_REG--;                                 \
@@ -327,6 +582,21 @@ static int opREP_STOSW_ ## size(uint32_t fetchdat)
                 SEG_CHECK_WRITE(&cpu_state.seg_es);                             \
         while (CNT_REG > 0)                                                     \
         {                                                                       \
+                int elements = rep_stos_block(DEST_REG, CNT_REG, REP_ADDR_MASK_ ## size, 2, AX, is486 ? 4 : 5, cycles_end); \
+                                                                                \
+                if (elements)                                                   \
+                {                                                               \
+                        if (cpu_state.flags & D_FLAG) DEST_REG -= elements * 2; \
+                        else                          DEST_REG += elements * 2; \
+                        CNT_REG -= elements;                                    \
+                        cycles -= (is486 ? 4 : 5) * elements;                   \
+                        writes += elements; total_cycles += (is486 ? 4 : 5) * elements; \
+                        ins += elements;                                        \
+                        if (cycles < cycles_end)                                \
+                                break;                                          \
+                        continue;                                               \
+                }                                                               \
+                                                                                \
                 CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG+1);       \
                 writememw(es, DEST_REG, AX); if (cpu_state.abrt) return 1;         \
                 if (cpu_state.flags & D_FLAG) DEST_REG -= 2;                              \
@@ -357,6 +627,21 @@ static int opREP_STOSL_ ## size(uint32_t fetchdat)
                 SEG_CHECK_WRITE(&cpu_state.seg_es);                             \
         while (CNT_REG > 0)                                                     \
         {                                                                       \
+                int elements = rep_stos_block(DEST_REG, CNT_REG, REP_ADDR_MASK_ ## size, 4, EAX, is486 ? 4 : 5, cycles_end); \
+                                                                                \
+                if (elements)                                                   \
+                {                                                               \
+                        if (cpu_state.flags & D_FLAG) DEST_REG -= elements * 4; \
+                        else                          DEST_REG += elements * 4; \
+                        CNT_REG -= elements;                                    \
+                        cycles -= (is486 ? 4 : 5) * elements;                   \
+                        writes += elements; total_cycles += (is486 ? 4 : 5) * elements; \
+                        ins += elements;                                        \
+                        if (cycles < cycles_end)                                \
+                                break;                                          \
+                        continue;                                               \
+                }                                                               \
+                                                                                \
                 CHECK_WRITE_REP(&cpu_state.seg_es, DEST_REG, DEST_REG+3);       \
                 writememl(es, DEST_REG, EAX); if (cpu_state.abrt) return 1;        \
                 if (cpu_state.flags & D_FLAG) DEST_REG -= 4;                              \